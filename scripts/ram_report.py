@@ -0,0 +1,352 @@
+#!/usr/bin/env python3
+#
+# This file is part of Nitrokey.
+#
+# Nitrokey is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# Nitrokey is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+#
+# RAM usage of the firmware ELF file (make ramcheck in build/gcc).
+#
+# Static RAM: .data and .bss up to _ebss, per module from the linker map
+# file (--map) and the largest objects from the symbol table.
+#
+# Stack: the frame of each function is read from the disassembly (push,
+# stmdb, sub sp), the call graph from the bl/blx and the tail call branches.
+# An indirect call may reach each function whose address is stored in the
+# flash or in .data. The worst case is the one of Reset_Handler (main) plus
+# the deepest interrupt handlers, one per preemption level (--isr-levels,
+# NVIC_PriorityGroup_1 of hw_config.c gives 2) and 32 bytes of exception
+# frame each. A dynamic stack allocation or a recursion can't be bounded,
+# it is reported and the result is a lower bound then.
+#
+# The exit code is 1 if the static RAM plus the worst case stack exceed
+# the budget (--budget, default the RAM size).
+#
+#   ram_report.py --map build/gcc/crypto.map build/gcc/crypto.elf
+#   ram_report.py --budget 19456 --objdump arm-none-eabi-objdump build/gcc/crypto.elf
+
+import argparse
+import os
+import re
+import struct
+import subprocess
+import sys
+
+RAM_START = 0x20000000
+EXCEPTION_FRAME = 32
+VECTOR_SECTION = ".isr_vector"
+
+SHT_SYMTAB = 2
+SHT_NOBITS = 8
+SHF_ALLOC = 0x2
+STT_OBJECT = 1
+
+
+def read_elf(elf_name):
+    """Sections {name: (type, flags, addr, data)} and symbols [(name, value, size, type)]."""
+    with open(elf_name, "rb") as f:
+        elf = f.read()
+
+    if elf[:4] != b"\x7fELF" or elf[4] != 1:
+        sys.exit("%s: no 32 bit ELF file" % elf_name)
+
+    shoff, = struct.unpack_from("<I", elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x2E)
+    headers = [struct.unpack_from("<IIIIIIIIII", elf, shoff + n * shentsize) for n in range(shnum)]
+
+    def string(table, offset):
+        start = headers[table][4] + offset
+        return elf[start:elf.index(b"\0", start)].decode("latin-1")
+
+    sections = {}
+    symbols = []
+    for header in headers:
+        name, stype, flags, addr, offset, size, link, _, _, entsize = header
+        data = b"" if SHT_NOBITS == stype else elf[offset:offset + size]
+        sections[string(shstrndx, name)] = (stype, flags, addr, data)
+        if SHT_SYMTAB == stype:
+            for i in range(0, size, entsize):
+                sname, value, ssize, info, _, _ = struct.unpack_from("<IIIBBH", data, i)
+                symbols.append((string(link, sname), value, ssize, info & 0x0F))
+    return sections, symbols
+
+
+def read_map(map_name, ram_end):
+    """RAM bytes per module {module: [data, bss]} of a GNU ld map file."""
+    modules = {}
+    pending = None
+    in_memory_map = False
+    with open(map_name, "r", errors="replace") as f:
+        for line in f:
+            if line.startswith("Linker script and memory map"):
+                in_memory_map = True
+                continue
+            if not in_memory_map:
+                continue
+
+            # A long input section name is followed by a line of its own
+            # with the address, the size and the module
+            m = re.match(r"^ (\.\S+|COMMON)\s*$", line)
+            if m:
+                pending = m.group(1)
+                continue
+            m = re.match(r"^ (\.\S+|COMMON)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$", line)
+            name = pending
+            pending = None
+            if not m:
+                continue
+            if m.group(1):
+                name = m.group(1)
+            if name is None:
+                continue
+
+            addr, size = int(m.group(2), 16), int(m.group(3), 16)
+            if not (RAM_START <= addr < ram_end) or 0 == size:
+                continue
+            if name.startswith(".data"):
+                kind = 0
+            elif name.startswith(".bss") or "COMMON" == name:
+                kind = 1
+            else:
+                continue
+            module = os.path.basename(m.group(4).strip())
+            modules.setdefault(module, [0, 0])[kind] += size
+    return modules
+
+
+class Function:
+    def __init__(self, name, addr):
+        self.name = name
+        self.addr = addr
+        self.frame = 0
+        self.dynamic = False
+        self.indirect = False
+        self.calls = set()
+
+
+def register_count(operand):
+    m = re.search(r"\{([^}]*)\}", operand)
+    if not m:
+        return 0
+    count = 0
+    for reg in m.group(1).split(","):
+        reg = reg.strip()
+        r = re.match(r"r(\d+)-r(\d+)$", reg)
+        count += int(r.group(2)) - int(r.group(1)) + 1 if r else 1
+    return count
+
+
+def immediate(operand):
+    m = re.search(r"#(-?(?:0x[0-9a-f]+|\d+))", operand)
+    return int(m.group(1), 0) if m else None
+
+
+BRANCH = re.compile(r"^b(eq|ne|cs|cc|hs|lo|mi|pl|vs|vc|hi|ls|ge|lt|gt|le|al)?(\.[nw])?$")
+TARGET = re.compile(r"<([^>+]+)(\+0x[0-9a-f]+)?>")
+
+
+def read_functions(objdump, elf_name):
+    """Frame size and callees of each function from the disassembly (GNU or LLVM objdump)."""
+    try:
+        listing = subprocess.run([objdump, "-d", "-w", "--no-show-raw-insn", elf_name],
+                                 stdout=subprocess.PIPE, universal_newlines=True, check=True).stdout
+    except (OSError, subprocess.CalledProcessError) as e:
+        sys.exit("%s: %s" % (objdump, e))
+
+    functions = {}
+    current = None
+    for line in listing.splitlines():
+        m = re.match(r"^([0-9a-f]+) <([^>]+)>:$", line)
+        if m:
+            name = m.group(2)
+            # Mapping symbols and local labels continue the function
+            if name.startswith("$") or name.startswith(".L"):
+                continue
+            current = functions.setdefault(name, Function(name, int(m.group(1), 16)))
+            continue
+        m = re.match(r"^\s*[0-9a-f]+:\s+([a-z][a-z0-9.]*)\s*(.*)$", line)
+        if not m or current is None:
+            continue
+        mnemonic = m.group(1)
+        operand = re.split(r"\s[;@]", m.group(2))[0].strip()
+
+        if mnemonic in ("push", "push.w") or (mnemonic in ("stmdb", "stmdb.w", "stmfd") and operand.startswith("sp!")):
+            current.frame += 4 * register_count(operand)
+        elif mnemonic in ("vpush", "vpush.64"):
+            current.frame += 8 * register_count(operand)
+        elif mnemonic in ("str", "str.w") and re.search(r"\[sp, #-\d+\]!", operand):
+            current.frame -= immediate(operand.split("[", 1)[1])
+        elif mnemonic in ("sub", "subs", "sub.w", "subw") and operand.startswith("sp,"):
+            value = immediate(operand)
+            if value is None:
+                current.dynamic = True
+            else:
+                current.frame += value
+        elif mnemonic in ("bl", "blx") and "<" in operand:
+            target = TARGET.search(operand)
+            if target:
+                current.calls.add(target.group(1))
+        elif mnemonic in ("blx", "bx") and re.match(r"^(r\d+|ip|sb|sl|fp)$", operand):
+            current.indirect = True
+        elif mnemonic in ("mov", "ldr", "ldr.w") and operand.startswith("pc,") and "[sp]" not in operand:
+            current.indirect = True
+        elif BRANCH.match(mnemonic):
+            target = TARGET.search(operand)
+            if target and not target.group(2) and target.group(1) != current.name:
+                current.calls.add(target.group(1))
+    return functions
+
+
+def address_taken(sections, functions):
+    """Functions whose Thumb address is stored in a flash or .data section."""
+    entries = {f.addr | 1: f.name for f in functions.values()}
+    taken = set()
+    for name, (stype, flags, _, data) in sections.items():
+        if not (flags & SHF_ALLOC) or SHT_NOBITS == stype or VECTOR_SECTION == name:
+            continue
+        for i in range(0, len(data) - 3, 4):
+            word, = struct.unpack_from("<I", data, i)
+            if word in entries:
+                taken.add(entries[word])
+    return taken
+
+
+class StackAnalysis:
+    def __init__(self, functions, indirect_targets):
+        self.functions = functions
+        self.indirect_targets = sorted(indirect_targets)
+        self.depth = {}
+        self.path = {}
+        self.active = []
+        self.cycles = set()
+        self.unbounded = set()
+        self.unknown = set()
+
+    def callees(self, f):
+        names = set(f.calls)
+        if f.indirect:
+            names.update(self.indirect_targets)
+        return sorted(names)
+
+    def worst(self, name):
+        """Worst case stack of a function and its callees, the deepest call path."""
+        if name in self.depth:
+            return self.depth[name], self.path[name]
+        f = self.functions.get(name)
+        if f is None:
+            self.unknown.add(name)
+            return 0, []
+        if name in self.active:
+            self.cycles.add(" > ".join(self.active[self.active.index(name):] + [name]))
+            return 0, []
+
+        self.active.append(name)
+        best, best_path = 0, []
+        for callee in self.callees(f):
+            depth, path = self.worst(callee)
+            if depth > best:
+                best, best_path = depth, path
+        self.active.pop()
+
+        if f.dynamic:
+            self.unbounded.add(name)
+        self.depth[name] = f.frame + best
+        self.path[name] = [name] + best_path
+        return self.depth[name], self.path[name]
+
+
+def print_path(analysis, path):
+    for name in path:
+        f = analysis.functions[name]
+        print("      %6d  %s%s" % (f.frame, name, "  (dynamic)" if f.dynamic else ""))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Static RAM and worst case stack of the firmware")
+    parser.add_argument("elf", help="firmware ELF file")
+    parser.add_argument("--map", help="linker map file, for the static RAM per module")
+    parser.add_argument("--objdump", default="arm-none-eabi-objdump", help="objdump of the toolchain")
+    parser.add_argument("--budget", type=int, help="RAM budget in bytes, default the RAM size")
+    parser.add_argument("--isr-levels", type=int, default=2, help="interrupt preemption levels, default 2")
+    parser.add_argument("--top", type=int, default=15, help="number of largest objects shown, default 15")
+    opts = parser.parse_args()
+
+    sections, symbols = read_elf(opts.elf)
+    values = {name: value for name, value, _, _ in symbols}
+    if "_ebss" not in values or "_estack" not in values:
+        sys.exit("%s: no _ebss or _estack symbol" % opts.elf)
+    ram_end = values["_estack"]
+    static = values["_ebss"] - RAM_START
+    budget = opts.budget if opts.budget is not None else ram_end - RAM_START
+
+    print("RAM %d bytes, static (.data and .bss) %d bytes, %d bytes left for the stack" %
+          (ram_end - RAM_START, static, ram_end - values["_ebss"]))
+
+    if opts.map:
+        modules = read_map(opts.map, ram_end)
+        print("\nStatic RAM per module\n   .data    .bss   total  module")
+        for module, (data, bss) in sorted(modules.items(), key=lambda m: -sum(m[1])):
+            print("  %6d  %6d  %6d  %s" % (data, bss, data + bss, module))
+
+    objects = sorted((s for s in symbols if STT_OBJECT == s[3] and RAM_START <= s[1] < ram_end and s[2] > 0),
+                     key=lambda s: -s[2])
+    print("\nLargest static objects\n    size  address     object")
+    for name, value, size, _ in objects[:opts.top]:
+        print("  %6d  0x%08x  %s" % (size, value, name))
+
+    functions = read_functions(opts.objdump, opts.elf)
+    analysis = StackAnalysis(functions, address_taken(sections, functions))
+
+    if VECTOR_SECTION not in sections:
+        sys.exit("%s: no %s section" % (opts.elf, VECTOR_SECTION))
+    by_addr = {f.addr: f.name for f in functions.values()}
+    vectors = sections[VECTOR_SECTION][3]
+    handlers = []
+    for i in range(4, len(vectors) - 3, 4):
+        word, = struct.unpack_from("<I", vectors, i)
+        name = by_addr.get(word & ~1)
+        if name and name not in handlers:
+            handlers.append(name)
+    if not handlers:
+        sys.exit("%s: no handlers in %s" % (opts.elf, VECTOR_SECTION))
+    reset = handlers.pop(0)
+
+    print("\nWorst case stack")
+    main_depth, path = analysis.worst(reset)
+    print("  %6d  %s" % (main_depth, reset))
+    print_path(analysis, path)
+
+    isr = sorted(((analysis.worst(h)[0] + EXCEPTION_FRAME, h) for h in handlers), reverse=True)
+    for depth, handler in isr[:opts.isr_levels]:
+        print("  %6d  %s, with the exception frame" % (depth, handler))
+        print_path(analysis, analysis.worst(handler)[1])
+    stack = main_depth + sum(depth for depth, _ in isr[:opts.isr_levels])
+
+    for cycle in sorted(analysis.cycles):
+        print("warning: recursion %s, not counted" % cycle)
+    for name in sorted(analysis.unbounded):
+        print("warning: dynamic stack allocation in %s, not counted" % name)
+    for name in sorted(analysis.unknown):
+        print("warning: call of %s without disassembly, not counted" % name)
+
+    total = static + stack
+    print("\nstatic %d + stack %d = %d bytes, budget %d bytes, margin %d bytes%s" %
+          (static, stack, total, budget, budget - total,
+           " (lower bound)" if analysis.cycles or analysis.unbounded or analysis.unknown else ""))
+    if total > budget:
+        print("error: RAM budget exceeded")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
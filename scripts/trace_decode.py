@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+#
+# This file is part of Nitrokey.
+#
+# Nitrokey is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# Nitrokey is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+#
+# Decode the binary trace log of the firmware (src/utils/trace.c).
+#
+# The format strings are read from the .trace_fmt section of the firmware
+# ELF file, a record refers to its format by the offset in this section.
+# The records are read from a file holding either the records as returned
+# by CMD_GET_TRACE (20 bytes each, without the 5 byte header) or a raw SWO
+# capture of the ITM stimulus port (--itm).
+#
+#   trace_decode.py build/gcc/crypto.elf trace.bin
+#   trace_decode.py --itm 1 build/gcc/crypto.elf swo.bin
+
+import argparse
+import re
+import struct
+import sys
+
+RECORD = struct.Struct("<HBBI3I")
+FORMAT_SECTION = ".trace_fmt"
+
+
+def read_format_section(elf_name):
+    with open(elf_name, "rb") as f:
+        elf = f.read()
+
+    if elf[:4] != b"\x7fELF":
+        sys.exit("%s: no ELF file" % elf_name)
+
+    if elf[4] == 1:
+        shoff, = struct.unpack_from("<I", elf, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x2E)
+        section = lambda n: struct.unpack_from("<IIIIII", elf, shoff + n * shentsize)
+    else:
+        shoff, = struct.unpack_from("<Q", elf, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x3A)
+        section = lambda n: struct.unpack_from("<IIQQQQ", elf, shoff + n * shentsize)
+
+    names_offset = section(shstrndx)[4]
+    for n in range(shnum):
+        name, _, _, addr, offset, size = section(n)
+        end = elf.index(b"\0", names_offset + name)
+        if elf[names_offset + name:end].decode() == FORMAT_SECTION:
+            return addr, elf[offset:offset + size]
+
+    sys.exit("%s: no %s section" % (elf_name, FORMAT_SECTION))
+
+
+def itm_payload(data, port):
+    """Concatenate the payload of the ITM software source packets of a port."""
+    payload = bytearray()
+    i = 0
+    while i < len(data):
+        header = data[i]
+        size = (0, 1, 2, 4)[header & 0x03]
+        if 0 == size:
+            # Sync, overflow or timestamp packet, a long timestamp has
+            # continuation bytes
+            i += 1
+            if 0xC0 == (header & 0xC0):
+                while i < len(data) and (data[i] & 0x80):
+                    i += 1
+                i += 1
+            continue
+        if 0 == (header & 0x04) and (header >> 3) == port:
+            payload += data[i + 1:i + 1 + size]
+        i += 1 + size
+    return bytes(payload)
+
+
+def format_text(fmt, args):
+    # The arguments are 32 bit words, a string can't be shown
+    fmt = re.sub(r"%(-?\d*)s", r"<0x%08x>", fmt)
+    fmt = re.sub(r"%(-?\d*)l+([diuxX])", r"%\1\2", fmt)
+    try:
+        return fmt % tuple(args)
+    except (TypeError, ValueError):
+        return "%s %s" % (fmt, " ".join("%08x" % a for a in args))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode the firmware trace log")
+    parser.add_argument("elf", help="firmware ELF file")
+    parser.add_argument("records", help="trace records, - for stdin")
+    parser.add_argument("--itm", type=int, metavar="PORT", help="input is a SWO capture, records on ITM port PORT")
+    parser.add_argument("--mhz", type=int, default=72, help="core clock, default 72")
+    opts = parser.parse_args()
+
+    base, formats = read_format_section(opts.elf)
+
+    if "-" == opts.records:
+        data = sys.stdin.buffer.read()
+    else:
+        with open(opts.records, "rb") as f:
+            data = f.read()
+    if opts.itm is not None:
+        data = itm_payload(data, opts.itm)
+
+    time_us = 0
+    last = None
+    for i in range(0, len(data) - RECORD.size + 1, RECORD.size):
+        nformat, nargs, _, cycles, a0, a1, a2 = RECORD.unpack_from(data, i)
+
+        # The cycle counter wraps after 59 s
+        if last is not None:
+            time_us += ((cycles - last) & 0xFFFFFFFF) / opts.mhz
+        last = cycles
+
+        offset = (nformat - base) & 0xFFFF
+        if offset >= len(formats):
+            print("%12.1f  <unknown format %04x>" % (time_us, nformat))
+            continue
+        fmt = formats[offset:formats.index(b"\0", offset)].decode("latin-1")
+        print("%12.1f  %s" % (time_us, format_text(fmt.rstrip("\r\n"), (a0, a1, a2)[:nargs])))
+
+
+if __name__ == "__main__":
+    main()
@@ -60,7 +60,7 @@ const uint8_t CCID_ConfigDescriptor[CCID_SIZ_CONFIG_DESC] = {
     0x02,   /* bDescriptorType */
     CCID_SIZ_CONFIG_DESC,
     0x00,
-    0x02,   /* bNumInterfaces */
+    0x03,   /* bNumInterfaces */
     0x01,   /* bConfigurationValue */
     0x00,   /* iConfiguration CCID = 6 ???? */
     USB_CONFIG_BUS_POWERED, /* bmAttributes */
@@ -133,14 +133,14 @@ const uint8_t CCID_ConfigDescriptor[CCID_SIZ_CONFIG_DESC] = {
     0x00, 0x00, 0x00, 0x00, /* dwMechanical: no special characteristics */
 
     // 0x3E,0x00,0x02,0x00, // instand pc reset on XP :-)
-    0xBA, 0x04, 0x01, 0x00, // 000104BAh
+    0xBA, 0x04, 0x02, 0x00, // 000204BAh
     // 00000002h Automatic parameter configuration based on ATR data
     // 00000008h Automatic ICC voltage selection
     // 00000010h Automatic ICC clock frequency change
     // 00000020h Automatic baud rate change
     // 00000080h Automatic PPS
     // 00000400h Automatic IFSD exchange
-    // 00010000h TPDU level exchanges with CCID
+    // 00020000h Short APDU level exchanges with CCID
 
     // 0x24,0x00,0x00,0x00, /* dwMaxCCIDMessageLength : Maximun block size +
     // header*/
@@ -164,16 +164,17 @@ const uint8_t CCID_ConfigDescriptor[CCID_SIZ_CONFIG_DESC] = {
     0x18,   // bInterval: Polling Interval (24 ms = 0x18)
 
 
-    // Endpoint 2 descriptor (Bulk out SCR)
+    // Endpoint 3 descriptor (Bulk out SCR)
     0x07,   /* bLength */
     0x05,   // bDescriptorType: Endpoint descriptor type
-    0x02,   // bEndpointAddress: Endpoint 2 OUT
+    0x03,   // bEndpointAddress: Endpoint 3 OUT (own endpoint register, so
+    // both bulk directions can be double buffered)
     0x02,   // bmAttributes: Bulk endpoint
     0x40,   // wMaxPacketSize(LSB): 64 char max (0x0040)
     0x00,   // wMaxPacketSize (MSB)
     0x00,   // bInterval: ignored
 
-    // Endpoint 3 descriptor (Bulk in SCR)
+    // Endpoint 2 descriptor (Bulk in SCR)
     0x07,   /* bLength */
     0x05,   // bDescriptorType: Endpoint descriptor type
     0x82,   // RB to avoid doublebuffering ? 0x82,// bEndpointAddress:
@@ -183,7 +184,44 @@ const uint8_t CCID_ConfigDescriptor[CCID_SIZ_CONFIG_DESC] = {
     0x00,   // wMaxPacketSize (MSB)
     0x00,   // bInterval: ignored
 
+    // Interface 2 descriptor (Interface 2 = HID command channel)
+    0x09,   /* bLength */
+    USB_INTERFACE_DESCRIPTOR_TYPE,  /* bDescriptorType */
+    COMMAND_INTERFACE_NO,   /* bInterfaceNumber */
+    0x00,   /* bAlternateSetting */
+    0x02,   /* bNumEndpoints = 2 */
+    0x03,   /* bInterfaceClass: HID */
+    0x00,   /* bInterfaceSubClass : 1=BOOT, 0=no boot */
+    0x00,   /* nInterfaceProtocol : 0=none, 1=keyboard, 2=mouse */
+    0,  /* iInterface: Index of string descriptor */
+      /******************** Descriptor of command channel HID ********************/
+    0x09,   /* bLength: HID Descriptor size */
+    HID_DESCRIPTOR_TYPE,    /* bDescriptorType: HID */
+    0x10,   /* bcdHID: HID Class Spec release number */
+    0x01,
+    0x00,   /* bCountryCode: Hardware target country */
+    0x01,   /* bNumDescriptors: Number of HID class descriptors to follow */
+    0x22,   /* bDescriptorType */
+    COMMAND_SIZ_REPORT_DESC,    /* wItemLength: Total length of Report descriptor */
+    0x00,
+
+    // Endpoint 5 descriptor (Interrupt in, command answers)
+    0x07,   /* bLength */
+    0x05,   // bDescriptorType: Endpoint descriptor type
+    0x85,   // bEndpointAddress: Endpoint 5 IN
+    0x03,   // bmAttributes: Interrupt endpoint
+    COMMAND_PACKET_SIZE,    // wMaxPacketSize(LSB): 32 char max (0x0020)
+    0x00,   // wMaxPacketSize (MSB)
+    0x01,   // bInterval: Polling Interval (1 ms)
 
+    // Endpoint 5 descriptor (Interrupt out, commands)
+    0x07,   /* bLength */
+    0x05,   // bDescriptorType: Endpoint descriptor type
+    0x05,   // bEndpointAddress: Endpoint 5 OUT
+    0x03,   // bmAttributes: Interrupt endpoint
+    COMMAND_PACKET_SIZE,    // wMaxPacketSize(LSB): 32 char max (0x0020)
+    0x00,   // wMaxPacketSize (MSB)
+    0x01,   // bInterval: Polling Interval (1 ms)
 };
 
 
@@ -214,6 +252,29 @@ const uint8_t Keyboard_ReportDescriptor[KEYBOARD_SIZ_REPORT_DESC] = {
     0xc0,   			// END_COLLECTION
 };
 
+// Command channel, the reports have the format of the feature reports
+const uint8_t Command_ReportDescriptor[COMMAND_SIZ_REPORT_DESC] = {
+    0x06, 0x00, 0xff,	// USAGE_PAGE (Vendor-Defined)
+    0x09, 0x02,			// USAGE (Vendor 2)
+    0xa1, 0x01,			// COLLECTION (Application)
+
+        0x09, 0x01,			//   USAGE (Input Report Data)
+        0x15, 0x00,         //   LOGICAL_MINIMUM (0)
+        0x26, 0xff, 0x00,   //   LOGICAL_MAXIMUM (255)
+        0x75, 0x08,         //   REPORT_SIZE (8)
+        0x95, KEYBOARD_FEATURE_COUNT,   // REPORT_COUNT (64)
+        0x81, 0x02,         //   INPUT (Data,Var,Abs)
+
+        0x09, 0x02,         //   USAGE(Output Report Data)
+        0x15, 0x00,         //   LOGICAL_MINIMUM (0)
+        0x26, 0xff, 0x00,   //   LOGICAL_MAXIMUM (255)
+        0x75, 0x08,         //   REPORT_SIZE (8)
+        0x95, KEYBOARD_FEATURE_COUNT,   // REPORT_COUNT (64)
+        0x91, 0x02, 		//   OUTPUT (Data,Var,Abs)
+
+    0xc0,   			// END_COLLECTION
+};
+
 /*****************************************************************************/
 
 const uint8_t CCID_StringLangID[CCID_SIZ_STRING_LANGID] = {
@@ -36,6 +36,7 @@
 #include "hotp.h"
 #include "keyboard.h"
 #include "report_protocol.h"
+#include "scheduler.h"
 
 #define KEY_STORE_ADDRESS 0x801FC00
 
@@ -58,9 +59,35 @@ uint8_t HID_SetReport_Value[KEYBOARD_FEATURE_COUNT];
 
 uint8_t HID_GetReport_Value[KEYBOARD_FEATURE_COUNT];
 
-uint8_t HID_SetReport_Value_tmp[KEYBOARD_FEATURE_COUNT];
+uint8_t HID_GetReport_Value_tmp[KEYBOARD_FEATURE_COUNT];    // last answer read by the host
 
-uint8_t HID_GetReport_Value_tmp[KEYBOARD_FEATURE_COUNT];
+// Command queue, the indices run free and are used modulo the queue size
+static typeHidCommandSlot tHidCommands[HID_COMMAND_QUEUE_SIZE];
+
+static volatile uint8_t cHidCommandWrite = 0;   // next free slot (USB interrupt)
+
+static volatile uint8_t cHidCommandRun = 0;     // next command to parse (main loop)
+
+static volatile uint8_t cHidCommandRead = 0;    // next answer for the host (USB interrupt)
+
+#define HID_COMMAND_SLOT(n)     (&tHidCommands[(n) & (HID_COMMAND_QUEUE_SIZE - 1)])
+
+// Last report rejected by the full queue, answered with CMD_STATUS_BUSY
+static typeHidCommandSlot tHidBusyCommand;
+
+static volatile uint8_t cHidBusyReports = 0;    // rejected reports (USB interrupt)
+
+static uint8_t cHidBusyTaken = 0;               // cHidBusyReports at HID_GetBusyCommand
+
+// Command channel (interface 2), one command at a time. The out endpoint
+// NAKs until the answer is sent.
+static uint8_t HID_ChannelCommand[KEYBOARD_FEATURE_COUNT];
+
+static uint8_t HID_ChannelAnswer[KEYBOARD_FEATURE_COUNT];
+
+static uint8_t cHidChannelCount = 0;    // bytes received or sent
+
+static volatile uint8_t cHidChannelState = HID_CHANNEL_RECEIVE;
 
 uint8_t message[KEYBOARD_FEATURE_COUNT];
 
@@ -120,6 +147,16 @@ ONE_DESCRIPTOR Keyboard_Hid_Descriptor = {
     KEYBOARD_SIZ_HID_DESC
 };
 
+ONE_DESCRIPTOR Command_Report_Descriptor = {
+    (uint8_t *) Command_ReportDescriptor,
+    COMMAND_SIZ_REPORT_DESC
+};
+
+ONE_DESCRIPTOR Command_Hid_Descriptor = {
+    (uint8_t *) CCID_ConfigDescriptor + COMMAND_OFF_HID_DESC,
+    KEYBOARD_SIZ_HID_DESC
+};
+
 ONE_DESCRIPTOR CCID_String_Descriptor[5] = {
     {(uint8_t *) CCID_StringLangID, CCID_SIZ_STRING_LANGID},
     {(uint8_t *) CCID_StringVendor, CCID_SIZ_STRING_VENDOR},
@@ -135,6 +172,10 @@ extern unsigned char Bot_State;
 extern Bulk_Only_CBW CBW;
 
 /* Private function prototypes ----------------------------------------------- */
+static void HID_UpdateCommandStatus (void);
+
+static void HID_ChannelReset (void);
+
 /* Extern function prototypes ------------------------------------------------ */
 /* Private functions --------------------------------------------------------- */
 /*******************************************************************************
@@ -199,16 +240,26 @@ void USB_CCID_Reset (void)
     SetEPTxStatus (ENDP1, EP_TX_NAK);
     SetEPRxStatus (ENDP1, EP_RX_DIS);
 
-    /* Initialize Endpoint 2 */
+    /* Initialize Endpoint 2 - CCID bulk in, double buffered */
     SetEPType (ENDP2, EP_BULK);
-
-    SetEPRxAddr (ENDP2, CCID_ENDP2_RXADDR);
-    SetEPRxCount (ENDP2, Device_Property->MaxPacketSize);
-    SetEPRxStatus (ENDP2, EP_RX_VALID);
-
-    SetEPTxAddr (ENDP2, CCID_ENDP2_TXADDR);
-    SetEPTxCount (ENDP2, Device_Property->MaxPacketSize);
-    SetEPTxStatus (ENDP2, EP_TX_VALID);
+    SetEPDoubleBuff (ENDP2);
+    SetEPDblBuffAddr (ENDP2, CCID_ENDP2_TXADDR0, CCID_ENDP2_TXADDR1);
+    SetEPDblBuffCount (ENDP2, EP_DBUF_IN, 0);
+    ClearDTOG_TX (ENDP2);
+    ClearDTOG_RX (ENDP2);   // SW_BUF
+    SetEPRxStatus (ENDP2, EP_RX_DIS);
+    SetEPTxStatus (ENDP2, EP_TX_VALID); // NAK until a buffer is released
+
+    /* Initialize Endpoint 3 - CCID bulk out, double buffered */
+    SetEPType (ENDP3, EP_BULK);
+    SetEPDoubleBuff (ENDP3);
+    SetEPDblBuffAddr (ENDP3, CCID_ENDP3_RXADDR0, CCID_ENDP3_RXADDR1);
+    SetEPDblBuffCount (ENDP3, EP_DBUF_OUT, Device_Property->MaxPacketSize);
+    ClearDTOG_RX (ENDP3);
+    ClearDTOG_TX (ENDP3);
+    ToggleDTOG_TX (ENDP3);  // SW_BUF, both buffers free for reception
+    SetEPTxStatus (ENDP3, EP_TX_DIS);
+    SetEPRxStatus (ENDP3, EP_RX_VALID);
 
     /* Initialize Endpoint 4 */
     SetEPType (ENDP4, EP_INTERRUPT);
@@ -217,6 +268,14 @@ void USB_CCID_Reset (void)
     SetEPRxStatus (ENDP4, EP_RX_DIS);
     SetEPTxStatus (ENDP4, EP_TX_NAK);
 
+    /* Initialize Endpoint 5 - HID command channel */
+    SetEPType (ENDP5, EP_INTERRUPT);
+    SetEPTxAddr (ENDP5, CCID_ENDP5_TXADDR);
+    SetEPRxAddr (ENDP5, CCID_ENDP5_RXADDR);
+    SetEPRxCount (ENDP5, COMMAND_PACKET_SIZE);
+    SetEPTxStatus (ENDP5, EP_TX_NAK);
+    HID_ChannelReset ();
+
     /* */
     SetEPRxCount (ENDP0, Device_Property->MaxPacketSize);
     SetEPRxValid (ENDP0);
@@ -230,6 +289,7 @@ void USB_CCID_Reset (void)
     Bot_State = BOT_IDLE;
 
     nFlagSendSMCardInserted = TRUE; // card is always inserted
+    SCHED_PostEvent (SCHED_CLASS_USB);
 }
 
 /*******************************************************************************
@@ -249,8 +309,13 @@ void USB_CCID_Storage_SetConfiguration (void)
         ClearDTOG_TX (ENDP1);
         ClearDTOG_RX (ENDP2);
         ClearDTOG_TX (ENDP2);
+        ClearDTOG_RX (ENDP3);
+        ClearDTOG_TX (ENDP3);
+        ToggleDTOG_TX (ENDP3);
         // ClearDTOG_TX(ENDP3);
         ClearDTOG_TX (ENDP4);
+        ClearDTOG_TX (ENDP5);
+        ClearDTOG_RX (ENDP5);
         Bot_State = BOT_IDLE;   /* set the Bot state machine to the IDLE state */
     }
 }
@@ -308,6 +373,310 @@ volatile uint8_t capsLockClicked = 0;
 
 volatile uint8_t scrollLockClicked = 0;
 
+/*******************************************************************************
+* Function Name  : HID_QueueCommand
+* Description    : Queue a received feature report for the main loop. No
+*                  answer is dropped: while the queue is full of pending
+*                  commands and unread answers the report is rejected, the
+*                  main loop answers it with CMD_STATUS_BUSY.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void HID_QueueCommand (void)
+{
+    typeHidCommandSlot* pSlot;
+
+    if (HID_COMMAND_QUEUE_SIZE == (uint8_t) (cHidCommandWrite - cHidCommandRead))
+    {
+        // A newer rejected report replaces an unanswered one
+        memcpy (tHidBusyCommand.cCommand, HID_SetReport_Value, KEYBOARD_FEATURE_COUNT);
+        tHidBusyCommand.cState = HID_COMMAND_QUEUED;
+        cHidBusyReports++;
+        device_status = STATUS_RECEIVED_REPORT;
+        SCHED_PostEvent (SCHED_CLASS_HID_COMMAND);
+        return;
+    }
+
+    pSlot = HID_COMMAND_SLOT (cHidCommandWrite);
+    memcpy (pSlot->cCommand, HID_SetReport_Value, KEYBOARD_FEATURE_COUNT);
+    pSlot->cState = HID_COMMAND_QUEUED;
+    cHidCommandWrite++;
+
+    if (device_status == STATUS_READY)
+    {
+        device_status = STATUS_RECEIVED_REPORT;
+    }
+    SCHED_PostEvent (SCHED_CLASS_HID_COMMAND);
+}
+
+/*******************************************************************************
+* Function Name  : HID_GetQueuedCommand
+* Description    : Oldest command not parsed yet, called by the main loop.
+* Input          : None.
+* Output         : None.
+* Return         : The command report or NULL.
+*******************************************************************************/
+uint8_t* HID_GetQueuedCommand (void)
+{
+    if (cHidCommandRun == cHidCommandWrite)
+    {
+        return NULL;
+    }
+    return HID_COMMAND_SLOT (cHidCommandRun)->cCommand;
+}
+
+/*******************************************************************************
+* Function Name  : HID_GetQueuedAnswerBuffer
+* Description    : Answer buffer of the command returned by HID_GetQueuedCommand.
+* Input          : None.
+* Output         : None.
+* Return         : The answer buffer.
+*******************************************************************************/
+uint8_t* HID_GetQueuedAnswerBuffer (void)
+{
+    return HID_COMMAND_SLOT (cHidCommandRun)->cAnswer;
+}
+
+/*******************************************************************************
+* Function Name  : HID_QueuedCommandDone
+* Description    : Hand the answer to the host, called by the main loop.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void HID_QueuedCommandDone (void)
+{
+    HID_COMMAND_SLOT (cHidCommandRun)->cState = HID_COMMAND_DONE;
+
+    __disable_irq ();
+    cHidCommandRun++;
+    HID_UpdateCommandStatus ();
+    __enable_irq ();
+}
+
+/*******************************************************************************
+* Function Name  : HID_GetBusyCommand
+* Description    : Report rejected by the full queue and not answered yet,
+*                  called by the main loop.
+* Input          : None.
+* Output         : None.
+* Return         : The command report or NULL.
+*******************************************************************************/
+uint8_t* HID_GetBusyCommand (void)
+{
+    if (HID_COMMAND_QUEUED != tHidBusyCommand.cState)
+    {
+        return NULL;
+    }
+    cHidBusyTaken = cHidBusyReports;
+    return tHidBusyCommand.cCommand;
+}
+
+/*******************************************************************************
+* Function Name  : HID_GetBusyAnswerBuffer
+* Description    : Answer buffer of the command returned by HID_GetBusyCommand.
+* Input          : None.
+* Output         : None.
+* Return         : The answer buffer.
+*******************************************************************************/
+uint8_t* HID_GetBusyAnswerBuffer (void)
+{
+    return tHidBusyCommand.cAnswer;
+}
+
+/*******************************************************************************
+* Function Name  : HID_BusyCommandDone
+* Description    : Hand the busy answer to the host, called by the main loop.
+*                  A report rejected meanwhile is answered by the next run.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void HID_BusyCommandDone (void)
+{
+    __disable_irq ();
+    if (cHidBusyTaken == cHidBusyReports)
+    {
+        tHidBusyCommand.cState = HID_COMMAND_DONE;
+    }
+    HID_UpdateCommandStatus ();
+    __enable_irq ();
+}
+
+/*******************************************************************************
+* Function Name  : HID_UpdateCommandStatus
+* Description    : Device status after a command, run the task again if more
+*                  commands are waiting. Called with disabled interrupts.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void HID_UpdateCommandStatus (void)
+{
+    if ((cHidCommandRun != cHidCommandWrite) || (HID_CHANNEL_QUEUED == cHidChannelState) || (HID_COMMAND_QUEUED == tHidBusyCommand.cState))
+    {
+        device_status = STATUS_RECEIVED_REPORT;
+        SCHED_PostEvent (SCHED_CLASS_HID_COMMAND);
+    }
+    else
+    {
+        device_status = STATUS_READY;
+    }
+}
+
+/*******************************************************************************
+* Function Name  : HID_ChannelReset
+* Description    : Drop a partly received or sent report of the command
+*                  channel. A command in work is answered when done.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void HID_ChannelReset (void)
+{
+    cHidChannelCount = 0;
+    if (HID_CHANNEL_SEND == cHidChannelState)
+    {
+        cHidChannelState = HID_CHANNEL_RECEIVE;
+    }
+
+    if (HID_CHANNEL_RECEIVE == cHidChannelState)
+    {
+        SetEPRxStatus (ENDP5, EP_RX_VALID);
+    }
+    else
+    {
+        SetEPRxStatus (ENDP5, EP_RX_NAK);
+    }
+}
+
+/*******************************************************************************
+* Function Name  : HID_ChannelOutMessage
+* Description    : Endpoint 5 out callback, collect the packets of a command.
+*                  The endpoint stays NAK after the last packet.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void HID_ChannelOutMessage (void)
+{
+    uint16_t nLength;
+
+    nLength = GetEPRxCount (ENDP5);
+    if (KEYBOARD_FEATURE_COUNT - cHidChannelCount < nLength)
+    {
+        nLength = KEYBOARD_FEATURE_COUNT - cHidChannelCount;
+    }
+    PMAToUserBufferCopy (&HID_ChannelCommand[cHidChannelCount], CCID_ENDP5_RXADDR, nLength);
+    cHidChannelCount += nLength;
+
+    // A short packet ends the report too
+    if ((KEYBOARD_FEATURE_COUNT > cHidChannelCount) && (COMMAND_PACKET_SIZE == nLength))
+    {
+        SetEPRxStatus (ENDP5, EP_RX_VALID);
+        return;
+    }
+
+    memset (&HID_ChannelCommand[cHidChannelCount], 0, KEYBOARD_FEATURE_COUNT - cHidChannelCount);
+    cHidChannelCount = 0;
+    cHidChannelState = HID_CHANNEL_QUEUED;
+
+    if (device_status == STATUS_READY)
+    {
+        device_status = STATUS_RECEIVED_REPORT;
+    }
+    SCHED_PostEvent (SCHED_CLASS_HID_COMMAND);
+}
+
+/*******************************************************************************
+* Function Name  : HID_ChannelSendPacket
+* Description    : Send the next packet of the answer
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+static void HID_ChannelSendPacket (void)
+{
+    UserToPMABufferCopy (&HID_ChannelAnswer[cHidChannelCount], CCID_ENDP5_TXADDR, COMMAND_PACKET_SIZE);
+    SetEPTxCount (ENDP5, COMMAND_PACKET_SIZE);
+    SetEPTxStatus (ENDP5, EP_TX_VALID);
+}
+
+/*******************************************************************************
+* Function Name  : HID_ChannelInMessage
+* Description    : Endpoint 5 in callback, send the rest of the answer and
+*                  accept the next command.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void HID_ChannelInMessage (void)
+{
+    if (HID_CHANNEL_SEND != cHidChannelState)
+    {
+        return;
+    }
+
+    cHidChannelCount += COMMAND_PACKET_SIZE;
+    if (KEYBOARD_FEATURE_COUNT > cHidChannelCount)
+    {
+        HID_ChannelSendPacket ();
+        return;
+    }
+
+    cHidChannelCount = 0;
+    cHidChannelState = HID_CHANNEL_RECEIVE;
+    SetEPRxStatus (ENDP5, EP_RX_VALID);
+}
+
+/*******************************************************************************
+* Function Name  : HID_GetChannelCommand
+* Description    : Command received by the command channel, called by the
+*                  main loop.
+* Input          : None.
+* Output         : None.
+* Return         : The command report or NULL.
+*******************************************************************************/
+uint8_t* HID_GetChannelCommand (void)
+{
+    if (HID_CHANNEL_QUEUED != cHidChannelState)
+    {
+        return NULL;
+    }
+    return HID_ChannelCommand;
+}
+
+/*******************************************************************************
+* Function Name  : HID_GetChannelAnswerBuffer
+* Description    : Answer buffer of the command channel.
+* Input          : None.
+* Output         : None.
+* Return         : The answer buffer.
+*******************************************************************************/
+uint8_t* HID_GetChannelAnswerBuffer (void)
+{
+    return HID_ChannelAnswer;
+}
+
+/*******************************************************************************
+* Function Name  : HID_ChannelCommandDone
+* Description    : Push the answer to the host, called by the main loop.
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void HID_ChannelCommandDone (void)
+{
+    __disable_irq ();
+    HID_ChannelAnswer[0] = STATUS_READY;
+    cHidChannelCount = 0;
+    cHidChannelState = HID_CHANNEL_SEND;
+    HID_ChannelSendPacket ();
+    HID_UpdateCommandStatus ();
+    __enable_irq ();
+}
+
 void USB_CCID_Status_In (void)
 {
     if (Request == SET_REPORT)  // SET_REPORT completion
@@ -324,6 +693,7 @@ void USB_CCID_Status_In (void)
                 if ((currentTime - lastNumLockChange) < DOUBLE_CLICK_TIME)
                 {
                     numLockClicked = 1;
+                    SCHED_PostEvent (SCHED_CLASS_KEYBOARD);
                 }
                 lastNumLockChange = currentTime;
             }
@@ -333,6 +703,7 @@ void USB_CCID_Status_In (void)
                 if ((currentTime - lastCapsLockChange) < DOUBLE_CLICK_TIME)
                 {
                     capsLockClicked = 1;
+                    SCHED_PostEvent (SCHED_CLASS_KEYBOARD);
                 }
                 lastCapsLockChange = currentTime;
             }
@@ -342,6 +713,7 @@ void USB_CCID_Status_In (void)
                 if ((currentTime - lastScrollLockChange) < DOUBLE_CLICK_TIME)
                 {
                     scrollLockClicked = 1;
+                    SCHED_PostEvent (SCHED_CLASS_KEYBOARD);
                 }
                 lastScrollLockChange = currentTime;
             }
@@ -352,11 +724,7 @@ void USB_CCID_Status_In (void)
         {
             // SwitchSmartcardLED(ENABLE);
 
-            if (device_status == STATUS_READY)
-            {
-                device_status = STATUS_RECEIVED_REPORT;
-                memcpy (HID_SetReport_Value_tmp, HID_SetReport_Value, KEYBOARD_FEATURE_COUNT);
-            }
+            HID_QueueCommand ();
             // parse_report(HID_SetReport_Value,HID_GetReport_Value_tmp);
             // HID_GetReport_Value_tmp[0]=0xdd;
         }
@@ -405,6 +773,19 @@ uint8_t* (*CopyRoutine) (uint16_t);
 
     }   /* End of GET_DESCRIPTOR */
 
+    else if ((RequestNo == GET_DESCRIPTOR) && (Type_Recipient == (STANDARD_REQUEST | INTERFACE_RECIPIENT))
+             && (pInformation->USBwIndex0 == COMMAND_INTERFACE_NO))
+    {
+        if (pInformation->USBwValue1 == REPORT_DESCRIPTOR)
+        {
+            CopyRoutine = Command_GetReportDescriptor;
+        }
+        else if (pInformation->USBwValue1 == HID_DESCRIPTOR_TYPE)
+        {
+            CopyRoutine = Command_GetHIDDescriptor;
+        }
+    }
+
   /*** GET_PROTOCOL ***/
     /* else if ((Type_Recipient == (CLASS_REQUEST | INTERFACE_RECIPIENT)) && RequestNo == GET_PROTOCOL) { CopyRoutine = Keyboard_GetProtocolValue; } */
   /*** GET_PROTOCOL, GET_REPORT, SET_REPORT ***/
@@ -493,9 +874,9 @@ RESULT USB_CCID_Get_Interface_Setting (uint8_t Interface, uint8_t AlternateSetti
     {
         return USB_UNSUPPORT;   /* in this application we don't have AlternateSetting */
     }
-    else if (Interface > 1)
+    else if (Interface > COMMAND_INTERFACE_NO)
     {
-        return USB_UNSUPPORT;   /* in this application we have only 1 interfaces */
+        return USB_UNSUPPORT;   /* in this application we have only 3 interfaces */
     }
     return USB_SUCCESS;
 }
@@ -627,6 +1008,30 @@ uint8_t* Keyboard_GetHIDDescriptor (uint16_t Length)
     return Standard_GetDescriptorData (Length, &Keyboard_Hid_Descriptor);
 }
 
+/*******************************************************************************
+* Function Name  : Command_GetReportDescriptor.
+* Description    : Gets the HID report descriptor of the command channel.
+* Input          : Length
+* Output         : None.
+* Return         : The address of the report descriptor.
+*******************************************************************************/
+uint8_t* Command_GetReportDescriptor (uint16_t Length)
+{
+    return Standard_GetDescriptorData (Length, &Command_Report_Descriptor);
+}
+
+/*******************************************************************************
+* Function Name  : Command_GetHIDDescriptor.
+* Description    : Gets the HID descriptor of the command channel.
+* Input          : Length
+* Output         : None.
+* Return         : The address of the HID descriptor.
+*******************************************************************************/
+uint8_t* Command_GetHIDDescriptor (uint16_t Length)
+{
+    return Standard_GetDescriptorData (Length, &Command_Hid_Descriptor);
+}
+
 
 
 
@@ -651,9 +1056,29 @@ uint8_t* Keyboard_GetReport_Feature (uint16_t Length)
         // HID_GetReport_Value[3] = 0xEF;
         // HID_GetReport_Value[63] = 0xFF;
 
+        typeHidCommandSlot* pSlot = HID_COMMAND_SLOT (cHidCommandRead);
+        uint8_t cStatus = device_status;
+
+        // The next answer in command order, then the answer of a rejected
+        // report, else the last answer again with the device status (old
+        // tools poll until the status is not busy)
+        if ((cHidCommandRead != cHidCommandRun) && (HID_COMMAND_DONE == pSlot->cState))
+        {
+            memcpy (HID_GetReport_Value_tmp, pSlot->cAnswer, KEYBOARD_FEATURE_COUNT);
+            pSlot->cState = HID_COMMAND_FREE;
+            cHidCommandRead++;
+            cStatus = STATUS_READY;
+        }
+        else if (HID_COMMAND_DONE == tHidBusyCommand.cState)
+        {
+            memcpy (HID_GetReport_Value_tmp, tHidBusyCommand.cAnswer, KEYBOARD_FEATURE_COUNT);
+            tHidBusyCommand.cState = HID_COMMAND_FREE;
+            cStatus = STATUS_READY;
+        }
+
         memcpy (HID_GetReport_Value, HID_GetReport_Value_tmp, KEYBOARD_FEATURE_COUNT);
         // memcpy(HID_GetReport_Value,HID_SetReport_Value,KEYBOARD_FEATURE_COUNT);
-        HID_GetReport_Value[0] = device_status;
+        HID_GetReport_Value[0] = cStatus;
 
 
 
@@ -31,6 +31,9 @@
 #include "CCID_Ifd_protocol.h"
 #include "CcidLocalAccess.h"
 #include "hotp.h"
+#include "profile.h"
+#include "perf_counters.h"
+#include "trace.h"
 
 #include "time.h"
 
@@ -45,6 +48,33 @@
 
 static typeSmartcardTransfer tSCT;
 
+/*******************************************************************************
+
+  Cache of OpenPGP data objects
+
+  The AID, the PW status bytes and the AES capability are read only once
+  from the card. APDUs which change the card state invalidate the cache.
+
+*******************************************************************************/
+
+static typeCcidDataObjectCache tCache;
+
+/*******************************************************************************
+
+  Smartcard session state
+
+  Tracks the power state of the card, the selected application and the
+  verified PINs, so redundant restarts and SELECTs are skipped. The
+  skipped APDUs are counted per HID command.
+
+*******************************************************************************/
+
+static typeCcidSession tSession = { FALSE, CCID_SESSION_APP_NONE, 0 };
+
+static unsigned char cSessionCommand = CCID_SESSION_NO_COMMAND;
+
+static unsigned short nApdusAvoided[CCID_SESSION_STAT_COMMANDS];
+
 /*******************************************************************************
 
   InitSCTStruct
@@ -59,13 +89,176 @@ void InitSCTStruct (typeSmartcardTransfer * _tSCT)
     _tSCT->cTPDUSequence = 0;
 }
 
+/*******************************************************************************
+
+  CcidInvalidateCache
+
+*******************************************************************************/
+
+void CcidInvalidateCache (void)
+{
+    tCache.cAIDValid = FALSE;
+    tCache.cPWStatusValid = FALSE;
+    tCache.cAesSupportValid = FALSE;
+}
+
+/*******************************************************************************
+
+  CcidCheckCacheInvalidation
+
+  Invalidate the cache and the session state when the command APDU may
+  change the card state
+
+*******************************************************************************/
+
+void CcidCheckCacheInvalidation (unsigned char* pAPDU)
+{
+    switch (pAPDU[CCID_INS])
+    {
+        case CCID_INS_SELECT:
+            // Security status is reset by a new selection
+            tSession.cSelectedApp = CCID_SESSION_APP_NONE;
+            tSession.cVerifiedPins = 0;
+            break;
+        case CCID_INS_VERIFY:
+            // A failed verification resets the security status of the PIN
+            tSession.cVerifiedPins &= ~CCID_SESSION_PIN_BIT (pAPDU[CCID_P2]);
+            CcidInvalidateCache ();
+            break;
+        case CCID_INS_TERMINATE_DF:
+        case CCID_INS_ACTIVATE_FILE:
+            tSession.cSelectedApp = CCID_SESSION_APP_NONE;
+            tSession.cVerifiedPins = 0;
+            CcidInvalidateCache ();
+            break;
+        case CCID_INS_CHANGE_REFERENCE_DATA:
+        case CCID_INS_RESET_RETRY_COUNTER:
+        case CCID_INS_PUT_DATA:
+        case CCID_INS_PUT_DATA_ODD:
+            CcidInvalidateCache ();
+            break;
+        default:
+            break;
+    }
+}
+
+/*******************************************************************************
+
+  CcidSessionPowerOn
+
+  The card has send the ATR, nothing is selected or verified
+
+*******************************************************************************/
+
+void CcidSessionPowerOn (void)
+{
+    tSession.cPowered = TRUE;
+    tSession.cSelectedApp = CCID_SESSION_APP_NONE;
+    tSession.cVerifiedPins = 0;
+}
+
+/*******************************************************************************
+
+  CcidSessionPowerOff
+
+  The card is reset, the session state and the cached data are lost
+
+*******************************************************************************/
+
+void CcidSessionPowerOff (void)
+{
+    tSession.cPowered = FALSE;
+    CcidSessionInvalidate ();
+}
+
+/*******************************************************************************
+
+  CcidSessionInvalidate
+
+  The card state is unknown (e.g. the host has send a TPDU), a SELECT is
+  needed before the next local access
+
+*******************************************************************************/
+
+void CcidSessionInvalidate (void)
+{
+    tSession.cSelectedApp = CCID_SESSION_APP_NONE;
+    tSession.cVerifiedPins = 0;
+    CcidInvalidateCache ();
+}
+
+/*******************************************************************************
+
+  CcidSessionIsPinVerified
+
+*******************************************************************************/
+
+uint8_t CcidSessionIsPinVerified (unsigned char cPinNr)
+{
+    if (0 != (tSession.cVerifiedPins & CCID_SESSION_PIN_BIT (cPinNr)))
+    {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*******************************************************************************
+
+  CcidSessionSetCommand
+
+  Set the HID command for the statistic of avoided APDUs,
+  CCID_SESSION_NO_COMMAND stops counting
+
+*******************************************************************************/
+
+void CcidSessionSetCommand (unsigned char cCommand)
+{
+    cSessionCommand = cCommand;
+}
+
+/*******************************************************************************
+
+  CcidSessionApduAvoided
+
+*******************************************************************************/
+
+static void CcidSessionApduAvoided (void)
+{
+    if (CCID_SESSION_STAT_COMMANDS <= cSessionCommand)
+    {
+        return;
+    }
+
+    if (0xFFFF != nApdusAvoided[cSessionCommand])
+    {
+        nApdusAvoided[cSessionCommand]++;
+    }
+}
+
+/*******************************************************************************
+
+  CcidSessionGetApdusAvoided
+
+*******************************************************************************/
+
+unsigned short CcidSessionGetApdusAvoided (unsigned char cCommand)
+{
+    if (CCID_SESSION_STAT_COMMANDS <= cCommand)
+    {
+        return (0);
+    }
+
+    return (nApdusAvoided[cCommand]);
+}
+
 /*******************************************************************************
 
   GenerateCRC
 
 *******************************************************************************/
 
-unsigned char GenerateCRC (unsigned char* pData, unsigned char cLength)
+unsigned char GenerateCRC (unsigned char* pData, unsigned short cLength)
 {
     unsigned char cCRC = 0;
 
@@ -142,6 +335,8 @@ unsigned int nAnswerLength = 0;
 
 unsigned char nOverhead = 0;
 
+unsigned int nData;
+
     // Send TPDU to smartcard an receive answer
     CRD_SendCommand ((unsigned char *) _tSCT->cTPDU, _tSCT->cTPDULength, CCID_TRANSFER_BUFFER_MAX, (unsigned int *) &nAnswerLength);
 
@@ -168,15 +363,17 @@ unsigned char nOverhead = 0;
         // SW2
     }
 
-    memcpy (&_tSCT->cAPDU[_tSCT->cAPDUAnswerLength], &_tSCT->cTPDU[CCID_TPDU_DATASTART], nAnswerLength - nOverhead);   // add
-    // new
-    // data
-    // to
-    // receive
-    // data
+    // A chained answer longer than a short APDU doesn't fit into cAPDU
+    nData = nAnswerLength - nOverhead;
+    if (CCID_TRANSFER_BUFFER_MAX < _tSCT->cAPDUAnswerLength + nData)
+    {
+        _tSCT->cAPDUAnswerStatus = APDU_ANSWER_RECEIVE_INCORRECT;
+        return (_tSCT->cAPDUAnswerStatus);
+    }
 
-    _tSCT->cAPDUAnswerLength += nAnswerLength - nOverhead;   // add length of
-    // recieved data
+    memcpy (&_tSCT->cAPDU[_tSCT->cAPDUAnswerLength], &_tSCT->cTPDU[CCID_TPDU_DATASTART], nData);  // add new data to receive data
+
+    _tSCT->cAPDUAnswerLength += nData;  // add length of recieved data
 
     return (_tSCT->cAPDUAnswerStatus);
 }
@@ -184,11 +381,13 @@ unsigned char nOverhead = 0;
 
 /*******************************************************************************
 
-  SendAPDU
+  SendAPDU_Exchange
+
+  Send an APDU as T=1 block, collect a chained answer
 
 *******************************************************************************/
 
-unsigned short SendAPDU (typeSmartcardTransfer * _tSCT)
+static unsigned short SendAPDU_Exchange (typeSmartcardTransfer * _tSCT)
 {
     _tSCT->cAPDUAnswerLength = 0;
 
@@ -223,6 +422,257 @@ unsigned short SendAPDU (typeSmartcardTransfer * _tSCT)
     return (_tSCT->cAPDUAnswerStatus);
 }
 
+/*******************************************************************************
+
+  SendAPDU_Counted
+
+  Counted by the performance counters, cIns is the INS of the command for
+  the trace. cAPDU may be the last part of a chained command and holds the
+  answer after the exchange.
+
+*******************************************************************************/
+
+static unsigned short SendAPDU_Counted (typeSmartcardTransfer * _tSCT, unsigned char cIns)
+{
+unsigned short cRet;
+
+uint32_t nStartCycles = PROF_GetCycles ();
+
+    cRet = SendAPDU_Exchange (_tSCT);
+    PERF_CountApdu (PROF_GetCycles () - nStartCycles);
+
+    if (APDU_ANSWER_COMMAND_CORRECT != cRet)
+    {
+        TRACE ("SendAPDU: INS %02x status %04x\r\n", cIns, cRet);
+    }
+
+    return (cRet);
+}
+
+/*******************************************************************************
+
+  SendAPDU
+
+  Send the command APDU in cAPDU
+
+*******************************************************************************/
+
+unsigned short SendAPDU (typeSmartcardTransfer * _tSCT)
+{
+    CcidCheckCacheInvalidation (_tSCT->cAPDU);
+
+    return (SendAPDU_Counted (_tSCT, _tSCT->cAPDU[CCID_INS]));
+}
+
+/*******************************************************************************
+
+  SendChainedAPDU
+
+  Send a command APDU which may be longer than one T=1 information field.
+  All but the last part are send as chained I-blocks, each one must be
+  acknowledged by the card with a R-block carrying the N(S) of the next
+  I-block as N(R). A R-block with an error or with the N(S) of the sent
+  block asks for a repetition, which is done CCID_TPDU_MAX_RESENDS times.
+  The last part is send with SendAPDU_Counted, so a chained answer is
+  collected as usual. Only the first part starts with the header, the
+  cache is checked here.
+
+*******************************************************************************/
+
+unsigned short SendChainedAPDU (typeSmartcardTransfer * _tSCT, unsigned char* pAPDU, unsigned int nAPDULength)
+{
+unsigned int nAnswerLength;
+
+unsigned char cIns = pAPDU[CCID_INS];
+
+unsigned char cPCB;
+
+int nResend;
+
+    CcidCheckCacheInvalidation (pAPDU);
+
+    while (CCID_TPDU_MAX_INF < nAPDULength)
+    {
+        _tSCT->cAPDULength = CCID_TPDU_MAX_INF;
+        memcpy (_tSCT->cAPDU, pAPDU, CCID_TPDU_MAX_INF);
+
+        for (nResend = 0;; nResend++)
+        {
+            GenerateTPDU (_tSCT);
+
+            // Set more data bit and renew the checksum
+            _tSCT->cTPDU[CCID_TPDU_PCD] |= CCID_TPDU_CHAINING_FLAG;
+            _tSCT->cTPDU[_tSCT->cTPDULength - 1] = GenerateCRC ((unsigned char *) &_tSCT->cTPDU, _tSCT->cTPDULength - 1);
+
+            nAnswerLength = 0;
+            CRD_SendCommand ((unsigned char *) _tSCT->cTPDU, _tSCT->cTPDULength, CCID_TRANSFER_BUFFER_MAX, &nAnswerLength);
+
+            // Card must answer with a R-block
+            cPCB = _tSCT->cTPDU[CCID_TPDU_PCD];
+            if ((CCID_TPDU_OVERHEAD > nAnswerLength) || (CCID_TPDU_R_BLOCK_FLAG != (cPCB & 0xC0)))
+            {
+                _tSCT->cAPDUAnswerStatus = APDU_ANSWER_RECEIVE_INCORRECT;
+                return (_tSCT->cAPDUAnswerStatus);
+            }
+
+            // GenerateTPDU has switched to the N(S) of the next block
+            if ((0 == (cPCB & CCID_TPDU_R_BLOCK_ERROR)) && ((0 != (cPCB & CCID_TPDU_R_BLOCK_SEQUENCE_FLAG)) == (_tSCT->cTPDUSequence & 1)))
+            {
+                break;
+            }
+
+            if (CCID_TPDU_MAX_RESENDS <= nResend)
+            {
+                TRACE ("SendChainedAPDU: INS %02x block rejected, R-block %02x\r\n", cIns, cPCB);
+                _tSCT->cAPDUAnswerStatus = APDU_ANSWER_RECEIVE_INCORRECT;
+                return (_tSCT->cAPDUAnswerStatus);
+            }
+
+            // Resend the block with the same N(S)
+            _tSCT->cTPDUSequence--;
+        }
+
+        pAPDU += CCID_TPDU_MAX_INF;
+        nAPDULength -= CCID_TPDU_MAX_INF;
+    }
+
+    _tSCT->cAPDULength = nAPDULength;
+    memcpy (_tSCT->cAPDU, pAPDU, nAPDULength);
+
+    return (SendAPDU_Counted (_tSCT, cIns));
+}
+
+/*******************************************************************************
+
+  CcidXfrAPDU
+
+  APDU level exchange for the CCID interface. The command APDU in pBuffer is
+  send to the card, T=1 chaining and the GET RESPONSE (61xx) and wrong Le
+  (6Cxx) procedures are handled here. On return pBuffer contains the
+  complete response APDU including SW1 SW2.
+
+*******************************************************************************/
+
+unsigned short CcidXfrAPDU (unsigned char* pBuffer, unsigned int* pSize, unsigned int nMaxSize)
+{
+unsigned short cRet;
+
+unsigned int nAnswerSize;
+
+unsigned int nCopy;
+
+unsigned char cCla;
+
+int nRetry;
+
+    if ((CCID_APDU_MIN_LENGTH > *pSize) || (CCID_APDU_MAX_LENGTH < *pSize) || (CCID_APDU_TRAILER_SIZE > nMaxSize))
+    {
+        return (APDU_ANSWER_WRONG_LENGTH);
+    }
+
+    nAnswerSize = 0;
+    cCla = pBuffer[CCID_CLA];
+
+    cRet = SendChainedAPDU (&tSCT, pBuffer, *pSize);
+
+    for (nRetry = 0; nRetry < CCID_GET_RESPONSE_MAX_LOOPS; nRetry++)
+    {
+        if ((APDU_ANSWER_RECEIVE_INCORRECT == cRet) || (APDU_ANSWER_CHAINED_DATA == cRet))
+        {
+            return (APDU_ANSWER_RECEIVE_INCORRECT);
+        }
+
+        // Collect the response data, leave room for the status bytes. A
+        // truncated answer is not returned as success.
+        nCopy = tSCT.cAPDUAnswerLength;
+        if (nAnswerSize + nCopy > nMaxSize - CCID_APDU_TRAILER_SIZE)
+        {
+            TRACE ("CcidXfrAPDU: answer of %d bytes exceeds %d\r\n", nAnswerSize + nCopy, nMaxSize - CCID_APDU_TRAILER_SIZE);
+            nAnswerSize = 0;
+            cRet = APDU_ANSWER_WRONG_LENGTH;
+            break;
+        }
+        memcpy (&pBuffer[nAnswerSize], tSCT.cAPDU, nCopy);
+        nAnswerSize += nCopy;
+
+        if (APDU_ANSWER_T0_COMMAND_CORRECT == (cRet & 0xFF00))
+        {
+            // More data available, fetch it with GET RESPONSE
+            tSCT.cAPDU[CCID_CLA] = cCla & 0x03;    // Keep logical channel
+            tSCT.cAPDU[CCID_INS] = 0xC0;
+            tSCT.cAPDU[CCID_P1] = 0x00;
+            tSCT.cAPDU[CCID_P2] = 0x00;
+            tSCT.cAPDU[CCID_LC] = (unsigned char) (cRet & 0x00FF);  // Le
+            tSCT.cAPDULength = CCID_SIZE_GET_RESPONSE;
+
+            cRet = SendAPDU (&tSCT);
+            continue;
+        }
+
+        if ((APDU_ANSWER_WRONG_LE == (cRet & 0xFF00)) && (0 == nAnswerSize))
+        {
+            // Wrong Le, repeat the command with the Le given by the card.
+            // The command is still in pBuffer because no data was copied
+            // back
+            if (FALSE == SetLeOfAPDU (pBuffer, *pSize, (unsigned char) (cRet & 0x00FF)))
+            {
+                break;
+            }
+            cRet = SendChainedAPDU (&tSCT, pBuffer, *pSize);
+            continue;
+        }
+
+        break;
+    }
+
+    pBuffer[nAnswerSize] = (unsigned char) (cRet >> 8);
+    pBuffer[nAnswerSize + 1] = (unsigned char) (cRet & 0x00FF);
+
+    *pSize = nAnswerSize + CCID_APDU_TRAILER_SIZE;
+
+    return (cRet);
+}
+
+/*******************************************************************************
+
+  SetLeOfAPDU
+
+  Replace the Le byte of a short command APDU, returns FALSE if the APDU
+  has no Le field
+
+*******************************************************************************/
+
+int SetLeOfAPDU (unsigned char* pAPDU, unsigned int nSize, unsigned char cLe)
+{
+    if (CCID_DATA == nSize) // Case 2: header and Le
+    {
+        pAPDU[CCID_LC] = cLe;
+        return (TRUE);
+    }
+
+    // Case 4: header, Lc, data and Le
+    if ((CCID_DATA < nSize) && (nSize == (unsigned int) CCID_DATA + pAPDU[CCID_LC] + 1))
+    {
+        pAPDU[nSize - 1] = cLe;
+        return (TRUE);
+    }
+
+    return (FALSE);
+}
+
+/*******************************************************************************
+
+  CcidInitSmartcardTransfer
+
+  Reset the T=1 block sequence, must be called after the card was restarted
+
+*******************************************************************************/
+
+void CcidInitSmartcardTransfer (void)
+{
+    InitSCTStruct (&tSCT);
+}
+
 /*******************************************************************************
 
   CcidSelectOpenPGPApp
@@ -235,12 +685,24 @@ unsigned short CcidSelectOpenPGPApp (void)
     unsigned short cRet;
     unsigned char cOpenPGPApp[CCID_SIZE_OPEN_PGP_APP] = { 0x00, 0xA4, 0x04, 0x00, 0x06, 0xD2, 0x76, 0x00, 0x01, 0x24, 0x01 };
 
+    // Already selected in this session ?
+    if (CCID_SESSION_APP_OPENPGP == tSession.cSelectedApp)
+    {
+        CcidSessionApduAvoided ();
+        return (APDU_ANSWER_COMMAND_CORRECT);
+    }
+
     tSCT.cAPDULength = CCID_SIZE_OPEN_PGP_APP;
 
     memcpy ((void *) &tSCT.cAPDU, cOpenPGPApp, tSCT.cAPDULength);
 
     cRet = SendAPDU (&tSCT);
 
+    if (APDU_ANSWER_COMMAND_CORRECT == cRet)
+    {
+        tSession.cSelectedApp = CCID_SESSION_APP_OPENPGP;
+    }
+
     return (cRet);
 }
 
@@ -331,6 +793,11 @@ unsigned short CcidVerifyPin (unsigned char cPinNr, const uint8_t * szPin)
 
     cRet = SendAPDU (&tSCT);
 
+    if (APDU_ANSWER_COMMAND_CORRECT == cRet)
+    {
+        tSession.cVerifiedPins |= CCID_SESSION_PIN_BIT (cPinNr);
+    }
+
     return (cRet);
 }
 
@@ -518,7 +985,7 @@ int CcidAesDecSub (int nSendLength, unsigned char* cSendData, int nReceiveLength
     int n;
 
 #ifdef DEBUG_OPENPGP_SHOW_CALLS
-    // CI_TickLocalPrintf ("ISO7816: Call AES_Dec_SUB\r\n");
+    TRACE ("ISO7816: Call AES_Dec_SUB\r\n");
 #endif
 
     // Correct key len ?
@@ -846,15 +1313,56 @@ unsigned int CcidReset (void)
     return (cRet);
 }
 
+/*******************************************************************************
+
+  LA_RestartSmartcard_u8
+
+  Restart the smartcard only when it is not powered. A running session is
+  used as it is, only the OpenPGP application is selected if needed.
+
+*******************************************************************************/
+
+uint8_t LA_RestartSmartcard_u8 (void)
+{
+    if (TRUE == tSession.cPowered)
+    {
+        CcidSessionApduAvoided ();  // Counts the skipped reset
+        InitSCTStruct (&tSCT);
+        CcidSelectOpenPGPApp ();
+        return (TRUE);
+    }
+
+    if (FALSE == RestartSmartcard ())
+    {
+        return (FALSE);
+    }
+
+    return (TRUE);
+}
+
 int getAID (void)
 {
+unsigned short cRet;
 
-    InitSCTStruct (&tSCT);
+unsigned char nReturnSize;
 
-    unsigned char nReturnSize;
+    if (TRUE == tCache.cAIDValid)
+    {
+        memcpy (tSCT.cAPDU, tCache.cAID, tCache.cAIDLength);
+        return tCache.cAIDLength;
+    }
+
+    InitSCTStruct (&tSCT);
 
     CcidSelectOpenPGPApp ();
-    CcidGetData (0x00, 0x4F, &nReturnSize);
+    cRet = CcidGetData (0x00, 0x4F, &nReturnSize);
+
+    if ((APDU_ANSWER_COMMAND_CORRECT == cRet) && (CCID_CACHE_AID_MAX_LENGTH >= nReturnSize))
+    {
+        memcpy (tCache.cAID, tSCT.cAPDU, nReturnSize);
+        tCache.cAIDLength = nReturnSize;
+        tCache.cAIDValid = TRUE;
+    }
 
     return nReturnSize;
 }
@@ -994,48 +1502,67 @@ unsigned short cRet;
     return 0;
 }
 
-uint8_t getPasswordRetryCount ()
-{
+/*******************************************************************************
 
-    InitSCTStruct (&tSCT);
+  CcidGetPWStatus
+
+  Read the PW status bytes (DO C4) into the cache
+
+*******************************************************************************/
 
+static uint8_t CcidGetPWStatus (void)
+{
 unsigned short cRet;
 
 unsigned char nReturnSize;
 
+    if (TRUE == tCache.cPWStatusValid)
+    {
+        return TRUE;
+    }
+
+    InitSCTStruct (&tSCT);
 
     CcidSelectOpenPGPApp ();
     cRet = CcidGetData (0x00, 0xC4, &nReturnSize);
-    if (APDU_ANSWER_COMMAND_CORRECT != cRet)
+    if ((APDU_ANSWER_COMMAND_CORRECT != cRet) || (CCID_CACHE_PW_STATUS_LENGTH > nReturnSize))
     {
-        return (0xFF);
+        return FALSE;
     }
 
-    return tSCT.cAPDU[6];
+    memcpy (tCache.cPWStatus, tSCT.cAPDU, CCID_CACHE_PW_STATUS_LENGTH);
+    tCache.cPWStatusValid = TRUE;
+
+    return TRUE;
 }
 
-uint8_t getUserPasswordRetryCount ()
+uint8_t getPasswordRetryCount ()
 {
+    if (FALSE == CcidGetPWStatus ())
+    {
+        return (0xFF);
+    }
 
-    InitSCTStruct (&tSCT);
-
-unsigned short cRet;
-
-unsigned char nReturnSize;
-
+    return tCache.cPWStatus[6];
+}
 
-    CcidSelectOpenPGPApp ();
-    cRet = CcidGetData (0x00, 0xC4, &nReturnSize);
-    if (APDU_ANSWER_COMMAND_CORRECT != cRet)
+uint8_t getUserPasswordRetryCount ()
+{
+    if (FALSE == CcidGetPWStatus ())
     {
         return (0xFF);
     }
 
-    return tSCT.cAPDU[4];
+    return tCache.cPWStatus[4];
 }
 
 uint8_t isAesSupported (void)
 {
+    if (TRUE == tCache.cAesSupportValid)
+    {
+        return tCache.cAesSupported;
+    }
+
     InitSCTStruct (&tSCT);
 
     CcidSelectOpenPGPApp ();
@@ -1066,9 +1593,15 @@ char test_data[17] = { 0x02,    // Use AES to DECIPHER
 
     // Determine if AES module exists
     if ((APDU_ANSWER_COMMAND_CORRECT == cRet) || (APDU_ANSWER_REF_DATA_NOT_FOUND == cRet))
-        return TRUE;
+        tCache.cAesSupported = TRUE;
+    else if (APDU_ANSWER_USE_CONDIT_NOT_SATISFIED == cRet)
+        tCache.cAesSupported = FALSE;
     else
-        return FALSE;
+        return FALSE;   // No valid answer, don't cache it
+
+    tCache.cAesSupportValid = TRUE;
+
+    return tCache.cAesSupported;
 }
 
 uint8_t sendAESMasterKey (int nLen, unsigned char* pcMasterKey)
@@ -1114,14 +1647,12 @@ uint8_t testSendUserPW2 (unsigned char* pcPW)
 {
     unsigned short nRet;
 
-    // CI_LocalPrintf ("Send user password : ");
     nRet = CcidVerifyPin (2, pcPW);
     if (APDU_ANSWER_COMMAND_CORRECT == nRet)
     {
-        // CI_LocalPrintf ("fail\n\r");
         return (TRUE);
     }
-    // CI_LocalPrintf ("OK \n\r");
+    TRACE ("testSendUserPW2: Verify PIN %04x\r\n", nRet);
 
     return (FALSE);
 }
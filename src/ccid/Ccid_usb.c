@@ -65,6 +65,8 @@ extern uint32_t Mass_Block_Size[2];
 #include "CCID_Ifd_ccid.h"
 #include "CCID_usb.h"
 #include "CCID_Ifd_protocol.h"
+#include "perf_counters.h"
+#include "recorder.h"
 
 
 // Defines for USB_vSetup structure
@@ -88,7 +90,12 @@ extern uint32_t Mass_Block_Size[2];
 #define TRANSMIT_OTHER										0x09
 #define TRANSMIT_FINISHED									0x0A
 
-unsigned char UsbMessageBuffer[USB_MESSAGE_BUFFER_LENGTH + 50];
+/* Two message buffers: one for the message in work, one for the reception of the next message */
+static unsigned char UsbMessageBufferPool[2][USB_MESSAGE_BUFFER_SIZE];
+
+unsigned char* UsbMessageBuffer = UsbMessageBufferPool[0];
+
+static unsigned char* UsbReceiveBuffer = UsbMessageBufferPool[1];
 
 unsigned char UsbIntMessageBuffer[4];
 
@@ -96,14 +103,55 @@ volatile unsigned char UsbMessageFlags;
 
 unsigned char AbortSequenceNumber;
 
-unsigned char BulkStatus;
+unsigned char BulkStatus;   // State of the message in work
+
+static unsigned char BulkOutStatus; // State of the reception buffer
 
 static int UsbMessageLength;
 
 static unsigned char* pUsbMessageBuffer;
 
+static int UsbReceiveLength;
+
+static int UsbReceiveCount;
+
+static unsigned char cBulkInPacketPrepared = FALSE; // Packet in the application owned tx buffer
+
+static unsigned char cBulkInLastPacket = FALSE;
+
+static unsigned char nBulkOutPacketsHeld = 0;   // Packets in the rx buffers not read, up to 2
+
 static unsigned char cCRD_CardPresent = FALSE;  // Flag card present
 
+static volatile unsigned char cTimeExtensionActive = FALSE; // Card is working on a message
+
+static volatile unsigned char cBulkInTimeExtensionSent = FALSE;    // Time extension in the tx buffer
+
+static unsigned int nTimeExtensionTimer;
+
+static unsigned char UsbTimeExtensionBuffer[USB_MESSAGE_HEADER_SIZE];
+
+
+/************************************************************************/
+/* ROUTINE void CCID_InitBulkTransfer(void) */
+/* */
+/* Reset both bulk state machines and the message buffers.  */
+/************************************************************************/
+
+void CCID_InitBulkTransfer (void)
+{
+    UsbMessageBuffer = UsbMessageBufferPool[0];
+    UsbReceiveBuffer = UsbMessageBufferPool[1];
+    pUsbMessageBuffer = UsbMessageBuffer;
+    BulkStatus = RECEIVE_FIRST_PART_INIT;
+    BulkOutStatus = RECEIVE_FIRST_PART_INIT;
+    UsbReceiveCount = 0;
+    cBulkInPacketPrepared = FALSE;
+    cBulkInLastPacket = FALSE;
+    nBulkOutPacketsHeld = 0;
+    cTimeExtensionActive = FALSE;
+    cBulkInTimeExtensionSent = FALSE;
+}
 
 /************************************************************************/
 /* ROUTINE void CCID_Init(void) */
@@ -113,8 +161,7 @@ static unsigned char cCRD_CardPresent = FALSE;  // Flag card present
 
 void CCID_Init (void)
 {
-    pUsbMessageBuffer = UsbMessageBuffer;
-    BulkStatus = RECEIVE_FIRST_PART_INIT;
+    CCID_InitBulkTransfer ();
     UsbMessageFlags = 0x00;
     CrdFlags = 0x00;
 }
@@ -128,8 +175,7 @@ void CCID_Init (void)
 void CCID_Init_IT (void)
 {
 
-    pUsbMessageBuffer = UsbMessageBuffer;
-    BulkStatus = RECEIVE_FIRST_PART_INIT;
+    CCID_InitBulkTransfer ();
     UsbMessageFlags = 0x00;
 
     /* Check a card presence */
@@ -152,8 +198,7 @@ void CCID_Init_IT (void)
 
 void CCID_Suspend_IT (void)
 {
-    pUsbMessageBuffer = UsbMessageBuffer;
-    BulkStatus = RECEIVE_FIRST_PART_INIT;
+    CCID_InitBulkTransfer ();
     UsbMessageFlags = 0x00;
 
     /* Check a card presence */
@@ -183,11 +228,11 @@ void CCID_Bot_Abort (uint8_t Direction)
             SetEPTxStatus (ENDP2, EP_TX_STALL);
             break;
         case DIR_OUT:
-            SetEPRxStatus (ENDP2, EP_RX_STALL);
+            SetEPRxStatus (ENDP3, EP_RX_STALL);
             break;
         case BOTH_DIR:
             SetEPTxStatus (ENDP2, EP_TX_STALL);
-            SetEPRxStatus (ENDP2, EP_RX_STALL);
+            SetEPRxStatus (ENDP3, EP_RX_STALL);
             break;
         default:
             break;
@@ -204,9 +249,9 @@ void CCID_Bot_Abort (uint8_t Direction)
 
 void CCID_Storage_Out (void)
 {
-    Data_Len = GetEPRxCount (ENDP2);
+    Data_Len = GetEPDblBuf0Count (ENDP3);
 
-    PMAToUserBufferCopy (Bulk_Data_Buff, CCID_ENDP2_RXADDR, Data_Len);
+    PMAToUserBufferCopy (Bulk_Data_Buff, CCID_ENDP3_RXADDR0, Data_Len);
 
     switch (Bot_State)
     {
@@ -223,141 +268,208 @@ void CCID_Storage_Out (void)
 
 
 /************************************************************************/
-/* ROUTINE void CCID_BulkOutMessage(void) */
+/* ROUTINE void CCID_SwapMessageBuffer(void) */
 /* */
-/* Receive the CCID message by the Bulk In Endpoint 2.  */
-/* save this message in UsbMessageBuffer.  */
+/* A complete message is in the receive buffer and the message buffer */
+/* is free: exchange both buffers and start the dispatch.  */
 /************************************************************************/
-static int UsbDataLength = 0;
 
-void CCID_BulkOutMessage (void)
+static void CCID_SwapMessageBuffer (void)
 {
-    unsigned char cnt;
+    unsigned char* pBuffer;
 
-    if (RECEIVE_FIRST_PART_INIT == BulkStatus)
+    pBuffer = UsbMessageBuffer;
+    UsbMessageBuffer = UsbReceiveBuffer;
+    UsbReceiveBuffer = pBuffer;
+
+    BulkOutStatus = RECEIVE_FIRST_PART_INIT;
+    BulkStatus = RECEIVE_FINISHED;
+    Set_bBulkOutCompleteFlag;
+}
+
+/************************************************************************/
+/* ROUTINE void CCID_BulkOutPacket(void) */
+/* */
+/* Read one packet from the double buffered Endpoint 3 */
+/* and add it to the message in UsbReceiveBuffer.  */
+/************************************************************************/
+
+static void CCID_BulkOutPacket (void)
+{
+    unsigned int cnt;
+
+    unsigned int nRxAddr;
+
+    /* The packet is in the buffer owned by the application (SW_BUF), */
+    /* the other buffer can receive the next packet meanwhile */
+    if (_GetENDPOINT (ENDP3) & EP_DTOG_TX)
     {
-        pUsbMessageBuffer = UsbMessageBuffer;   // max
-        // USB_MES_BUFFBUFFER_LENGTH
-        // - BulkOut Byte
-        UsbDataLength = 0;
+        cnt = GetEPDblBuf0Count (ENDP3);
+        nRxAddr = CCID_ENDP3_RXADDR0;
+    }
+    else
+    {
+        cnt = GetEPDblBuf1Count (ENDP3);
+        nRxAddr = CCID_ENDP3_RXADDR1;
     }
 
-    /* Get Data into Buffer */
-    cnt = GetEPRxCount (ENDP2);
-    PMAToUserBufferCopy (pUsbMessageBuffer, CCID_ENDP2_RXADDR, cnt);    // copy
-    // data
-    // in
-    // USB
-    // buffer
+    if (RECEIVE_FIRST_PART_INIT == BulkOutStatus)
+    {
+        UsbReceiveCount = 0;
+    }
 
-    UsbDataLength += cnt;
-    pUsbMessageBuffer = &pUsbMessageBuffer[cnt];    // set new the end of the
-    // buffer
+    /* Copy only as long as the message fits in the buffer */
+    if (UsbReceiveCount + cnt <= USB_MESSAGE_BUFFER_SIZE)
+    {
+        PMAToUserBufferCopy (&UsbReceiveBuffer[UsbReceiveCount], nRxAddr, cnt);
+        UsbReceiveCount += cnt;
+    }
 
+    FreeUserBuffer (ENDP3, EP_DBUF_OUT);
 
     /* Get the message length of the transfer */
-    if (RECEIVE_FIRST_PART_INIT == BulkStatus)
+    if (RECEIVE_FIRST_PART_INIT == BulkOutStatus)
     {
         /* Calculate number of byte to receive to finish the message */
-        UsbMessageLength = USB_MESSAGE_HEADER_SIZE;
-        UsbMessageLength += UsbMessageBuffer[OFFSET_DWLENGTH];
-        UsbMessageLength += UsbMessageBuffer[OFFSET_DWLENGTH + 1] << 8;
+        UsbReceiveLength = USB_MESSAGE_HEADER_SIZE;
+        UsbReceiveLength += UsbReceiveBuffer[OFFSET_DWLENGTH];
+        UsbReceiveLength += UsbReceiveBuffer[OFFSET_DWLENGTH + 1] << 8;
 
         /* check for length errors */
-        if ((UsbMessageBuffer[OFFSET_DWLENGTH + 2] != 0) ||
-            (UsbMessageBuffer[OFFSET_DWLENGTH + 3] != 0) || (UsbMessageLength > USB_MESSAGE_BUFFER_MAX_LENGTH))
+        if ((UsbReceiveBuffer[OFFSET_DWLENGTH + 2] != 0) ||
+            (UsbReceiveBuffer[OFFSET_DWLENGTH + 3] != 0) || (UsbReceiveLength > USB_MESSAGE_BUFFER_MAX_LENGTH))
         {
-            BulkStatus = RECEIVE_UNCORRECTLENGTH_INIT;
-            pUsbMessageBuffer = &UsbMessageBuffer[OFFSET_ABDATA];
+            BulkOutStatus = RECEIVE_UNCORRECTLENGTH_INIT;
         }
     }
 
-    UsbMessageLength -= (int) cnt;  // bytes to get after this packet
+    UsbReceiveLength -= (int) cnt;  // bytes to get after this packet
 
     /* Set transfer state */
-    if (UsbMessageLength > 0)
+    if (UsbReceiveLength > 0)
     {
-        BulkStatus = RECEIVE_OTHER_INIT;
+        if (RECEIVE_FIRST_PART_INIT == BulkOutStatus)
+        {
+            BulkOutStatus = RECEIVE_OTHER_INIT;
+        }
+        return;
     }
 
-    if (UsbMessageLength == 0)
+    if ((UsbReceiveLength < 0) || (RECEIVE_UNCORRECTLENGTH_INIT == BulkOutStatus))
     {
-        BulkStatus = RECEIVE_FINISHED;
+        UsbReceiveBuffer[OFFSET_DWLENGTH] = 0xFF;
+        UsbReceiveBuffer[OFFSET_DWLENGTH + 1] = 0xFF;
+        UsbReceiveBuffer[OFFSET_DWLENGTH + 2] = 0xFF;
+        UsbReceiveBuffer[OFFSET_DWLENGTH + 3] = 0xFF;
+        BulkOutStatus = RECEIVE_TOOLONGMESSAGE_FINISHED;
+    }
+    else
+    {
+        BulkOutStatus = RECEIVE_FINISHED;
     }
 
-    if (UsbMessageLength < 0)
+    /* Start the message now if the last answer was send */
+    if (RECEIVE_FIRST_PART_INIT == BulkStatus)
     {
-        BulkStatus = RECEIVE_TOOLONGMESSAGE_FINISHED;
+        CCID_SwapMessageBuffer ();
     }
+}
 
+/************************************************************************/
+/* ROUTINE void CCID_BulkOutMessage(void) */
+/* */
+/* Receive the CCID message by the Bulk Out Endpoint 3.  */
+/* save this message in UsbReceiveBuffer.  */
+/************************************************************************/
 
-    switch (BulkStatus)
+void CCID_BulkOutMessage (void)
+{
+    /* Both message buffers in use: keep the packet in the PMA. The */
+    /* hardware fills the second rx buffer, then the endpoint NAKs */
+    /* until the answer of the current message is send */
+    if ((RECEIVE_FINISHED == BulkOutStatus) || (RECEIVE_TOOLONGMESSAGE_FINISHED == BulkOutStatus) || (0 < nBulkOutPacketsHeld))
     {
-        case RECEIVE_OTHER_INIT:
-            SetEPRxStatus (ENDP2, EP_RX_VALID); // enable the next
-            // transaction
-            break;
+        nBulkOutPacketsHeld++;
+        return;
+    }
 
-        case RECEIVE_UNCORRECTLENGTH_INIT:
-            BulkStatus = RECEIVE_UNCORRECTLENGTH_END;
-            break;
+    CCID_BulkOutPacket ();
+}
 
-        case RECEIVE_OTHER_END:
-        case RECEIVE_UNCORRECTLENGTH_END:
-            if (UsbDataLength == 0)
-            {
-                if (BulkStatus == RECEIVE_OTHER_END)
-                {
-                    BulkStatus = RECEIVE_FINISHED;
-                }
-                else
-                {
-                    BulkStatus = RECEIVE_TOOLONGMESSAGE_FINISHED;
-                }
-            }
-            if (UsbDataLength != 0xFF)
-            {
-                UsbMessageLength -= (int) UsbDataLength;
-                if ((UsbMessageLength > 0) && (BulkStatus == RECEIVE_OTHER_END))
-                {   // Jeffery Lee 2002/12/05 <+> <1>
-                    pUsbMessageBuffer += UsbDataLength;
-                    BulkStatus = RECEIVE_OTHER_INIT;    // Jeffery Lee
-                    // 2002/12/05 <+> <1>
-                }   // Jeffery Lee 2002/12/05 <+> <1>
-                if (UsbMessageLength == 0)
-                {
-                    if (BulkStatus == RECEIVE_OTHER_END)
-                    {
-                        BulkStatus = RECEIVE_FINISHED;
-                    }
-                    else
-                    {
-                        BulkStatus = RECEIVE_TOOLONGMESSAGE_FINISHED;
-                    }
-                }
+/************************************************************************/
+/* ROUTINE void CCID_BulkOutResume(void) */
+/* */
+/* The message buffer is free again, start a waiting message */
+/* and read the held packets in the order of reception. A held */
+/* packet may complete the next message, the packets after it */
+/* stay held.  */
+/************************************************************************/
 
-                if (UsbMessageLength < 0)
-                {
-                    BulkStatus = RECEIVE_TOOLONGMESSAGE_FINISHED;
-                }
-            }
-            break;
+static void CCID_BulkOutResume (void)
+{
+    if ((RECEIVE_FINISHED == BulkOutStatus) || (RECEIVE_TOOLONGMESSAGE_FINISHED == BulkOutStatus))
+    {
+        CCID_SwapMessageBuffer ();
+    }
 
-        case RECEIVE_TOOLONGMESSAGE_FINISHED:
-            UsbMessageBuffer[OFFSET_DWLENGTH] = 0xFF;
-            UsbMessageBuffer[OFFSET_DWLENGTH + 1] = 0xFF;
-            UsbMessageBuffer[OFFSET_DWLENGTH + 2] = 0xFF;
-            UsbMessageBuffer[OFFSET_DWLENGTH + 3] = 0xFF;
+    while ((0 < nBulkOutPacketsHeld) && (RECEIVE_FINISHED != BulkOutStatus) && (RECEIVE_TOOLONGMESSAGE_FINISHED != BulkOutStatus))
+    {
+        nBulkOutPacketsHeld--;
+        CCID_BulkOutPacket ();
+    }
+}
 
-        case RECEIVE_FINISHED:
-            UsbDataLength = 0;
-            Set_bBulkOutCompleteFlag;
-            break;
+/************************************************************************/
+/* ROUTINE void CCID_BulkInPreparePacket(void) */
+/* */
+/* Copy the next packet of the answer in the application owned buffer */
+/* of the double buffered Endpoint 2.  */
+/************************************************************************/
 
-        default:
-            UsbDataLength = 0;
-            Set_bBulkOutCompleteFlag;
-            break;
+static void CCID_BulkInPreparePacket (void)
+{
+    int nSize;
+
+    nSize = UsbMessageLength;
+    if (USB_MAX_PACKET_SIZE < nSize)
+    {
+        nSize = USB_MAX_PACKET_SIZE;
+    }
+
+    if (_GetENDPOINT (ENDP2) & EP_DTOG_RX)  // SW_BUF
+    {
+        UserToPMABufferCopy ((uint8_t *) pUsbMessageBuffer, CCID_ENDP2_TXADDR1, nSize);
+        SetEPDblBuf1Count (ENDP2, EP_DBUF_IN, nSize);
+    }
+    else
+    {
+        UserToPMABufferCopy ((uint8_t *) pUsbMessageBuffer, CCID_ENDP2_TXADDR0, nSize);
+        SetEPDblBuf0Count (ENDP2, EP_DBUF_IN, nSize);
+    }
+
+    pUsbMessageBuffer += nSize;
+    UsbMessageLength -= nSize;
+
+    // A short packet ends the transfer, so a full last packet is followed
+    // by a ZLP (Zero Lentgh Packet)
+    cBulkInLastPacket = (USB_MAX_PACKET_SIZE > nSize) ? TRUE : FALSE;
+    cBulkInPacketPrepared = TRUE;
+}
+
+/************************************************************************/
+/* ROUTINE void CCID_BulkInReleasePacket(void) */
+/* */
+/* Hand over the prepared packet to the USB hardware.  */
+/************************************************************************/
+
+static void CCID_BulkInReleasePacket (void)
+{
+    FreeUserBuffer (ENDP2, EP_DBUF_IN);
+    cBulkInPacketPrepared = FALSE;
+
+    if (TRUE == cBulkInLastPacket)
+    {
+        BulkStatus = TRANSMIT_FINISHED;
     }
 }
 
@@ -366,10 +478,22 @@ void CCID_BulkOutMessage (void)
 /* */
 /* Transmit the CCID message by the Bulk In Endpoint 2.  */
 /* this message was in UsbMessageBuffer.  */
+/* While one packet is send, the next one is prepared in the */
+/* second buffer, so it can be released at once.  */
 /************************************************************************/
 
 unsigned char CCID_BulkInMessage (void)
 {
+    // A time extension was send, start the answer if it is ready meanwhile
+    if (TRUE == cBulkInTimeExtensionSent)
+    {
+        cBulkInTimeExtensionSent = FALSE;
+        if (TRANSMIT_HEADER != BulkStatus)
+        {
+            return (BulkStatus);
+        }
+    }
+
     switch (BulkStatus)
     {
         case TRANSMIT_HEADER:
@@ -383,51 +507,27 @@ unsigned char CCID_BulkInMessage (void)
             }
 
             pUsbMessageBuffer = UsbMessageBuffer;
-            // ">=" instead of ">" to implement the ZLP feature (Zero Lentgh
-            // Packet).
-            if (UsbMessageLength >= USB_MAX_PACKET_SIZE)
-            {
-
-                UserToPMABufferCopy ((uint8_t *) pUsbMessageBuffer, CCID_ENDP2_TXADDR, USB_MAX_PACKET_SIZE);
+            BulkStatus = TRANSMIT_OTHER;
 
-                pUsbMessageBuffer += USB_MAX_PACKET_SIZE;
-                UsbMessageLength -= USB_MAX_PACKET_SIZE;
-                BulkStatus = TRANSMIT_OTHER;
-                SetEPTxCount (ENDP2, USB_MAX_PACKET_SIZE);
-                SetEPTxStatus (ENDP2, EP_TX_VALID);
+            CCID_BulkInPreparePacket ();
+            CCID_BulkInReleasePacket ();
 
-            }
-            else
+            if (TRANSMIT_OTHER == BulkStatus)
             {
-                UserToPMABufferCopy ((uint8_t *) pUsbMessageBuffer, CCID_ENDP2_TXADDR, UsbMessageLength);
-                BulkStatus = TRANSMIT_FINISHED;
-                SetEPTxCount (ENDP2, UsbMessageLength);
-                SetEPTxStatus (ENDP2, EP_TX_VALID);
+                CCID_BulkInPreparePacket ();
             }
             break;
 
         case TRANSMIT_OTHER:
-            // ">=" instead of ">" to implement the ZLP feature (Zero Lentgh
-            // Packet).
-            if (UsbMessageLength >= USB_MAX_PACKET_SIZE)
+            // Last packet is send, release the prepared one
+            if (TRUE == cBulkInPacketPrepared)
             {
-                UserToPMABufferCopy ((uint8_t *) pUsbMessageBuffer, CCID_ENDP2_TXADDR, USB_MAX_PACKET_SIZE);
-
-                pUsbMessageBuffer += USB_MAX_PACKET_SIZE;
-                UsbMessageLength -= USB_MAX_PACKET_SIZE;
+                CCID_BulkInReleasePacket ();
 
-                SetEPTxCount (ENDP2, USB_MAX_PACKET_SIZE);
-                SetEPTxStatus (ENDP2, EP_TX_VALID);
-            }
-            else
-            {
-                UserToPMABufferCopy ((uint8_t *) pUsbMessageBuffer, CCID_ENDP2_TXADDR, UsbMessageLength);
-
-                pUsbMessageBuffer += UsbMessageLength;
-                BulkStatus = TRANSMIT_FINISHED;
-
-                SetEPTxCount (ENDP2, UsbMessageLength);
-                SetEPTxStatus (ENDP2, EP_TX_VALID);
+                if (TRANSMIT_OTHER == BulkStatus)
+                {
+                    CCID_BulkInPreparePacket ();
+                }
             }
             break;
 
@@ -435,7 +535,7 @@ unsigned char CCID_BulkInMessage (void)
             Set_bBulkInCompleteFlag;
             BulkStatus = RECEIVE_FIRST_PART_INIT;
             Bot_State = BOT_DATA_IN_LAST;
-            SetEPRxStatus (ENDP2, EP_RX_VALID);
+            CCID_BulkOutResume ();
             break;
 
         default:
@@ -446,6 +546,107 @@ unsigned char CCID_BulkInMessage (void)
 }
 
 
+/************************************************************************/
+/* ROUTINE void CCID_StartTimeExtension(void) */
+/* */
+/* The message in UsbMessageBuffer may keep the card busy for a long */
+/* time, send time extension requests until the answer is ready.  */
+/************************************************************************/
+
+void CCID_StartTimeExtension (void)
+{
+    nTimeExtensionTimer = 0;
+    cTimeExtensionActive = TRUE;
+}
+
+/************************************************************************/
+/* ROUTINE void CCID_StopTimeExtension(void) */
+/************************************************************************/
+
+void CCID_StopTimeExtension (void)
+{
+    cTimeExtensionActive = FALSE;
+}
+
+/************************************************************************/
+/* ROUTINE void CCID_TimeExtensionTick(void) */
+/* */
+/* Called by the 10 ms systick interrupt. Sends a RDR_to_PC_DataBlock */
+/* with bmCommandStatus time extension every */
+/* CCID_TIME_EXTENSION_INTERVAL ticks, so the host keeps waiting for */
+/* the answer of the card.  */
+/* The systick and the USB interrupts have the same preemption */
+/* priority, so endpoint 2 is not changed by the callback meanwhile.  */
+/************************************************************************/
+
+void CCID_TimeExtensionTick (void)
+{
+    if (FALSE == cTimeExtensionActive)
+    {
+        return;
+    }
+
+    nTimeExtensionTimer++;
+    if (CCID_TIME_EXTENSION_INTERVAL > nTimeExtensionTimer)
+    {
+        return;
+    }
+    nTimeExtensionTimer = 0;
+
+    // Only while the message is in work and the last packet was send
+    if ((RECEIVE_FINISHED != BulkStatus) || (TRUE == cBulkInTimeExtensionSent))
+    {
+        return;
+    }
+
+    UsbTimeExtensionBuffer[OFFSET_BMESSAGETYPE] = RDR_TO_PC_DATABLOCK;
+    UsbTimeExtensionBuffer[OFFSET_DWLENGTH] = 0x00;
+    UsbTimeExtensionBuffer[OFFSET_DWLENGTH + 1] = 0x00;
+    UsbTimeExtensionBuffer[OFFSET_DWLENGTH + 2] = 0x00;
+    UsbTimeExtensionBuffer[OFFSET_DWLENGTH + 3] = 0x00;
+    UsbTimeExtensionBuffer[OFFSET_BSLOT] = UsbMessageBuffer[OFFSET_BSLOT];
+    UsbTimeExtensionBuffer[OFFSET_BSEQ] = UsbMessageBuffer[OFFSET_BSEQ];
+    UsbTimeExtensionBuffer[OFFSET_BSTATUS] = CCID_STATUS_TIME_EXTENSION;    // ICC present and active
+    UsbTimeExtensionBuffer[OFFSET_BERROR] = CCID_TIME_EXTENSION_MULTIPLIER;
+    UsbTimeExtensionBuffer[OFFSET_BCHAINPARAMETER] = 0x00;
+
+    if (_GetENDPOINT (ENDP2) & EP_DTOG_RX)  // SW_BUF
+    {
+        UserToPMABufferCopy (UsbTimeExtensionBuffer, CCID_ENDP2_TXADDR1, USB_MESSAGE_HEADER_SIZE);
+        SetEPDblBuf1Count (ENDP2, EP_DBUF_IN, USB_MESSAGE_HEADER_SIZE);
+    }
+    else
+    {
+        UserToPMABufferCopy (UsbTimeExtensionBuffer, CCID_ENDP2_TXADDR0, USB_MESSAGE_HEADER_SIZE);
+        SetEPDblBuf0Count (ENDP2, EP_DBUF_IN, USB_MESSAGE_HEADER_SIZE);
+    }
+
+    cBulkInTimeExtensionSent = TRUE;
+    FreeUserBuffer (ENDP2, EP_DBUF_IN);
+}
+
+#ifdef ENABLE_RECORDER
+/************************************************************************
+
+	CCID_RecordLength
+
+	Length of the message in UsbMessageBuffer, only the header of an
+	invalid message is recorded
+
+************************************************************************/
+
+static uint16_t CCID_RecordLength (void)
+{
+    uint16_t nLength = MAKEWORD (UsbMessageBuffer[OFFSET_DWLENGTH + 1], UsbMessageBuffer[OFFSET_DWLENGTH]);
+
+    if ((0 != UsbMessageBuffer[OFFSET_DWLENGTH + 2]) || (0 != UsbMessageBuffer[OFFSET_DWLENGTH + 3]) || (USB_MESSAGE_BUFFER_MAX_LENGTH < nLength))
+    {
+        nLength = 0;
+    }
+    return (USB_MESSAGE_HEADER_SIZE + nLength);
+}
+#endif
+
 /************************************************************************/
 /* ROUTINE void CCID_DispatchMessage(void) */
 /* */
@@ -459,16 +660,21 @@ void CCID_DispatchMessage (void)
 
     if (bBulkOutCompleteFlag)
     {
+        PERF_Count (PERF_CCID_MESSAGES);
+        REC_RECORD (REC_CCID_MESSAGE, UsbMessageBuffer, CCID_RecordLength ());
+
         switch (UsbMessageBuffer[OFFSET_BMESSAGETYPE])
         {
 
             case PC_TO_RDR_ICCPOWERON:
+                CCID_StartTimeExtension ();
                 ErrorCode = PC_to_RDR_IccPowerOn ();
                 if (SLOT_NO_ERROR == ErrorCode)
                 {
                     ErrorCode = IFD_SetATRData ();  // Create ATR output
                     // Message
                 }
+                CCID_StopTimeExtension ();
                 RDR_to_PC_DataBlock (ErrorCode);
                 break;
             case PC_TO_RDR_ICCPOWEROFF:
@@ -482,7 +688,9 @@ void CCID_DispatchMessage (void)
                 RDR_to_PC_SlotStatus (ErrorCode);
                 break;
             case PC_TO_RDR_XFRBLOCK:
+                CCID_StartTimeExtension ();
                 ErrorCode = PC_to_RDR_XfrBlock ();
+                CCID_StopTimeExtension ();
                 RDR_to_PC_DataBlock (ErrorCode);
                 break;
             case PC_TO_RDR_GETPARAMETERS:
@@ -498,7 +706,9 @@ void CCID_DispatchMessage (void)
                 RDR_to_PC_Parameters (ErrorCode);
                 break;
             case PC_TO_RDR_ESCAPE:
+                CCID_StartTimeExtension ();
                 ErrorCode = PC_to_RDR_Escape ();
+                CCID_StopTimeExtension ();
                 RDR_to_PC_Escape (ErrorCode);
                 break;
             case PC_TO_RDR_ICCCLOCK:
@@ -518,6 +728,8 @@ void CCID_DispatchMessage (void)
                 break;
         }
 
+        REC_RECORD (REC_CCID_ANSWER, UsbMessageBuffer, USB_MESSAGE_HEADER_SIZE);
+
         BulkStatus = TRANSMIT_HEADER;
         Reset_bBulkOutCompleteFlag;
     }
@@ -658,9 +870,20 @@ void CCID_CheckUsbCommunication (void)
 {
     CCID_DispatchMessage ();
 
-    if ((TRANSMIT_HEADER == BulkStatus) || (TRANSMIT_FINISHED == BulkStatus))
+    // The rest of the answer is send by the endpoint 2 callback. The
+    // transfer must not be finished here, the last packet may still be in
+    // the PMA buffer
+    if (TRANSMIT_HEADER == BulkStatus)
     {
-        CCID_BulkInMessage ();  // something to send ?
+        // The endpoint 2 callback must not run between releasing the first
+        // and preparing the second packet
+        __disable_irq ();
+        // A pending time extension starts the answer by the callback
+        if (FALSE == cBulkInTimeExtensionSent)
+        {
+            CCID_BulkInMessage ();  // something to send ?
+        }
+        __enable_irq ();
     }
 }
 
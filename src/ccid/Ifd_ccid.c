@@ -29,6 +29,7 @@
 #include "CCID_Ifd_ccid.h"
 #include "CCID_usb.h"
 #include "CCID_Macro.h"
+#include "CcidLocalAccess.h"
 
 /************************************************************************************/
 /************************************************************************************/
@@ -52,6 +53,10 @@ unsigned char PC_to_RDR_IccPowerOn (void)
         return (SLOTERROR_HW_ERROR);
     }
 
+    // New card session, start with T=1 sequence number 0
+    CcidInitSmartcardTransfer ();
+    IFD_Init ();
+
     return (SLOT_NO_ERROR);
 }
 
@@ -22,6 +22,7 @@
 #include "string.h"
 
 #include "smartcard.h"
+#include "CcidLocalAccess.h"
 
 #include "CCID_Global.h"
 #include "CCID_Macro.h"
@@ -29,6 +30,8 @@
 #include "CCID_SlotErrorCode.h"
 #include "CCID_Ifd_protocol.h"
 #include "CCID_Crd.h"
+#include "CCIDHID_usb_desc.h"
+#include "report_protocol.h"
 
 const unsigned int FvsFI[] = { 0, 372, 558, 744, 1116, 1488, 1860, 0, 0, 512, 768, 1024, 1536, 2048, 0,
     0
@@ -36,7 +39,7 @@ const unsigned int FvsFI[] = { 0, 372, 558, 744, 1116, 1488, 1860, 0, 0, 512, 76
 const unsigned int Dmul64vsDI[] = { 0, 64, 128, 256, 512, 1024, 2048, 0, 768, 1280, 32, 16, 8, 4, 2, 1 };
 
 
-static volatile unsigned char IccTransactionLevelType;
+static volatile unsigned char IccTransactionLevelType = SHORTAPDU_LEVEL | T1_TYPE;
 
 static unsigned char XfrFlag;
 
@@ -66,8 +69,8 @@ static Param IccParameters;
 
 void IFD_Init (void)
 {
-    SetChar_bmTransactionLevel;
-    SetT0_bTransactionType;
+    SetShortApdu_bmTransactionLevel;
+    SetT1_bTransactionType;
     XfrFlag = INS;
 
     IccParameters.FiDi = DEFAULT_FIDI;
@@ -201,6 +204,13 @@ unsigned char IFD_XfrBlock (unsigned char* pBlockBuffer, unsigned int* pBlockSiz
         return XFR_BADLEVELPARAMETER;
     }
 
+    // The command is not decoded at character and TPDU level, so the
+    // cached data objects of the card may be changed by it
+    if (bmTransactionLevel != SHORTAPDU_LEVEL)
+    {
+        CcidSessionInvalidate ();
+    }
+
     if ((bmTransactionLevel == CHARACTER_LEVEL) && (bTransactionType == T0_TYPE))
     {
         ErrorCode = IFD_XfrCharT0 (pBlockBuffer, pBlockSize, ExpectedAnswerSize);
@@ -219,6 +229,10 @@ unsigned char IFD_XfrBlock (unsigned char* pBlockBuffer, unsigned int* pBlockSiz
     if ((bmTransactionLevel == TPDU_LEVEL) && (bTransactionType == T1_TYPE))
         ErrorCode = IFD_XfrTpduT1 (pBlockBuffer, pBlockSize);
 
+    // T=1 handling and GET RESPONSE are done in the reader
+    if (bmTransactionLevel == SHORTAPDU_LEVEL)
+        ErrorCode = IFD_XfrShortApdu (pBlockBuffer, pBlockSize);
+
     if (ErrorCode != SLOT_NO_ERROR)
         return ErrorCode;
 
@@ -356,6 +370,36 @@ unsigned char IFD_XfrTpduT1 (unsigned char* pBlockBuffer, unsigned int* pBlockSi
 }
 
 
+/************************************************************************/
+/* ROUTINE unsigned char IFD_XfrShortApdu() */
+/* */
+/* Input : buffer filled with a command APDU */
+/* Output : buffer filled with the response APDU (data + SW1 SW2) */
+/* Return an Error code : */
+/* 0x00 if OK */
+/************************************************************************/
+
+unsigned char IFD_XfrShortApdu (unsigned char* pBlockBuffer, unsigned int* pBlockSize)
+{
+    unsigned short cRet;
+
+    if ((*pBlockSize < CCID_APDU_MIN_LENGTH) || (*pBlockSize > CCID_APDU_MAX_LENGTH))
+    {
+        return SLOTERROR_BAD_LENTGH;
+    }
+
+    cRet = CcidXfrAPDU (pBlockBuffer, pBlockSize, USB_MESSAGE_BUFFER_MAX_LENGTH - USB_MESSAGE_HEADER_SIZE);
+
+    if (APDU_ANSWER_RECEIVE_INCORRECT == cRet)
+    {
+        *pBlockSize = 0;
+        return SLOTERROR_HW_ERROR;
+    }
+
+    return (SLOT_NO_ERROR);
+}
+
+
 /************************************************************************/
 /* ROUTINE unsigned char IFD_GetParameters() */
 /* */
@@ -481,6 +525,52 @@ void IFD_EscapeSendHwName (unsigned char* pBlockBuffer, unsigned int* pBlockSize
     *pBlockSize = strlen (CCID_HW_NAME);
 }
 
+/*
+   Escape with the HID command set: 1b IFD_ESCAPE_REPORT_COMMANDS followed by
+   up to IFD_ESCAPE_MAX_REPORTS reports in the feature report format. The
+   answer has the same layout, every report is replaced by its answer.
+ */
+
+void IFD_EscapeReportCommands (unsigned char* pBlockBuffer, unsigned int* pBlockSize)
+{
+    static unsigned char cAnswer[KEYBOARD_FEATURE_COUNT];
+    unsigned char* pReport;
+    unsigned int nReports;
+
+    nReports = (*pBlockSize - 1) / KEYBOARD_FEATURE_COUNT;
+    if ((0 == nReports) || (IFD_ESCAPE_MAX_REPORTS < nReports) || (0 != (*pBlockSize - 1) % KEYBOARD_FEATURE_COUNT))
+    {
+        *pBlockSize = 0;
+        return;
+    }
+
+    pReport = &pBlockBuffer[1];
+    while (0 < nReports)
+    {
+        // The command reads the report while it writes the answer
+        parse_report (pReport, cAnswer);
+        memcpy (pReport, cAnswer, KEYBOARD_FEATURE_COUNT);
+
+        pReport += KEYBOARD_FEATURE_COUNT;
+        nReports--;
+    }
+}
+
+/*
+   Escape with a streamed object: 1b IFD_ESCAPE_STREAM_OBJECT followed by the
+   frame of parse_stream_object (), no 64 byte limit. The answer is 1b
+   IFD_ESCAPE_STREAM_OBJECT and the answer report.
+ */
+
+void IFD_EscapeStreamObject (unsigned char* pBlockBuffer, unsigned int* pBlockSize)
+{
+    static unsigned char cAnswer[KEYBOARD_FEATURE_COUNT];
+
+    parse_stream_object (&pBlockBuffer[1], *pBlockSize - 1, cAnswer);
+    memcpy (&pBlockBuffer[1], cAnswer, KEYBOARD_FEATURE_COUNT);
+    *pBlockSize = 1 + KEYBOARD_FEATURE_COUNT;
+}
+
 #define IFD_ESCAPE_SEND_HW_NAME 2
 
 unsigned char IFD_Escape (unsigned char* pBlockBuffer, unsigned int* pBlockSize)
@@ -498,6 +588,16 @@ unsigned char IFD_Escape (unsigned char* pBlockBuffer, unsigned int* pBlockSize)
             IFD_EscapeSendHwName (pBlockBuffer, pBlockSize);
         }
     }
+    else if ((1 < nSize) && (IFD_ESCAPE_REPORT_COMMANDS == pBlockBuffer[0]))
+    {
+        *pBlockSize = nSize;
+        IFD_EscapeReportCommands (pBlockBuffer, pBlockSize);
+    }
+    else if ((1 < nSize) && (IFD_ESCAPE_STREAM_OBJECT == pBlockBuffer[0]))
+    {
+        *pBlockSize = nSize;
+        IFD_EscapeStreamObject (pBlockBuffer, pBlockSize);
+    }
 
     return SLOT_NO_ERROR;
 }
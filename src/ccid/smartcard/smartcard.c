@@ -20,6 +20,7 @@
  */
 
 /* Includes ------------------------------------------------------------------ */
+#include <stddef.h>
 #include "stm32f10x_flash.h"
 #include "stm32f10x_systick.h"
 #include "stm32f10x_usart.h"
@@ -28,6 +29,11 @@
 #include "CCID_Global.h"
 #include "CCID_usb.h"
 #include "hw_config.h"
+#include "CcidLocalAccess.h"
+#include "scheduler.h"
+#include "perf_counters.h"
+#include "profile.h"
+#include "recorder.h"
 
 /* Private typedef ----------------------------------------------------------- */
 /* Private define ------------------------------------------------------------ */
@@ -164,8 +170,8 @@ static void NVIC_Configuration (void)
     /* Set the Vector Table base location at 0x20000000 */
     NVIC_SetVectorTable (NVIC_VectTab_RAM, 0x0);
 #else /* VECT_TAB_FLASH */
-    /* Set the Vector Table base location at 0x08000000 */
-    NVIC_SetVectorTable (NVIC_VectTab_FLASH, 0x0);
+    /* RAM copy of the vector table at 0x08000000, read while the flash is erased */
+    RAM_InitVectorTable ();
 #endif
 
     /* Configure one bit for preemption priority */
@@ -236,30 +242,15 @@ void SmartcardOff (void)
 
 /*******************************************************************************
 * Function Name  : Delay
-* Description    : Inserts a delay time.
+* Description    : Inserts a delay time, the scheduler runs the other tasks
+*                  meanwhile. Not the CCID protocol, it may be the caller.
 * Input          : nCount: specifies the delay time length (time base 10 ms).
 * Output         : None
 * Return         : None
 *******************************************************************************/
 void Delay (u32 nCount)
 {
-    TimingDelay = nCount;
-
-    /* Enable the SysTick Counter */
-    // SysTick_CounterCmd(SysTick_Counter_Enable);
-
-    while (TimingDelay != 0)
-    {
-
-        CCID_CheckUsbCommunication ();
-
-    }
-
-    /* Disable the SysTick Counter */
-    // SysTick_CounterCmd(SysTick_Counter_Disable);
-
-    /* Clear the SysTick Counter */
-    // SysTick_CounterCmd(SysTick_Counter_Clear);
+    SCHED_Wait (nCount * 10, SCHED_ALLOW_NO_USB);
 }
 
 /*******************************************************************************
@@ -278,6 +269,7 @@ void Delay_noUSBCheck (u32 nCount)
 
     while (TimingDelay != 0)
     {
+        __WFI ();   // woken up by the SysTick at the latest
     }
 
     /* Disable the SysTick Counter */
@@ -1338,41 +1330,186 @@ int WaitForATR (void)
 
 /*******************************************************************************
 
-	CRD_SendCommand
+  Interrupt driven receive of the card answer
+
+  CRD_StartCommand sends the command and enables the USART receive
+  interrupt. The answer is collected by CRD_USART_IRQHandler, the end of
+  the answer is detected by the length of the T=1 block, a T=0 error status
+  or a timeout of CRD_TransferTick (10 ms systick).
+  The state of the transfer is read with CRD_PollCommand, an optional
+  callback is called at the end of the transfer (in interrupt context).
+
+  The receive path is executed from RAM and accesses the USART registers
+  directly, bytes arrive while the flash is erased or programmed
+  (ramfunc.c). Only the callback is in the flash, it runs after the last
+  byte.
 
 *******************************************************************************/
 
-int CRD_SendCommand (unsigned char* pTransmitBuffer, unsigned int nCommandSize, unsigned int nExpectedAnswerSize, unsigned int* nReceivedAnswerSize)
+// The answer goes to the cTPDU of CcidLocalAccess.c or the larger message buffer of Ifd_protocol.c
+#define SC_TRANSFER_MAX_ANSWER      (CCID_TRANSFER_BUFFER_MAX + CCID_TPDU_OVERHEAD)
+
+typedef struct
+{
+    volatile unsigned char cState;
+    unsigned char cT1Block;
+    unsigned char* pBuffer;
+    unsigned int nMaxSize;
+    volatile unsigned int nReceived;
+    volatile unsigned int nTimeout;
+    volatile int nStatus;
+    volatile unsigned int nRepeats;     // characters repeated after a parity error
+    void (*pfComplete) (int nStatus, unsigned int nReceivedSize);
+} typeSmartcardTransferState;
+
+static typeSmartcardTransferState tTransfer = { SC_TRANSFER_IDLE, FALSE, NULL, 0, 0, 0, SC_GET_STATUS, 0, NULL };
+
+static void (*pfIdleTask) (void) = NULL;
+
+/*******************************************************************************
+
+  CRD_CompleteCommand
+
+  Called in interrupt context
+
+*******************************************************************************/
+
+static RAMFUNC void CRD_CompleteCommand (int nStatus)
+{
+    USART1->CR1 &= ~USART_CR1_RXNEIE;
+
+    tTransfer.nStatus = nStatus;
+    tTransfer.cState = SC_TRANSFER_DONE;
+
+    if (NULL != tTransfer.pfComplete)
+    {
+        tTransfer.pfComplete (nStatus, tTransfer.nReceived);
+    }
+}
+
+/*******************************************************************************
+
+  CRD_USART_IRQHandler
+
+*******************************************************************************/
+
+RAMFUNC void CRD_USART_IRQHandler (void)
+{
+    unsigned char cData;
+
+    unsigned int n;
+
+    uint16_t nFlags;
+
+    nFlags = USART1->SR;
+    if (0 == (nFlags & (USART_FLAG_RXNE | USART_FLAG_PE | USART_FLAG_ORE)))
+    {
+        return;
+    }
+
+    // Reading the data register clears the receive and error flags
+    cData = (unsigned char) USART1->DR;
+
+    if (0 != (nFlags & USART_FLAG_PE))
+    {
+        tTransfer.nRepeats++;   // NACK is send, the card repeats the byte
+        return;
+    }
+
+    if (SC_TRANSFER_RECEIVE != tTransfer.cState)
+    {
+        return;
+    }
+
+    n = tTransfer.nReceived;
+    tTransfer.pBuffer[n] = cData;
+    n++;
+    tTransfer.nReceived = n;
+    tTransfer.nTimeout = SC_TRANSFER_CHAR_TIMEOUT;
+
+    // T=0 error status, the second byte is the last one
+    if ((2 == n) && (FALSE == tTransfer.cT1Block) && (0x60 == (tTransfer.pBuffer[0] & 0xF0)))
+    {
+        CRD_CompleteCommand (SC_GET_WRONG_STATUS);
+        return;
+    }
+
+    // T=1 block complete: prologue, information field and LRC
+    if ((TRUE == tTransfer.cT1Block) && (CCID_TPDU_PROLOG < n) && (n == CCID_TPDU_PROLOG + tTransfer.pBuffer[2] + 1))
+    {
+        CRD_CompleteCommand (SC_GET_STATUS);
+        return;
+    }
+
+    if (tTransfer.nMaxSize <= n)
+    {
+        CRD_CompleteCommand (SC_GET_STATUS);
+    }
+}
+
+/*******************************************************************************
+
+  CRD_TransferTick
+
+  Called by the 10 ms systick interrupt
+
+*******************************************************************************/
+
+void CRD_TransferTick (void)
+{
+    if (SC_TRANSFER_RECEIVE != tTransfer.cState)
+    {
+        return;
+    }
+
+    if (0 != tTransfer.nTimeout)
+    {
+        tTransfer.nTimeout--;
+        return;
+    }
+
+    // No more data, end of answer
+    if (0 == tTransfer.nReceived)
+    {
+        CRD_CompleteCommand (SC_GET_NO_STATUS);
+    }
+    else
+    {
+        CRD_CompleteCommand (SC_GET_STATUS);
+    }
+}
+
+/*******************************************************************************
+
+  CRD_StartCommand
+
+  Send the command and start the reception of the answer in pTransmitBuffer.
+
+  Return  SC_TRANSFER_BUSY    Answer is received in background
+          33                  Error while sending
+
+*******************************************************************************/
+
+int CRD_StartCommand (unsigned char* pTransmitBuffer, unsigned int nCommandSize, void (*pfComplete) (int nStatus, unsigned int nReceivedSize))
 {
     int i;
 
 #ifdef GERMALTO_CARD
     int i1;
 #endif
-    int nDelayTime;
-
-    int nStatus;
-
     int nRecData;
 
     unsigned char cSendData;
 
-    nStatus = SC_GET_STATUS;
-
-    /* Test for baudrate set */
-    if (4 == nCommandSize)
+    // The sended block is a T=1 block, so the answer is one too
+    tTransfer.cT1Block = FALSE;
+    if ((CCID_TPDU_PROLOG < nCommandSize) && (nCommandSize == CCID_TPDU_PROLOG + pTransmitBuffer[2] + 1))
     {
-        if ((0xff == pTransmitBuffer[0]) && (0x11 == pTransmitBuffer[1]))
-        {
-            *nReceivedAnswerSize = 4;
-            return (SC_GET_STATUS);
-        }
+        tTransfer.cT1Block = TRUE;
     }
 
     SwitchSmartcardLED (ENABLE);
 
-
-
     for (i = 0; i < nCommandSize; i++)
     {
         cSendData = pTransmitBuffer[i];
@@ -1396,82 +1533,138 @@ int CRD_SendCommand (unsigned char* pTransmitBuffer, unsigned int nCommandSize,
 #endif
     }
 
+    for (i = 0; i < SC_TRANSFER_MAX_ANSWER; i++)
+    {
+        pTransmitBuffer[i] = 0xa5;
+    }
+
+    tTransfer.pBuffer = pTransmitBuffer;
+    tTransfer.nMaxSize = SC_TRANSFER_MAX_ANSWER;
+    tTransfer.nReceived = 0;
+    tTransfer.nTimeout = SC_TRANSFER_FIRST_CHAR_TIMEOUT;   // Long wait for first byte, allow card to work
+    tTransfer.pfComplete = pfComplete;
+    tTransfer.nStatus = SC_GET_STATUS;
+    tTransfer.cState = SC_TRANSFER_RECEIVE;
+
     /* Flush the USART1 DR */
     (void) USART_ReceiveData (USART1);
 
-    for (i = 0; i < ICC_MESSAGE_BUFFER_MAX_LENGTH - USB_MESSAGE_HEADER_SIZE; i++)
+    USART_ITConfig (USART1, USART_IT_RXNE, ENABLE);
+
+    return (SC_TRANSFER_BUSY);
+}
+
+/*******************************************************************************
+
+  CRD_PollCommand
+
+  Return  SC_TRANSFER_BUSY    Answer not complete
+          SC_GET_...          Status of the finished transfer
+
+*******************************************************************************/
+
+int CRD_PollCommand (unsigned int* nReceivedAnswerSize)
+{
+    if (SC_TRANSFER_RECEIVE == tTransfer.cState)
     {
-        pTransmitBuffer[i] = 0xa5;
+        return (SC_TRANSFER_BUSY);
     }
 
-    /* Get answer */
-    //
-    for (i = 0; i < ICC_MESSAGE_BUFFER_MAX_LENGTH - USB_MESSAGE_HEADER_SIZE; i++)   // max
-        // buffer
-        // size
-        // (had
-        // to
-        // be
-        // checked)
-    {
-        nDelayTime = SC_Receive_Timeout;
-        if (0 == i)
-        {
-            nDelayTime = SC_Receive_Timeout * 10000L;   // Long long wait for
-            // first byte, allow
-            // card to work
-        }
+    *nReceivedAnswerSize = tTransfer.nReceived;
 
-        if ((USART_ByteReceive (&pTransmitBuffer[i], nDelayTime)) != SUCCESS)
-        {
-            break;
-        }
+    if (SC_TRANSFER_DONE == tTransfer.cState)
+    {
+        tTransfer.cState = SC_TRANSFER_IDLE;
+        SwitchSmartcardLED (DISABLE);
 
-        switch (i)
+        // Counted here, PERF_Count is in the flash
+        for (; 0 < tTransfer.nRepeats; tTransfer.nRepeats--)
         {
-            case 0:
-                // ACK byte ?
-                if (((pTransmitBuffer[i] & (u8) 0xFE) ==
-                     (((u8) ~ (pTransmitBuffer[1])) & (u8) 0xFE)) || ((pTransmitBuffer[i] & (u8) 0xFE) == (pTransmitBuffer[1] & (u8) 0xFE)))
-                {
-                    break;
-                }
-                // Get Error state
-                if (((pTransmitBuffer[i] & (u8) 0xF0) == 0x60)) // ||
-                    // TransansmitBuffer[i]
-                    // &
-                    // ()0xF0F0)
-                    // == 0x90))
-                {
-                    nStatus = SC_GET_WRONG_STATUS;
-                }
-                break;
+            PERF_Count (PERF_SC_CHAR_REPEATS);
         }
+    }
+
+    return (tTransfer.nStatus);
+}
+
+/*******************************************************************************
+
+  CRD_IsCommandActive
 
-        if ((1 == i) && (SC_GET_WRONG_STATUS == nStatus))   // Get Error code
+*******************************************************************************/
+
+unsigned char CRD_IsCommandActive (void)
+{
+    if (SC_TRANSFER_IDLE != tTransfer.cState)
+    {
+        return (TRUE);
+    }
+
+    return (FALSE);
+}
+
+/*******************************************************************************
+
+  CRD_SetIdleTask
+
+  The task is called while CRD_SendCommand waits for the card answer, it
+  must not use the smartcard
+
+*******************************************************************************/
+
+void CRD_SetIdleTask (void (*pfTask) (void))
+{
+    pfIdleTask = pfTask;
+}
+
+/*******************************************************************************
+
+	CRD_SendCommand
+
+*******************************************************************************/
+
+int CRD_SendCommand (unsigned char* pTransmitBuffer, unsigned int nCommandSize, unsigned int nExpectedAnswerSize, unsigned int* nReceivedAnswerSize)
+{
+    int nStatus;
+
+    /* Test for baudrate set */
+    if (4 == nCommandSize)
+    {
+        if ((0xff == pTransmitBuffer[0]) && (0x11 == pTransmitBuffer[1]))
         {
-            *nReceivedAnswerSize = 2;
-            SwitchSmartcardLED (DISABLE);
-            return (nStatus);
+            *nReceivedAnswerSize = 4;
+            return (SC_GET_STATUS);
         }
     }
-#ifdef GERMALTO_CARD
-    if (FALSE == uFlagCode)
+
+    PROF_BEGIN (PROF_MARKER_CARD_COMMAND);
+    REC_RECORD (REC_TPDU_OUT, pTransmitBuffer, nCommandSize);
+
+    nStatus = CRD_StartCommand (pTransmitBuffer, nCommandSize, NULL);
+    if (SC_TRANSFER_BUSY != nStatus)
     {
-        *nReceivedAnswerSize = i - 1;
-        for (i1 = 1; i1 < i; i1++)
+        REC_RECORD (REC_TPDU_IN, pTransmitBuffer, 0);
+        return (nStatus);
+    }
+
+    // Serve other requests until the card has answered
+    while (SC_TRANSFER_BUSY == (nStatus = CRD_PollCommand (nReceivedAnswerSize)))
+    {
+        if (NULL != pfIdleTask)
         {
-            pTransmitBuffer[i1 - 1] = pTransmitBuffer[i1];
+            pfIdleTask ();
         }
     }
-    else
-#endif /* GERMALTO_CARD */
+
+    PROF_END (PROF_MARKER_CARD_COMMAND);
+    REC_RECORD (REC_TPDU_IN, pTransmitBuffer, (SC_GET_WRONG_STATUS == nStatus) ? 0 : *nReceivedAnswerSize);
+
+    if (SC_GET_WRONG_STATUS == nStatus)
     {
-        *nReceivedAnswerSize = i;
+        *nReceivedAnswerSize = 2;
+        return (nStatus);
     }
 
-    SwitchSmartcardLED (DISABLE);
-
     if (0 == *nReceivedAnswerSize)
     {
         *nReceivedAnswerSize = 2;
@@ -1555,6 +1748,8 @@ int scTest (void)
     /* Apply the Procedure Type Selection (PTS) */
     SC_PTSConfig ();
 
+    CcidSessionPowerOn ();
+
     /* Inserts delay(400ms) for Smartcard clock resynchronisation */
     // Delay_noUSBCheck(40);
 
@@ -1601,6 +1796,9 @@ char RestartSmartcard (void)
 
     InvalidateATR ();
 
+    // The card state is lost by the reset
+    CcidSessionPowerOff ();
+
     n = 0;
     while (FALSE == WaitForATR ())
     {
@@ -1612,6 +1810,8 @@ char RestartSmartcard (void)
     }
     SC_PTSConfig ();
 
+    CcidSessionPowerOn ();
+
     // Delay_noUSBCheck (40);
 
     return (TRUE);
@@ -34,6 +34,7 @@
 #if defined(POLARSSL_AES_C)
 
 #include "aes.h"
+#include "profile.h"
 // #include "polarssl/padlock.h"
 
 #include <string.h>
@@ -689,6 +690,8 @@ void aes_crypt_ecb (aes_context * ctx, int mode, unsigned char input[16], unsign
     }
 #endif
 
+    PROF_BEGIN (PROF_MARKER_AES_BLOCK);
+
     RK = ctx->rk;
 
     GET_ULONG_LE (X0, input, 0);
@@ -765,6 +768,8 @@ void aes_crypt_ecb (aes_context * ctx, int mode, unsigned char input[16], unsign
     PUT_ULONG_LE (X1, output, 4);
     PUT_ULONG_LE (X2, output, 8);
     PUT_ULONG_LE (X3, output, 12);
+
+    PROF_END (PROF_MARKER_AES_BLOCK);
 }
 
 /*
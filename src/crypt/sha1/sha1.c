@@ -21,6 +21,7 @@
 #include <string.h> /* memcpy & co */
 #include <stdint.h>
 #include "sha1.h"
+#include "profile.h"
 
 #ifdef DEBUG
 #  undef DEBUG
@@ -100,6 +101,8 @@ void sha1_nextBlock (sha1_ctx_t * state, const void* block)
         0xca62c1d6
     };
 
+    PROF_BEGIN (PROF_MARKER_SHA1_BLOCK);
+
     /* load the w array (changing the endian and so) */
     for (t = 0; t < 16; ++t)
     {
@@ -151,6 +154,8 @@ void sha1_nextBlock (sha1_ctx_t * state, const void* block)
         state->h[t] += a[t];
     }
     state->length += 512;
+
+    PROF_END (PROF_MARKER_SHA1_BLOCK);
 }
 
 /********************************************************************************************************/
@@ -0,0 +1,594 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * nkbench, benchmarks of the firmware core as JSON (make bench)
+ *
+ *   nkbench [-e firmware elf] [-s size tool] [-r runs]
+ *
+ * The crypto is timed in batches, the best batch of the runs counts. Host
+ * time is given in ns and, on x86, in TSC cycles. parse_report () is run
+ * for each known command ID with a zero payload on a new device, so the
+ * card and flash state is the same for each run; besides the host time the
+ * modeled card time, the APDUs and the flash erases and programs are given,
+ * which don't depend on the build machine. The status shows the path taken,
+ * commands with a password stop at the authorization.
+ *
+ * With -e the ROM and RAM usage of the ARM firmware is read with the size
+ * tool (default arm-none-eabi-size), like sizeafter of build/gcc.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined (__x86_64__) || defined (__i386__)
+#include <x86intrin.h>
+#define BENCH_TSC
+#endif
+#include "stm32f10x.h"
+#include "stm32f10x_crc.h"
+#include "CCIDHID_usb_desc.h"
+#include "sha1.h"
+#include "hmac-sha1.h"
+#include "aes.h"
+#include "hotp.h"
+#include "report_protocol.h"
+#include "host.h"
+
+#define BENCH_RUNS              5
+#define BENCH_HASH_ITERATIONS   20000
+#define BENCH_AES_ITERATIONS    100000
+#define BENCH_SETUP_ITERATIONS  20000
+#define BENCH_LOOKAHEAD_ITERATIONS  2000
+
+#define BENCH_FLASH_START       0x08000000  // ROM and RAM of the STM32F103
+#define BENCH_FLASH_END         0x08100000
+#define BENCH_RAM_START         0x20000000
+#define BENCH_RAM_END           0x20010000
+
+typedef struct
+{
+    double fNs;
+    double fCycles;
+} typeBenchTime;
+
+// Modeled cost of a run on the device
+typedef struct
+{
+    uint64_t nCardNs;
+    uint32_t nApdus;
+    uint32_t nErases;
+    uint32_t nPrograms;
+    uint64_t nFlashNs;
+} typeBenchDevice;
+
+static int nBenchRuns = BENCH_RUNS;
+static const char* szBenchSep = "";
+
+static uint8_t cBenchKey[SECRET_LENGTH_DEFINE];
+static uint8_t cBenchBlock[64];
+static sha1_ctx_t tBenchSha1;
+static aes_context tBenchAes;
+static uint32_t nBenchCode;
+
+/*******************************************************************************
+
+  BENCH_Now
+
+*******************************************************************************/
+
+static typeBenchTime BENCH_Now (void)
+{
+    typeBenchTime tNow;
+    struct timespec tSpec;
+
+    clock_gettime (CLOCK_MONOTONIC, &tSpec);
+    tNow.fNs = (double) tSpec.tv_sec * 1e9 + tSpec.tv_nsec;
+#ifdef BENCH_TSC
+    tNow.fCycles = (double) __rdtsc ();
+#else
+    tNow.fCycles = 0;
+#endif
+    return (tNow);
+}
+
+/*******************************************************************************
+
+  BENCH_Time
+
+  Time per call of pfOp, the best of the runs of nIterations calls
+
+*******************************************************************************/
+
+static typeBenchTime BENCH_Time (void (*pfOp) (void), uint32_t nIterations)
+{
+    typeBenchTime tBest = { 0, 0 };
+    typeBenchTime tStart;
+    typeBenchTime tEnd;
+    uint32_t i;
+    int nRun;
+
+    for (nRun = 0; nRun < nBenchRuns; nRun++)
+    {
+        tStart = BENCH_Now ();
+        for (i = 0; i < nIterations; i++)
+        {
+            pfOp ();
+        }
+        tEnd = BENCH_Now ();
+
+        tEnd.fNs = (tEnd.fNs - tStart.fNs) / nIterations;
+        tEnd.fCycles = (tEnd.fCycles - tStart.fCycles) / nIterations;
+        if ((0 == nRun) || (tEnd.fNs < tBest.fNs))
+        {
+            tBest = tEnd;
+        }
+    }
+    return (tBest);
+}
+
+/*******************************************************************************
+
+  BENCH_PrintTime
+
+  "ns" and "cycles" members, cycles is null without a TSC
+
+*******************************************************************************/
+
+static void BENCH_PrintTime (typeBenchTime tTime)
+{
+    printf ("\"ns\": %.1f, \"cycles\": ", tTime.fNs);
+#ifdef BENCH_TSC
+    printf ("%.0f", tTime.fCycles);
+#else
+    printf ("null");
+#endif
+}
+
+static void BENCH_PrintItem (const char* szName, uint32_t nIterations, typeBenchTime tTime)
+{
+    printf ("%s\n    {\"name\": \"%s\", \"iterations\": %u, ", szBenchSep, szName, nIterations);
+    BENCH_PrintTime (tTime);
+    printf ("}");
+    szBenchSep = ",";
+}
+
+static void BENCH_PrintDevice (const typeBenchDevice * pDevice)
+{
+    printf ("\"card_us\": %.1f, \"apdus\": %u, \"erases\": %u, \"programs\": %u, \"flash_us\": %.1f",
+            pDevice->nCardNs / 1000.0, pDevice->nApdus, pDevice->nErases, pDevice->nPrograms, pDevice->nFlashNs / 1000.0);
+}
+
+/*******************************************************************************
+
+  BENCH_DeviceStart / BENCH_DeviceEnd
+
+  Modeled cost between the calls
+
+*******************************************************************************/
+
+static void BENCH_DeviceStart (typeBenchDevice * pDevice)
+{
+    HOST_FlashResetStats ();
+    pDevice->nCardNs = HOST_UsartTimeNs ();
+    pDevice->nApdus = HOST_CardApdus ();
+}
+
+static void BENCH_DeviceEnd (typeBenchDevice * pDevice)
+{
+    const typeHostFlashStats* pStats = HOST_FlashStats ();
+    uint32_t nPage;
+
+    pDevice->nCardNs = HOST_UsartTimeNs () - pDevice->nCardNs;
+    pDevice->nApdus = HOST_CardApdus () - pDevice->nApdus;
+    pDevice->nErases = 0;
+    pDevice->nPrograms = 0;
+    for (nPage = 0; nPage < HOST_FLASH_PAGES; nPage++)
+    {
+        pDevice->nErases += pStats->nErases[nPage];
+        pDevice->nPrograms += pStats->nPrograms[nPage];
+    }
+    pDevice->nFlashNs = pStats->nBusyNs;
+}
+
+/*******************************************************************************
+
+  Crypto operations
+
+*******************************************************************************/
+
+static void BENCH_Sha1NextBlock (void)
+{
+    sha1_nextBlock (&tBenchSha1, cBenchBlock);
+}
+
+static void BENCH_HmacSha1 (void)
+{
+    uint64_t nCounter = 0;
+
+    hmac_sha1 (cBenchBlock, cBenchKey, sizeof (cBenchKey) * 8, &nCounter, 64);
+}
+
+static void BENCH_Hotp6 (void)
+{
+    nBenchCode += get_hotp_value (nBenchCode, cBenchKey, sizeof (cBenchKey), 6);
+}
+
+static void BENCH_Hotp8 (void)
+{
+    nBenchCode += get_hotp_value (nBenchCode, cBenchKey, sizeof (cBenchKey), 8);
+}
+
+static void BENCH_AesSetKey (void)
+{
+    aes_setkey_enc (&tBenchAes, cBenchKey, 256);
+}
+
+static void BENCH_AesEncrypt (void)
+{
+    aes_crypt_ecb (&tBenchAes, AES_ENCRYPT, cBenchBlock, cBenchBlock);
+}
+
+static void BENCH_AesDecrypt (void)
+{
+    aes_crypt_ecb (&tBenchAes, AES_DECRYPT, cBenchBlock, cBenchBlock);
+}
+
+static void BENCH_LookAhead (void)
+{
+    validate_code_from_hotp_slot (0, nBenchCode);
+}
+
+/*******************************************************************************
+
+  BENCH_Crypto
+
+*******************************************************************************/
+
+static void BENCH_Crypto (void)
+{
+    memset (cBenchKey, 0x5A, sizeof (cBenchKey));
+    memset (cBenchBlock, 0xA5, sizeof (cBenchBlock));
+    sha1_init (&tBenchSha1);
+
+    printf ("  \"crypto\": [");
+    szBenchSep = "";
+    BENCH_PrintItem ("sha1_nextBlock", BENCH_HASH_ITERATIONS, BENCH_Time (BENCH_Sha1NextBlock, BENCH_HASH_ITERATIONS));
+    BENCH_PrintItem ("hmac_sha1", BENCH_HASH_ITERATIONS, BENCH_Time (BENCH_HmacSha1, BENCH_HASH_ITERATIONS));
+    BENCH_PrintItem ("get_hotp_value_6", BENCH_HASH_ITERATIONS, BENCH_Time (BENCH_Hotp6, BENCH_HASH_ITERATIONS));
+    BENCH_PrintItem ("get_hotp_value_8", BENCH_HASH_ITERATIONS, BENCH_Time (BENCH_Hotp8, BENCH_HASH_ITERATIONS));
+    BENCH_PrintItem ("aes256_setkey_enc", BENCH_SETUP_ITERATIONS, BENCH_Time (BENCH_AesSetKey, BENCH_SETUP_ITERATIONS));
+    BENCH_PrintItem ("aes_crypt_ecb_encrypt", BENCH_AES_ITERATIONS, BENCH_Time (BENCH_AesEncrypt, BENCH_AES_ITERATIONS));
+    aes_setkey_dec (&tBenchAes, cBenchKey, 256);
+    BENCH_PrintItem ("aes_crypt_ecb_decrypt", BENCH_AES_ITERATIONS, BENCH_Time (BENCH_AesDecrypt, BENCH_AES_ITERATIONS));
+    printf ("\n  ],\n");
+}
+
+/*******************************************************************************
+
+  BENCH_Report
+
+  Run a report with the command cCmd and a zero payload on the open
+  device, returns the status of the answer
+
+*******************************************************************************/
+
+static uint8_t BENCH_Report (uint8_t cCmd, typeBenchTime * pTime, typeBenchDevice * pDevice)
+{
+    uint8_t cReport[KEYBOARD_FEATURE_COUNT];
+    uint32_t nCrc;
+    typeBenchTime tStart;
+
+    memset (cReport, 0, sizeof (cReport));
+    cReport[CMD_TYPE_OFFSET] = cCmd;
+    CRC_ResetDR ();
+    nCrc = CRC_CalcBlockCRC ((uint32_t *) cReport, KEYBOARD_FEATURE_COUNT / 4 - 1);
+    memcpy (&cReport[OUTPUT_CRC_OFFSET], &nCrc, 4);
+
+    BENCH_DeviceStart (pDevice);
+    tStart = BENCH_Now ();
+    HOST_SetReport (cReport);
+    *pTime = BENCH_Now ();
+    BENCH_DeviceEnd (pDevice);
+
+    pTime->fNs -= tStart.fNs;
+    pTime->fCycles -= tStart.fCycles;
+    return (HOST_GetReport ()[OUTPUT_CMD_STATUS_OFFSET]);
+}
+
+/*******************************************************************************
+
+  BENCH_ParseReport
+
+  Each command ID known to parse_report (), on a new device per run
+
+*******************************************************************************/
+
+static int BENCH_ParseReport (void)
+{
+    uint8_t cKnown[256];
+    typeBenchTime tTime;
+    typeBenchTime tBest;
+    typeBenchDevice tDevice;
+    uint8_t cStatus = 0;
+    int nCmd;
+    int nRun;
+
+    // Unknown commands don't change the device, one device finds them
+    if (0 != HOST_DeviceOpen (NULL, HOST_DEFAULT_SERIAL))
+    {
+        return (-1);
+    }
+    for (nCmd = 0; nCmd < 256; nCmd++)
+    {
+        cKnown[nCmd] = (CMD_STATUS_UNKNOWN_COMMAND != BENCH_Report ((uint8_t) nCmd, &tTime, &tDevice));
+    }
+    HOST_DeviceClose ();
+
+    printf ("  \"parse_report\": [");
+    szBenchSep = "";
+    for (nCmd = 0; nCmd < 256; nCmd++)
+    {
+        if (!cKnown[nCmd])
+        {
+            continue;
+        }
+
+        for (nRun = 0; nRun < nBenchRuns; nRun++)
+        {
+            if (0 != HOST_DeviceOpen (NULL, HOST_DEFAULT_SERIAL))
+            {
+                return (-1);
+            }
+            cStatus = BENCH_Report ((uint8_t) nCmd, &tTime, &tDevice);
+            HOST_DeviceClose ();
+
+            if ((0 == nRun) || (tTime.fNs < tBest.fNs))
+            {
+                tBest = tTime;
+            }
+        }
+
+        printf ("%s\n    {\"cmd\": \"0x%02x\", \"status\": %u, ", szBenchSep, nCmd, cStatus);
+        BENCH_PrintTime (tBest);
+        printf (", ");
+        BENCH_PrintDevice (&tDevice);
+        printf ("}");
+        szBenchSep = ",";
+    }
+    printf ("\n  ],\n");
+    return (0);
+}
+
+/*******************************************************************************
+
+  BENCH_WriteSlot
+
+  Program HOTP slot 1 on a new device, the time of the first run and the
+  flash cost of write_to_slot ()
+
+*******************************************************************************/
+
+static void BENCH_WriteSlot (OTP_slot * pSlot, typeBenchTime * pTime, typeBenchDevice * pDevice)
+{
+    typeBenchTime tStart;
+
+    memset (pSlot, 0, sizeof (OTP_slot));
+    pSlot->type = 'H';
+    memcpy (pSlot->name, "bench", 5);
+    memset (pSlot->secret, 0x5A, SECRET_LENGTH_DEFINE);
+
+    BENCH_DeviceStart (pDevice);
+    tStart = BENCH_Now ();
+    write_to_slot (pSlot, get_HOTP_slot_offset (0), sizeof (OTP_slot));
+    *pTime = BENCH_Now ();
+    BENCH_DeviceEnd (pDevice);
+
+    pTime->fNs -= tStart.fNs;
+    pTime->fCycles -= tStart.fCycles;
+}
+
+/*******************************************************************************
+
+  BENCH_Storage
+
+  write_to_slot () and the look-ahead of the HOTP verification: a wrong
+  code takes all values of the window, a code at the end of the window
+  increments the counter for each of them
+
+*******************************************************************************/
+
+static int BENCH_Storage (void)
+{
+    OTP_slot tSlot;
+    typeBenchTime tTime;
+    typeBenchTime tStart;
+    typeBenchDevice tDevice;
+    int nOffset;
+
+    if (0 != HOST_DeviceOpen (NULL, HOST_DEFAULT_SERIAL))
+    {
+        return (-1);
+    }
+
+    BENCH_WriteSlot (&tSlot, &tTime, &tDevice);
+    printf ("  \"write_to_slot\": {");
+    BENCH_PrintTime (tTime);
+    printf (", ");
+    BENCH_PrintDevice (&tDevice);
+    printf ("},\n");
+
+    set_counter_value (hotp_slot_counters[0], 0);
+
+    // No code of the window is 0, a HOTP value has 6 digits
+    nBenchCode = 100000000;
+    tTime = BENCH_Time (BENCH_LookAhead, BENCH_LOOKAHEAD_ITERATIONS);
+    printf ("  \"hotp_lookahead\": {\"miss\": {\"iterations\": %u, ", BENCH_LOOKAHEAD_ITERATIONS);
+    BENCH_PrintTime (tTime);
+
+    nBenchCode = get_hotp_value (9, tSlot.secret, SECRET_LENGTH_DEFINE, 6);
+    BENCH_DeviceStart (&tDevice);
+    tStart = BENCH_Now ();
+    nOffset = validate_code_from_hotp_slot (0, nBenchCode);
+    tTime = BENCH_Now ();
+    BENCH_DeviceEnd (&tDevice);
+    tTime.fNs -= tStart.fNs;
+    tTime.fCycles -= tStart.fCycles;
+
+    printf ("}, \"hit\": {\"offset\": %d, ", nOffset);
+    BENCH_PrintTime (tTime);
+    printf (", ");
+    BENCH_PrintDevice (&tDevice);
+    printf ("}},\n");
+
+    HOST_DeviceClose ();
+    return (0);
+}
+
+/*******************************************************************************
+
+  BENCH_Memory
+
+  Sections of the firmware ELF from the size tool. ROM holds the sections
+  in flash and the initial values of .data, RAM the sections in SRAM.
+
+*******************************************************************************/
+
+static void BENCH_Memory (const char* szElf, const char* szSize)
+{
+    char szCommand[512];
+    char szLine[256];
+    char szName[64];
+    unsigned long nSize;
+    unsigned long nAddress;
+    unsigned long nRom = 0;
+    unsigned long nRam = 0;
+    FILE* pPipe;
+
+    printf ("  \"memory\": ");
+    if (NULL == szElf)
+    {
+        printf ("null\n");
+        return;
+    }
+
+    snprintf (szCommand, sizeof (szCommand), "%s -A '%s' 2>/dev/null", szSize, szElf);
+    pPipe = popen (szCommand, "r");
+    if (NULL == pPipe)
+    {
+        printf ("null\n");
+        return;
+    }
+
+    printf ("{\"elf\": \"%s\", \"sections\": [", szElf);
+    szBenchSep = "";
+    while (NULL != fgets (szLine, sizeof (szLine), pPipe))
+    {
+        if ((3 != sscanf (szLine, "%63s %lu %lu", szName, &nSize, &nAddress)) || (0 == nSize))
+        {
+            continue;
+        }
+
+        if ((BENCH_FLASH_START <= nAddress) && (BENCH_FLASH_END > nAddress))
+        {
+            nRom += nSize;
+        }
+        else if ((BENCH_RAM_START <= nAddress) && (BENCH_RAM_END > nAddress))
+        {
+            nRam += nSize;
+            if (0 == strcmp (szName, ".data"))
+            {
+                nRom += nSize;
+            }
+        }
+        else
+        {
+            continue;   // debug sections
+        }
+
+        printf ("%s\n    {\"name\": \"%s\", \"size\": %lu, \"address\": \"0x%08lx\"}", szBenchSep, szName, nSize, nAddress);
+        szBenchSep = ",";
+    }
+
+    if (0 != pclose (pPipe))
+    {
+        fprintf (stderr, "%s failed on %s\n", szSize, szElf);
+    }
+    printf ("\n  ], \"rom\": %lu, \"ram\": %lu}\n", nRom, nRam);
+}
+
+/*******************************************************************************
+
+  main
+
+*******************************************************************************/
+
+int main (int argc, char* argv[])
+{
+    const char* szElf = NULL;
+    const char* szSize = "arm-none-eabi-size";
+    int nOpt;
+
+    while (-1 != (nOpt = getopt (argc, argv, "e:s:r:")))
+    {
+        switch (nOpt)
+        {
+            case 'e':
+                szElf = (0 == access (optarg, R_OK)) ? optarg : NULL;
+                if (NULL == szElf)
+                {
+                    fprintf (stderr, "%s: no firmware %s, memory usage left out\n", argv[0], optarg);
+                }
+                break;
+            case 's':
+                szSize = optarg;
+                break;
+            case 'r':
+                nBenchRuns = atoi (optarg);
+                break;
+            default:
+                fprintf (stderr, "usage: %s [-e firmware elf] [-s size tool] [-r runs]\n", argv[0]);
+                return (2);
+        }
+    }
+
+    if (0 >= nBenchRuns)
+    {
+        fprintf (stderr, "%s: runs must be > 0\n", argv[0]);
+        return (2);
+    }
+
+    printf ("{\n");
+#ifdef BENCH_TSC
+    printf ("  \"clock\": \"tsc\",\n");
+#else
+    printf ("  \"clock\": \"ns\",\n");
+#endif
+    printf ("  \"runs\": %d,\n", nBenchRuns);
+
+    BENCH_Crypto ();
+    if ((0 != BENCH_ParseReport ()) || (0 != BENCH_Storage ()))
+    {
+        fprintf (stderr, "can't map the flash image at 0x%08x\n", HOST_FLASH_BASE);
+        return (1);
+    }
+    BENCH_Memory (szElf, szSize);
+    printf ("}\n");
+    return (0);
+}
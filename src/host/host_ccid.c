@@ -0,0 +1,826 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * nkccid, the CCID bulk transfer with back-to-back messages
+ *
+ *   nkccid [-n messages]
+ *
+ * Sends the messages of each test at once through the bulk endpoints of
+ * host_usb.c, like a host queueing its commands. Every packet taken by
+ * endpoint 3 is followed by its callback CCID_BulkOutMessage (), every
+ * packet sent by endpoint 2 by CCID_BulkInMessage (). The main loop,
+ * CCID_CheckUsbCommunication (), only runs when no packet moves, so the
+ * next commands arrive while the last one is in work and its answer is
+ * sent. The tests (default 32 messages each):
+ *
+ *   endpoints    the configuration descriptor has the bulk OUT endpoint
+ *                0x03 and the bulk IN endpoint 0x82, a driver still bound
+ *                to the old bulk OUT endpoint 0x02 is NAKed by endpoint 2
+ *   slot status  PC_to_RDR_GetSlotStatus, a single packet each
+ *   xfr block    PC_to_RDR_XfrBlock with a 220 byte APDU, 4 packets each
+ *   chained xfr  a 255 byte APDU in two I-blocks, the card rejects the
+ *                first one 0 to CCID_TPDU_MAX_RESENDS + 1 times
+ *   escape       PC_to_RDR_Escape with the HID command set: 1 to 4 reports,
+ *                a bad length and a bad report CRC (always 6 messages)
+ *   escape stream  a HOTP slot uploaded as a whole object in one escape
+ *                frame of more than 64 bytes after CMD_FIRST_AUTHENTICATE
+ *                and read back, an object with a bad CRC and a frame cut
+ *                short (always 5 messages)
+ *
+ * The answers are checked by bSeq and message type, the reports of the
+ * escape answers by command, status and CRC. Prints per message
+ * the packets, the NAKed OUT packets, the commands received during the
+ * answer of the last one and the host time of the bulk callbacks and of
+ * the dispatch without the card backend. Returns 1 if a check failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "stm32f10x.h"
+#include "hw_config.h"
+#include "usb_regs.h"
+#include "CCIDHID_usb_conf.h"
+#include "CCID_Global.h"
+#include "CCID_usb.h"
+#include "CCID_Ifd_protocol.h"
+#include "CcidLocalAccess.h"
+#include "CCIDHID_usb_desc.h"
+#include "report_protocol.h"
+#include "host.h"
+
+#define CCIDT_MAX_MESSAGES      256
+#define CCIDT_DEFAULT_MESSAGES  32
+#define CCIDT_XFR_APDU          220
+#define CCIDT_CHAINED_APDU      (CCID_DATA + 250)   // two I-blocks
+#define CCIDT_STATUS_FAILED     0x40                // bmCommandStatus of bStatus
+
+#define CCIDT_DESC_INTERFACE    0x04
+#define CCIDT_DESC_ENDPOINT     0x05
+#define CCIDT_CLASS_CCID        0x0B
+#define CCIDT_EP_BULK           0x02
+#define CCIDT_EP_IN             0x80
+#define CCIDT_BULK_OUT          0x03
+#define CCIDT_BULK_IN           (CCIDT_EP_IN | 0x02)
+#define CCIDT_OLD_BULK_OUT      0x02
+
+#define CCIDT_ESCAPE_BAD_LENGTH 4
+#define CCIDT_ESCAPE_BAD_CRC    5
+#define CCIDT_ESCAPE_MESSAGES   6
+
+#define CCIDT_STREAM_AUTH       0
+#define CCIDT_STREAM_OBJECT     1
+#define CCIDT_STREAM_READ       2
+#define CCIDT_STREAM_BAD_CRC    3
+#define CCIDT_STREAM_SHORT      4
+#define CCIDT_STREAM_MESSAGES   5
+#define CCIDT_STREAM_SLOT       0x11
+#define CCIDT_STREAM_NAME       "escape stream"
+#define CCIDT_OTP_OBJECT        (sizeof (OTP_slot) - offsetof (OTP_slot, name))
+
+// Main loop runs without a moved packet until the transfer counts as stalled
+#define CCIDT_MAX_IDLE_LOOPS    3
+
+typedef struct
+{
+    uint8_t cData[USB_MESSAGE_BUFFER_SIZE];
+    int nLength;
+} typeCcidtMessage;
+
+typedef struct
+{
+    uint32_t nPacketsOut;
+    uint32_t nPacketsIn;
+    uint32_t nNaks;
+    uint32_t nOverlapped;   // commands started before the last answer was complete
+    uint64_t nBulkNs;
+    uint64_t nDispatchNs;
+} typeCcidtStats;
+
+static typeCcidtMessage tCcidtCommands[CCIDT_MAX_MESSAGES];
+static typeCcidtMessage tCcidtAnswers[CCIDT_MAX_MESSAGES];
+static uint8_t cCcidtSequence;
+static int nCcidtErrors;
+
+/*******************************************************************************
+
+  CCIDT_Ns
+
+*******************************************************************************/
+
+static uint64_t CCIDT_Ns (void)
+{
+    struct timespec tNow;
+
+    clock_gettime (CLOCK_MONOTONIC, &tNow);
+    return ((uint64_t) tNow.tv_sec * 1000000000 + tNow.tv_nsec);
+}
+
+/*******************************************************************************
+
+  CCIDT_InitEndpoints
+
+  The bulk endpoints like CCID_Reset () of CCIDHID_usb_prop.c
+
+*******************************************************************************/
+
+static void CCIDT_InitEndpoints (void)
+{
+    SetBTABLE (BTABLE_ADDRESS);
+
+    SetEPType (ENDP2, EP_BULK);
+    SetEPDoubleBuff (ENDP2);
+    SetEPDblBuffAddr (ENDP2, CCID_ENDP2_TXADDR0, CCID_ENDP2_TXADDR1);
+    SetEPDblBuffCount (ENDP2, EP_DBUF_IN, 0);
+    ClearDTOG_TX (ENDP2);
+    ClearDTOG_RX (ENDP2);
+    SetEPRxStatus (ENDP2, EP_RX_DIS);
+    SetEPTxStatus (ENDP2, EP_TX_VALID);
+
+    SetEPType (ENDP3, EP_BULK);
+    SetEPDoubleBuff (ENDP3);
+    SetEPDblBuffAddr (ENDP3, CCID_ENDP3_RXADDR0, CCID_ENDP3_RXADDR1);
+    SetEPDblBuffCount (ENDP3, EP_DBUF_OUT, BULK_MAX_PACKET_SIZE);
+    ClearDTOG_RX (ENDP3);
+    ClearDTOG_TX (ENDP3);
+    ToggleDTOG_TX (ENDP3);
+    SetEPTxStatus (ENDP3, EP_TX_DIS);
+    SetEPRxStatus (ENDP3, EP_RX_VALID);
+
+    CCID_InitBulkTransfer ();
+}
+
+/*******************************************************************************
+
+  CCIDT_Endpoints
+
+  Walk the configuration descriptor for the bulk endpoints of the CCID
+  interface, then send a packet to the old bulk OUT endpoint
+
+*******************************************************************************/
+
+static void CCIDT_Endpoints (void)
+{
+    uint8_t cPacket[BULK_MAX_PACKET_SIZE];
+    uint8_t cBulkOut = 0;
+    uint8_t cBulkIn = 0;
+    int nCcidInterface = 0;
+    int i;
+
+    for (i = 0; i + 1 < CCID_SIZ_CONFIG_DESC; i += CCID_ConfigDescriptor[i])
+    {
+        if (0 == CCID_ConfigDescriptor[i])
+        {
+            break;      // a broken descriptor, the check below fails
+        }
+        if (CCIDT_DESC_INTERFACE == CCID_ConfigDescriptor[i + 1])
+        {
+            nCcidInterface = (CCIDT_CLASS_CCID == CCID_ConfigDescriptor[i + 5]);
+        }
+        else if (nCcidInterface && (CCIDT_DESC_ENDPOINT == CCID_ConfigDescriptor[i + 1]) && (CCIDT_EP_BULK == (CCID_ConfigDescriptor[i + 3] & 0x03)))
+        {
+            if (0 != (CCID_ConfigDescriptor[i + 2] & CCIDT_EP_IN))
+            {
+                cBulkIn = CCID_ConfigDescriptor[i + 2];
+            }
+            else
+            {
+                cBulkOut = CCID_ConfigDescriptor[i + 2];
+            }
+        }
+    }
+
+    if ((CCIDT_BULK_OUT != cBulkOut) || (CCIDT_BULK_IN != cBulkIn))
+    {
+        printf ("endpoints: bulk OUT 0x%02x IN 0x%02x, expected 0x%02x 0x%02x\n", cBulkOut, cBulkIn, CCIDT_BULK_OUT, CCIDT_BULK_IN);
+        nCcidtErrors++;
+    }
+
+    // Endpoint register 2 only sends, its OUT direction is disabled
+    memset (cPacket, 0, USB_MESSAGE_HEADER_SIZE);
+    cPacket[OFFSET_BMESSAGETYPE] = PC_TO_RDR_GETSLOTSTATUS;
+    if (0 != HOST_UsbOut (ENDP2, cPacket, USB_MESSAGE_HEADER_SIZE))
+    {
+        printf ("endpoints: a packet to the old bulk OUT endpoint 0x%02x was taken\n", CCIDT_OLD_BULK_OUT);
+        nCcidtErrors++;
+    }
+    else
+    {
+        printf ("endpoints    bulk OUT 0x%02x IN 0x%02x, OUT 0x%02x NAKed\n", cBulkOut, cBulkIn, CCIDT_OLD_BULK_OUT);
+    }
+}
+
+/*******************************************************************************
+
+  CCIDT_SetMessage
+
+  Build a command message with the next bSeq
+
+*******************************************************************************/
+
+static void CCIDT_SetMessage (typeCcidtMessage * pMessage, uint8_t cType, const uint8_t * pData, int nLength)
+{
+    memset (pMessage->cData, 0, USB_MESSAGE_HEADER_SIZE);
+    pMessage->cData[OFFSET_BMESSAGETYPE] = cType;
+    pMessage->cData[OFFSET_DWLENGTH] = (uint8_t) nLength;
+    pMessage->cData[OFFSET_DWLENGTH + 1] = (uint8_t) (nLength >> 8);
+    pMessage->cData[OFFSET_BSEQ] = cCcidtSequence++;
+    if (0 < nLength)
+    {
+        memcpy (&pMessage->cData[OFFSET_ABDATA], pData, nLength);
+    }
+    pMessage->nLength = USB_MESSAGE_HEADER_SIZE + nLength;
+}
+
+/*******************************************************************************
+
+  CCIDT_Transfer
+
+  Send nMessages commands back-to-back and receive their answers, a short
+  packet ends an answer. Returns 0 or -1 if the transfer stalled.
+
+*******************************************************************************/
+
+static int CCIDT_Transfer (int nMessages, typeCcidtStats * pStats)
+{
+    uint8_t cPacket[BULK_MAX_PACKET_SIZE];
+    typeCcidtMessage* pAnswer;
+    uint64_t nStart;
+    uint64_t nCard;
+    int nOut = 0;
+    int nOutPos = 0;
+    int nIn = 0;
+    int nIdle = 0;
+    int nMoved;
+    int nSize;
+
+    memset (pStats, 0, sizeof (*pStats));
+    memset (tCcidtAnswers, 0, nMessages * sizeof (tCcidtAnswers[0]));
+
+    while (nIn < nMessages)
+    {
+        nMoved = 0;
+
+        // The host sends as long as endpoint 3 takes the packets
+        while (nOut < nMessages)
+        {
+            nSize = tCcidtCommands[nOut].nLength - nOutPos;
+            if (BULK_MAX_PACKET_SIZE < nSize)
+            {
+                nSize = BULK_MAX_PACKET_SIZE;
+            }
+            nStart = CCIDT_Ns ();
+            if (0 == HOST_UsbOut (ENDP3, &tCcidtCommands[nOut].cData[nOutPos], nSize))
+            {
+                pStats->nNaks++;
+                break;
+            }
+            if ((0 == nOutPos) && (nIn < nOut))
+            {
+                pStats->nOverlapped++;
+            }
+            CCID_BulkOutMessage ();
+            pStats->nBulkNs += CCIDT_Ns () - nStart;
+            pStats->nPacketsOut++;
+            nMoved = 1;
+
+            nOutPos += nSize;
+            if (tCcidtCommands[nOut].nLength == nOutPos)
+            {
+                nOut++;
+                nOutPos = 0;
+            }
+        }
+
+        // and reads the packets of endpoint 2
+        while (nIn < nMessages)
+        {
+            nStart = CCIDT_Ns ();
+            nSize = HOST_UsbIn (ENDP2, cPacket);
+            if (0 > nSize)
+            {
+                break;
+            }
+            CCID_BulkInMessage ();
+            pStats->nBulkNs += CCIDT_Ns () - nStart;
+            pStats->nPacketsIn++;
+            nMoved = 1;
+
+            pAnswer = &tCcidtAnswers[nIn];
+            if ((int) sizeof (pAnswer->cData) >= pAnswer->nLength + nSize)
+            {
+                memcpy (&pAnswer->cData[pAnswer->nLength], cPacket, nSize);
+                pAnswer->nLength += nSize;
+            }
+            if (BULK_MAX_PACKET_SIZE > nSize)
+            {
+                nIn++;
+            }
+        }
+
+        if (0 != nMoved)
+        {
+            nIdle = 0;
+            continue;
+        }
+
+        nIdle++;
+        if (CCIDT_MAX_IDLE_LOOPS < nIdle)
+        {
+            fprintf (stderr, "transfer stalled after %d of %d commands and %d answers\n", nOut, nMessages, nIn);
+            return (-1);
+        }
+
+        nStart = CCIDT_Ns ();
+        nCard = HOST_CardBackendNs ();
+        CCID_CheckUsbCommunication ();
+        pStats->nDispatchNs += CCIDT_Ns () - nStart - (HOST_CardBackendNs () - nCard);
+    }
+    return (0);
+}
+
+/*******************************************************************************
+
+  CCIDT_CheckAnswer
+
+  Message type, bSeq and length of an answer, returns 0 or -1
+
+*******************************************************************************/
+
+static int CCIDT_CheckAnswer (const char* szTest, int nMessage, uint8_t cType)
+{
+    const typeCcidtMessage* pAnswer = &tCcidtAnswers[nMessage];
+    int nLength;
+
+    if (USB_MESSAGE_HEADER_SIZE > pAnswer->nLength)
+    {
+        fprintf (stderr, "%s %d: answer of %d bytes\n", szTest, nMessage, pAnswer->nLength);
+        nCcidtErrors++;
+        return (-1);
+    }
+
+    nLength = pAnswer->cData[OFFSET_DWLENGTH] | (pAnswer->cData[OFFSET_DWLENGTH + 1] << 8);
+    if ((cType != pAnswer->cData[OFFSET_BMESSAGETYPE]) || (tCcidtCommands[nMessage].cData[OFFSET_BSEQ] != pAnswer->cData[OFFSET_BSEQ]) ||
+        (USB_MESSAGE_HEADER_SIZE + nLength != pAnswer->nLength))
+    {
+        fprintf (stderr, "%s %d: answer type %02x seq %u length %d, expected type %02x seq %u\n", szTest, nMessage, pAnswer->cData[OFFSET_BMESSAGETYPE],
+                 pAnswer->cData[OFFSET_BSEQ], pAnswer->nLength, cType, tCcidtCommands[nMessage].cData[OFFSET_BSEQ]);
+        nCcidtErrors++;
+        return (-1);
+    }
+    return (0);
+}
+
+/*******************************************************************************
+
+  CCIDT_Print
+
+*******************************************************************************/
+
+static void CCIDT_Print (const char* szTest, int nMessages, const typeCcidtStats * pStats)
+{
+    printf ("%-12s %3d messages  %5.2f packets out  %5.2f in  %5.2f NAKs  %3u overlapped  bulk %6.2f us  dispatch %7.2f us per message\n", szTest,
+            nMessages, (double) pStats->nPacketsOut / nMessages, (double) pStats->nPacketsIn / nMessages, (double) pStats->nNaks / nMessages,
+            pStats->nOverlapped, pStats->nBulkNs / 1000.0 / nMessages, pStats->nDispatchNs / 1000.0 / nMessages);
+}
+
+/*******************************************************************************
+
+  CCIDT_SlotStatus
+
+*******************************************************************************/
+
+static void CCIDT_SlotStatus (int nMessages)
+{
+    typeCcidtStats tStats;
+    int i;
+
+    for (i = 0; i < nMessages; i++)
+    {
+        CCIDT_SetMessage (&tCcidtCommands[i], PC_TO_RDR_GETSLOTSTATUS, NULL, 0);
+    }
+    if (0 != CCIDT_Transfer (nMessages, &tStats))
+    {
+        nCcidtErrors++;
+        return;
+    }
+    for (i = 0; i < nMessages; i++)
+    {
+        CCIDT_CheckAnswer ("slot status", i, RDR_TO_PC_SLOTSTATUS);
+    }
+    CCIDT_Print ("slot status", nMessages, &tStats);
+}
+
+/*******************************************************************************
+
+  CCIDT_XfrBlock
+
+  SELECT of an unknown application, the card answers with a status word
+
+*******************************************************************************/
+
+static void CCIDT_XfrBlock (int nMessages)
+{
+    uint8_t cApdu[CCIDT_XFR_APDU];
+    typeCcidtStats tStats;
+    int i;
+
+    CCIDT_SetMessage (&tCcidtCommands[0], PC_TO_RDR_ICCPOWERON, NULL, 0);
+    if ((0 != CCIDT_Transfer (1, &tStats)) || (0 != CCIDT_CheckAnswer ("power on", 0, RDR_TO_PC_DATABLOCK)))
+    {
+        nCcidtErrors++;
+        return;
+    }
+
+    cApdu[0] = 0x00;
+    cApdu[1] = 0xA4;
+    cApdu[2] = 0x04;
+    cApdu[3] = 0x00;
+    cApdu[4] = CCIDT_XFR_APDU - 5;
+    for (i = 5; i < CCIDT_XFR_APDU; i++)
+    {
+        cApdu[i] = (uint8_t) i;
+    }
+
+    for (i = 0; i < nMessages; i++)
+    {
+        CCIDT_SetMessage (&tCcidtCommands[i], PC_TO_RDR_XFRBLOCK, cApdu, sizeof (cApdu));
+    }
+    if (0 != CCIDT_Transfer (nMessages, &tStats))
+    {
+        nCcidtErrors++;
+        return;
+    }
+    for (i = 0; i < nMessages; i++)
+    {
+        if ((0 == CCIDT_CheckAnswer ("xfr block", i, RDR_TO_PC_DATABLOCK)) && (USB_MESSAGE_HEADER_SIZE + 2 > tCcidtAnswers[i].nLength))
+        {
+            fprintf (stderr, "xfr block %d: no status word\n", i);
+            nCcidtErrors++;
+        }
+    }
+    CCIDT_Print ("xfr block", nMessages, &tStats);
+}
+
+/*******************************************************************************
+
+  CCIDT_ChainedXfrBlock
+
+  SELECT longer than an I-block, the card rejects the first block up to
+  CCID_TPDU_MAX_RESENDS times. One more rejection fails the command.
+
+*******************************************************************************/
+
+static void CCIDT_ChainedXfrBlock (void)
+{
+    uint8_t cApdu[CCIDT_CHAINED_APDU];
+    typeCcidtStats tStats;
+    uint32_t nRejects;
+    int nFailed;
+    int i;
+
+    cApdu[0] = 0x00;
+    cApdu[1] = 0xA4;
+    cApdu[2] = 0x04;
+    cApdu[3] = 0x00;
+    cApdu[4] = CCIDT_CHAINED_APDU - CCID_DATA;
+    for (i = CCID_DATA; i < CCIDT_CHAINED_APDU; i++)
+    {
+        cApdu[i] = (uint8_t) i;
+    }
+
+    for (nRejects = 0; nRejects <= CCID_TPDU_MAX_RESENDS + 1; nRejects++)
+    {
+        HOST_CardRejectBlocks (nRejects);
+        CCIDT_SetMessage (&tCcidtCommands[0], PC_TO_RDR_XFRBLOCK, cApdu, sizeof (cApdu));
+        if ((0 != CCIDT_Transfer (1, &tStats)) || (0 != CCIDT_CheckAnswer ("chained xfr", 0, RDR_TO_PC_DATABLOCK)))
+        {
+            nCcidtErrors++;
+            break;
+        }
+
+        nFailed = (0 != (tCcidtAnswers[0].cData[OFFSET_BSTATUS] & CCIDT_STATUS_FAILED));
+        if ((CCID_TPDU_MAX_RESENDS < nRejects) != nFailed)
+        {
+            fprintf (stderr, "chained xfr with %u rejected blocks: %s\n", nRejects, nFailed ? "failed" : "no error");
+            nCcidtErrors++;
+        }
+        else if (!nFailed && (USB_MESSAGE_HEADER_SIZE + 2 != tCcidtAnswers[0].nLength))
+        {
+            fprintf (stderr, "chained xfr with %u rejected blocks: no status word\n", nRejects);
+            nCcidtErrors++;
+        }
+    }
+    HOST_CardRejectBlocks (0);
+
+    printf ("%-12s %u rejected blocks repeated\n", "chained xfr", CCID_TPDU_MAX_RESENDS);
+}
+
+/*******************************************************************************
+
+  CCIDT_ReportCrc
+
+*******************************************************************************/
+
+static uint32_t CCIDT_ReportCrc (const uint8_t * pReport)
+{
+    CRC_ResetDR ();
+    return (CRC_CalcBlockCRC ((uint32_t *) pReport, KEYBOARD_FEATURE_COUNT / 4 - 1));
+}
+
+/*******************************************************************************
+
+  CCIDT_CheckEscape
+
+  The answer of an escape with nReports reports, the commands are in
+  the command message. Returns 0 or -1.
+
+*******************************************************************************/
+
+static int CCIDT_CheckEscape (int nMessage, int nReports, uint8_t cStatus)
+{
+    const uint8_t* pCommand = &tCcidtCommands[nMessage].cData[OFFSET_ABDATA + 1];
+    const uint8_t* pAnswer = &tCcidtAnswers[nMessage].cData[OFFSET_ABDATA + 1];
+    uint32_t nCommandCrc;
+    uint32_t nCrc;
+    int i;
+
+    if (0 != CCIDT_CheckAnswer ("escape", nMessage, RDR_TO_PC_ESCAPE))
+    {
+        return (-1);
+    }
+    if (USB_MESSAGE_HEADER_SIZE + ((0 < nReports) ? 1 + nReports * KEYBOARD_FEATURE_COUNT : 0) != tCcidtAnswers[nMessage].nLength)
+    {
+        fprintf (stderr, "escape %d: answer of %d bytes for %d reports\n", nMessage, tCcidtAnswers[nMessage].nLength, nReports);
+        nCcidtErrors++;
+        return (-1);
+    }
+
+    for (i = 0; i < nReports; i++)
+    {
+        // The answer carries the CRC calculated over the command
+        memcpy (&nCommandCrc, &pAnswer[OUTPUT_CMD_CRC_OFFSET], 4);
+        memcpy (&nCrc, &pAnswer[OUTPUT_CRC_OFFSET], 4);
+        if ((pCommand[CMD_TYPE_OFFSET] != pAnswer[OUTPUT_CMD_TYPE_OFFSET]) || (cStatus != pAnswer[OUTPUT_CMD_STATUS_OFFSET]) ||
+            (CCIDT_ReportCrc (pCommand) != nCommandCrc) || (CCIDT_ReportCrc (pAnswer) != nCrc))
+        {
+            fprintf (stderr, "escape %d report %d: command %02x status %u, expected command %02x status %u or a bad CRC\n", nMessage, i,
+                     pAnswer[OUTPUT_CMD_TYPE_OFFSET], pAnswer[OUTPUT_CMD_STATUS_OFFSET], pCommand[CMD_TYPE_OFFSET], cStatus);
+            nCcidtErrors++;
+            return (-1);
+        }
+        pCommand += KEYBOARD_FEATURE_COUNT;
+        pAnswer += KEYBOARD_FEATURE_COUNT;
+    }
+    return (0);
+}
+
+/*******************************************************************************
+
+  CCIDT_Escape
+
+  Escape messages with 1 to IFD_ESCAPE_MAX_REPORTS reports of commands
+  with and without the card, one with a second report cut short and one
+  with a wrong report CRC
+
+*******************************************************************************/
+
+static void CCIDT_Escape (void)
+{
+    static const uint8_t cCommands[] = { CMD_GET_STATUS, CMD_GET_PASSWORD_RETRY_COUNT, CMD_GET_USER_PASSWORD_RETRY_COUNT };
+    uint8_t cData[1 + IFD_ESCAPE_MAX_REPORTS * KEYBOARD_FEATURE_COUNT];
+    typeCcidtStats tStats;
+    uint8_t* pReport;
+    uint32_t nCrc;
+    int nReports;
+    int i;
+
+    cData[0] = IFD_ESCAPE_REPORT_COMMANDS;
+    memset (&cData[1], 0, sizeof (cData) - 1);
+    for (i = 0; i < IFD_ESCAPE_MAX_REPORTS; i++)
+    {
+        pReport = &cData[1 + i * KEYBOARD_FEATURE_COUNT];
+        pReport[CMD_TYPE_OFFSET] = cCommands[i % sizeof (cCommands)];
+        nCrc = CCIDT_ReportCrc (pReport);
+        memcpy (&pReport[OUTPUT_CRC_OFFSET], &nCrc, 4);
+    }
+
+    for (nReports = 1; nReports <= IFD_ESCAPE_MAX_REPORTS; nReports++)
+    {
+        CCIDT_SetMessage (&tCcidtCommands[nReports - 1], PC_TO_RDR_ESCAPE, cData, 1 + nReports * KEYBOARD_FEATURE_COUNT);
+    }
+    CCIDT_SetMessage (&tCcidtCommands[CCIDT_ESCAPE_BAD_LENGTH], PC_TO_RDR_ESCAPE, cData, 1 + KEYBOARD_FEATURE_COUNT + KEYBOARD_FEATURE_COUNT / 2);
+    CCIDT_SetMessage (&tCcidtCommands[CCIDT_ESCAPE_BAD_CRC], PC_TO_RDR_ESCAPE, cData, 1 + KEYBOARD_FEATURE_COUNT);
+    tCcidtCommands[CCIDT_ESCAPE_BAD_CRC].cData[OFFSET_ABDATA + 1 + OUTPUT_CRC_OFFSET] ^= 0x01;
+
+    if (0 != CCIDT_Transfer (CCIDT_ESCAPE_MESSAGES, &tStats))
+    {
+        nCcidtErrors++;
+        return;
+    }
+    for (nReports = 1; nReports <= IFD_ESCAPE_MAX_REPORTS; nReports++)
+    {
+        CCIDT_CheckEscape (nReports - 1, nReports, CMD_STATUS_OK);
+    }
+    CCIDT_CheckEscape (CCIDT_ESCAPE_BAD_LENGTH, 0, CMD_STATUS_OK);
+    CCIDT_CheckEscape (CCIDT_ESCAPE_BAD_CRC, 1, CMD_STATUS_WRONG_CRC);
+    CCIDT_Print ("escape", CCIDT_ESCAPE_MESSAGES, &tStats);
+}
+
+/*******************************************************************************
+
+  CCIDT_SetReport
+
+  A report of the HID command set with its CRC
+
+*******************************************************************************/
+
+static void CCIDT_SetReport (uint8_t * pReport, uint8_t cType)
+{
+    uint32_t nCrc;
+
+    pReport[CMD_TYPE_OFFSET] = cType;
+    nCrc = CCIDT_ReportCrc (pReport);
+    memcpy (&pReport[OUTPUT_CRC_OFFSET], &nCrc, 4);
+}
+
+/*******************************************************************************
+
+  CCIDT_CheckStream
+
+  The answer of an escape with a streamed object, returns 0 or -1
+
+*******************************************************************************/
+
+static int CCIDT_CheckStream (int nMessage, uint8_t cStatus)
+{
+    const uint8_t* pAnswer = &tCcidtAnswers[nMessage].cData[OFFSET_ABDATA];
+    uint32_t nCrc;
+
+    if (0 != CCIDT_CheckAnswer ("escape stream", nMessage, RDR_TO_PC_ESCAPE))
+    {
+        return (-1);
+    }
+
+    memcpy (&nCrc, &pAnswer[1 + OUTPUT_CRC_OFFSET], 4);
+    if ((USB_MESSAGE_HEADER_SIZE + 1 + KEYBOARD_FEATURE_COUNT != tCcidtAnswers[nMessage].nLength) || (IFD_ESCAPE_STREAM_OBJECT != pAnswer[0]) ||
+        (CMD_STREAM_OPEN != pAnswer[1 + OUTPUT_CMD_TYPE_OFFSET]) || (cStatus != pAnswer[1 + OUTPUT_CMD_STATUS_OFFSET]) ||
+        (CCIDT_ReportCrc (&pAnswer[1]) != nCrc))
+    {
+        fprintf (stderr, "escape stream %d: answer of %d bytes status %u, expected status %u or a bad CRC\n", nMessage, tCcidtAnswers[nMessage].nLength,
+                 pAnswer[1 + OUTPUT_CMD_STATUS_OFFSET], cStatus);
+        nCcidtErrors++;
+        return (-1);
+    }
+    if ((CMD_STATUS_OK == cStatus) && (CCIDT_OTP_OBJECT != pAnswer[1 + OUTPUT_CMD_RESULT_OFFSET]))
+    {
+        fprintf (stderr, "escape stream %d: %u bytes received\n", nMessage, pAnswer[1 + OUTPUT_CMD_RESULT_OFFSET]);
+        nCcidtErrors++;
+        return (-1);
+    }
+    return (0);
+}
+
+/*******************************************************************************
+
+  CCIDT_EscapeStream
+
+  Escape frames with a whole OTP slot object, the frame is longer than a
+  report
+
+*******************************************************************************/
+
+static void CCIDT_EscapeStream (void)
+{
+    static const uint8_t cTempPassword[25] = "escape temp password";
+    uint8_t cReports[2][1 + KEYBOARD_FEATURE_COUNT];
+    uint8_t cFrame[1 + STREAM_OBJECT_HEADER_LENGTH + CCIDT_OTP_OBJECT];
+    uint32_t nObject[(CCIDT_OTP_OBJECT + 3) / 4];
+    cmd_stream_open_payload* pHeader = (cmd_stream_open_payload *) &cFrame[1];
+    typeCcidtStats tStats;
+    const uint8_t* pName;
+
+    // Admin authentication and the read back in the report format
+    memset (cReports, 0, sizeof (cReports));
+    cReports[0][0] = IFD_ESCAPE_REPORT_COMMANDS;
+    memcpy (&cReports[0][1 + 1], HOST_CARD_ADMIN_PIN, strlen (HOST_CARD_ADMIN_PIN));
+    memcpy (&cReports[0][1 + 26], cTempPassword, sizeof (cTempPassword));
+    CCIDT_SetReport (&cReports[0][1], CMD_FIRST_AUTHENTICATE);
+    cReports[1][0] = IFD_ESCAPE_REPORT_COMMANDS;
+    cReports[1][1 + 1] = CCIDT_STREAM_SLOT;
+    CCIDT_SetReport (&cReports[1][1], CMD_READ_SLOT);
+
+    // Name, secret and the rest zero, the CRC over the zero padded words
+    memset (nObject, 0, sizeof (nObject));
+    memcpy (nObject, CCIDT_STREAM_NAME, strlen (CCIDT_STREAM_NAME));
+    memset ((uint8_t *) nObject + 15, 0x5A, SECRET_LENGTH_DEFINE);
+
+    memset (cFrame, 0, sizeof (cFrame));
+    cFrame[0] = IFD_ESCAPE_STREAM_OBJECT;
+    memcpy (pHeader->temporary_admin_password, cTempPassword, sizeof (cTempPassword));
+    pHeader->target = STREAM_TARGET_OTP_SLOT;
+    pHeader->slot_number = CCIDT_STREAM_SLOT;
+    pHeader->length = CCIDT_OTP_OBJECT;
+    CRC_ResetDR ();
+    pHeader->object_crc = CRC_CalcBlockCRC (nObject, (CCIDT_OTP_OBJECT + 3) / 4);
+    memcpy (&cFrame[1 + STREAM_OBJECT_HEADER_LENGTH], nObject, CCIDT_OTP_OBJECT);
+
+    CCIDT_SetMessage (&tCcidtCommands[CCIDT_STREAM_AUTH], PC_TO_RDR_ESCAPE, cReports[0], sizeof (cReports[0]));
+    CCIDT_SetMessage (&tCcidtCommands[CCIDT_STREAM_OBJECT], PC_TO_RDR_ESCAPE, cFrame, sizeof (cFrame));
+    CCIDT_SetMessage (&tCcidtCommands[CCIDT_STREAM_READ], PC_TO_RDR_ESCAPE, cReports[1], sizeof (cReports[1]));
+    pHeader->object_crc ^= 0x01;
+    CCIDT_SetMessage (&tCcidtCommands[CCIDT_STREAM_BAD_CRC], PC_TO_RDR_ESCAPE, cFrame, sizeof (cFrame));
+    pHeader->object_crc ^= 0x01;
+    CCIDT_SetMessage (&tCcidtCommands[CCIDT_STREAM_SHORT], PC_TO_RDR_ESCAPE, cFrame, sizeof (cFrame) - 1);
+
+    if (0 != CCIDT_Transfer (CCIDT_STREAM_MESSAGES, &tStats))
+    {
+        nCcidtErrors++;
+        return;
+    }
+
+    CCIDT_CheckEscape (CCIDT_STREAM_AUTH, 1, CMD_STATUS_OK);
+    CCIDT_CheckStream (CCIDT_STREAM_OBJECT, CMD_STATUS_OK);
+    if (0 == CCIDT_CheckEscape (CCIDT_STREAM_READ, 1, CMD_STATUS_OK))
+    {
+        pName = &tCcidtAnswers[CCIDT_STREAM_READ].cData[OFFSET_ABDATA + 1 + OUTPUT_CMD_RESULT_OFFSET];
+        if (0 != memcmp (pName, CCIDT_STREAM_NAME, strlen (CCIDT_STREAM_NAME) + 1))
+        {
+            fprintf (stderr, "escape stream: slot name \"%.15s\", expected \"%s\"\n", pName, CCIDT_STREAM_NAME);
+            nCcidtErrors++;
+        }
+    }
+    CCIDT_CheckStream (CCIDT_STREAM_BAD_CRC, CMD_STATUS_WRONG_CRC);
+    CCIDT_CheckStream (CCIDT_STREAM_SHORT, CMD_STATUS_STREAM_ERROR);
+    CCIDT_Print ("escape stream", CCIDT_STREAM_MESSAGES, &tStats);
+}
+
+/*******************************************************************************
+
+  main
+
+*******************************************************************************/
+
+int main (int argc, char* argv[])
+{
+    int nMessages = CCIDT_DEFAULT_MESSAGES;
+    int nOpt;
+
+    while (-1 != (nOpt = getopt (argc, argv, "n:")))
+    {
+        switch (nOpt)
+        {
+            case 'n':
+                nMessages = atoi (optarg);
+                break;
+            default:
+                fprintf (stderr, "usage: %s [-n messages]\n", argv[0]);
+                return (2);
+        }
+    }
+    if ((0 >= nMessages) || (CCIDT_MAX_MESSAGES < nMessages))
+    {
+        fprintf (stderr, "%s: 1 to %d messages\n", argv[0], CCIDT_MAX_MESSAGES);
+        return (2);
+    }
+
+    if (0 != HOST_DeviceOpen (NULL, HOST_DEFAULT_SERIAL))
+    {
+        fprintf (stderr, "can't map the flash image at 0x%08x\n", HOST_FLASH_BASE);
+        return (1);
+    }
+    CCIDT_InitEndpoints ();
+
+    CCIDT_Endpoints ();
+    CCIDT_SlotStatus (nMessages);
+    CCIDT_XfrBlock (nMessages);
+    CCIDT_ChainedXfrBlock ();
+    CCIDT_Escape ();
+    CCIDT_EscapeStream ();
+
+    HOST_DeviceClose ();
+
+    if (0 != nCcidtErrors)
+    {
+        fprintf (stderr, "%d errors\n", nCcidtErrors);
+        return (1);
+    }
+    return (0);
+}
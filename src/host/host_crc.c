@@ -0,0 +1,92 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Software version of the STM32 CRC unit: CRC-32 polynomial 0x04C11DB7,
+ * 32 bit words shifted in MSB first, no reflection and no final XOR
+ */
+
+#include "stm32f10x.h"
+#include "stm32f10x_crc.h"
+
+#define CRC_POLYNOMIAL      0x04C11DB7
+
+static uint32_t nCrcDR = 0xFFFFFFFF;
+
+/*******************************************************************************
+
+  CRC_ResetDR
+
+*******************************************************************************/
+
+void CRC_ResetDR (void)
+{
+    nCrcDR = 0xFFFFFFFF;
+}
+
+/*******************************************************************************
+
+  CRC_CalcCRC
+
+*******************************************************************************/
+
+uint32_t CRC_CalcCRC (uint32_t Data)
+{
+    int i;
+
+    nCrcDR ^= Data;
+    for (i = 0; i < 32; i++)
+    {
+        if (nCrcDR & 0x80000000)
+        {
+            nCrcDR = (nCrcDR << 1) ^ CRC_POLYNOMIAL;
+        }
+        else
+        {
+            nCrcDR <<= 1;
+        }
+    }
+    return (nCrcDR);
+}
+
+/*******************************************************************************
+
+  CRC_CalcBlockCRC
+
+*******************************************************************************/
+
+uint32_t CRC_CalcBlockCRC (uint32_t pBuffer[], uint32_t BufferLength)
+{
+    uint32_t i;
+
+    for (i = 0; i < BufferLength; i++)
+    {
+        CRC_CalcCRC (pBuffer[i]);
+    }
+    return (nCrcDR);
+}
+
+/*******************************************************************************
+
+  CRC_GetCRC
+
+*******************************************************************************/
+
+uint32_t CRC_GetCRC (void)
+{
+    return (nCrcDR);
+}
@@ -0,0 +1,124 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Device of the host build: the startup of main () with the smartcard at
+ * the modeled USART and the feature reports of the keyboard interface like Keyboard_SetReport_Feature () and
+ * Keyboard_GetReport_Feature (). A report is parsed when it is set, the
+ * answer is ready at the next get.
+ */
+
+#include <string.h>
+#include "stm32f10x.h"
+#include "CCIDHID_usb_desc.h"
+#include "hotp.h"
+#include "report_protocol.h"
+#include "HandleAesStorageKey.h"
+#include "profile.h"
+#include "perf_counters.h"
+#include "smartcard.h"
+#include "CCID_usb.h"
+#include "host.h"
+
+static uint8_t cSetReport[KEYBOARD_FEATURE_COUNT];
+static uint8_t cAnswer[KEYBOARD_FEATURE_COUNT];
+
+/*******************************************************************************
+
+  HOST_DeviceOpen
+
+  Map the flash image szImage (NULL = erased image in memory), set up the
+  card with the serial number nSerial and run the startup of main (), which
+  powers the card. Returns 0 or -1.
+
+*******************************************************************************/
+
+int HOST_DeviceOpen (const char* szImage, uint32_t nSerial)
+{
+    if (0 != HOST_FlashOpen (szImage))
+    {
+        return (-1);
+    }
+    if (0 != HOST_UsartOpen ())
+    {
+        HOST_FlashClose ();
+        return (-1);
+    }
+    if (0 != HOST_UsbOpen ())
+    {
+        HOST_UsartClose ();
+        HOST_FlashClose ();
+        return (-1);
+    }
+    HOST_CardInit (nSerial);
+    HOST_CardSetSerial (nSerial);
+    PROF_Init ();
+
+    check_backups ();
+    PERF_Init ();
+    SmartCardInitInterface ();
+    CCID_Init ();   // done by USB_Start ()
+    StartupCheck_u8 ();
+
+    memset (cAnswer, 0, sizeof (cAnswer));
+    return (0);
+}
+
+/*******************************************************************************
+
+  HOST_DeviceClose
+
+  Save the perf counters, unmap the USB peripheral, the USART and the flash
+
+*******************************************************************************/
+
+void HOST_DeviceClose (void)
+{
+    PERF_Flush ();
+    HOST_UsbClose ();
+    HOST_UsartClose ();
+    HOST_FlashClose ();
+}
+
+/*******************************************************************************
+
+  HOST_SetReport
+
+  Feature report from the host, KEYBOARD_FEATURE_COUNT bytes without a
+  report ID
+
+*******************************************************************************/
+
+void HOST_SetReport (const uint8_t* pReport)
+{
+    memcpy (cSetReport, pReport, KEYBOARD_FEATURE_COUNT);
+    parse_report (cSetReport, cAnswer);
+}
+
+/*******************************************************************************
+
+  HOST_GetReport
+
+  Answer of the last report, the first byte is the device status
+
+*******************************************************************************/
+
+const uint8_t* HOST_GetReport (void)
+{
+    cAnswer[0] = STATUS_READY;
+    return (cAnswer);
+}
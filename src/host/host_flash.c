@@ -0,0 +1,328 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Emulated flash of the host build
+ *
+ * The flash image is mapped twice: read only at the address of the target
+ * flash, so the firmware reads it as usual and a direct write faults, and
+ * writable for the FLASH_* functions. With an image file the mapping is
+ * shared with the file, otherwise the image is an erased memory file.
+ *
+ * Like the STM32F1 a halfword is programmed only when it is erased, except
+ * with 0x0000, so bits only go from 1 to 0. Erases and programs are counted
+ * per page and take the time of tHostFlashTiming, the busy flash stalls the
+ * firmware and the 1 ms timer goes on.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "stm32f10x.h"
+#include "ramfunc.h"
+#include "host.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE     0x100000
+#endif
+
+static uint8_t* pFlash = NULL;      // writable view
+static uint8_t cFlashLocked = 1;
+
+// STM32F103 datasheet: page erase 20 - 40 ms, halfword program 52.5 us
+// typical, 10000 erase cycles
+typeHostFlashTiming tHostFlashTiming = {
+    .nEraseNs = 20000000,
+    .nProgramNs = 52500,
+    .nEndurance = 10000,
+};
+
+static typeHostFlashStats tFlashStats;
+static uint64_t nFlashRestNs = 0;      // busy time below the next tick
+
+/*******************************************************************************
+
+  HOST_FlashOpen
+
+  Map the flash image szImage, which is created erased if it doesn't
+  exist. NULL maps an erased image without a file. Returns 0 or -1.
+
+*******************************************************************************/
+
+int HOST_FlashOpen (const char* szImage)
+{
+    struct stat tStat;
+    void* pView;
+    int nFile;
+    int nNew;
+
+    if (NULL == szImage)
+    {
+        nFile = memfd_create ("flash", 0);
+    }
+    else
+    {
+        nFile = open (szImage, O_RDWR | O_CREAT, 0600);
+    }
+    if (0 > nFile)
+    {
+        return (-1);
+    }
+
+    if ((0 != fstat (nFile, &tStat)) || (0 != ftruncate (nFile, HOST_FLASH_SIZE)))
+    {
+        close (nFile);
+        return (-1);
+    }
+    nNew = (HOST_FLASH_SIZE != tStat.st_size);
+
+    pFlash = mmap (NULL, HOST_FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, nFile, 0);
+    pView = mmap ((void *) HOST_FLASH_BASE, HOST_FLASH_SIZE, PROT_READ, MAP_SHARED | MAP_FIXED_NOREPLACE, nFile, 0);
+    close (nFile);
+
+    if ((MAP_FAILED == pFlash) || ((void *) HOST_FLASH_BASE != pView))
+    {
+        if (MAP_FAILED != pFlash)
+        {
+            munmap (pFlash, HOST_FLASH_SIZE);
+        }
+        if (MAP_FAILED != pView)
+        {
+            munmap (pView, HOST_FLASH_SIZE);
+        }
+        pFlash = NULL;
+        return (-1);
+    }
+
+    if (nNew)
+    {
+        memset (pFlash, 0xFF, HOST_FLASH_SIZE);
+    }
+    cFlashLocked = 1;
+    HOST_FlashResetStats ();
+    return (0);
+}
+
+/*******************************************************************************
+
+  HOST_FlashClose
+
+*******************************************************************************/
+
+void HOST_FlashClose (void)
+{
+    if (NULL == pFlash)
+    {
+        return;
+    }
+    munmap (pFlash, HOST_FLASH_SIZE);
+    munmap ((void *) HOST_FLASH_BASE, HOST_FLASH_SIZE);
+    pFlash = NULL;
+}
+
+/*******************************************************************************
+
+  HOST_FlashStats
+
+  Erases, programs and busy time since the last reset
+
+*******************************************************************************/
+
+const typeHostFlashStats* HOST_FlashStats (void)
+{
+    return (&tFlashStats);
+}
+
+/*******************************************************************************
+
+  HOST_FlashResetStats
+
+*******************************************************************************/
+
+void HOST_FlashResetStats (void)
+{
+    memset (&tFlashStats, 0, sizeof (tFlashStats));
+}
+
+/*******************************************************************************
+
+  HOST_FlashBusy
+
+  The flash is busy for nNs, the timer ticks on
+
+*******************************************************************************/
+
+static void HOST_FlashBusy (uint64_t nNs)
+{
+    tFlashStats.nBusyNs += nNs;
+    nFlashRestNs += nNs;
+    while (1000000 <= nFlashRestNs)
+    {
+        nFlashRestNs -= 1000000;
+        HOST_TimerTick ();
+    }
+}
+
+/*******************************************************************************
+
+  HOST_FlashOffset
+
+  Offset of a flash address in the image, -1 if the address isn't a
+  flash address with the given alignment
+
+*******************************************************************************/
+
+static int HOST_FlashOffset (uint32_t nAddress, uint32_t nAlign)
+{
+    if ((NULL == pFlash) || (HOST_FLASH_BASE > nAddress) || ((HOST_FLASH_BASE + HOST_FLASH_SIZE) <= nAddress) || (0 != (nAddress % nAlign)))
+    {
+        return (-1);
+    }
+    return (nAddress - HOST_FLASH_BASE);
+}
+
+/*******************************************************************************
+
+  FLASH_Unlock / FLASH_Lock
+
+*******************************************************************************/
+
+void FLASH_Unlock (void)
+{
+    cFlashLocked = 0;
+}
+
+void FLASH_Lock (void)
+{
+    cFlashLocked = 1;
+}
+
+/*******************************************************************************
+
+  FLASH_ErasePage
+
+*******************************************************************************/
+
+FLASH_Status FLASH_ErasePage (uint32_t Page_Address)
+{
+    int nOffset = HOST_FlashOffset (Page_Address, 1);
+
+    if ((0 > nOffset) || cFlashLocked)
+    {
+        return (FLASH_ERROR_WRP);
+    }
+
+    nOffset -= nOffset % HOST_FLASH_PAGE_SIZE;
+    memset (&pFlash[nOffset], 0xFF, HOST_FLASH_PAGE_SIZE);
+
+    tFlashStats.nErases[nOffset / HOST_FLASH_PAGE_SIZE]++;
+    HOST_FlashBusy (tHostFlashTiming.nEraseNs);
+    return (FLASH_COMPLETE);
+}
+
+/*******************************************************************************
+
+  FLASH_ProgramHalfWord
+
+  Like the target a halfword can only be programmed when erased, except
+  with 0x0000. A rejected program isn't done and takes no time.
+
+*******************************************************************************/
+
+FLASH_Status FLASH_ProgramHalfWord (uint32_t Address, uint16_t Data)
+{
+    int nOffset = HOST_FlashOffset (Address, 2);
+    uint16_t nOld;
+
+    if ((0 > nOffset) || cFlashLocked)
+    {
+        return (FLASH_ERROR_WRP);
+    }
+
+    memcpy (&nOld, &pFlash[nOffset], 2);
+    if ((0xFFFF != nOld) && (0x0000 != Data))
+    {
+        tFlashStats.nProgramErrors++;
+        return (FLASH_ERROR_PG);
+    }
+
+    memcpy (&pFlash[nOffset], &Data, 2);
+
+    tFlashStats.nPrograms[nOffset / HOST_FLASH_PAGE_SIZE]++;
+    HOST_FlashBusy (tHostFlashTiming.nProgramNs);
+    return (FLASH_COMPLETE);
+}
+
+/*******************************************************************************
+
+  FLASH_ProgramWord
+
+*******************************************************************************/
+
+FLASH_Status FLASH_ProgramWord (uint32_t Address, uint32_t Data)
+{
+    FLASH_Status nStatus;
+
+    nStatus = FLASH_ProgramHalfWord (Address, (uint16_t) Data);
+    if (FLASH_COMPLETE != nStatus)
+    {
+        return (nStatus);
+    }
+    return (FLASH_ProgramHalfWord (Address + 2, (uint16_t) (Data >> 16)));
+}
+
+/*******************************************************************************
+
+  RAM_Flash*
+
+  The flash operations executed from RAM on the target (ramfunc.c)
+
+*******************************************************************************/
+
+FLASH_Status RAM_FlashErasePage (uint32_t nAddress)
+{
+    return (FLASH_ErasePage (nAddress));
+}
+
+FLASH_Status RAM_FlashProgramHalfWord (uint32_t nAddress, uint16_t nData)
+{
+    return (FLASH_ProgramHalfWord (nAddress, nData));
+}
+
+FLASH_Status RAM_FlashProgramWord (uint32_t nAddress, uint32_t nData)
+{
+    return (FLASH_ProgramWord (nAddress, nData));
+}
+
+/*******************************************************************************
+
+  FLASH_PrefetchBufferCmd / FLASH_SetLatency
+
+  Flash access setup of the clock configuration, no effect
+
+*******************************************************************************/
+
+void FLASH_PrefetchBufferCmd (uint32_t FLASH_PrefetchBuffer)
+{
+}
+
+void FLASH_SetLatency (uint32_t FLASH_Latency)
+{
+}
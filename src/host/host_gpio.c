@@ -0,0 +1,143 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * LED and button stubs of the host build. The blink requests are counted
+ * per LED, the button is never pressed. The GPIO functions of smartcard.c
+ * pass the power and reset pins of the smartcard to host_sccard.c.
+ */
+
+#include "stm32f10x.h"
+#include "hw_config.h"
+#include "platform_config.h"
+#include "smartcard.h"
+#include "host.h"
+
+static uint32_t nBlinks[HOST_LEDS];
+static uint8_t cOathLed = 0;
+static uint8_t cSmartcardLed = 0;
+
+// Serial number of hw_config.c, set by the card of the host build
+__IO uint32_t cardSerial = 0;
+
+/*******************************************************************************
+
+  HOST_GetBlinks
+
+  Number of blinks requested for a LED since the startup
+
+*******************************************************************************/
+
+uint32_t HOST_GetBlinks (uint8_t cLed)
+{
+    if (HOST_LEDS <= cLed)
+    {
+        return (0);
+    }
+    return (nBlinks[cLed]);
+}
+
+/*******************************************************************************
+
+  LED functions of hw_config.c
+
+*******************************************************************************/
+
+void SwitchSmartcardLED (FunctionalState NewState)
+{
+    cSmartcardLed = (ENABLE == NewState);
+}
+
+void SwitchOATHLED (FunctionalState NewState)
+{
+    cOathLed = (ENABLE == NewState);
+}
+
+void ClearAllBlinking (void)
+{
+    SwitchOATHLED (DISABLE);
+    SwitchSmartcardLED (DISABLE);
+}
+
+void StartBlinkingOATHLED (uint16_t times)
+{
+    nBlinks[HOST_LED_OATH] += times;
+}
+
+void VerifyBlinkError (uint16_t times)
+{
+    nBlinks[HOST_LED_VERIFY_ERROR] += times;
+}
+
+void VerifyBlinkCorrect (uint16_t times)
+{
+    nBlinks[HOST_LED_VERIFY_CORRECT] += times;
+}
+
+uint8_t ReadButton (void)
+{
+    return (Bit_SET);   // released, the input has a pull up
+}
+
+/*******************************************************************************
+
+  HOST_GpioWrite
+
+  Output pins to the smartcard
+
+*******************************************************************************/
+
+static void HOST_GpioWrite (GPIO_TypeDef * GPIOx, uint16_t GPIO_Pin, uint8_t cLevel)
+{
+    if ((SMARTCARD_POWER_PORT == GPIOx) && (0 != (GPIO_Pin & (SMARTCARD_POWER_PIN_1 | SMARTCARD_POWER_PIN_2))))
+    {
+        HOST_CardPower (cLevel);
+    }
+    if ((GPIO_RESET == GPIOx) && (0 != (GPIO_Pin & SC_RESET)))
+    {
+        HOST_CardReset (cLevel);
+    }
+}
+
+/*******************************************************************************
+
+  GPIO functions of the standard peripheral library
+
+*******************************************************************************/
+
+void GPIO_Init (GPIO_TypeDef * GPIOx, GPIO_InitTypeDef * GPIO_InitStruct)
+{
+}
+
+void GPIO_PinRemapConfig (uint32_t GPIO_Remap, FunctionalState NewState)
+{
+}
+
+void GPIO_SetBits (GPIO_TypeDef * GPIOx, uint16_t GPIO_Pin)
+{
+    HOST_GpioWrite (GPIOx, GPIO_Pin, TRUE);
+}
+
+void GPIO_ResetBits (GPIO_TypeDef * GPIOx, uint16_t GPIO_Pin)
+{
+    HOST_GpioWrite (GPIOx, GPIO_Pin, FALSE);
+}
+
+void GPIO_WriteBit (GPIO_TypeDef * GPIOx, uint16_t GPIO_Pin, BitAction BitVal)
+{
+    HOST_GpioWrite (GPIOx, GPIO_Pin, (Bit_RESET != BitVal));
+}
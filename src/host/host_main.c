@@ -0,0 +1,272 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * nkhost, runs feature reports through parse_report
+ *
+ *   nkhost [-f flash image] [-l latency file] [-r recording] [-v] [script]
+ *
+ * A script line holds the bytes of a report in hex, starting with the
+ * command type. The rest of the report is zero, the CRC is added. For each
+ * report the answer is printed in hex. "tick <ms>" advances the clock,
+ * empty lines and lines starting with # are skipped.
+ *
+ * -l loads the latency model of the card (see HOST_CardLoadLatency ()),
+ * -v prints the APDUs and the modeled time of the card and its line per
+ * report to stderr. -r reads the traffic recorder by CMD_GET_RECORDING
+ * at the end and writes the records to a file for nkplay, the firmware
+ * has to be build with RECORDER=1.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "stm32f10x.h"
+#include "stm32f10x_crc.h"
+#include "CCIDHID_usb_desc.h"
+#include "report_protocol.h"
+#include "host.h"
+
+/*******************************************************************************
+
+  HOST_ParseLine
+
+  Read the hex bytes of a script line into a report, returns the count or
+  -1 on a syntax error
+
+*******************************************************************************/
+
+static int HOST_ParseLine (const char* szLine, uint8_t * pReport)
+{
+    unsigned int nByte;
+    int nCount = 0;
+    int nChars;
+
+    while (1 == sscanf (szLine, " %2x%n", &nByte, &nChars))
+    {
+        if (OUTPUT_CRC_OFFSET <= nCount)
+        {
+            return (-1);
+        }
+        pReport[nCount++] = (uint8_t) nByte;
+        szLine += nChars;
+    }
+
+    while ((' ' == *szLine) || ('\t' == *szLine) || ('\r' == *szLine) || ('\n' == *szLine))
+    {
+        szLine++;
+    }
+    return ((0 == *szLine) ? nCount : -1);
+}
+
+/*******************************************************************************
+
+  HOST_SendReport
+
+  Add the CRC to the report and run it through parse_report
+
+*******************************************************************************/
+
+static const uint8_t* HOST_SendReport (uint8_t * pReport)
+{
+    uint32_t nCrc;
+
+    CRC_ResetDR ();
+    nCrc = CRC_CalcBlockCRC ((uint32_t *) pReport, KEYBOARD_FEATURE_COUNT / 4 - 1);
+    memcpy (&pReport[OUTPUT_CRC_OFFSET], &nCrc, 4);
+
+    HOST_SetReport (pReport);
+    return (HOST_GetReport ());
+}
+
+/*******************************************************************************
+
+  HOST_ReadRecording
+
+  Write the records of the traffic recorder to szFile, returns 0 or -1
+
+*******************************************************************************/
+
+static int HOST_ReadRecording (const char* szFile)
+{
+    uint8_t cReport[KEYBOARD_FEATURE_COUNT];
+    const uint8_t* pAnswer;
+    uint8_t* pRecording = NULL;
+    uint32_t nLength = 0;
+    uint32_t nPosition = 0;
+    uint32_t nStart;
+    uint8_t cCount;
+    FILE* pFile;
+
+    do
+    {
+        memset (cReport, 0, sizeof (cReport));
+        cReport[0] = CMD_GET_RECORDING;
+        memcpy (&cReport[CMD_DATA_OFFSET], &nPosition, 4);
+        pAnswer = HOST_SendReport (cReport);
+        if (CMD_STATUS_OK != pAnswer[OUTPUT_CMD_STATUS_OFFSET])
+        {
+            fprintf (stderr, "no traffic recorder, build with RECORDER=1\n");
+            free (pRecording);
+            return (-1);
+        }
+
+        memcpy (&nStart, &pAnswer[OUTPUT_CMD_RESULT_OFFSET], 4);
+        cCount = pAnswer[OUTPUT_CMD_RESULT_OFFSET + 4];
+        if (nStart != nPosition)
+        {
+            // The position has been dropped, start again at the oldest record
+            nLength = 0;
+        }
+
+        pRecording = realloc (pRecording, nLength + cCount + 1);
+        if (NULL == pRecording)
+        {
+            return (-1);
+        }
+        memcpy (&pRecording[nLength], &pAnswer[OUTPUT_CMD_RESULT_OFFSET + 5], cCount);
+        nLength += cCount;
+        nPosition = nStart + cCount;
+    }
+    while (0 < cCount);
+
+    pFile = fopen (szFile, "wb");
+    if ((NULL == pFile) || (nLength != fwrite (pRecording, 1, nLength, pFile)))
+    {
+        perror (szFile);
+        free (pRecording);
+        return (-1);
+    }
+    fclose (pFile);
+    free (pRecording);
+    return (0);
+}
+
+/*******************************************************************************
+
+  main
+
+*******************************************************************************/
+
+int main (int argc, char* argv[])
+{
+    uint8_t cReport[KEYBOARD_FEATURE_COUNT];
+    const uint8_t* pAnswer;
+    const char* szImage = NULL;
+    const char* szLatency = NULL;
+    const char* szRecording = NULL;
+    char szLine[512];
+    FILE* pScript = stdin;
+    unsigned int nMs;
+    uint32_t nApdus;
+    uint64_t nLineNs;
+    int nVerbose = FALSE;
+    int nLine = 0;
+    int nOpt;
+    int i;
+
+    while (-1 != (nOpt = getopt (argc, argv, "f:l:r:v")))
+    {
+        switch (nOpt)
+        {
+            case 'f':
+                szImage = optarg;
+                break;
+            case 'l':
+                szLatency = optarg;
+                break;
+            case 'r':
+                szRecording = optarg;
+                break;
+            case 'v':
+                nVerbose = TRUE;
+                break;
+            default:
+                fprintf (stderr, "usage: %s [-f flash image] [-l latency file] [-r recording] [-v] [script]\n", argv[0]);
+                return (2);
+        }
+    }
+
+    if ((optind < argc) && (NULL == (pScript = fopen (argv[optind], "r"))))
+    {
+        perror (argv[optind]);
+        return (2);
+    }
+
+    if ((NULL != szLatency) && (0 != HOST_CardLoadLatency (szLatency)))
+    {
+        return (2);
+    }
+
+    if (0 != HOST_DeviceOpen (szImage, HOST_DEFAULT_SERIAL))
+    {
+        fprintf (stderr, "can't map the flash image at 0x%08x\n", HOST_FLASH_BASE);
+        return (1);
+    }
+
+    while (NULL != fgets (szLine, sizeof (szLine), pScript))
+    {
+        nLine++;
+        if (1 == sscanf (szLine, " tick %u", &nMs))
+        {
+            HOST_Wait (nMs);
+            continue;
+        }
+
+        if ('#' == szLine[strspn (szLine, " \t")])
+        {
+            continue;
+        }
+
+        memset (cReport, 0, sizeof (cReport));
+        i = HOST_ParseLine (szLine, cReport);
+        if (0 > i)
+        {
+            fprintf (stderr, "line %d: syntax error\n", nLine);
+            return (1);
+        }
+        if (0 == i)
+        {
+            continue;
+        }
+
+        nApdus = HOST_CardApdus ();
+        nLineNs = HOST_UsartTimeNs ();
+
+        pAnswer = HOST_SendReport (cReport);
+
+        if (nVerbose)
+        {
+            fprintf (stderr, "line %d: %u APDUs, card %.3f ms\n", nLine, HOST_CardApdus () - nApdus, (HOST_UsartTimeNs () - nLineNs) / 1000000.0);
+        }
+
+        for (i = 0; i < KEYBOARD_FEATURE_COUNT; i++)
+        {
+            printf ("%02x", pAnswer[i]);
+        }
+        printf ("\n");
+    }
+
+    if ((NULL != szRecording) && (0 != HOST_ReadRecording (szRecording)))
+    {
+        return (1);
+    }
+
+    HOST_DeviceClose ();
+    return (0);
+}
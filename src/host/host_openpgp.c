@@ -0,0 +1,680 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Software OpenPGP card of the host build
+ *
+ * Card backend which answers the APDUs of an OpenPGP card V2.1 with the
+ * default PINs: SELECT, GET DATA, VERIFY, CHANGE REFERENCE DATA, RESET
+ * RETRY COUNTER, PUT DATA, PSO:DECIPHER with the AES key (DO D5), GET
+ * CHALLENGE, TERMINATE DF and ACTIVATE FILE. There are no RSA keys, the
+ * random numbers are a fixed sequence.
+ */
+
+#include <string.h>
+#include "stm32f10x.h"
+#include "CcidLocalAccess.h"
+#include "aes.h"
+#include "host.h"
+
+#define PGP_PIN_MAX             32
+#define PGP_RETRIES             3
+#define PGP_DO_MAX              64
+
+// VERIFY P2
+#define PGP_PW1_81              0x81    // PW1 for PSO:CDS
+#define PGP_PW1_82              0x82    // PW1 for the other commands
+#define PGP_PW3                 0x83
+
+#define PGP_VERIFIED(n)         (1 << ((n) & 0x03))
+
+typedef struct
+{
+    uint8_t cPin[PGP_PIN_MAX];
+    uint8_t cLength;
+    uint8_t cMinLength;
+    uint8_t cRetries;
+} typePgpPin;
+
+typedef struct
+{
+    uint16_t nTag;
+    uint8_t cLength;
+    uint8_t cData[PGP_DO_MAX];
+} typePgpDO;
+
+// OpenPGP card V2.1 of ZeitControl: T=1, IFSC 254
+static const uint8_t cPgpATR[] = { 0x3B, 0xDA, 0x18, 0xFF, 0x81, 0xB1, 0xFE, 0x75, 0x1F, 0x03, 0x00, 0x31, 0xC5, 0x73, 0xC0, 0x01, 0x40, 0x00, 0x90, 0x00, 0x0C };
+
+static const uint8_t cPgpAIDPrefix[] = { 0xD2, 0x76, 0x00, 0x01, 0x24, 0x01 };
+
+// Extended capabilities: GET CHALLENGE, PSO:DEC/ENC with AES
+static const uint8_t cPgpExtCaps[] = { 0x42, 0x00, 0x00, 0xFF, 0x04, 0xC0, 0x00, 0xFF };
+static const uint8_t cPgpRsaAttr[] = { 0x01, 0x08, 0x00, 0x00, 0x20, 0x00 };
+
+// Simple DOs set by PUT DATA: name, login data, language, sex, URL
+static typePgpDO tPgpDO[] = {
+    {0x005B}, {0x005E}, {0x5F2D}, {0x5F35}, {0x5F50}
+};
+
+#define PGP_DOS                 (sizeof (tPgpDO) / sizeof (tPgpDO[0]))
+
+static uint8_t cPgpAID[16] = { 0xD2, 0x76, 0x00, 0x01, 0x24, 0x01, 0x02, 0x01, 0x00, 0x05, 0x00, 0x00, 0x5F, 0x11, 0x00, 0x00 };
+
+static typePgpPin tPW1;
+static typePgpPin tPW3;
+static uint8_t cPgpAesKey[32];
+static uint8_t cPgpAesKeyLength;
+static uint8_t cPgpTerminated;
+static uint8_t cPgpSelected;
+static uint8_t cPgpVerified;
+static uint32_t nPgpRandom = 1;
+
+/*******************************************************************************
+
+  PGP_SetPin
+
+*******************************************************************************/
+
+static void PGP_SetPin (typePgpPin * pPin, const uint8_t * pNew, uint8_t cLength)
+{
+    memcpy (pPin->cPin, pNew, cLength);
+    pPin->cLength = cLength;
+    pPin->cRetries = PGP_RETRIES;
+}
+
+/*******************************************************************************
+
+  PGP_Init
+
+  Factory state of the card
+
+*******************************************************************************/
+
+static void PGP_Init (uint32_t nSeed)
+{
+    unsigned int i;
+
+    PGP_SetPin (&tPW1, (const uint8_t *) HOST_CARD_USER_PIN, strlen (HOST_CARD_USER_PIN));
+    tPW1.cMinLength = 6;
+    PGP_SetPin (&tPW3, (const uint8_t *) HOST_CARD_ADMIN_PIN, strlen (HOST_CARD_ADMIN_PIN));
+    tPW3.cMinLength = 8;
+
+    memset (cPgpAesKey, 0, sizeof (cPgpAesKey));
+    cPgpAesKeyLength = 0;
+
+    for (i = 0; i < PGP_DOS; i++)
+    {
+        tPgpDO[i].cLength = 0;
+    }
+
+    cPgpTerminated = FALSE;
+    cPgpSelected = FALSE;
+    cPgpVerified = 0;
+    nPgpRandom = (0 == nSeed) ? 1 : nSeed;
+}
+
+/*******************************************************************************
+
+  PGP_SetSerial
+
+*******************************************************************************/
+
+static void PGP_SetSerial (uint32_t nSerial)
+{
+    cPgpAID[10] = (uint8_t) (nSerial >> 24);
+    cPgpAID[11] = (uint8_t) (nSerial >> 16);
+    cPgpAID[12] = (uint8_t) (nSerial >> 8);
+    cPgpAID[13] = (uint8_t) nSerial;
+}
+
+/*******************************************************************************
+
+  PGP_PowerOn
+
+  The PINs must be verified again after a reset
+
+*******************************************************************************/
+
+static int PGP_PowerOn (uint8_t * pATR)
+{
+    cPgpSelected = FALSE;
+    cPgpVerified = 0;
+
+    memcpy (pATR, cPgpATR, sizeof (cPgpATR));
+    return (sizeof (cPgpATR));
+}
+
+/*******************************************************************************
+
+  PGP_Status
+
+  Append SW1 SW2 to a response of nLength bytes
+
+*******************************************************************************/
+
+static int PGP_Status (uint8_t * pResponse, int nLength, unsigned short nStatus)
+{
+    pResponse[nLength] = (uint8_t) (nStatus >> 8);
+    pResponse[nLength + 1] = (uint8_t) nStatus;
+    return (nLength + 2);
+}
+
+/*******************************************************************************
+
+  PGP_Tlv
+
+  Append a TLV with a length below 128 to pOut, returns the new length
+
+*******************************************************************************/
+
+static int PGP_Tlv (uint8_t * pOut, int nPos, uint16_t nTag, const uint8_t * pData, int nLength)
+{
+    if (0xFF < nTag)
+    {
+        pOut[nPos++] = (uint8_t) (nTag >> 8);
+    }
+    pOut[nPos++] = (uint8_t) nTag;
+    pOut[nPos++] = (uint8_t) nLength;
+    if (NULL == pData)
+    {
+        memset (&pOut[nPos], 0, nLength);
+    }
+    else
+    {
+        memcpy (&pOut[nPos], pData, nLength);
+    }
+    return (nPos + nLength);
+}
+
+/*******************************************************************************
+
+  PGP_FindDO
+
+*******************************************************************************/
+
+static typePgpDO* PGP_FindDO (uint16_t nTag)
+{
+    unsigned int i;
+
+    for (i = 0; i < PGP_DOS; i++)
+    {
+        if (nTag == tPgpDO[i].nTag)
+        {
+            return (&tPgpDO[i]);
+        }
+    }
+    return (NULL);
+}
+
+/*******************************************************************************
+
+  PGP_PWStatus
+
+  DO C4: PW1 valid for one PSO:CDS only, max. lengths, retry counters
+
+*******************************************************************************/
+
+static int PGP_PWStatus (uint8_t * pOut)
+{
+    pOut[0] = 0x00;
+    pOut[1] = PGP_PIN_MAX;
+    pOut[2] = PGP_PIN_MAX;
+    pOut[3] = PGP_PIN_MAX;
+    pOut[4] = tPW1.cRetries;
+    pOut[5] = 0;    // no resetting code
+    pOut[6] = tPW3.cRetries;
+    return (7);
+}
+
+/*******************************************************************************
+
+  PGP_GetData
+
+*******************************************************************************/
+
+static int PGP_GetData (uint16_t nTag, uint8_t * pResponse)
+{
+    uint8_t cInner[200];
+    uint8_t cStatus[7];
+    typePgpDO* pDO;
+    int nInner = 0;
+    int nLength = 0;
+
+    switch (nTag)
+    {
+        case 0x004F:
+            memcpy (pResponse, cPgpAID, sizeof (cPgpAID));
+            nLength = sizeof (cPgpAID);
+            break;
+
+        case 0x5F52:
+            memcpy (pResponse, &cPgpATR[11], 10);
+            nLength = 10;
+            break;
+
+        case 0x00C4:
+            nLength = PGP_PWStatus (pResponse);
+            break;
+
+        case 0x0065:
+            // Cardholder related data
+            pDO = PGP_FindDO (0x005B);
+            nLength = PGP_Tlv (pResponse, nLength, 0x005B, pDO->cData, pDO->cLength);
+            pDO = PGP_FindDO (0x5F2D);
+            nLength = PGP_Tlv (pResponse, nLength, 0x5F2D, pDO->cData, pDO->cLength);
+            pDO = PGP_FindDO (0x5F35);
+            nLength = PGP_Tlv (pResponse, nLength, 0x5F35, pDO->cData, pDO->cLength);
+            break;
+
+        case 0x006E:
+            // Application related data, the key attributes and fingerprints
+            // of the missing RSA keys
+            nInner = PGP_Tlv (cInner, nInner, 0x00C0, cPgpExtCaps, sizeof (cPgpExtCaps));
+            nInner = PGP_Tlv (cInner, nInner, 0x00C1, cPgpRsaAttr, sizeof (cPgpRsaAttr));
+            nInner = PGP_Tlv (cInner, nInner, 0x00C2, cPgpRsaAttr, sizeof (cPgpRsaAttr));
+            nInner = PGP_Tlv (cInner, nInner, 0x00C3, cPgpRsaAttr, sizeof (cPgpRsaAttr));
+            nInner = PGP_Tlv (cInner, nInner, 0x00C4, cStatus, PGP_PWStatus (cStatus));
+            nInner = PGP_Tlv (cInner, nInner, 0x00C5, NULL, 60);
+            nInner = PGP_Tlv (cInner, nInner, 0x00C6, NULL, 60);
+            nInner = PGP_Tlv (cInner, nInner, 0x00CD, NULL, 12);
+
+            nLength = PGP_Tlv (pResponse, nLength, 0x004F, cPgpAID, sizeof (cPgpAID));
+            nLength = PGP_Tlv (pResponse, nLength, 0x5F52, &cPgpATR[11], 10);
+            pResponse[nLength++] = 0x73;
+            pResponse[nLength++] = 0x81;
+            pResponse[nLength++] = (uint8_t) nInner;
+            memcpy (&pResponse[nLength], cInner, nInner);
+            nLength += nInner;
+            break;
+
+        case 0x007A:
+            // Security support template, the signature counter
+            nLength = PGP_Tlv (pResponse, nLength, 0x0093, NULL, 3);
+            break;
+
+        default:
+            pDO = PGP_FindDO (nTag);
+            if (NULL == pDO)
+            {
+                return (PGP_Status (pResponse, 0, APDU_ANSWER_REF_DATA_NOT_FOUND));
+            }
+            memcpy (pResponse, pDO->cData, pDO->cLength);
+            nLength = pDO->cLength;
+            break;
+    }
+
+    return (PGP_Status (pResponse, nLength, APDU_ANSWER_COMMAND_CORRECT));
+}
+
+/*******************************************************************************
+
+  PGP_CheckPin
+
+  Compare a PIN and count the retries
+
+*******************************************************************************/
+
+static unsigned short PGP_CheckPin (typePgpPin * pPin, const uint8_t * pData, int nLength)
+{
+    if (0 == pPin->cRetries)
+    {
+        return (APDU_ANSWER_AUTH_METHOD_BLOCKED);
+    }
+
+    if ((nLength != pPin->cLength) || (0 != memcmp (pPin->cPin, pData, nLength)))
+    {
+        pPin->cRetries--;
+        return (APDU_ANSWER_SEC_STATUS_NOT_SATISFIED);
+    }
+
+    pPin->cRetries = PGP_RETRIES;
+    return (APDU_ANSWER_COMMAND_CORRECT);
+}
+
+/*******************************************************************************
+
+  PGP_Verify
+
+  Lc = 0 asks for the verification state, 63Cx gives the retries left
+
+*******************************************************************************/
+
+static unsigned short PGP_Verify (uint8_t cP2, const uint8_t * pData, int nLength)
+{
+    typePgpPin* pPin;
+    unsigned short nStatus;
+
+    if ((PGP_PW1_81 != cP2) && (PGP_PW1_82 != cP2) && (PGP_PW3 != cP2))
+    {
+        return (APDU_ANSWER_WRONG_P1_P2);
+    }
+    pPin = (PGP_PW3 == cP2) ? &tPW3 : &tPW1;
+
+    if (0 == nLength)
+    {
+        if (0 != (cPgpVerified & PGP_VERIFIED (cP2)))
+        {
+            return (APDU_ANSWER_COMMAND_CORRECT);
+        }
+        return (0x63C0 | pPin->cRetries);
+    }
+
+    nStatus = PGP_CheckPin (pPin, pData, nLength);
+    if (APDU_ANSWER_COMMAND_CORRECT == nStatus)
+    {
+        cPgpVerified |= PGP_VERIFIED (cP2);
+    }
+    else
+    {
+        cPgpVerified &= ~PGP_VERIFIED (cP2);
+    }
+    return (nStatus);
+}
+
+/*******************************************************************************
+
+  PGP_ChangePin
+
+  The data is the old PIN followed by the new one
+
+*******************************************************************************/
+
+static unsigned short PGP_ChangePin (uint8_t cP2, const uint8_t * pData, int nLength)
+{
+    typePgpPin* pPin;
+    unsigned short nStatus;
+    int nNew;
+
+    if ((PGP_PW1_81 != cP2) && (PGP_PW3 != cP2))
+    {
+        return (APDU_ANSWER_WRONG_P1_P2);
+    }
+    pPin = (PGP_PW3 == cP2) ? &tPW3 : &tPW1;
+
+    nNew = nLength - pPin->cLength;
+    if (0 > nNew)
+    {
+        nNew = 0;
+    }
+
+    nStatus = PGP_CheckPin (pPin, pData, nLength - nNew);
+    if (APDU_ANSWER_COMMAND_CORRECT != nStatus)
+    {
+        return (nStatus);
+    }
+
+    if ((pPin->cMinLength > nNew) || (PGP_PIN_MAX < nNew))
+    {
+        return (APDU_ANSWER_WRONG_DATA_FIELD);
+    }
+    PGP_SetPin (pPin, &pData[nLength - nNew], nNew);
+    return (APDU_ANSWER_COMMAND_CORRECT);
+}
+
+/*******************************************************************************
+
+  PGP_ResetRetryCounter
+
+  Only with P1 = 02, there is no resetting code
+
+*******************************************************************************/
+
+static unsigned short PGP_ResetRetryCounter (uint8_t cP1, uint8_t cP2, const uint8_t * pData, int nLength)
+{
+    if ((0x02 != cP1) || (PGP_PW1_81 != cP2))
+    {
+        return ((0x00 == cP1) ? APDU_ANSWER_SEC_STATUS_NOT_SATISFIED : APDU_ANSWER_WRONG_P1_P2);
+    }
+
+    if (0 == (cPgpVerified & PGP_VERIFIED (PGP_PW3)))
+    {
+        return (APDU_ANSWER_SEC_STATUS_NOT_SATISFIED);
+    }
+
+    if ((tPW1.cMinLength > nLength) || (PGP_PIN_MAX < nLength))
+    {
+        return (APDU_ANSWER_WRONG_DATA_FIELD);
+    }
+    PGP_SetPin (&tPW1, pData, nLength);
+    return (APDU_ANSWER_COMMAND_CORRECT);
+}
+
+/*******************************************************************************
+
+  PGP_PutData
+
+*******************************************************************************/
+
+static unsigned short PGP_PutData (uint16_t nTag, const uint8_t * pData, int nLength)
+{
+    typePgpDO* pDO;
+
+    if (0 == (cPgpVerified & PGP_VERIFIED (PGP_PW3)))
+    {
+        return (APDU_ANSWER_SEC_STATUS_NOT_SATISFIED);
+    }
+
+    if (0x00D5 == nTag)
+    {
+        if ((16 != nLength) && (32 != nLength))
+        {
+            return (APDU_ANSWER_WRONG_LENGTH);
+        }
+        memcpy (cPgpAesKey, pData, nLength);
+        cPgpAesKeyLength = nLength;
+        return (APDU_ANSWER_COMMAND_CORRECT);
+    }
+
+    pDO = PGP_FindDO (nTag);
+    if (NULL == pDO)
+    {
+        return (APDU_ANSWER_REF_DATA_NOT_FOUND);
+    }
+    if (PGP_DO_MAX < nLength)
+    {
+        return (APDU_ANSWER_WRONG_LENGTH);
+    }
+    memcpy (pDO->cData, pData, nLength);
+    pDO->cLength = nLength;
+    return (APDU_ANSWER_COMMAND_CORRECT);
+}
+
+/*******************************************************************************
+
+  PGP_Decipher
+
+  PSO:DECIPHER, only with the AES key (padding indicator 02). A missing
+  key is reported before the PIN check, the firmware detects the AES
+  support by this.
+
+*******************************************************************************/
+
+static int PGP_Decipher (const uint8_t * pData, int nLength, uint8_t * pResponse)
+{
+    aes_context tAes;
+    int i;
+
+    if ((0 == nLength) || (0x02 != pData[0]) || (0 == cPgpAesKeyLength))
+    {
+        return (PGP_Status (pResponse, 0, APDU_ANSWER_REF_DATA_NOT_FOUND));
+    }
+
+    if (0 == (cPgpVerified & PGP_VERIFIED (PGP_PW1_82)))
+    {
+        return (PGP_Status (pResponse, 0, APDU_ANSWER_SEC_STATUS_NOT_SATISFIED));
+    }
+
+    nLength--;
+    if ((0 == nLength) || (0 != (nLength % 16)))
+    {
+        return (PGP_Status (pResponse, 0, APDU_ANSWER_WRONG_LENGTH));
+    }
+
+    aes_setkey_dec (&tAes, cPgpAesKey, cPgpAesKeyLength * 8);
+    for (i = 0; i < nLength; i += 16)
+    {
+        aes_crypt_ecb (&tAes, AES_DECRYPT, (unsigned char *) &pData[1 + i], &pResponse[i]);
+    }
+    memset (&tAes, 0, sizeof (tAes));
+
+    return (PGP_Status (pResponse, nLength, APDU_ANSWER_COMMAND_CORRECT));
+}
+
+/*******************************************************************************
+
+  PGP_Transmit
+
+*******************************************************************************/
+
+static int PGP_Transmit (const uint8_t * pCommand, int nCommand, uint8_t * pResponse, int nMaxResponse)
+{
+    const uint8_t* pData = &pCommand[5];
+    uint16_t nP1P2;
+    int nLength = 0;
+    int nLe = 0;
+    int i;
+
+    if (4 > nCommand)
+    {
+        return (PGP_Status (pResponse, 0, APDU_ANSWER_WRONG_LENGTH));
+    }
+
+    // Short APDU cases 1 - 4
+    if (5 == nCommand)
+    {
+        nLe = (0 == pCommand[4]) ? 256 : pCommand[4];
+    }
+    else if (5 < nCommand)
+    {
+        nLength = pCommand[4];
+        if ((nCommand != 5 + nLength) && (nCommand != 5 + nLength + 1))
+        {
+            return (PGP_Status (pResponse, 0, APDU_ANSWER_WRONG_LENGTH));
+        }
+        if (nCommand == 5 + nLength + 1)
+        {
+            nLe = (0 == pCommand[nCommand - 1]) ? 256 : pCommand[nCommand - 1];
+        }
+    }
+
+    // No command chaining and no secure messaging
+    if (0x10 == (pCommand[CCID_CLA] & 0xFC))
+    {
+        return (PGP_Status (pResponse, 0, APDU_ANSWER_LAST_CHAIN_CMD_EXPECTED));
+    }
+    if (0x00 != (pCommand[CCID_CLA] & 0xFC))
+    {
+        return (PGP_Status (pResponse, 0, APDU_ANSWER_CLA_NOT_SUPPORTED));
+    }
+
+    nP1P2 = (pCommand[CCID_P1] << 8) | pCommand[CCID_P2];
+
+    if (0xA4 == pCommand[CCID_INS])
+    {
+        if ((0x0400 != nP1P2) || (sizeof (cPgpAIDPrefix) > nLength) || (0 != memcmp (pData, cPgpAIDPrefix, sizeof (cPgpAIDPrefix))))
+        {
+            return (PGP_Status (pResponse, 0, 0x6A82));    // file not found
+        }
+        cPgpSelected = TRUE;
+        cPgpVerified = 0;
+        return (PGP_Status (pResponse, 0, cPgpTerminated ? APDU_ANSWER_SEL_FILE_TERM_STATE : APDU_ANSWER_COMMAND_CORRECT));
+    }
+
+    if (FALSE == cPgpSelected)
+    {
+        return (PGP_Status (pResponse, 0, APDU_ANSWER_USE_CONDIT_NOT_SATISFIED));
+    }
+
+    // A terminated card knows ACTIVATE FILE only
+    if (cPgpTerminated && (0x44 != pCommand[CCID_INS]))
+    {
+        return (PGP_Status (pResponse, 0, APDU_ANSWER_USE_CONDIT_NOT_SATISFIED));
+    }
+
+    switch (pCommand[CCID_INS])
+    {
+        case 0xCA:     // GET DATA
+            if (HOST_CARD_MAX_RESPONSE > nMaxResponse)
+            {
+                return (-1);
+            }
+            return (PGP_GetData (nP1P2, pResponse));
+
+        case 0x20:     // VERIFY
+            return (PGP_Status (pResponse, 0, PGP_Verify (pCommand[CCID_P2], pData, nLength)));
+
+        case 0x24:     // CHANGE REFERENCE DATA
+            return (PGP_Status (pResponse, 0, PGP_ChangePin (pCommand[CCID_P2], pData, nLength)));
+
+        case 0x2C:     // RESET RETRY COUNTER
+            return (PGP_Status (pResponse, 0, PGP_ResetRetryCounter (pCommand[CCID_P1], pCommand[CCID_P2], pData, nLength)));
+
+        case 0xDA:     // PUT DATA
+            return (PGP_Status (pResponse, 0, PGP_PutData (nP1P2, pData, nLength)));
+
+        case 0x2A:     // PSO
+            if (0x8086 != nP1P2)
+            {
+                return (PGP_Status (pResponse, 0, APDU_ANSWER_WRONG_P1_P2));
+            }
+            return (PGP_Decipher (pData, nLength, pResponse));
+
+        case 0x84:     // GET CHALLENGE
+            if (nMaxResponse < nLe + 2)
+            {
+                return (PGP_Status (pResponse, 0, APDU_ANSWER_WRONG_LENGTH));
+            }
+            for (i = 0; i < nLe; i++)
+            {
+                // xorshift32
+                nPgpRandom ^= nPgpRandom << 13;
+                nPgpRandom ^= nPgpRandom >> 17;
+                nPgpRandom ^= nPgpRandom << 5;
+                pResponse[i] = (uint8_t) nPgpRandom;
+            }
+            return (PGP_Status (pResponse, nLe, APDU_ANSWER_COMMAND_CORRECT));
+
+        case 0xE6:     // TERMINATE DF, with PW3 or when PW3 is blocked
+            if ((0 == (cPgpVerified & PGP_VERIFIED (PGP_PW3))) && (0 != tPW3.cRetries))
+            {
+                return (PGP_Status (pResponse, 0, APDU_ANSWER_SEC_STATUS_NOT_SATISFIED));
+            }
+            cPgpTerminated = TRUE;
+            cPgpVerified = 0;
+            return (PGP_Status (pResponse, 0, APDU_ANSWER_COMMAND_CORRECT));
+
+        case 0x44:     // ACTIVATE FILE, resets a terminated card
+            if (cPgpTerminated)
+            {
+                PGP_Init (nPgpRandom);
+                cPgpSelected = TRUE;
+            }
+            return (PGP_Status (pResponse, 0, APDU_ANSWER_COMMAND_CORRECT));
+
+        default:
+            return (PGP_Status (pResponse, 0, APDU_ANSWER_INS_NOT_SUPPORTED));
+    }
+}
+
+const typeHostCardBackend tHostOpenPGPCard = {
+    "openpgp",
+    PGP_Init,
+    PGP_SetSerial,
+    PGP_PowerOn,
+    PGP_Transmit
+};
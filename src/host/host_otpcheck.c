@@ -0,0 +1,487 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * nkotpcheck, cross-check of libnkotp.a with the firmware OTP code
+ *
+ *   nkotpcheck [-f flash image] [-n codes] [-s seed] [-r requests]
+ *
+ * For each kernel of the CPU:
+ *   - the HOTP test values of RFC 4226
+ *   - n random secrets, counters and digits against get_hotp_value ()
+ * With the selected kernel, on the slots of the emulated flash:
+ *   - HOTP codes around the look-ahead window against
+ *     validate_code_from_hotp_slot () and the counter it leaves
+ *   - TOTP codes against get_code_from_totp_slot () for random times and
+ *     intervals
+ * Then the verification rate of each kernel for r requests with a full
+ * window, next to get_hotp_value (). The exit code is 1 on a difference.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "stm32f10x.h"
+#include "CCIDHID_usb_desc.h"
+#include "hotp.h"
+#include "report_protocol.h"
+#include "otpverify.h"
+#include "host.h"
+
+#define CHECK_SLOT_CHECKS       200
+#define CHECK_SLOT_REPROGRAM    25      // slot checks with one secret
+#define CHECK_TOTP_CHECKS       100
+#define CHECK_RATE_KEYS         1024
+
+static const char* szCheckKernels[] = { "auto", "scalar", "sse4", "avx2" };
+
+static uint64_t nCheckRandom = 0x9E3779B97F4A7C15;
+static uint32_t nCheckErrors = 0;
+
+/*******************************************************************************
+
+  CHECK_Random
+
+  xorshift64, the same sequence for the same seed
+
+*******************************************************************************/
+
+static uint64_t CHECK_Random (void)
+{
+    nCheckRandom ^= nCheckRandom << 13;
+    nCheckRandom ^= nCheckRandom >> 7;
+    nCheckRandom ^= nCheckRandom << 17;
+    return (nCheckRandom);
+}
+
+/*******************************************************************************
+
+  CHECK_Counter
+
+  Random counter, every 8th one at a 32 bit or 64 bit edge
+
+*******************************************************************************/
+
+static uint64_t CHECK_Counter (void)
+{
+    static const uint64_t nEdges[] = { 0, 0xFFFFFFF0, 0x100000000, 0xFFFFFFFFFFFFFFF0 };
+    uint64_t nRandom = CHECK_Random ();
+
+    if (0 == (nRandom & 7))
+    {
+        return (nEdges[(nRandom >> 3) & 3] + ((nRandom >> 5) & 7));
+    }
+    return ((nRandom & 0x100) ? nRandom >> 16 : (nRandom >> 40));
+}
+
+/*******************************************************************************
+
+  CHECK_Secret
+
+  Random secret of 0 to 40 bytes, zero padded to the slot size like the
+  secret of a slot. Returns the length.
+
+*******************************************************************************/
+
+static uint8_t CHECK_Secret (uint8_t * pSecret)
+{
+    uint8_t cLength = CHECK_Random () % (SECRET_LENGTH_DEFINE + 1);
+    uint8_t i;
+
+    memset (pSecret, 0, SECRET_LENGTH_DEFINE);
+    for (i = 0; i < cLength; i++)
+    {
+        pSecret[i] = (uint8_t) CHECK_Random ();
+    }
+    return (cLength);
+}
+
+/*******************************************************************************
+
+  CHECK_Error
+
+*******************************************************************************/
+
+static void CHECK_Error (const char* szCheck, uint64_t nCounter, long nFirmware, long nLibrary)
+{
+    if (10 > nCheckErrors++)
+    {
+        printf ("  %s: counter %llu, firmware %ld, library %ld (%s)\n", szCheck, (unsigned long long) nCounter, nFirmware, nLibrary, OTPV_KernelName ());
+    }
+}
+
+/*******************************************************************************
+
+  CHECK_Rfc4226
+
+  Appendix D of RFC 4226
+
+*******************************************************************************/
+
+static void CHECK_Rfc4226 (void)
+{
+    static const uint32_t nExpected[10] = { 755224, 287082, 359152, 969429, 338314, 254676, 287922, 162583, 399871, 520489 };
+    typeOtpvKey tKey;
+    uint32_t nCodes[10];
+    int i;
+
+    OTPV_KeyInit (&tKey, (const uint8_t *) "12345678901234567890", 20, 6);
+    OTPV_Codes (&tKey, 0, nCodes, 10);
+    for (i = 0; i < 10; i++)
+    {
+        if ((nExpected[i] != nCodes[i]) || (nExpected[i] != OTPV_Code (&tKey, i)))
+        {
+            CHECK_Error ("rfc 4226", i, nExpected[i], nCodes[i]);
+        }
+    }
+}
+
+/*******************************************************************************
+
+  CHECK_Values
+
+  Random secrets and counters against get_hotp_value (), in one batch of
+  distinct keys and as windows of one key
+
+*******************************************************************************/
+
+static void CHECK_Values (uint32_t nCodes)
+{
+    typeOtpvRequest* pRequests = malloc (nCodes * sizeof (typeOtpvRequest));
+    typeOtpvKey* pKeys = malloc (nCodes * sizeof (typeOtpvKey));
+    uint8_t cSecret[SECRET_LENGTH_DEFINE];
+    uint32_t nWindow[OTPV_HOTP_WINDOW];
+    uint8_t cLength;
+    uint8_t cDigits;
+    uint32_t i, j;
+
+    if ((NULL == pRequests) || (NULL == pKeys))
+    {
+        fprintf (stderr, "out of memory\n");
+        exit (2);
+    }
+
+    for (i = 0; i < nCodes; i++)
+    {
+        cLength = CHECK_Secret (cSecret);
+        cDigits = (CHECK_Random () & 1) ? 8 : 6;
+        OTPV_KeyInit (&pKeys[i], cSecret, cLength, cDigits);
+
+        pRequests[i].pKey = &pKeys[i];
+        pRequests[i].nCounter = CHECK_Counter ();
+        pRequests[i].nCode = get_hotp_value (pRequests[i].nCounter, cSecret, SECRET_LENGTH_DEFINE, cDigits);
+
+        if (0 == (i & 63))
+        {
+            OTPV_Codes (&pKeys[i], pRequests[i].nCounter, nWindow, OTPV_HOTP_WINDOW);
+            for (j = 0; j < OTPV_HOTP_WINDOW; j++)
+            {
+                if (get_hotp_value (pRequests[i].nCounter + j, cSecret, SECRET_LENGTH_DEFINE, cDigits) != nWindow[j])
+                {
+                    CHECK_Error ("window", pRequests[i].nCounter + j, get_hotp_value (pRequests[i].nCounter + j, cSecret, SECRET_LENGTH_DEFINE, cDigits), nWindow[j]);
+                }
+            }
+        }
+    }
+
+    OTPV_Verify (pRequests, nCodes, 1);
+    for (i = 0; i < nCodes; i++)
+    {
+        if (0 != pRequests[i].nResult)
+        {
+            CHECK_Error ("get_hotp_value", pRequests[i].nCounter, pRequests[i].nCode, OTPV_Code (pRequests[i].pKey, pRequests[i].nCounter));
+        }
+    }
+
+    free (pRequests);
+    free (pKeys);
+}
+
+/*******************************************************************************
+
+  CHECK_WriteSlot
+
+  Program a slot by the write to slot command, returns the key. An empty
+  secret keeps the secret of the slot, write_to_slot () copies it back.
+
+*******************************************************************************/
+
+static void CHECK_WriteSlot (uint8_t cSlotNumber, uint64_t nIntervalOrCounter, typeOtpvKey * pKey)
+{
+    uint8_t cOutput[KEYBOARD_FEATURE_COUNT];
+    OTP_slot tSlot;
+
+    memset (&tSlot, 0, sizeof (tSlot));
+    tSlot.slot_number = cSlotNumber;
+    memcpy (tSlot.name, "check", 5);
+    CHECK_Secret (tSlot.secret);
+    tSlot.use_8_digits = CHECK_Random () & 1;
+    tSlot.interval_or_counter = nIntervalOrCounter;
+
+    cmd_write_to_slot (&tSlot, cOutput);
+    OTPV_KeyInit (pKey, tSlot.secret, SECRET_LENGTH_DEFINE, tSlot.use_8_digits ? 8 : 6);
+}
+
+/*******************************************************************************
+
+  CHECK_HotpSlot
+
+  Codes in front of, inside and behind the look-ahead window of HOTP slot 1.
+  A server continues after the accepted code like the device.
+
+*******************************************************************************/
+
+static void CHECK_HotpSlot (void)
+{
+    typeOtpvRequest tRequest;
+    typeOtpvKey tKey;
+    uint64_t nCounter = 0;
+    int nFirmware;
+    int nAhead;
+    int i;
+
+    for (i = 0; i < CHECK_SLOT_CHECKS; i++)
+    {
+        if (0 == (i % CHECK_SLOT_REPROGRAM))
+        {
+            nCounter = CHECK_Counter () & 0xFFFFFFFFFFFF;
+            CHECK_WriteSlot (0x10, nCounter, &tKey);
+        }
+
+        // -1 is a used code, 10 and 11 are behind the window
+        nAhead = (int) (CHECK_Random () % (OTPV_HOTP_WINDOW + 3)) - 1;
+        tRequest.pKey = &tKey;
+        tRequest.nCounter = nCounter;
+        tRequest.nCode = OTPV_Code (&tKey, nCounter + nAhead);
+
+        nFirmware = validate_code_from_hotp_slot (0, tRequest.nCode);
+        OTPV_Verify (&tRequest, 1, OTPV_HOTP_WINDOW);
+        if (nFirmware != tRequest.nResult)
+        {
+            CHECK_Error ("validate_code_from_hotp_slot", nCounter + nAhead, nFirmware, tRequest.nResult);
+        }
+
+        if (0 <= tRequest.nResult)
+        {
+            nCounter += tRequest.nResult + 1;
+        }
+        if (nCounter != get_counter_value (hotp_slot_counters[0]))
+        {
+            CHECK_Error ("hotp counter", nCounter, (long) get_counter_value (hotp_slot_counters[0]), (long) nCounter);
+            nCounter = get_counter_value (hotp_slot_counters[0]);
+        }
+    }
+}
+
+/*******************************************************************************
+
+  CHECK_TotpSlot
+
+  TOTP slot 1 at random times, interval_or_counter is the interval
+
+*******************************************************************************/
+
+static void CHECK_TotpSlot (void)
+{
+    typeOtpvKey tKey;
+    uint64_t nInterval;
+    uint32_t nFirmware;
+    uint32_t nLibrary;
+    int i;
+
+    for (i = 0; i < CHECK_TOTP_CHECKS; i++)
+    {
+        nInterval = (i & 1) ? 30 : 1 + CHECK_Random () % 3600;
+        CHECK_WriteSlot (0x20, nInterval, &tKey);
+
+        current_time = (uint32_t) CHECK_Random ();
+        nFirmware = get_code_from_totp_slot (0, 0);
+        nLibrary = OTPV_Code (&tKey, OTPV_TotpCounter (current_time, nInterval));
+        if (nFirmware != nLibrary)
+        {
+            CHECK_Error ("get_code_from_totp_slot", OTPV_TotpCounter (current_time, nInterval), nFirmware, nLibrary);
+        }
+    }
+}
+
+/*******************************************************************************
+
+  CHECK_Ns
+
+*******************************************************************************/
+
+static uint64_t CHECK_Ns (void)
+{
+    struct timespec tNow;
+
+    clock_gettime (CLOCK_MONOTONIC, &tNow);
+    return ((uint64_t) tNow.tv_sec * 1000000000 + tNow.tv_nsec);
+}
+
+/*******************************************************************************
+
+  CHECK_Rate
+
+  Verification rate of the kernel, requests with a full window and a code
+  which isn't in it
+
+*******************************************************************************/
+
+static void CHECK_Rate (uint32_t nRequests)
+{
+    static typeOtpvKey tKeys[CHECK_RATE_KEYS];
+    typeOtpvRequest* pRequests = malloc (nRequests * sizeof (typeOtpvRequest));
+    uint8_t cSecret[SECRET_LENGTH_DEFINE];
+    uint64_t nNs;
+    uint32_t i;
+
+    if (NULL == pRequests)
+    {
+        fprintf (stderr, "out of memory\n");
+        exit (2);
+    }
+
+    for (i = 0; i < CHECK_RATE_KEYS; i++)
+    {
+        OTPV_KeyInit (&tKeys[i], cSecret, CHECK_Secret (cSecret), 6);
+    }
+    for (i = 0; i < nRequests; i++)
+    {
+        pRequests[i].pKey = &tKeys[i % CHECK_RATE_KEYS];
+        pRequests[i].nCounter = CHECK_Random () >> 32;
+        pRequests[i].nCode = 1000000;   // never a 6 digit code
+    }
+
+    nNs = CHECK_Ns ();
+    OTPV_Verify (pRequests, nRequests, OTPV_HOTP_WINDOW);
+    nNs = CHECK_Ns () - nNs;
+
+    printf ("  %-14s %10.0f codes/s %10.0f requests/s\n", OTPV_KernelName (), nRequests * (double) OTPV_HOTP_WINDOW * 1e9 / nNs, nRequests * 1e9 / nNs);
+    free (pRequests);
+}
+
+/*******************************************************************************
+
+  CHECK_RateFirmware
+
+  get_hotp_value () for comparison, it hashes the pads for every code
+
+*******************************************************************************/
+
+static void CHECK_RateFirmware (uint32_t nRequests)
+{
+    uint8_t cSecret[SECRET_LENGTH_DEFINE];
+    uint32_t nCodes = nRequests * OTPV_HOTP_WINDOW / 10;
+    volatile uint32_t nCode;
+    uint64_t nNs;
+    uint32_t i;
+
+    CHECK_Secret (cSecret);
+    nNs = CHECK_Ns ();
+    for (i = 0; i < nCodes; i++)
+    {
+        nCode = get_hotp_value (i, cSecret, SECRET_LENGTH_DEFINE, 6);
+    }
+    nNs = CHECK_Ns () - nNs;
+
+    printf ("  %-14s %10.0f codes/s\n", "get_hotp_value", nCodes * 1e9 / nNs);
+}
+
+/*******************************************************************************
+
+  main
+
+*******************************************************************************/
+
+int main (int argc, char* argv[])
+{
+    const char* szImage = NULL;
+    uint32_t nCodes = 10000;
+    uint32_t nRequests = 100000;
+    uint64_t nSeed;
+    int nKernel;
+    int nOpt;
+
+    while (-1 != (nOpt = getopt (argc, argv, "f:n:s:r:")))
+    {
+        switch (nOpt)
+        {
+            case 'f':
+                szImage = optarg;
+                break;
+            case 'n':
+                nCodes = strtoul (optarg, NULL, 0);
+                break;
+            case 's':
+                nSeed = strtoull (optarg, NULL, 0);
+                nCheckRandom = (0 == nSeed) ? 1 : nSeed;
+                break;
+            case 'r':
+                nRequests = strtoul (optarg, NULL, 0);
+                break;
+            default:
+                fprintf (stderr, "usage: %s [-f flash image] [-n codes] [-s seed] [-r requests]\n", argv[0]);
+                return (2);
+        }
+    }
+
+    if ((0 == nCodes) || (0 == nRequests))
+    {
+        fprintf (stderr, "%s: codes and requests must be > 0\n", argv[0]);
+        return (2);
+    }
+
+    if (0 != HOST_DeviceOpen (szImage, HOST_DEFAULT_SERIAL))
+    {
+        fprintf (stderr, "can't map the flash image at 0x%08x\n", HOST_FLASH_BASE);
+        return (1);
+    }
+
+    for (nKernel = OTPV_KERNEL_SCALAR; nKernel <= OTPV_KERNEL_AVX2; nKernel++)
+    {
+        if (0 != OTPV_SetKernel (nKernel))
+        {
+            printf ("%s: not supported by the CPU\n", szCheckKernels[nKernel]);
+            continue;
+        }
+        CHECK_Rfc4226 ();
+        CHECK_Values (nCodes);
+        printf ("%s: %u codes checked\n", OTPV_KernelName (), nCodes + (nCodes + 63) / 64 * OTPV_HOTP_WINDOW);
+    }
+
+    OTPV_SetKernel (OTPV_KERNEL_AUTO);
+    CHECK_HotpSlot ();
+    CHECK_TotpSlot ();
+    printf ("slots: %u HOTP look-ahead and %u TOTP checks (%s)\n", CHECK_SLOT_CHECKS, CHECK_TOTP_CHECKS, OTPV_KernelName ());
+
+    printf ("verification, window of %u:\n", OTPV_HOTP_WINDOW);
+    CHECK_RateFirmware (nRequests);
+    for (nKernel = OTPV_KERNEL_SCALAR; nKernel <= OTPV_KERNEL_AVX2; nKernel++)
+    {
+        if (0 == OTPV_SetKernel (nKernel))
+        {
+            CHECK_Rate (nRequests);
+        }
+    }
+
+    printf ("%u differences\n", nCheckErrors);
+
+    HOST_DeviceClose ();
+    return ((0 == nCheckErrors) ? 0 : 1);
+}
@@ -0,0 +1,498 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Bulk HOTP/TOTP verification, see otpverify.h
+ *
+ * The message of a code is a single 8 byte block, so a code takes two
+ * SHA-1 compressions from the precomputed states of the inner and outer
+ * HMAC pads. The compressions of several codes run in the lanes of a
+ * vector: 4 with SSE4, 8 with AVX2. The kernel is chosen at runtime, the
+ * scalar kernel is the fallback and does the remainder of a batch.
+ *
+ * Standalone, no firmware code. nkotpcheck (host_otpcheck.c) compares the
+ * kernels with get_hotp_value () and validate_code_from_hotp_slot ().
+ */
+
+#include <string.h>
+#include "otpverify.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define OTPV_X86
+#endif
+
+#define OTPV_CHUNK              64      // codes per kernel run, a multiple of the lanes
+
+#define OTPV_INNER_BITS         ((64 + 8) * 8)      // ipad block and the counter
+#define OTPV_OUTER_BITS         ((64 + 20) * 8)     // opad block and the inner hash
+
+typedef struct
+{
+    const typeOtpvKey* pKey;
+    uint64_t nCounter;
+} typeOtpvJob;
+
+typedef void (*typeOtpvKernelFn) (const typeOtpvJob * pJobs, uint32_t (*pHash)[5]);
+
+typedef struct
+{
+    const char* szName;
+    uint32_t nLanes;
+    typeOtpvKernelFn pfHash;
+} typeOtpvKernel;
+
+#define OTPV_ROL(x, n)          (((x) << (n)) | ((x) >> (32 - (n))))
+
+/*
+ * SHA-1 compression of the block w[16] into h[5], for uint32_t and for the
+ * vector types, whose operators work on all lanes. w is used as the ring
+ * of the message schedule.
+ */
+#define OTPV_ROUND(r, f, k) \
+    do \
+    { \
+        if (16 <= (r)) \
+        { \
+            t = w[((r) + 13) & 15] ^ w[((r) + 8) & 15] ^ w[((r) + 2) & 15] ^ w[(r) & 15]; \
+            w[(r) & 15] = OTPV_ROL (t, 1); \
+        } \
+        t = OTPV_ROL (a, 5) + (f) + e + (k) + w[(r) & 15]; \
+        e = d; \
+        d = c; \
+        c = OTPV_ROL (b, 30); \
+        b = a; \
+        a = t; \
+    } \
+    while (0)
+
+#define OTPV_COMPRESS(type, h, w) \
+    do \
+    { \
+        type a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], t; \
+        int r; \
+        for (r = 0; r < 20; r++) \
+            OTPV_ROUND (r, (b & c) | (~b & d), 0x5A827999U); \
+        for (; r < 40; r++) \
+            OTPV_ROUND (r, b ^ c ^ d, 0x6ED9EBA1U); \
+        for (; r < 60; r++) \
+            OTPV_ROUND (r, (b & c) | (b & d) | (c & d), 0x8F1BBCDCU); \
+        for (; r < 80; r++) \
+            OTPV_ROUND (r, b ^ c ^ d, 0xCA62C1D6U); \
+        h[0] += a; \
+        h[1] += b; \
+        h[2] += c; \
+        h[3] += d; \
+        h[4] += e; \
+    } \
+    while (0)
+
+/*******************************************************************************
+
+  OTPV_HashScalar
+
+  HMAC-SHA1 of one counter
+
+*******************************************************************************/
+
+static void OTPV_HashScalar (const typeOtpvJob * pJobs, uint32_t (*pHash)[5])
+{
+    uint32_t h[5], w[16];
+    int i;
+
+    memcpy (h, pJobs->pKey->nInner, sizeof (h));
+    memset (w, 0, sizeof (w));
+    w[0] = (uint32_t) (pJobs->nCounter >> 32);
+    w[1] = (uint32_t) pJobs->nCounter;
+    w[2] = 0x80000000;
+    w[15] = OTPV_INNER_BITS;
+    OTPV_COMPRESS (uint32_t, h, w);
+
+    memset (w, 0, sizeof (w));
+    for (i = 0; i < 5; i++)
+    {
+        w[i] = h[i];
+    }
+    w[5] = 0x80000000;
+    w[15] = OTPV_OUTER_BITS;
+    memcpy (h, pJobs->pKey->nOuter, sizeof (h));
+    OTPV_COMPRESS (uint32_t, h, w);
+
+    memcpy (pHash[0], h, sizeof (h));
+}
+
+#ifdef OTPV_X86
+typedef uint32_t typeOtpvVec4 __attribute__ ((vector_size (16)));
+typedef uint32_t typeOtpvVec8 __attribute__ ((vector_size (32)));
+
+/*
+ * Multi buffer kernel, lane l hashes pJobs[l]. The vectors stay inside the
+ * function, which is compiled for the instruction set of the kernel.
+ */
+#define OTPV_DEFINE_KERNEL(name, type, lanes, isa) \
+__attribute__ ((target (isa))) static void name (const typeOtpvJob * pJobs, uint32_t (*pHash)[5]) \
+{ \
+    type h[5], w[16]; \
+    int i, l; \
+ \
+    memset (w, 0, sizeof (w)); \
+    for (l = 0; l < (lanes); l++) \
+    { \
+        for (i = 0; i < 5; i++) \
+        { \
+            h[i][l] = pJobs[l].pKey->nInner[i]; \
+        } \
+        w[0][l] = (uint32_t) (pJobs[l].nCounter >> 32); \
+        w[1][l] = (uint32_t) pJobs[l].nCounter; \
+        w[2][l] = 0x80000000; \
+        w[15][l] = OTPV_INNER_BITS; \
+    } \
+    OTPV_COMPRESS (type, h, w); \
+ \
+    for (i = 0; i < 5; i++) \
+    { \
+        w[i] = h[i]; \
+    } \
+    memset (&w[5], 0, 10 * sizeof (type)); \
+    for (l = 0; l < (lanes); l++) \
+    { \
+        for (i = 0; i < 5; i++) \
+        { \
+            h[i][l] = pJobs[l].pKey->nOuter[i]; \
+        } \
+        w[5][l] = 0x80000000; \
+        w[15][l] = OTPV_OUTER_BITS; \
+    } \
+    OTPV_COMPRESS (type, h, w); \
+ \
+    for (l = 0; l < (lanes); l++) \
+    { \
+        for (i = 0; i < 5; i++) \
+        { \
+            pHash[l][i] = h[i][l]; \
+        } \
+    } \
+}
+
+OTPV_DEFINE_KERNEL (OTPV_HashSse4, typeOtpvVec4, 4, "sse4.1")
+OTPV_DEFINE_KERNEL (OTPV_HashAvx2, typeOtpvVec8, 8, "avx2")
+#endif /* OTPV_X86 */
+
+static const typeOtpvKernel tOtpvKernels[] = {
+    [OTPV_KERNEL_SCALAR] = {"scalar", 1, OTPV_HashScalar},
+#ifdef OTPV_X86
+    [OTPV_KERNEL_SSE4] = {"sse4", 4, OTPV_HashSse4},
+    [OTPV_KERNEL_AVX2] = {"avx2", 8, OTPV_HashAvx2},
+#endif
+};
+
+#define OTPV_KERNELS            (sizeof (tOtpvKernels) / sizeof (tOtpvKernels[0]))
+
+static const typeOtpvKernel* pOtpvKernel = NULL;
+
+/*******************************************************************************
+
+  OTPV_Supported
+
+  Returns 1 if the CPU runs the kernel
+
+*******************************************************************************/
+
+static int OTPV_Supported (int nKernel)
+{
+    if ((OTPV_KERNEL_SCALAR > nKernel) || (OTPV_KERNELS <= (unsigned int) nKernel) || (NULL == tOtpvKernels[nKernel].pfHash))
+    {
+        return (0);
+    }
+#ifdef OTPV_X86
+    __builtin_cpu_init ();
+    if (OTPV_KERNEL_SSE4 == nKernel)
+    {
+        return (0 != __builtin_cpu_supports ("sse4.1"));
+    }
+    if (OTPV_KERNEL_AVX2 == nKernel)
+    {
+        return (0 != __builtin_cpu_supports ("avx2"));
+    }
+#endif
+    return (1);
+}
+
+/*******************************************************************************
+
+  OTPV_SetKernel
+
+  Select the SHA-1 kernel, returns 0 or -1 if the CPU lacks it
+
+*******************************************************************************/
+
+int OTPV_SetKernel (int nKernel)
+{
+    if (OTPV_KERNEL_AUTO == nKernel)
+    {
+        for (nKernel = OTPV_KERNELS - 1; OTPV_KERNEL_SCALAR < nKernel; nKernel--)
+        {
+            if (OTPV_Supported (nKernel))
+            {
+                break;
+            }
+        }
+    }
+
+    if (!OTPV_Supported (nKernel))
+    {
+        return (-1);
+    }
+    pOtpvKernel = &tOtpvKernels[nKernel];
+    return (0);
+}
+
+/*******************************************************************************
+
+  OTPV_KernelName
+
+*******************************************************************************/
+
+const char* OTPV_KernelName (void)
+{
+    if (NULL == pOtpvKernel)
+    {
+        OTPV_SetKernel (OTPV_KERNEL_AUTO);
+    }
+    return (pOtpvKernel->szName);
+}
+
+/*******************************************************************************
+
+  OTPV_KeyInit
+
+  Hash the pads of a secret, the secret is zero padded to the 40 bytes of a
+  slot. cDigits is 6 or 8, returns 0 or -1.
+
+*******************************************************************************/
+
+int OTPV_KeyInit (typeOtpvKey * pKey, const uint8_t * pSecret, uint8_t cSecretLength, uint8_t cDigits)
+{
+    static const uint32_t nSha1Init[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    uint8_t cBlock[64];
+    uint32_t w[16];
+    int i;
+
+    if ((OTPV_SECRET_LENGTH < cSecretLength) || ((6 != cDigits) && (8 != cDigits)))
+    {
+        return (-1);
+    }
+
+    memset (cBlock, 0, sizeof (cBlock));
+    memcpy (cBlock, pSecret, cSecretLength);
+
+    for (i = 0; i < 16; i++)
+    {
+        w[i] = ((cBlock[4 * i] << 24) | (cBlock[4 * i + 1] << 16) | (cBlock[4 * i + 2] << 8) | cBlock[4 * i + 3]) ^ 0x36363636;
+    }
+    memcpy (pKey->nInner, nSha1Init, sizeof (nSha1Init));
+    OTPV_COMPRESS (uint32_t, pKey->nInner, w);
+
+    for (i = 0; i < 16; i++)
+    {
+        w[i] = ((cBlock[4 * i] << 24) | (cBlock[4 * i + 1] << 16) | (cBlock[4 * i + 2] << 8) | cBlock[4 * i + 3]) ^ 0x5C5C5C5C;
+    }
+    memcpy (pKey->nOuter, nSha1Init, sizeof (nSha1Init));
+    OTPV_COMPRESS (uint32_t, pKey->nOuter, w);
+
+    pKey->cDigits = cDigits;
+    memset (cBlock, 0, sizeof (cBlock));
+    memset (w, 0, sizeof (w));
+    return (0);
+}
+
+/*******************************************************************************
+
+  OTPV_TotpCounter
+
+  Counter of a TOTP slot at nTime (s) like get_code_from_totp_slot (),
+  nInterval is interval_or_counter of the slot
+
+*******************************************************************************/
+
+uint64_t OTPV_TotpCounter (uint64_t nTime, uint64_t nInterval)
+{
+    return ((0 == nInterval) ? 0 : nTime / nInterval);
+}
+
+/*******************************************************************************
+
+  OTPV_Truncate
+
+  dynamic_truncate () of the hash words and the digits of get_hotp_value ()
+
+*******************************************************************************/
+
+static uint32_t OTPV_Truncate (const uint32_t * pHash, uint8_t cDigits)
+{
+    uint8_t cHash[20];
+    uint8_t cOffset;
+    uint32_t nCode;
+    int i;
+
+    for (i = 0; i < 20; i++)
+    {
+        cHash[i] = (uint8_t) (pHash[i / 4] >> (24 - 8 * (i % 4)));
+    }
+
+    cOffset = cHash[19] & 0xf;
+    nCode = (cHash[cOffset] & 0x7f) << 24 | cHash[cOffset + 1] << 16 | cHash[cOffset + 2] << 8 | cHash[cOffset + 3];
+
+    return ((8 == cDigits) ? nCode % 100000000 : nCode % 1000000);
+}
+
+/*******************************************************************************
+
+  OTPV_Run
+
+  Codes of up to OTPV_CHUNK jobs, the kernel takes whole groups of lanes
+  and the scalar kernel the rest
+
+*******************************************************************************/
+
+static void OTPV_Run (const typeOtpvJob * pJobs, uint32_t * pCodes, uint32_t nJobs)
+{
+    uint32_t nHash[OTPV_CHUNK][5];
+    uint32_t nLanes;
+    uint32_t i = 0;
+
+    if (NULL == pOtpvKernel)
+    {
+        OTPV_SetKernel (OTPV_KERNEL_AUTO);
+    }
+
+    nLanes = pOtpvKernel->nLanes;
+    for (; i + nLanes <= nJobs; i += nLanes)
+    {
+        pOtpvKernel->pfHash (&pJobs[i], &nHash[i]);
+    }
+    for (; i < nJobs; i++)
+    {
+        OTPV_HashScalar (&pJobs[i], &nHash[i]);
+    }
+
+    for (i = 0; i < nJobs; i++)
+    {
+        pCodes[i] = OTPV_Truncate (nHash[i], pJobs[i].pKey->cDigits);
+    }
+}
+
+/*******************************************************************************
+
+  OTPV_Code
+
+  Code of a counter, get_hotp_value ()
+
+*******************************************************************************/
+
+uint32_t OTPV_Code (const typeOtpvKey * pKey, uint64_t nCounter)
+{
+    typeOtpvJob tJob = { pKey, nCounter };
+    uint32_t nHash[1][5];
+
+    OTPV_HashScalar (&tJob, nHash);
+    return (OTPV_Truncate (nHash[0], pKey->cDigits));
+}
+
+/*******************************************************************************
+
+  OTPV_Codes
+
+  Codes of nCodes counters from nCounter
+
+*******************************************************************************/
+
+void OTPV_Codes (const typeOtpvKey * pKey, uint64_t nCounter, uint32_t * pCodes, uint32_t nCodes)
+{
+    typeOtpvJob tJobs[OTPV_CHUNK];
+    uint32_t nCount;
+    uint32_t i;
+
+    while (0 < nCodes)
+    {
+        nCount = (OTPV_CHUNK < nCodes) ? OTPV_CHUNK : nCodes;
+        for (i = 0; i < nCount; i++)
+        {
+            tJobs[i].pKey = pKey;
+            tJobs[i].nCounter = nCounter++;
+        }
+        OTPV_Run (tJobs, pCodes, nCount);
+        pCodes += nCount;
+        nCodes -= nCount;
+    }
+}
+
+/*******************************************************************************
+
+  OTPV_Verify
+
+  Look for the code of each request in the nWindow counters from nCounter,
+  the windows of all requests share the lanes. nResult is the first offset
+  with the code like in validate_code_from_hotp_slot ().
+
+*******************************************************************************/
+
+void OTPV_Verify (typeOtpvRequest * pRequests, uint32_t nRequests, uint32_t nWindow)
+{
+    typeOtpvJob tJobs[OTPV_CHUNK];
+    uint32_t nCodes[OTPV_CHUNK];
+    uint32_t nJobRequest[OTPV_CHUNK];
+    uint32_t nJobOffset[OTPV_CHUNK];
+    uint32_t nRequest = 0;
+    uint32_t nOffset = 0;
+    uint32_t nCount;
+    uint32_t i;
+
+    for (i = 0; i < nRequests; i++)
+    {
+        pRequests[i].nResult = OTPV_CODE_NOT_VALID;
+    }
+    if (0 == nWindow)
+    {
+        return;
+    }
+
+    while (nRequest < nRequests)
+    {
+        for (nCount = 0; (nCount < OTPV_CHUNK) && (nRequest < nRequests); nCount++)
+        {
+            tJobs[nCount].pKey = pRequests[nRequest].pKey;
+            tJobs[nCount].nCounter = pRequests[nRequest].nCounter + nOffset;
+            nJobRequest[nCount] = nRequest;
+            nJobOffset[nCount] = nOffset;
+            if (nWindow <= ++nOffset)
+            {
+                nOffset = 0;
+                nRequest++;
+            }
+        }
+        OTPV_Run (tJobs, nCodes, nCount);
+
+        // The offsets of a request come in order, the first match stays
+        for (i = 0; i < nCount; i++)
+        {
+            if ((nCodes[i] == pRequests[nJobRequest[i]].nCode) && (OTPV_CODE_NOT_VALID == pRequests[nJobRequest[i]].nResult))
+            {
+                pRequests[nJobRequest[i]].nResult = nJobOffset[i];
+            }
+        }
+    }
+}
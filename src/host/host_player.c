@@ -0,0 +1,427 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * nkplay, plays a recording of the traffic recorder on the host build
+ *
+ *   nkplay [-f flash image] [-l latency file] [-c cycles per us] recording
+ *
+ * The recording is written by nkhost -r, or read from a device built with
+ * RECORDER=1 by CMD_GET_RECORDING. Each HID report and CCID message is a
+ * step, the T=1 blocks of the card until the next step belong to it. The
+ * records before the first step (startup) are skipped.
+ *
+ * The steps run in the order of the recording. The card is the replay
+ * backend, loaded per step with the APDUs reassembled from the recorded
+ * I-blocks, so the firmware sees the responses of the recorded card. The
+ * 1 ms clock is advanced to the recorded start of each step, the timeouts
+ * and the TOTP time of the firmware see the recorded gaps.
+ *
+ * Per step the status of the answer is compared with the recorded one and
+ * the recorded duration (ms of the timestamps, the cycles scaled by -c,
+ * 72 for the target, 1000 for a recording of the host build where the
+ * cycles are ns) is printed next to the modeled time of the card line and
+ * the flash, the APDUs and the replay mismatches. The exit code is 1 if a
+ * step differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "stm32f10x.h"
+#include "hw_config.h"
+#include "CCIDHID_usb_desc.h"
+#include "CCID_Global.h"
+#include "CCID_usb.h"
+#include "report_protocol.h"
+#include "recorder.h"
+#include "host.h"
+
+#define PLAY_MAX_RECORDS        65536
+
+// T=1 block, NAD PCB LEN INF LRC
+#define PLAY_T1_PCB             1
+#define PLAY_T1_LEN             2
+#define PLAY_T1_INF             3
+#define PLAY_T1_R_OR_S_BLOCK    0x80
+#define PLAY_T1_MORE            0x20
+
+typedef struct
+{
+    typeRecHeader tHeader;
+    const uint8_t* pData;
+} typePlayRecord;
+
+typedef struct
+{
+    uint8_t cCommand[HOST_CARD_MAX_APDU];
+    int nCommand;
+    uint8_t cResponse[HOST_CARD_MAX_RESPONSE];
+    int nResponse;
+    uint8_t cCommandDone;
+} typePlayApdu;
+
+static typePlayRecord tPlayRecords[PLAY_MAX_RECORDS];
+static int nPlayRecords;
+
+/*******************************************************************************
+
+  PLAY_Load
+
+  Split the recording into records, returns 0 or -1
+
+*******************************************************************************/
+
+static int PLAY_Load (const uint8_t * pRecording, long nLength)
+{
+    long nPosition = 0;
+
+    nPlayRecords = 0;
+    while (nPosition + (long) sizeof (typeRecHeader) <= nLength)
+    {
+        if (PLAY_MAX_RECORDS <= nPlayRecords)
+        {
+            return (-1);
+        }
+        memcpy (&tPlayRecords[nPlayRecords].tHeader, &pRecording[nPosition], sizeof (typeRecHeader));
+        nPosition += sizeof (typeRecHeader);
+        if (nLength < nPosition + tPlayRecords[nPlayRecords].tHeader.nLength)
+        {
+            return (-1);
+        }
+        tPlayRecords[nPlayRecords].pData = &pRecording[nPosition];
+        nPosition += tPlayRecords[nPlayRecords].tHeader.nLength;
+        nPlayRecords++;
+    }
+    return ((nPosition == nLength) ? 0 : -1);
+}
+
+/*******************************************************************************
+
+  PLAY_IsStep
+
+*******************************************************************************/
+
+static int PLAY_IsStep (const typePlayRecord * pRecord)
+{
+    return ((REC_HID_REPORT == pRecord->tHeader.cType) || (REC_CCID_MESSAGE == pRecord->tHeader.cType));
+}
+
+/*******************************************************************************
+
+  PLAY_AddBlock
+
+  Add the INF of a recorded I-block to the APDU, a complete response is
+  given to the replay card. R- and S-blocks are left to the T=1 layer of
+  the card model. Returns the number of added APDUs.
+
+*******************************************************************************/
+
+static int PLAY_AddBlock (typePlayApdu * pApdu, const typePlayRecord * pRecord)
+{
+    const uint8_t* pBlock = pRecord->pData;
+    int nInf;
+
+    if ((REC_TPDU_IN == pRecord->tHeader.cType) && (0 == pRecord->tHeader.nLength))
+    {
+        // The card didn't answer, the APDU is lost
+        memset (pApdu, 0, sizeof (*pApdu));
+        return (0);
+    }
+
+    if ((PLAY_T1_INF + 1 > pRecord->tHeader.nLength) || (0 != (pBlock[PLAY_T1_PCB] & PLAY_T1_R_OR_S_BLOCK)))
+    {
+        return (0);
+    }
+    nInf = pBlock[PLAY_T1_LEN];
+    if (PLAY_T1_INF + nInf + 1 > pRecord->tHeader.nLength)
+    {
+        return (0);
+    }
+
+    if (REC_TPDU_OUT == pRecord->tHeader.cType)
+    {
+        if ((TRUE == pApdu->cCommandDone) || ((int) sizeof (pApdu->cCommand) < pApdu->nCommand + nInf))
+        {
+            memset (pApdu, 0, sizeof (*pApdu));
+        }
+        memcpy (&pApdu->cCommand[pApdu->nCommand], &pBlock[PLAY_T1_INF], nInf);
+        pApdu->nCommand += nInf;
+        pApdu->cCommandDone = (0 == (pBlock[PLAY_T1_PCB] & PLAY_T1_MORE));
+        return (0);
+    }
+
+    if ((FALSE == pApdu->cCommandDone) || ((int) sizeof (pApdu->cResponse) < pApdu->nResponse + nInf))
+    {
+        memset (pApdu, 0, sizeof (*pApdu));
+        return (0);
+    }
+    memcpy (&pApdu->cResponse[pApdu->nResponse], &pBlock[PLAY_T1_INF], nInf);
+    pApdu->nResponse += nInf;
+    if (0 != (pBlock[PLAY_T1_PCB] & PLAY_T1_MORE))
+    {
+        return (0);
+    }
+
+    HOST_ReplayAdd (pApdu->cCommand, pApdu->nCommand, pApdu->cResponse, pApdu->nResponse);
+    memset (pApdu, 0, sizeof (*pApdu));
+    return (1);
+}
+
+/*******************************************************************************
+
+  PLAY_HostNs
+
+*******************************************************************************/
+
+static uint64_t PLAY_HostNs (void)
+{
+    struct timespec tNow;
+
+    clock_gettime (CLOCK_MONOTONIC, &tNow);
+    return ((uint64_t) tNow.tv_sec * 1000000000 + tNow.tv_nsec);
+}
+
+/*******************************************************************************
+
+  PLAY_FlashSum
+
+*******************************************************************************/
+
+static void PLAY_FlashSum (uint32_t * pnErases, uint32_t * pnPrograms, uint64_t * pnBusyNs)
+{
+    const typeHostFlashStats* pStats = HOST_FlashStats ();
+    uint32_t nPage;
+
+    *pnErases = 0;
+    *pnPrograms = 0;
+    for (nPage = 0; nPage < HOST_FLASH_PAGES; nPage++)
+    {
+        *pnErases += pStats->nErases[nPage];
+        *pnPrograms += pStats->nPrograms[nPage];
+    }
+    *pnBusyNs = pStats->nBusyNs;
+}
+
+/*******************************************************************************
+
+  PLAY_Step
+
+  Run the step starting at record nStep, returns the index of the next step
+  and sets *pcDiffers if the step differs from the recording
+
+*******************************************************************************/
+
+static int PLAY_Step (int nStep, double fCyclesPerUs, uint8_t * pcDiffers)
+{
+    const typePlayRecord* pStep = &tPlayRecords[nStep];
+    const typePlayRecord* pAnswer = NULL;
+    uint8_t cReport[KEYBOARD_FEATURE_COUNT];
+    typePlayApdu tApdu;
+    uint8_t cStatus;
+    uint8_t cRecordedStatus = 0;
+    uint32_t nErases, nPrograms;
+    uint32_t nErasesBefore, nProgramsBefore;
+    uint64_t nBusyNs, nBusyNsBefore;
+    uint64_t nLineNs = HOST_UsartTimeNs ();
+    uint64_t nHostNs;
+    uint32_t nApdus = HOST_CardApdus ();
+    int nRecordedApdus = 0;
+    int nNext;
+
+    memset (&tApdu, 0, sizeof (tApdu));
+    HOST_ReplayClear ();
+    for (nNext = nStep + 1; (nNext < nPlayRecords) && !PLAY_IsStep (&tPlayRecords[nNext]); nNext++)
+    {
+        switch (tPlayRecords[nNext].tHeader.cType)
+        {
+            case REC_HID_ANSWER:
+            case REC_CCID_ANSWER:
+                pAnswer = &tPlayRecords[nNext];
+                break;
+            case REC_TPDU_OUT:
+            case REC_TPDU_IN:
+                nRecordedApdus += PLAY_AddBlock (&tApdu, &tPlayRecords[nNext]);
+                break;
+        }
+    }
+
+    PLAY_FlashSum (&nErasesBefore, &nProgramsBefore, &nBusyNsBefore);
+    nHostNs = PLAY_HostNs ();
+
+    if (REC_HID_REPORT == pStep->tHeader.cType)
+    {
+        memset (cReport, 0, sizeof (cReport));
+        memcpy (cReport, pStep->pData, (KEYBOARD_FEATURE_COUNT < pStep->tHeader.nLength) ? KEYBOARD_FEATURE_COUNT : pStep->tHeader.nLength);
+        HOST_SetReport (cReport);
+        cStatus = HOST_GetReport ()[OUTPUT_CMD_STATUS_OFFSET];
+        if (NULL != pAnswer)
+        {
+            cRecordedStatus = pAnswer->pData[0];
+        }
+        printf ("%6d  hid  0x%02x", nStep, cReport[0]);
+    }
+    else
+    {
+        memcpy (UsbMessageBuffer, pStep->pData, pStep->tHeader.nLength);
+        Set_bBulkOutCompleteFlag;
+        CCID_DispatchMessage ();
+        cStatus = UsbMessageBuffer[OFFSET_BSTATUS];
+        if (NULL != pAnswer)
+        {
+            cRecordedStatus = pAnswer->pData[OFFSET_BSTATUS];
+        }
+        printf ("%6d  ccid 0x%02x", nStep, pStep->pData[OFFSET_BMESSAGETYPE]);
+    }
+
+    nHostNs = PLAY_HostNs () - nHostNs;
+    PLAY_FlashSum (&nErases, &nPrograms, &nBusyNs);
+    nApdus = HOST_CardApdus () - nApdus;
+
+    *pcDiffers = (NULL == pAnswer) || (cStatus != cRecordedStatus) || (0 != HOST_ReplayMismatches ()) || ((uint32_t) nRecordedApdus != nApdus);
+
+    printf ("  %3u/", cStatus);
+    if (NULL != pAnswer)
+    {
+        printf ("%-3u  %6u ms %10.1f us", cRecordedStatus, pAnswer->tHeader.nTime - pStep->tHeader.nTime, (pAnswer->tHeader.nCycles - pStep->tHeader.nCycles) / fCyclesPerUs);
+    }
+    else
+    {
+        printf ("-    %6s ms %10s us", "-", "-");
+    }
+    printf ("  %8.3f ms  %7.3f ms %3u/%-4u  %3u/%-3d %3u  %8.1f us%s\n",
+            (HOST_UsartTimeNs () - nLineNs) / 1000000.0, (nBusyNs - nBusyNsBefore) / 1000000.0, nErases - nErasesBefore, nPrograms - nProgramsBefore,
+            nApdus, nRecordedApdus, HOST_ReplayMismatches (), nHostNs / 1000.0, *pcDiffers ? "  differs" : "");
+
+    return (nNext);
+}
+
+/*******************************************************************************
+
+  main
+
+*******************************************************************************/
+
+int main (int argc, char* argv[])
+{
+    const char* szImage = NULL;
+    const char* szLatency = NULL;
+    uint8_t cATR[HOST_CARD_MAX_ATR];
+    uint8_t* pRecording;
+    double fCyclesPerUs = 72;
+    uint64_t nStartTime;
+    uint32_t nFirstTime = 0;
+    uint32_t nElapsed;
+    uint32_t nSteps = 0;
+    uint32_t nDiffers = 0;
+    uint8_t cDiffers;
+    FILE* pFile;
+    long nLength;
+    int nRecord;
+    int nOpt;
+
+    while (-1 != (nOpt = getopt (argc, argv, "f:l:c:")))
+    {
+        switch (nOpt)
+        {
+            case 'f':
+                szImage = optarg;
+                break;
+            case 'l':
+                szLatency = optarg;
+                break;
+            case 'c':
+                fCyclesPerUs = strtod (optarg, NULL);
+                break;
+            default:
+                fprintf (stderr, "usage: %s [-f flash image] [-l latency file] [-c cycles per us] recording\n", argv[0]);
+                return (2);
+        }
+    }
+
+    if ((optind + 1 != argc) || (0 >= fCyclesPerUs))
+    {
+        fprintf (stderr, "usage: %s [-f flash image] [-l latency file] [-c cycles per us] recording\n", argv[0]);
+        return (2);
+    }
+
+    pFile = fopen (argv[optind], "rb");
+    if (NULL == pFile)
+    {
+        perror (argv[optind]);
+        return (2);
+    }
+    fseek (pFile, 0, SEEK_END);
+    nLength = ftell (pFile);
+    rewind (pFile);
+    pRecording = malloc (nLength + 1);
+    if ((NULL == pRecording) || ((size_t) nLength != fread (pRecording, 1, nLength, pFile)) || (0 != PLAY_Load (pRecording, nLength)))
+    {
+        fprintf (stderr, "%s: not a recording\n", argv[optind]);
+        return (2);
+    }
+    fclose (pFile);
+
+    if ((NULL != szLatency) && (0 != HOST_CardLoadLatency (szLatency)))
+    {
+        return (2);
+    }
+
+    if (0 != HOST_DeviceOpen (szImage, HOST_DEFAULT_SERIAL))
+    {
+        fprintf (stderr, "can't map the flash image at 0x%08x\n", HOST_FLASH_BASE);
+        return (1);
+    }
+
+    // The startup ran with the card model, the steps get the recorded card
+    HOST_ReplaySetATR (cATR, tHostOpenPGPCard.pfPowerOn (cATR));
+    HOST_CardSetBackend (&tHostReplayCard);
+
+    printf ("  step  type     status/rec   recorded                 card line   flash  erase/prog  apdus/rec mis   host\n");
+
+    for (nRecord = 0; (nRecord < nPlayRecords) && !PLAY_IsStep (&tPlayRecords[nRecord]); nRecord++)
+    {
+    }
+    if (nRecord < nPlayRecords)
+    {
+        nFirstTime = tPlayRecords[nRecord].tHeader.nTime;
+    }
+    nStartTime = currentTime;
+
+    while (nRecord < nPlayRecords)
+    {
+        // Keep the recorded gap to the previous step
+        nElapsed = (uint32_t) (currentTime - nStartTime);
+        if (tPlayRecords[nRecord].tHeader.nTime - nFirstTime > nElapsed)
+        {
+            HOST_Wait (tPlayRecords[nRecord].tHeader.nTime - nFirstTime - nElapsed);
+        }
+
+        nRecord = PLAY_Step (nRecord, fCyclesPerUs, &cDiffers);
+        nSteps++;
+        nDiffers += cDiffers;
+    }
+
+    printf ("%u steps, %u differ\n", nSteps, nDiffers);
+
+    HOST_ReplayClear ();
+    HOST_DeviceClose ();
+    free (pRecording);
+    return ((0 == nDiffers) ? 0 : 1);
+}
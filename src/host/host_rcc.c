@@ -0,0 +1,122 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Clock and interrupt controller stubs of the host build, for the setup
+ * code of smartcard.c. The clocks are the ones of the target at 72 MHz,
+ * the card clock of host_usart.c is derived from PCLK2.
+ */
+
+#include "stm32f10x.h"
+#include "ramfunc.h"
+#include "host.h"
+
+#define HOST_SYSCLK             72000000
+
+/*******************************************************************************
+
+  RCC_GetClocksFreq
+
+*******************************************************************************/
+
+void RCC_GetClocksFreq (RCC_ClocksTypeDef * RCC_Clocks)
+{
+    RCC_Clocks->SYSCLK_Frequency = HOST_SYSCLK;
+    RCC_Clocks->HCLK_Frequency = HOST_SYSCLK;
+    RCC_Clocks->PCLK1_Frequency = HOST_SYSCLK / 2;
+    RCC_Clocks->PCLK2_Frequency = HOST_SYSCLK;
+    RCC_Clocks->ADCCLK_Frequency = HOST_SYSCLK / 6;
+}
+
+/*******************************************************************************
+
+  RCC functions of the clock setup, the PLL is always ready
+
+*******************************************************************************/
+
+void RCC_DeInit (void)
+{
+}
+
+void RCC_HSEConfig (uint32_t RCC_HSE)
+{
+}
+
+ErrorStatus RCC_WaitForHSEStartUp (void)
+{
+    return (SUCCESS);
+}
+
+void RCC_HCLKConfig (uint32_t RCC_SYSCLK)
+{
+}
+
+void RCC_PCLK1Config (uint32_t RCC_HCLK)
+{
+}
+
+void RCC_PCLK2Config (uint32_t RCC_HCLK)
+{
+}
+
+void RCC_PLLConfig (uint32_t RCC_PLLSource, uint32_t RCC_PLLMul)
+{
+}
+
+void RCC_PLLCmd (FunctionalState NewState)
+{
+}
+
+FlagStatus RCC_GetFlagStatus (uint8_t RCC_FLAG)
+{
+    return (SET);
+}
+
+void RCC_SYSCLKConfig (uint32_t RCC_SYSCLKSource)
+{
+}
+
+uint8_t RCC_GetSYSCLKSource (void)
+{
+    return (0x08);  // PLL
+}
+
+void RCC_APB2PeriphClockCmd (uint32_t RCC_APB2Periph, FunctionalState NewState)
+{
+}
+
+/*******************************************************************************
+
+  NVIC functions, the interrupts of the host build are function calls
+
+*******************************************************************************/
+
+void NVIC_PriorityGroupConfig (uint32_t NVIC_PriorityGroup)
+{
+}
+
+void NVIC_SetVectorTable (uint32_t NVIC_VectTab, uint32_t Offset)
+{
+}
+
+void RAM_InitVectorTable (void)
+{
+}
+
+void NVIC_Init (NVIC_InitTypeDef * NVIC_InitStruct)
+{
+}
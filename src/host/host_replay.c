@@ -0,0 +1,310 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Replayed card of the host build
+ *
+ * Card backend which answers with the responses of a file written by
+ * HOST_CardRecord (), or by hand from a trace of a real card:
+ *
+ *   atr 3bda18ff81b1fe751f030031c573c001400090000c
+ *   > 00a4040006d27600012401
+ *   < 9000
+ *
+ * The commands are answered in the order of the file. A command which
+ * differs from the file is counted as mismatch and answered with 6F00.
+ *
+ * The entries may also be given by HOST_ReplayAdd (), the player of the
+ * traffic recorder (host_player.c) loads the APDUs of each step.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stm32f10x.h"
+#include "host.h"
+
+#define REPLAY_MAX_ENTRIES      4096
+
+typedef struct
+{
+    uint8_t* pCommand;
+    uint16_t nCommand;
+    uint8_t* pResponse;
+    uint16_t nResponse;
+} typeReplayEntry;
+
+static uint8_t cReplayATR[HOST_CARD_MAX_ATR];
+static int nReplayATR;
+static typeReplayEntry tReplay[REPLAY_MAX_ENTRIES];
+static int nReplayEntries;
+static int nReplayNext;
+static uint32_t nReplayMismatches;
+
+/*******************************************************************************
+
+  REPLAY_ParseHex
+
+  Returns the number of bytes or -1
+
+*******************************************************************************/
+
+static int REPLAY_ParseHex (const char* szHex, uint8_t * pData, int nMax)
+{
+    unsigned int nByte;
+    int nCount = 0;
+    int nChars;
+
+    while (1 == sscanf (szHex, " %2x%n", &nByte, &nChars))
+    {
+        if (nMax <= nCount)
+        {
+            return (-1);
+        }
+        pData[nCount++] = (uint8_t) nByte;
+        szHex += nChars;
+    }
+    szHex += strspn (szHex, " \t\r\n");
+
+    return ((0 == *szHex) ? nCount : -1);
+}
+
+/*******************************************************************************
+
+  REPLAY_Copy
+
+*******************************************************************************/
+
+static uint8_t* REPLAY_Copy (const uint8_t * pData, int nLength)
+{
+    uint8_t* pCopy = malloc (nLength);
+
+    if (NULL != pCopy)
+    {
+        memcpy (pCopy, pData, nLength);
+    }
+    return (pCopy);
+}
+
+/*******************************************************************************
+
+  HOST_ReplayClear
+
+  Drop the entries, the next command is answered by the next added entry
+
+*******************************************************************************/
+
+void HOST_ReplayClear (void)
+{
+    int i;
+
+    for (i = 0; i < nReplayEntries; i++)
+    {
+        free (tReplay[i].pCommand);
+        free (tReplay[i].pResponse);
+    }
+    memset (tReplay, 0, sizeof (tReplay));
+    nReplayEntries = 0;
+    nReplayNext = 0;
+    nReplayMismatches = 0;
+}
+
+/*******************************************************************************
+
+  HOST_ReplayAdd
+
+  Add a command and its response, nResponse 0 leaves the response to a
+  later call. Returns 0 or -1.
+
+*******************************************************************************/
+
+int HOST_ReplayAdd (const uint8_t * pCommand, int nCommand, const uint8_t * pResponse, int nResponse)
+{
+    typeReplayEntry* pEntry;
+
+    if ((REPLAY_MAX_ENTRIES <= nReplayEntries) || (0 >= nCommand) || (HOST_CARD_MAX_APDU < nCommand) || (HOST_CARD_MAX_RESPONSE < nResponse))
+    {
+        return (-1);
+    }
+
+    pEntry = &tReplay[nReplayEntries++];
+    pEntry->pCommand = REPLAY_Copy (pCommand, nCommand);
+    pEntry->nCommand = nCommand;
+    pEntry->pResponse = NULL;
+    pEntry->nResponse = 0;
+    if (2 <= nResponse)
+    {
+        pEntry->pResponse = REPLAY_Copy (pResponse, nResponse);
+        pEntry->nResponse = nResponse;
+    }
+    return (0);
+}
+
+/*******************************************************************************
+
+  HOST_ReplaySetATR
+
+*******************************************************************************/
+
+void HOST_ReplaySetATR (const uint8_t * pATR, int nATR)
+{
+    nReplayATR = (HOST_CARD_MAX_ATR < nATR) ? HOST_CARD_MAX_ATR : nATR;
+    memcpy (cReplayATR, pATR, nReplayATR);
+}
+
+/*******************************************************************************
+
+  HOST_ReplayOpen
+
+  Load a recorded card, returns 0 or -1
+
+*******************************************************************************/
+
+int HOST_ReplayOpen (const char* szFile)
+{
+    uint8_t cData[HOST_CARD_MAX_RESPONSE];
+    char szLine[2 * HOST_CARD_MAX_RESPONSE + 16];
+    FILE* pFile;
+    int nLine = 0;
+    int nLength;
+
+    pFile = fopen (szFile, "r");
+    if (NULL == pFile)
+    {
+        perror (szFile);
+        return (-1);
+    }
+
+    HOST_ReplayClear ();
+    nReplayATR = 0;
+
+    while (NULL != fgets (szLine, sizeof (szLine), pFile))
+    {
+        nLine++;
+        if (0 == strncmp (szLine, "atr ", 4))
+        {
+            nReplayATR = REPLAY_ParseHex (&szLine[4], cReplayATR, sizeof (cReplayATR));
+            nLength = nReplayATR;
+        }
+        else if ((0 == strncmp (szLine, "> ", 2)) && (REPLAY_MAX_ENTRIES > nReplayEntries))
+        {
+            nLength = REPLAY_ParseHex (&szLine[2], cData, HOST_CARD_MAX_APDU);
+            if (0 < nLength)
+            {
+                HOST_ReplayAdd (cData, nLength, NULL, 0);
+            }
+        }
+        else if ((0 == strncmp (szLine, "< ", 2)) && (0 < nReplayEntries))
+        {
+            nLength = REPLAY_ParseHex (&szLine[2], cData, sizeof (cData));
+            if (2 <= nLength)
+            {
+                tReplay[nReplayEntries - 1].pResponse = REPLAY_Copy (cData, nLength);
+                tReplay[nReplayEntries - 1].nResponse = nLength;
+            }
+        }
+        else
+        {
+            // Comments, empty lines and the entries above the maximum
+            nLength = 0;
+        }
+
+        if (0 > nLength)
+        {
+            fprintf (stderr, "%s:%d: syntax error\n", szFile, nLine);
+            fclose (pFile);
+            return (-1);
+        }
+    }
+
+    fclose (pFile);
+    return ((2 <= nReplayATR) ? 0 : -1);
+}
+
+/*******************************************************************************
+
+  HOST_ReplayMismatches
+
+  Commands which weren't found in the file
+
+*******************************************************************************/
+
+uint32_t HOST_ReplayMismatches (void)
+{
+    return (nReplayMismatches);
+}
+
+/*******************************************************************************
+
+  REPLAY_Init
+
+*******************************************************************************/
+
+static void REPLAY_Init (uint32_t nSeed)
+{
+    nReplayNext = 0;
+    nReplayMismatches = 0;
+}
+
+/*******************************************************************************
+
+  REPLAY_PowerOn
+
+*******************************************************************************/
+
+static int REPLAY_PowerOn (uint8_t * pATR)
+{
+    memcpy (pATR, cReplayATR, nReplayATR);
+    return (nReplayATR);
+}
+
+/*******************************************************************************
+
+  REPLAY_Transmit
+
+*******************************************************************************/
+
+static int REPLAY_Transmit (const uint8_t * pCommand, int nCommand, uint8_t * pResponse, int nMaxResponse)
+{
+    typeReplayEntry* pEntry;
+
+    if (nReplayEntries <= nReplayNext)
+    {
+        nReplayMismatches++;
+        return (-1);    // end of the recording, the card is mute
+    }
+
+    pEntry = &tReplay[nReplayNext++];
+    if ((nCommand != pEntry->nCommand) || (0 != memcmp (pCommand, pEntry->pCommand, nCommand)) || (0 == pEntry->nResponse) || (nMaxResponse < pEntry->nResponse))
+    {
+        nReplayMismatches++;
+        pResponse[0] = 0x6F;
+        pResponse[1] = 0x00;
+        return (2);
+    }
+
+    memcpy (pResponse, pEntry->pResponse, pEntry->nResponse);
+    return (pEntry->nResponse);
+}
+
+const typeHostCardBackend tHostReplayCard = {
+    "replay",
+    REPLAY_Init,
+    NULL,
+    REPLAY_PowerOn,
+    REPLAY_Transmit
+};
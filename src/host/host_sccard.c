@@ -0,0 +1,824 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Smartcard of the host build
+ *
+ * The card at the I/O line of host_usart.c, it gets the bytes of
+ * smartcard.c one by one: power and reset from the GPIO pins, the ATR
+ * after the rising reset, a PPS exchange and the T=1 layer of the card
+ * (LRC check, chaining in both directions with IFSD bytes, the S-blocks).
+ * A byte sent with another etu than the card uses is lost, like the
+ * framing errors of a wrong PPS.
+ *
+ * The complete APDUs are answered by a card backend (host_openpgp.c or
+ * host_replay.c), which can be recorded to a file for host_replay.c.
+ *
+ * The answers are queued on the line with the times of tHostCardLatency:
+ * characters of nCharEtu, the BGT before a T=1 block and the processing
+ * time of an APDU by its INS. The defaults are rough values of an OpenPGP
+ * card V2.1, HOST_CardLoadLatency () reads the values of a measured card.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "stm32f10x.h"
+#include "CcidLocalAccess.h"
+#include "hw_config.h"
+#include "host.h"
+
+#define SCC_IFSD_DEFAULT        32      // ISO 7816-3, until S(IFS request)
+#define SCC_MAX_PPS             6
+#define SCC_MAX_BLOCK           (CCID_TPDU_OVERHEAD + 255)
+#define SCC_IFSC                254     // TA3 of the ATR
+#define SCC_ETU_TOLERANCE       20      // 1/20 = 5 % between reader and card
+
+#define SCC_PCB_I_SEQUENCE      0x40
+#define SCC_PCB_R_SEQUENCE      0x10
+#define SCC_PCB_R_ERROR         0x0F
+#define SCC_PCB_S_BLOCK         0xC0
+#define SCC_PCB_S_RESPONSE      0x20
+#define SCC_S_RESYNCH           0x00
+#define SCC_S_IFS               0x01
+
+// State of the card
+#define SCC_OFF                 0
+#define SCC_RESET               1       // powered, reset low or mute
+#define SCC_ATR                 2       // ATR sent, a PPS may follow
+#define SCC_PPS                 3
+#define SCC_T1                  4
+
+// Rough times of an OpenPGP card V2.1, the PIN commands write the retry
+// counter to the EEPROM
+typeHostCardLatency tHostCardLatency = {
+    .nAtrDelayClk = 10000,
+    .nCharEtu = 11,             // TC1 = 255 of the ATR
+    .nBlockGuardEtu = 22,
+    .nPollNs = 250,             // USART_ByteReceive loop at 72 MHz
+    .nDefaultUs = 10000,
+    .nInsUs = {
+        [0x20] = 45000,         // VERIFY
+        [0x24] = 90000,         // CHANGE REFERENCE DATA
+        [0x2A] = 25000,         // PSO:DECIPHER with AES
+        [0x2C] = 90000,         // RESET RETRY COUNTER
+        [0x44] = 400000,        // ACTIVATE FILE
+        [0x84] = 15000,         // GET CHALLENGE
+        [0xA4] = 5000,          // SELECT
+        [0xCA] = 8000,          // GET DATA
+        [0xDA] = 60000,         // PUT DATA
+        [0xE6] = 50000,         // TERMINATE DF
+    }
+};
+
+static const uint16_t nSccFTable[16] = { 372, 372, 558, 744, 1116, 1488, 1860, 0, 0, 512, 768, 1024, 1536, 2048, 0, 0 };
+static const uint8_t cSccDTable[16] = { 0, 1, 2, 4, 8, 16, 32, 64, 12, 20, 0, 0, 0, 0, 0, 0 };
+
+static const typeHostCardBackend* pSccBackend = &tHostOpenPGPCard;
+
+static uint8_t cSccState = SCC_OFF;
+static uint8_t cSccResetHigh = FALSE;
+static uint8_t cSccATR[HOST_CARD_MAX_ATR];
+static int nSccATR;
+static uint8_t cSccFD = 0x11;   // TA1 coding of the used F and D
+
+static uint8_t cSccPps[SCC_MAX_PPS];
+static int nSccPps;
+
+static uint8_t cSccBlock[SCC_MAX_BLOCK];
+static int nSccBlock;
+
+static uint8_t cSccCommand[HOST_CARD_MAX_APDU];
+static int nSccCommand;
+static uint8_t cSccResponse[HOST_CARD_MAX_RESPONSE];
+static int nSccResponse;
+static int nSccResponseSent;
+static int nSccLastPart;
+static uint8_t cSccSequence;    // N(S) of the next I-block of the card
+static uint8_t cSccIfsd = SCC_IFSD_DEFAULT;
+
+static FILE* pSccRecord = NULL;
+static uint64_t nSccBackendNs;
+static uint32_t nSccApdus;
+static uint32_t nSccLineErrors;
+static uint32_t nSccRejectBlocks;
+
+/*******************************************************************************
+
+  SCC_EtuNs
+
+  Elementary time unit of the card, F / (D * f)
+
+*******************************************************************************/
+
+static uint64_t SCC_EtuNs (void)
+{
+    uint32_t nClock = HOST_UsartClockHz ();
+    uint32_t nD = cSccDTable[cSccFD & 0x0F];
+
+    if ((0 == nClock) || (0 == nD))
+    {
+        return (0);
+    }
+    return ((uint64_t) nSccFTable[cSccFD >> 4] * 1000000000 / ((uint64_t) nD * nClock));
+}
+
+/*******************************************************************************
+
+  SCC_LineMatches
+
+  The byte of the reader is readable if both sides use the same etu
+
+*******************************************************************************/
+
+static int SCC_LineMatches (void)
+{
+    uint64_t nCardNs = SCC_EtuNs ();
+    uint64_t nReaderNs;
+    uint64_t nDiffNs;
+
+    if ((0 == nCardNs) || (0 == HOST_UsartBaud ()))
+    {
+        return (FALSE);
+    }
+    nReaderNs = 1000000000 / HOST_UsartBaud ();
+    nDiffNs = (nCardNs > nReaderNs) ? nCardNs - nReaderNs : nReaderNs - nCardNs;
+
+    return (nDiffNs * SCC_ETU_TOLERANCE <= nCardNs);
+}
+
+/*******************************************************************************
+
+  SCC_Send
+
+  Queue bytes of the card, the first one starts nDelayNs after the last
+  byte on the line
+
+*******************************************************************************/
+
+static void SCC_Send (const uint8_t * pData, int nLength, uint64_t nDelayNs)
+{
+    uint64_t nCharNs = tHostCardLatency.nCharEtu * SCC_EtuNs ();
+    int i;
+
+    for (i = 0; i < nLength; i++)
+    {
+        HOST_UsartQueue (pData[i], (0 == i) ? nDelayNs : 0, nCharNs);
+    }
+}
+
+/*******************************************************************************
+
+  SCC_Lrc
+
+*******************************************************************************/
+
+static uint8_t SCC_Lrc (const uint8_t * pBlock, int nLength)
+{
+    uint8_t cLrc = 0;
+    int i;
+
+    for (i = 0; i < nLength; i++)
+    {
+        cLrc ^= pBlock[i];
+    }
+    return (cLrc);
+}
+
+/*******************************************************************************
+
+  SCC_SendBlock
+
+  Send a block of the card after nDelayNs
+
+*******************************************************************************/
+
+static void SCC_SendBlock (uint8_t cPCB, const uint8_t * pInf, int nInf, uint64_t nDelayNs)
+{
+    uint8_t cBlock[SCC_MAX_BLOCK];
+
+    cBlock[CCID_TPDU_NAD] = 0;
+    cBlock[CCID_TPDU_PCD] = cPCB;
+    cBlock[CCID_TPDU_LENGTH] = (uint8_t) nInf;
+    if (0 < nInf)
+    {
+        memcpy (&cBlock[CCID_TPDU_DATASTART], pInf, nInf);
+    }
+    cBlock[CCID_TPDU_DATASTART + nInf] = SCC_Lrc (cBlock, CCID_TPDU_DATASTART + nInf);
+
+    SCC_Send (cBlock, CCID_TPDU_OVERHEAD + nInf, nDelayNs);
+}
+
+/*******************************************************************************
+
+  SCC_RecordHex
+
+*******************************************************************************/
+
+static void SCC_RecordHex (const char* szPrefix, const uint8_t * pData, int nLength)
+{
+    int i;
+
+    if (NULL == pSccRecord)
+    {
+        return;
+    }
+
+    fprintf (pSccRecord, "%s", szPrefix);
+    for (i = 0; i < nLength; i++)
+    {
+        fprintf (pSccRecord, "%02x", pData[i]);
+    }
+    fprintf (pSccRecord, "\n");
+    fflush (pSccRecord);
+}
+
+/*******************************************************************************
+
+  SCC_SendNextPart
+
+  Next I-block of the response, chained if it doesn't fit into IFSD
+
+*******************************************************************************/
+
+static void SCC_SendNextPart (uint64_t nDelayNs)
+{
+    uint8_t cPCB;
+    int nPart;
+
+    nPart = nSccResponse - nSccResponseSent;
+    cPCB = cSccSequence ? SCC_PCB_I_SEQUENCE : 0;
+    if (cSccIfsd < nPart)
+    {
+        nPart = cSccIfsd;
+        cPCB |= CCID_TPDU_CHAINING_FLAG;
+    }
+    cSccSequence ^= 1;
+
+    nSccLastPart = nSccResponseSent;
+    nSccResponseSent += nPart;
+
+    SCC_SendBlock (cPCB, &cSccResponse[nSccLastPart], nPart, nDelayNs);
+}
+
+/*******************************************************************************
+
+  SCC_Transmit
+
+  Send the collected APDU to the backend, returns its processing time in
+  ns or 0 for a mute card
+
+*******************************************************************************/
+
+static uint64_t SCC_Transmit (void)
+{
+    struct timespec tStart;
+    struct timespec tEnd;
+    uint32_t nUs;
+
+    SCC_RecordHex ("> ", cSccCommand, nSccCommand);
+
+    clock_gettime (CLOCK_MONOTONIC, &tStart);
+    nSccResponse = pSccBackend->pfTransmit (cSccCommand, nSccCommand, cSccResponse, sizeof (cSccResponse));
+    clock_gettime (CLOCK_MONOTONIC, &tEnd);
+
+    nSccBackendNs += (uint64_t) (tEnd.tv_sec - tStart.tv_sec) * 1000000000 + tEnd.tv_nsec - tStart.tv_nsec;
+    nSccApdus++;
+
+    nUs = (4 <= nSccCommand) ? tHostCardLatency.nInsUs[cSccCommand[1]] : 0;
+    if (0 == nUs)
+    {
+        nUs = tHostCardLatency.nDefaultUs;
+    }
+
+    nSccCommand = 0;
+    nSccResponseSent = 0;
+
+    if (2 > nSccResponse)
+    {
+        nSccResponse = 0;
+        return (0);
+    }
+
+    SCC_RecordHex ("< ", cSccResponse, nSccResponse);
+    return ((uint64_t) nUs * 1000);
+}
+
+/*******************************************************************************
+
+  SCC_Block
+
+  A complete T=1 block of the reader in cSccBlock
+
+*******************************************************************************/
+
+static void SCC_Block (void)
+{
+    uint64_t nBgtNs = tHostCardLatency.nBlockGuardEtu * SCC_EtuNs ();
+    uint64_t nProcessNs;
+    uint8_t cPCB = cSccBlock[CCID_TPDU_PCD];
+    uint8_t cInf = cSccBlock[CCID_TPDU_LENGTH];
+    uint8_t cIfs;
+
+    if (0 != SCC_Lrc (cSccBlock, nSccBlock))
+    {
+        // R-block with an EDC error
+        SCC_SendBlock (CCID_TPDU_R_BLOCK_FLAG | (cSccSequence ? SCC_PCB_R_SEQUENCE : 0) | 0x01, NULL, 0, nBgtNs);
+        return;
+    }
+
+    if (SCC_IFSC < cInf)
+    {
+        // R-block with an other error
+        SCC_SendBlock (CCID_TPDU_R_BLOCK_FLAG | (cSccSequence ? SCC_PCB_R_SEQUENCE : 0) | 0x02, NULL, 0, nBgtNs);
+        return;
+    }
+
+    // S-block requests
+    if (SCC_PCB_S_BLOCK == (cPCB & 0xE0))
+    {
+        switch (cPCB & 0x1F)
+        {
+            case SCC_S_RESYNCH:
+                cSccSequence = 0;
+                cSccIfsd = SCC_IFSD_DEFAULT;
+                nSccCommand = 0;
+                nSccResponse = 0;
+                SCC_SendBlock (cPCB | SCC_PCB_S_RESPONSE, NULL, 0, nBgtNs);
+                break;
+
+            case SCC_S_IFS:
+                cIfs = cSccBlock[CCID_TPDU_DATASTART];
+                if ((1 == cInf) && (0 != cIfs) && (CCID_TPDU_MAX_INF >= cIfs))
+                {
+                    cSccIfsd = cIfs;
+                }
+                SCC_SendBlock (cPCB | SCC_PCB_S_RESPONSE, &cIfs, 1, nBgtNs);
+                break;
+
+            default:
+                // WTX and ABORT are not requested by the reader
+                SCC_SendBlock (CCID_TPDU_R_BLOCK_FLAG | 0x02, NULL, 0, nBgtNs);
+                break;
+        }
+        return;
+    }
+
+    // R-block, the next part of a chained answer or a repetition
+    if (CCID_TPDU_R_BLOCK_FLAG == (cPCB & 0xC0))
+    {
+        if (0 != (cPCB & SCC_PCB_R_ERROR))
+        {
+            nSccResponseSent = nSccLastPart;
+            cSccSequence ^= 1;
+        }
+        if (nSccResponseSent >= nSccResponse)
+        {
+            SCC_SendBlock (CCID_TPDU_R_BLOCK_FLAG | 0x02, NULL, 0, nBgtNs);
+            return;
+        }
+        SCC_SendNextPart (nBgtNs);
+        return;
+    }
+
+    // Chained I-block taken as received with an EDC error
+    if ((0 != (cPCB & CCID_TPDU_CHAINING_FLAG)) && (0 < nSccRejectBlocks))
+    {
+        nSccRejectBlocks--;
+        SCC_SendBlock (CCID_TPDU_R_BLOCK_FLAG | ((cPCB & SCC_PCB_I_SEQUENCE) ? SCC_PCB_R_SEQUENCE : 0) | 0x01, NULL, 0, nBgtNs);
+        return;
+    }
+
+    // I-block, collect the APDU
+    if ((int) sizeof (cSccCommand) < nSccCommand + cInf)
+    {
+        nSccCommand = 0;
+        SCC_SendBlock (CCID_TPDU_R_BLOCK_FLAG | 0x02, NULL, 0, nBgtNs);
+        return;
+    }
+    memcpy (&cSccCommand[nSccCommand], &cSccBlock[CCID_TPDU_DATASTART], cInf);
+    nSccCommand += cInf;
+
+    if (0 != (cPCB & CCID_TPDU_CHAINING_FLAG))
+    {
+        // Acknowledge with N(R) of the next block of the reader
+        SCC_SendBlock (CCID_TPDU_R_BLOCK_FLAG | ((cPCB & SCC_PCB_I_SEQUENCE) ? 0 : SCC_PCB_R_SEQUENCE), NULL, 0, nBgtNs);
+        return;
+    }
+
+    nProcessNs = SCC_Transmit ();
+    if (0 != nProcessNs)
+    {
+        SCC_SendNextPart (nProcessNs);
+    }
+}
+
+/*******************************************************************************
+
+  SCC_PpsLength
+
+  Length of the PPS request, 0 until PPS0 is received
+
+*******************************************************************************/
+
+static int SCC_PpsLength (void)
+{
+    int nLength = 3;    // PPSS, PPS0, PCK
+
+    if (2 > nSccPps)
+    {
+        return (0);
+    }
+    nLength += (0 != (cSccPps[1] & 0x10)) + (0 != (cSccPps[1] & 0x20)) + (0 != (cSccPps[1] & 0x40));
+    return (nLength);
+}
+
+/*******************************************************************************
+
+  SCC_Pps
+
+  A complete PPS request, the card confirms T=1 with F and D up to the
+  values of TA1. Other requests are not answered.
+
+*******************************************************************************/
+
+static void SCC_Pps (void)
+{
+    uint8_t cTA1 = ((2 < nSccATR) && (0 != (cSccATR[1] & 0x10))) ? cSccATR[2] : 0x11;
+    uint8_t cFD = 0x11;
+
+    cSccState = SCC_T1;
+
+    if ((0 != SCC_Lrc (cSccPps, nSccPps)) || (1 != (cSccPps[1] & 0x0F)))
+    {
+        return;
+    }
+
+    if (0 != (cSccPps[1] & 0x10))
+    {
+        cFD = cSccPps[2];
+        if (((cFD >> 4) > (cTA1 >> 4)) || ((cFD & 0x0F) > (cTA1 & 0x0F)) || (0 == nSccFTable[cFD >> 4]) || (0 == cSccDTable[cFD & 0x0F]))
+        {
+            return;
+        }
+    }
+
+    // The answer is sent with the old etu, then the card switches
+    SCC_Send (cSccPps, nSccPps, tHostCardLatency.nBlockGuardEtu * SCC_EtuNs ());
+    cSccFD = cFD;
+}
+
+/*******************************************************************************
+
+  SCC_Atr
+
+  Cold reset of the card by the rising reset line
+
+*******************************************************************************/
+
+static void SCC_Atr (void)
+{
+    uint32_t nClock = HOST_UsartClockHz ();
+
+    cSccState = SCC_RESET;
+    cSccFD = 0x11;
+    cSccSequence = 0;
+    cSccIfsd = SCC_IFSD_DEFAULT;
+    nSccCommand = 0;
+    nSccResponse = 0;
+    nSccResponseSent = 0;
+    nSccBlock = 0;
+
+    nSccATR = pSccBackend->pfPowerOn (cSccATR);
+    if ((2 > nSccATR) || (0 == nClock))
+    {
+        return;     // mute card
+    }
+
+    SCC_RecordHex ("atr ", cSccATR, nSccATR);
+    SCC_Send (cSccATR, nSccATR, (uint64_t) tHostCardLatency.nAtrDelayClk * 1000000000 / nClock);
+    cSccState = SCC_ATR;
+}
+
+/*******************************************************************************
+
+  HOST_CardPower
+
+  VCC of the card, from the GPIO pins
+
+*******************************************************************************/
+
+void HOST_CardPower (uint8_t cOn)
+{
+    if (FALSE == cOn)
+    {
+        if (SCC_OFF != cSccState)
+        {
+            cSccState = SCC_OFF;
+            HOST_UsartFlush ();
+        }
+        return;
+    }
+
+    if (SCC_OFF == cSccState)
+    {
+        cSccState = SCC_RESET;
+        if (TRUE == cSccResetHigh)
+        {
+            SCC_Atr ();
+        }
+    }
+}
+
+/*******************************************************************************
+
+  HOST_CardReset
+
+  Level of the reset line, from the GPIO pin
+
+*******************************************************************************/
+
+void HOST_CardReset (uint8_t cHigh)
+{
+    uint8_t cRising = (FALSE == cSccResetHigh) && (FALSE != cHigh);
+
+    cSccResetHigh = (FALSE != cHigh);
+
+    if (SCC_OFF == cSccState)
+    {
+        return;
+    }
+    if (FALSE == cSccResetHigh)
+    {
+        cSccState = SCC_RESET;
+    }
+    else if (cRising)
+    {
+        SCC_Atr ();
+    }
+}
+
+/*******************************************************************************
+
+  HOST_CardReceive
+
+  Byte of the reader at the current line time
+
+*******************************************************************************/
+
+void HOST_CardReceive (uint8_t cByte)
+{
+    if ((SCC_OFF == cSccState) || (SCC_RESET == cSccState))
+    {
+        return;
+    }
+
+    if (FALSE == SCC_LineMatches ())
+    {
+        nSccLineErrors++;
+        return;
+    }
+
+    if (SCC_ATR == cSccState)
+    {
+        // A PPS request must be the first exchange after the ATR
+        if (0xFF == cByte)
+        {
+            cSccState = SCC_PPS;
+            nSccPps = 0;
+        }
+        else
+        {
+            cSccState = SCC_T1;
+            nSccBlock = 0;
+        }
+    }
+
+    if (SCC_PPS == cSccState)
+    {
+        cSccPps[nSccPps++] = cByte;
+        if (nSccPps == SCC_PpsLength ())
+        {
+            SCC_Pps ();
+            nSccBlock = 0;
+        }
+        return;
+    }
+
+    cSccBlock[nSccBlock++] = cByte;
+    if ((CCID_TPDU_PROLOG < nSccBlock) && (nSccBlock == CCID_TPDU_OVERHEAD + cSccBlock[CCID_TPDU_LENGTH]))
+    {
+        SCC_Block ();
+        nSccBlock = 0;
+    }
+}
+
+/*******************************************************************************
+
+  HOST_CardLoadLatency
+
+  Read the latency model from a file, lines of
+
+    atr_delay <card clocks from the reset to the ATR>
+    char <etu of a card character>
+    bgt <etu of the block guard time>
+    poll <ns of a receiver poll>
+    default <us of an APDU>
+    ins <INS in hex> <us of the APDU>
+
+  Returns 0 or -1
+
+*******************************************************************************/
+
+int HOST_CardLoadLatency (const char* szFile)
+{
+    char szLine[128];
+    FILE* pFile;
+    unsigned int nIns;
+    unsigned int nValue;
+    int nLine = 0;
+    int nOk;
+
+    pFile = fopen (szFile, "r");
+    if (NULL == pFile)
+    {
+        perror (szFile);
+        return (-1);
+    }
+
+    while (NULL != fgets (szLine, sizeof (szLine), pFile))
+    {
+        nLine++;
+        nOk = TRUE;
+        if (1 == sscanf (szLine, " atr_delay %u", &nValue))
+        {
+            tHostCardLatency.nAtrDelayClk = nValue;
+        }
+        else if (1 == sscanf (szLine, " char %u", &nValue))
+        {
+            tHostCardLatency.nCharEtu = nValue;
+        }
+        else if (1 == sscanf (szLine, " bgt %u", &nValue))
+        {
+            tHostCardLatency.nBlockGuardEtu = nValue;
+        }
+        else if (1 == sscanf (szLine, " poll %u", &nValue))
+        {
+            tHostCardLatency.nPollNs = nValue;
+        }
+        else if (1 == sscanf (szLine, " default %u", &nValue))
+        {
+            tHostCardLatency.nDefaultUs = nValue;
+        }
+        else if ((2 == sscanf (szLine, " ins %x %u", &nIns, &nValue)) && (0xFF >= nIns))
+        {
+            tHostCardLatency.nInsUs[nIns] = nValue;
+        }
+        else
+        {
+            // Comments and empty lines
+            nOk = ('#' == szLine[strspn (szLine, " \t")]) || (0 == szLine[strspn (szLine, " \t\r\n")]);
+        }
+
+        if (FALSE == nOk)
+        {
+            fprintf (stderr, "%s:%d: syntax error\n", szFile, nLine);
+            fclose (pFile);
+            return (-1);
+        }
+    }
+
+    fclose (pFile);
+    return (0);
+}
+
+/*******************************************************************************
+
+  HOST_CardSetBackend
+
+  Card backend of the following HOST_CardInit ()
+
+*******************************************************************************/
+
+void HOST_CardSetBackend (const typeHostCardBackend * pBackend)
+{
+    pSccBackend = pBackend;
+}
+
+/*******************************************************************************
+
+  HOST_CardRecord
+
+  Write the ATR and the APDUs of the card to szFile, the format of
+  host_replay.c. Returns 0 or -1.
+
+*******************************************************************************/
+
+int HOST_CardRecord (const char* szFile)
+{
+    pSccRecord = fopen (szFile, "w");
+    if (NULL == pSccRecord)
+    {
+        perror (szFile);
+        return (-1);
+    }
+    fprintf (pSccRecord, "# %s card\n", pSccBackend->szName);
+    return (0);
+}
+
+/*******************************************************************************
+
+  HOST_CardBackendNs
+
+  Host time spent in the card backend
+
+*******************************************************************************/
+
+uint64_t HOST_CardBackendNs (void)
+{
+    return (nSccBackendNs);
+}
+
+/*******************************************************************************
+
+  HOST_CardApdus
+
+  Number of APDUs answered by the backend
+
+*******************************************************************************/
+
+uint32_t HOST_CardApdus (void)
+{
+    return (nSccApdus);
+}
+
+/*******************************************************************************
+
+  HOST_CardLineErrors
+
+  Bytes of the reader lost by a wrong etu
+
+*******************************************************************************/
+
+uint32_t HOST_CardLineErrors (void)
+{
+    return (nSccLineErrors);
+}
+
+/*******************************************************************************
+
+  HOST_CardRejectBlocks
+
+  The next nBlocks chained I-blocks of the reader are answered with a
+  R-block with an EDC error, which asks for a repetition
+
+*******************************************************************************/
+
+void HOST_CardRejectBlocks (uint32_t nBlocks)
+{
+    nSccRejectBlocks = nBlocks;
+}
+
+/*******************************************************************************
+
+  HOST_CardInit
+
+  Factory state of the card, nSeed starts its random numbers. The card is
+  powered by the startup of the firmware.
+
+*******************************************************************************/
+
+void HOST_CardInit (uint32_t nSeed)
+{
+    nSccRejectBlocks = 0;
+    pSccBackend->pfInit (nSeed);
+}
+
+/*******************************************************************************
+
+  HOST_CardSetSerial
+
+*******************************************************************************/
+
+void HOST_CardSetSerial (uint32_t nSerial)
+{
+    if (NULL != pSccBackend->pfSetSerial)
+    {
+        pSccBackend->pfSetSerial (nSerial);
+    }
+    cardSerial = nSerial;
+}
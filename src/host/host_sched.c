@@ -0,0 +1,333 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * nksched, wake to service latency of the scheduler
+ *
+ *   nksched [-t ms] [-u period] [-h period] [-k period] [-f period]
+ *
+ * Runs the main loop of main.c (SCHED_Run) for -t ms (default 10000) with
+ * tasks doing the work of the tasks of main.c. The tick hook plays the
+ * interrupt handlers and posts the event of a class every period ms:
+ *   -u  USB, a CCID XfrBlock with a GET CHALLENGE of the card   (default 50)
+ *   -h  HID command, CMD_GET_STATUS, every 4th one is
+ *       CMD_GET_USER_PASSWORD_RETRY_COUNT which needs the card  (default 20)
+ *   -k  keyboard, a HOTP code of slot 1, writes the counter     (default 1000)
+ *   -f  flash, PERF_Flush ()                                    (default 5000)
+ * A period of 0 disables the class. The card answer is received at the
+ * __WFI () of the firmware (HOST_UsartSetAsync), the other classes run
+ * while a task waits for the card like on the target.
+ *
+ * Prints the figures of CMD_GET_SCHED_STATS, read by SCHED_GetStats ():
+ * the command is a debug command (ADD_DEBUG_COMMANDS).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "stm32f10x.h"
+#include "stm32f10x_crc.h"
+#include "CCIDHID_usb_desc.h"
+#include "hotp.h"
+#include "report_protocol.h"
+#include "CCID_Global.h"
+#include "CCID_usb.h"
+#include "smartcard.h"
+#include "perf_counters.h"
+#include "scheduler.h"
+#include "host.h"
+
+#define SCHEDT_CARD_COMMAND_EVERY   4       // HID commands per command for the card
+#define SCHEDT_CHALLENGE_LENGTH     8
+
+#define CCID_RDR_TO_PC_DATABLOCK    0x80
+#define CCID_STATUS_FAILED          0x40
+
+static const char* szSchedtClasses[SCHED_CLASSES] = { "usb", "hid command", "keyboard", "flash" };
+
+static uint32_t nSchedtPeriod[SCHED_CLASSES] = { 50, 20, 1000, 5000 };
+static uint32_t nSchedtTicks = 0;
+
+static uint8_t cSchedtSequence = 0;
+static uint32_t nSchedtHidCommands = 0;
+static uint32_t nSchedtErrors = 0;
+
+/*******************************************************************************
+
+  SCHEDT_Tick
+
+  Tick hook, the interrupt handlers posting the events
+
+*******************************************************************************/
+
+static void SCHEDT_Tick (void)
+{
+    uint8_t cClass;
+
+    nSchedtTicks++;
+    for (cClass = 0; cClass < SCHED_CLASSES; cClass++)
+    {
+        if ((0 != nSchedtPeriod[cClass]) && (0 == nSchedtTicks % nSchedtPeriod[cClass]))
+        {
+            SCHED_PostEvent (cClass);
+        }
+    }
+}
+
+/*******************************************************************************
+
+  SCHEDT_XfrBlock
+
+  A XfrBlock of the bulk out endpoint, passed to CCID_DispatchMessage ()
+  like nkvpcd. Returns 0 if the card answered nAnswer bytes and 90 00, or
+  -1.
+
+*******************************************************************************/
+
+static int SCHEDT_XfrBlock (const uint8_t * pApdu, int nApdu, uint32_t nAnswer)
+{
+    memset (UsbMessageBuffer, 0, USB_MESSAGE_HEADER_SIZE);
+    UsbMessageBuffer[OFFSET_BMESSAGETYPE] = PC_TO_RDR_XFRBLOCK;
+    UsbMessageBuffer[OFFSET_DWLENGTH] = (uint8_t) nApdu;
+    UsbMessageBuffer[OFFSET_BSEQ] = cSchedtSequence++;
+    memcpy (&UsbMessageBuffer[OFFSET_ABDATA], pApdu, nApdu);
+
+    Set_bBulkOutCompleteFlag;
+    CCID_DispatchMessage ();
+
+    if ((CCID_RDR_TO_PC_DATABLOCK != UsbMessageBuffer[OFFSET_BMESSAGETYPE]) || (0 != (UsbMessageBuffer[OFFSET_BSTATUS] & CCID_STATUS_FAILED)) ||
+        (nAnswer + 2 != (UsbMessageBuffer[OFFSET_DWLENGTH] | (UsbMessageBuffer[OFFSET_DWLENGTH + 1] << 8))) ||
+        (0x90 != UsbMessageBuffer[OFFSET_ABDATA + nAnswer]) || (0x00 != UsbMessageBuffer[OFFSET_ABDATA + nAnswer + 1]))
+    {
+        return (-1);
+    }
+    return (0);
+}
+
+/*******************************************************************************
+
+  SCHEDT_UsbTask
+
+  The CCID protocol owns the card, the first XfrBlock selects the OpenPGP
+  application
+
+*******************************************************************************/
+
+static void SCHEDT_UsbTask (void)
+{
+    static const uint8_t cSelect[] = { 0x00, 0xA4, 0x04, 0x00, 0x06, 0xD2, 0x76, 0x00, 0x01, 0x24, 0x01 };
+    static const uint8_t cGetChallenge[] = { 0x00, 0x84, 0x00, 0x00, SCHEDT_CHALLENGE_LENGTH };
+
+    if ((0 == cSchedtSequence) && (0 != SCHEDT_XfrBlock (cSelect, sizeof (cSelect), 0)))
+    {
+        nSchedtErrors++;
+    }
+
+    if (0 != SCHEDT_XfrBlock (cGetChallenge, sizeof (cGetChallenge), SCHEDT_CHALLENGE_LENGTH))
+    {
+        nSchedtErrors++;
+    }
+}
+
+/*******************************************************************************
+
+  SCHEDT_HidCommandTask
+
+  Parse a report like HidCommandTask (), the reports needing the card are
+  left to the main loop
+
+*******************************************************************************/
+
+static void SCHEDT_HidCommandTask (void)
+{
+    uint8_t cReport[KEYBOARD_FEATURE_COUNT];
+    uint8_t cOutput[KEYBOARD_FEATURE_COUNT];
+    uint32_t nCrc;
+
+    memset (cReport, 0, sizeof (cReport));
+    cReport[CMD_TYPE_OFFSET] = (0 == (nSchedtHidCommands + 1) % SCHEDT_CARD_COMMAND_EVERY) ? CMD_GET_USER_PASSWORD_RETRY_COUNT : CMD_GET_STATUS;
+
+    if (SCHED_IsNested () && (parse_report_active () || cmd_needs_smartcard (cReport[CMD_TYPE_OFFSET])))
+    {
+        SCHED_DeferEvent (SCHED_CLASS_HID_COMMAND);
+        return;
+    }
+
+    CRC_ResetDR ();
+    nCrc = CRC_CalcBlockCRC ((uint32_t *) cReport, KEYBOARD_FEATURE_COUNT / 4 - 1);
+    memcpy (&cReport[OUTPUT_CRC_OFFSET], &nCrc, 4);
+
+    memset (cOutput, 0, sizeof (cOutput));
+    parse_report (cReport, cOutput);
+    if (CMD_STATUS_OK != cOutput[OUTPUT_CMD_STATUS_OFFSET])
+    {
+        nSchedtErrors++;
+    }
+    nSchedtHidCommands++;
+}
+
+/*******************************************************************************
+
+  SCHEDT_KeyboardTask
+
+  A lock key double click like KeyboardTask ()
+
+*******************************************************************************/
+
+static void SCHEDT_KeyboardTask (void)
+{
+    if (SCHED_IsNested () && parse_report_active ())
+    {
+        SCHED_DeferEvent (SCHED_CLASS_KEYBOARD);
+        return;
+    }
+
+    get_code_from_hotp_slot (0);
+}
+
+/*******************************************************************************
+
+  SCHEDT_FlashTask
+
+  Like FlashTask ()
+
+*******************************************************************************/
+
+static void SCHEDT_FlashTask (void)
+{
+    if (SCHED_IsNested ())
+    {
+        SCHED_DeferEvent (SCHED_CLASS_FLASH);
+        return;
+    }
+
+    PERF_Flush ();
+}
+
+/*******************************************************************************
+
+  SCHEDT_IdleTask
+
+  Like SmartcardIdleTask ()
+
+*******************************************************************************/
+
+static void SCHEDT_IdleTask (void)
+{
+    SCHED_Yield (SCHED_ALLOW_NO_USB);
+}
+
+/*******************************************************************************
+
+  SCHEDT_WriteHotpSlot
+
+  Program HOTP slot 1 like the write to slot command
+
+*******************************************************************************/
+
+static void SCHEDT_WriteHotpSlot (void)
+{
+    OTP_slot tSlot;
+    uint8_t cOutput[KEYBOARD_FEATURE_COUNT];
+
+    memset (&tSlot, 0, sizeof (tSlot));
+    tSlot.slot_number = 0x10;
+    memcpy (tSlot.name, "sched", 5);
+    memset (tSlot.secret, 0x5A, SECRET_LENGTH_DEFINE);
+
+    cmd_write_to_slot (&tSlot, cOutput);
+}
+
+/*******************************************************************************
+
+  main
+
+*******************************************************************************/
+
+int main (int argc, char* argv[])
+{
+    typeSchedStats tStats;
+    uint32_t nDuration = 10000;
+    uint32_t nStart;
+    uint8_t cClass;
+    int nOpt;
+
+    while (-1 != (nOpt = getopt (argc, argv, "t:u:h:k:f:")))
+    {
+        switch (nOpt)
+        {
+            case 't':
+                nDuration = strtoul (optarg, NULL, 0);
+                break;
+            case 'u':
+                nSchedtPeriod[SCHED_CLASS_USB] = strtoul (optarg, NULL, 0);
+                break;
+            case 'h':
+                nSchedtPeriod[SCHED_CLASS_HID_COMMAND] = strtoul (optarg, NULL, 0);
+                break;
+            case 'k':
+                nSchedtPeriod[SCHED_CLASS_KEYBOARD] = strtoul (optarg, NULL, 0);
+                break;
+            case 'f':
+                nSchedtPeriod[SCHED_CLASS_FLASH] = strtoul (optarg, NULL, 0);
+                break;
+            default:
+                fprintf (stderr, "usage: %s [-t ms] [-u period] [-h period] [-k period] [-f period]\n", argv[0]);
+                return (2);
+        }
+    }
+
+    if (0 != HOST_DeviceOpen (NULL, HOST_DEFAULT_SERIAL))
+    {
+        fprintf (stderr, "can't map the flash image at 0x%08x\n", HOST_FLASH_BASE);
+        return (1);
+    }
+
+    SCHEDT_WriteHotpSlot ();
+    PERF_Flush ();
+
+    SCHED_SetTask (SCHED_CLASS_USB, SCHEDT_UsbTask);
+    SCHED_SetTask (SCHED_CLASS_HID_COMMAND, SCHEDT_HidCommandTask);
+    SCHED_SetTask (SCHED_CLASS_KEYBOARD, SCHEDT_KeyboardTask);
+    SCHED_SetTask (SCHED_CLASS_FLASH, SCHEDT_FlashTask);
+    CRD_SetIdleTask (SCHEDT_IdleTask);
+    HOST_UsartSetAsync (TRUE);
+    HOST_SetTickHook (SCHEDT_Tick);
+
+    nStart = SCHED_GetTime ();
+    while ((SCHED_GetTime () - nStart) < nDuration)
+    {
+        SCHED_Run ();
+    }
+
+    HOST_SetTickHook (NULL);
+    HOST_UsartSetAsync (FALSE);
+    CRD_SetIdleTask (NULL);
+
+    printf ("%u ms, %u card APDUs, %u errors\n", nDuration, HOST_CardApdus (), nSchedtErrors);
+    printf ("class        period ms    served  mean ms  max ms  deferred\n");
+    for (cClass = 0; cClass < SCHED_CLASSES; cClass++)
+    {
+        SCHED_GetStats (cClass, &tStats);
+        printf ("%-11s  %9u  %8u  %7.2f  %6u  %8u\n", szSchedtClasses[cClass], nSchedtPeriod[cClass], tStats.nServed,
+                (0 == tStats.nServed) ? 0.0 : (double) tStats.nLatencySum / tStats.nServed, tStats.nLatencyMax, tStats.nDeferred);
+    }
+
+    HOST_DeviceClose ();
+    return ((0 == nSchedtErrors) ? 0 : 1);
+}
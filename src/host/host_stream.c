@@ -0,0 +1,287 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * nkstream, the streamed object upload (CMD_STREAM_OPEN / CMD_STREAM_DATA)
+ *
+ *   nkstream
+ *
+ * Uploads HOTP slot 1 and a password safe entry through parse_report
+ * after CMD_FIRST_AUTHENTICATE. The tests:
+ *
+ *   success      open and one data report, the slot name is read back
+ *   no auth      open with a wrong temporary admin password
+ *   bad crc      object CRC off by one, the commit fails
+ *   wrong order  the data report with sequence 2 aborts the stream, the
+ *                one with sequence 1 finds no stream
+ *   replaced     a second open replaces an open stream
+ *   pws          password safe entry, the safe isn't enabled: the commit
+ *                fails
+ *
+ * Every answer is checked by status and bytes received, after a failed
+ * upload the slot still holds the object of the last commit. Returns 1 if
+ * a check failed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "stm32f10x.h"
+#include "stm32f10x_crc.h"
+#include "CCIDHID_usb_desc.h"
+#include "hotp.h"
+#include "report_protocol.h"
+#include "password_safe.h"
+#include "host.h"
+
+#define STREAMT_HOTP_SLOT       0x10
+#define STREAMT_PWS_SLOT        0
+
+#define STREAMT_OTP_LENGTH      (sizeof (OTP_slot) - offsetof (OTP_slot, name))
+#define STREAMT_PWS_LENGTH      (PWS_SLOTNAME_LENGTH + PWS_PASSWORD_LENGTH + PWS_LOGINNAME_LENGTH)
+#define STREAMT_MAX_LENGTH      STREAMT_OTP_LENGTH
+
+#define STREAMT_NAME_LENGTH     15
+
+static const uint8_t cStreamtTempPassword[25] = "stream temp password";
+
+static int nStreamtErrors = 0;
+
+/*******************************************************************************
+
+  STREAMT_SendReport
+
+  Add the CRC and run the report, returns the answer
+
+*******************************************************************************/
+
+static const uint8_t* STREAMT_SendReport (uint8_t * pReport)
+{
+    uint32_t nCrc;
+
+    CRC_ResetDR ();
+    nCrc = CRC_CalcBlockCRC ((uint32_t *) pReport, KEYBOARD_FEATURE_COUNT / 4 - 1);
+    memcpy (&pReport[OUTPUT_CRC_OFFSET], &nCrc, 4);
+
+    HOST_SetReport (pReport);
+    return (HOST_GetReport ());
+}
+
+/*******************************************************************************
+
+  STREAMT_Check
+
+  Check the status and the bytes received of a stream answer
+
+*******************************************************************************/
+
+static void STREAMT_Check (const char* szTest, const char* szReport, const uint8_t * pAnswer, uint8_t cStatus, uint8_t cReceived)
+{
+    if ((cStatus != pAnswer[OUTPUT_CMD_STATUS_OFFSET]) || ((CMD_STATUS_OK == cStatus) && (cReceived != pAnswer[OUTPUT_CMD_RESULT_OFFSET])))
+    {
+        printf ("%s: %s, status %u received %u, expected status %u received %u\n", szTest, szReport, pAnswer[OUTPUT_CMD_STATUS_OFFSET],
+                pAnswer[OUTPUT_CMD_RESULT_OFFSET], cStatus, cReceived);
+        nStreamtErrors++;
+    }
+}
+
+/*******************************************************************************
+
+  STREAMT_OtpObject
+
+  Object of HOTP slot 1 named szName in a word buffer, returns its CRC
+
+*******************************************************************************/
+
+static uint32_t STREAMT_OtpObject (const char* szName, uint32_t * pObject)
+{
+    uint8_t* pBytes = (uint8_t *) pObject;
+
+    memset (pObject, 0, (STREAMT_MAX_LENGTH + 3) / 4 * 4);
+    strncpy ((char *) pBytes, szName, STREAMT_NAME_LENGTH);
+    memset (pBytes + STREAMT_NAME_LENGTH, 0x5A, SECRET_LENGTH_DEFINE);
+
+    CRC_ResetDR ();
+    return (CRC_CalcBlockCRC (pObject, (STREAMT_OTP_LENGTH + 3) / 4));
+}
+
+/*******************************************************************************
+
+  STREAMT_Open
+
+  CMD_STREAM_OPEN with the first bytes of the object, returns the answer
+
+*******************************************************************************/
+
+static const uint8_t* STREAMT_Open (uint8_t cTarget, uint8_t cSlot, uint8_t cLength, uint32_t nCrc, const uint32_t * pObject, const uint8_t * pPassword)
+{
+    uint8_t cReport[KEYBOARD_FEATURE_COUNT];
+    cmd_stream_open_payload* pPayload = (cmd_stream_open_payload *) (cReport + 1);
+
+    memset (cReport, 0, sizeof (cReport));
+    cReport[CMD_TYPE_OFFSET] = CMD_STREAM_OPEN;
+    memcpy (pPayload->temporary_admin_password, pPassword, sizeof (pPayload->temporary_admin_password));
+    pPayload->target = cTarget;
+    pPayload->slot_number = cSlot;
+    pPayload->length = cLength;
+    pPayload->object_crc = nCrc;
+    memcpy (pPayload->data, pObject, STREAM_OPEN_DATA_LENGTH);
+
+    return (STREAMT_SendReport (cReport));
+}
+
+/*******************************************************************************
+
+  STREAMT_Data
+
+  CMD_STREAM_DATA with the bytes of data report cSequence
+
+*******************************************************************************/
+
+static const uint8_t* STREAMT_Data (uint8_t cSequence, const uint32_t * pObject)
+{
+    uint8_t cReport[KEYBOARD_FEATURE_COUNT];
+    cmd_stream_data_payload* pPayload = (cmd_stream_data_payload *) (cReport + 1);
+
+    memset (cReport, 0, sizeof (cReport));
+    cReport[CMD_TYPE_OFFSET] = CMD_STREAM_DATA;
+    pPayload->sequence = cSequence;
+    memcpy (pPayload->data, (const uint8_t *) pObject + STREAM_OPEN_DATA_LENGTH, STREAM_DATA_LENGTH);
+
+    return (STREAMT_SendReport (cReport));
+}
+
+/*******************************************************************************
+
+  STREAMT_CheckSlotName
+
+  Read HOTP slot 1 and compare its name
+
+*******************************************************************************/
+
+static void STREAMT_CheckSlotName (const char* szTest, const char* szName)
+{
+    uint8_t cReport[KEYBOARD_FEATURE_COUNT];
+    char szSlotName[STREAMT_NAME_LENGTH + 1];
+    const uint8_t* pAnswer;
+
+    memset (cReport, 0, sizeof (cReport));
+    cReport[CMD_TYPE_OFFSET] = CMD_READ_SLOT;
+    cReport[1] = STREAMT_HOTP_SLOT;
+    pAnswer = STREAMT_SendReport (cReport);
+
+    memcpy (szSlotName, &pAnswer[OUTPUT_CMD_RESULT_OFFSET], STREAMT_NAME_LENGTH);
+    szSlotName[STREAMT_NAME_LENGTH] = 0;
+    if ((CMD_STATUS_OK != pAnswer[OUTPUT_CMD_STATUS_OFFSET]) || (0 != strcmp (szSlotName, szName)))
+    {
+        printf ("%s: slot name \"%s\" status %u, expected \"%s\"\n", szTest, szSlotName, pAnswer[OUTPUT_CMD_STATUS_OFFSET], szName);
+        nStreamtErrors++;
+    }
+}
+
+/*******************************************************************************
+
+  STREAMT_Authenticate
+
+  CMD_FIRST_AUTHENTICATE with the admin PIN of the card model, returns 0 or
+  -1
+
+*******************************************************************************/
+
+static int STREAMT_Authenticate (void)
+{
+    uint8_t cReport[KEYBOARD_FEATURE_COUNT];
+
+    memset (cReport, 0, sizeof (cReport));
+    cReport[CMD_TYPE_OFFSET] = CMD_FIRST_AUTHENTICATE;
+    memcpy (&cReport[1], HOST_CARD_ADMIN_PIN, strlen (HOST_CARD_ADMIN_PIN));
+    memcpy (&cReport[26], cStreamtTempPassword, sizeof (cStreamtTempPassword));
+
+    return ((CMD_STATUS_OK == STREAMT_SendReport (cReport)[OUTPUT_CMD_STATUS_OFFSET]) ? 0 : -1);
+}
+
+/*******************************************************************************
+
+  main
+
+*******************************************************************************/
+
+int main (void)
+{
+    static const uint8_t cWrongPassword[25] = "wrong temp password";
+    uint32_t nObject[(STREAMT_MAX_LENGTH + 3) / 4];
+    uint32_t nCrc;
+
+    if (0 != HOST_DeviceOpen (NULL, HOST_DEFAULT_SERIAL))
+    {
+        fprintf (stderr, "can't map the flash image at 0x%08x\n", HOST_FLASH_BASE);
+        return (1);
+    }
+
+    if (0 != STREAMT_Authenticate ())
+    {
+        fprintf (stderr, "can't authenticate with the admin PIN\n");
+        return (1);
+    }
+
+    nCrc = STREAMT_OtpObject ("stream 1", nObject);
+    STREAMT_Check ("success", "open", STREAMT_Open (STREAM_TARGET_OTP_SLOT, STREAMT_HOTP_SLOT, STREAMT_OTP_LENGTH, nCrc, nObject, cStreamtTempPassword),
+                   CMD_STATUS_OK, STREAM_OPEN_DATA_LENGTH);
+    STREAMT_Check ("success", "data 1", STREAMT_Data (1, nObject), CMD_STATUS_OK, STREAMT_OTP_LENGTH);
+    STREAMT_CheckSlotName ("success", "stream 1");
+
+    nCrc = STREAMT_OtpObject ("stream 2", nObject);
+    STREAMT_Check ("no auth", "open", STREAMT_Open (STREAM_TARGET_OTP_SLOT, STREAMT_HOTP_SLOT, STREAMT_OTP_LENGTH, nCrc, nObject, cWrongPassword),
+                   CMD_STATUS_NOT_AUTHORIZED, 0);
+    STREAMT_Check ("no auth", "data 1", STREAMT_Data (1, nObject), CMD_STATUS_STREAM_ERROR, 0);
+    STREAMT_CheckSlotName ("no auth", "stream 1");
+
+    nCrc = STREAMT_OtpObject ("stream 3", nObject);
+    STREAMT_Check ("bad crc", "open", STREAMT_Open (STREAM_TARGET_OTP_SLOT, STREAMT_HOTP_SLOT, STREAMT_OTP_LENGTH, nCrc + 1, nObject, cStreamtTempPassword),
+                   CMD_STATUS_OK, STREAM_OPEN_DATA_LENGTH);
+    STREAMT_Check ("bad crc", "data 1", STREAMT_Data (1, nObject), CMD_STATUS_WRONG_CRC, 0);
+    STREAMT_CheckSlotName ("bad crc", "stream 1");
+
+    nCrc = STREAMT_OtpObject ("stream 4", nObject);
+    STREAMT_Check ("wrong order", "open", STREAMT_Open (STREAM_TARGET_OTP_SLOT, STREAMT_HOTP_SLOT, STREAMT_OTP_LENGTH, nCrc, nObject, cStreamtTempPassword),
+                   CMD_STATUS_OK, STREAM_OPEN_DATA_LENGTH);
+    STREAMT_Check ("wrong order", "data 2", STREAMT_Data (2, nObject), CMD_STATUS_STREAM_ERROR, 0);
+    STREAMT_Check ("wrong order", "data 1", STREAMT_Data (1, nObject), CMD_STATUS_STREAM_ERROR, 0);
+    STREAMT_CheckSlotName ("wrong order", "stream 1");
+
+    nCrc = STREAMT_OtpObject ("stream 5", nObject);
+    STREAMT_Check ("replaced", "open", STREAMT_Open (STREAM_TARGET_OTP_SLOT, STREAMT_HOTP_SLOT, STREAMT_OTP_LENGTH, nCrc, nObject, cStreamtTempPassword),
+                   CMD_STATUS_OK, STREAM_OPEN_DATA_LENGTH);
+    nCrc = STREAMT_OtpObject ("stream 6", nObject);
+    STREAMT_Check ("replaced", "open", STREAMT_Open (STREAM_TARGET_OTP_SLOT, STREAMT_HOTP_SLOT, STREAMT_OTP_LENGTH, nCrc, nObject, cStreamtTempPassword),
+                   CMD_STATUS_OK, STREAM_OPEN_DATA_LENGTH);
+    STREAMT_Check ("replaced", "data 1", STREAMT_Data (1, nObject), CMD_STATUS_OK, STREAMT_OTP_LENGTH);
+    STREAMT_CheckSlotName ("replaced", "stream 6");
+
+    // Name, password and login name, the safe key was never unlocked
+    memset (nObject, 0, sizeof (nObject));
+    memcpy (nObject, "stream pws", 10);
+    CRC_ResetDR ();
+    nCrc = CRC_CalcBlockCRC (nObject, (STREAMT_PWS_LENGTH + 3) / 4);
+    STREAMT_Check ("pws", "open", STREAMT_Open (STREAM_TARGET_PWS_SLOT, STREAMT_PWS_SLOT, STREAMT_PWS_LENGTH, nCrc, nObject, cStreamtTempPassword),
+                   CMD_STATUS_OK, STREAM_OPEN_DATA_LENGTH);
+    STREAMT_Check ("pws", "data 1", STREAMT_Data (1, nObject), CMD_STATUS_NOT_AUTHORIZED, 0);
+
+    printf ("6 tests, %d errors\n", nStreamtErrors);
+
+    HOST_DeviceClose ();
+    return ((0 == nStreamtErrors) ? 0 : 1);
+}
@@ -0,0 +1,150 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Fake tick source of the host build
+ *
+ * There are no interrupts, the 1 ms timer is a virtual clock. It advances
+ * when the firmware sleeps (__WFI), so a wait of the firmware takes no real
+ * time and a run is deterministic.
+ *
+ * Every 10 ticks the work of the 10 ms SysTick handler of stm32f10x_it.c
+ * is done: TimingDelay, the second counter of the TOTP time and the
+ * transfer timeout of smartcard.c. CCID_TimeExtensionTick () is left out,
+ * it writes to the USB endpoint. A driver may add the work of other
+ * interrupt handlers with HOST_SetTickHook ().
+ */
+
+#include <stddef.h>
+#include "stm32f10x.h"
+#include "scheduler.h"
+#include "perf_counters.h"
+#include "smartcard.h"
+#include "hotp.h"
+#include "host.h"
+
+#define HOST_SYSTICK_MS         10
+
+// ms since startup, like the TIM2 interrupt
+uint64_t currentTime = 0;
+
+vu32 TimingDelay = 0;
+
+static vu32 TimeCounter = 100;
+static uint8_t cSysTickMs = 0;
+
+static void (*pfTickHook) (void) = NULL;
+
+/*******************************************************************************
+
+  HOST_SysTick
+
+  The work of SysTick_Handler ()
+
+*******************************************************************************/
+
+static void HOST_SysTick (void)
+{
+    if (TimingDelay != 0x00)
+    {
+        TimingDelay--;
+    }
+    if (TimeCounter != 0x00)
+    {
+        TimeCounter--;
+    }
+    else
+    {
+        TimeCounter = 100;
+        current_time++;
+    }
+
+    CRD_TransferTick ();
+}
+
+/*******************************************************************************
+
+  HOST_TimerTick
+
+  The work of the TIM2 interrupt handler
+
+*******************************************************************************/
+
+void HOST_TimerTick (void)
+{
+    currentTime++;
+    SCHED_TimerTick ();
+    PERF_TimerTick ();
+
+    cSysTickMs++;
+    if (HOST_SYSTICK_MS <= cSysTickMs)
+    {
+        cSysTickMs = 0;
+        HOST_SysTick ();
+    }
+
+    if (NULL != pfTickHook)
+    {
+        pfTickHook ();
+    }
+}
+
+/*******************************************************************************
+
+  HOST_SetTickHook
+
+  pfHook is called at every tick like an interrupt handler, NULL = none
+
+*******************************************************************************/
+
+void HOST_SetTickHook (void (*pfHook) (void))
+{
+    pfTickHook = pfHook;
+}
+
+/*******************************************************************************
+
+  HOST_WaitForInterrupt
+
+  Called by __WFI, the next interrupt is the next tick or a byte of the
+  card in the async mode of the USART
+
+*******************************************************************************/
+
+void HOST_WaitForInterrupt (void)
+{
+    if (0 == HOST_UsartWaitForInterrupt ())
+    {
+        HOST_TimerTick ();
+    }
+}
+
+/*******************************************************************************
+
+  HOST_Wait
+
+  Advance the virtual clock by nMs ms
+
+*******************************************************************************/
+
+void HOST_Wait (uint32_t nMs)
+{
+    while (0 < nMs--)
+    {
+        HOST_TimerTick ();
+    }
+}
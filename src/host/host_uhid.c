@@ -0,0 +1,380 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * nkuhid, virtual Nitrokey Pro devices on /dev/uhid
+ *
+ *   nkuhid [-n count] [-s first serial] [-d image dir] [-u uhid node]
+ *
+ * Each device is a process of its own with the VID/PID and the keyboard
+ * report descriptor of CCIDHID_usb_desc.c, so hidapi clients find it like
+ * the stick. Its flash image is <image dir>/nk<serial>.img, without -d the
+ * image is erased at each start. The clock runs in real time, the modeled
+ * time of the card commands is added to it.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <linux/uhid.h>
+#include "stm32f10x.h"
+#include "CCIDHID_usb_desc.h"
+#include "host.h"
+
+#define UHID_MAX_DEVICES        1024
+#define UHID_BUS_USB            0x03
+#define UHID_VERSION            0x0101  // bcdDevice
+
+static volatile sig_atomic_t cUhidStop = 0;
+static uint64_t nUhidClock;
+
+/*******************************************************************************
+
+  UHID_Stop
+
+*******************************************************************************/
+
+static void UHID_Stop (int nSignal)
+{
+    cUhidStop = 1;
+}
+
+/*******************************************************************************
+
+  UHID_Write
+
+*******************************************************************************/
+
+static int UHID_Write (int nUhid, const struct uhid_event* pEvent)
+{
+    if (sizeof (*pEvent) != write (nUhid, pEvent, sizeof (*pEvent)))
+    {
+        perror ("uhid write");
+        return (-1);
+    }
+    return (0);
+}
+
+/*******************************************************************************
+
+  UHID_Create
+
+*******************************************************************************/
+
+static int UHID_Create (int nUhid, uint32_t nSerial)
+{
+    struct uhid_event tEvent;
+
+    memset (&tEvent, 0, sizeof (tEvent));
+    tEvent.type = UHID_CREATE2;
+    strcpy ((char *) tEvent.u.create2.name, "Nitrokey Nitrokey Pro");
+    snprintf ((char *) tEvent.u.create2.phys, sizeof (tEvent.u.create2.phys), "nkuhid/%d", (int) getpid ());
+    snprintf ((char *) tEvent.u.create2.uniq, sizeof (tEvent.u.create2.uniq), "%08X", nSerial);
+    tEvent.u.create2.rd_size = KEYBOARD_SIZ_REPORT_DESC;
+    tEvent.u.create2.bus = UHID_BUS_USB;
+    tEvent.u.create2.vendor = GLOBAL_VID;
+    tEvent.u.create2.product = GLOBAL_PID;
+    tEvent.u.create2.version = UHID_VERSION;
+    tEvent.u.create2.country = 0;
+    memcpy (tEvent.u.create2.rd_data, Keyboard_ReportDescriptor, KEYBOARD_SIZ_REPORT_DESC);
+
+    return (UHID_Write (nUhid, &tEvent));
+}
+
+/*******************************************************************************
+
+  UHID_RunClock
+
+  Advance the 1 ms timer to the time since the start
+
+*******************************************************************************/
+
+static void UHID_RunClock (void)
+{
+    struct timespec tNow;
+    uint64_t nMs;
+
+    clock_gettime (CLOCK_MONOTONIC, &tNow);
+    nMs = (uint64_t) tNow.tv_sec * 1000 + tNow.tv_nsec / 1000000;
+
+    if (0 == nUhidClock)
+    {
+        nUhidClock = nMs;
+    }
+    HOST_Wait ((uint32_t) (nMs - nUhidClock));
+    nUhidClock = nMs;
+}
+
+/*******************************************************************************
+
+  UHID_Event
+
+  Answer a request of the kernel. The descriptor has no report IDs, the
+  hidraw buffers start with a report number 0 which is passed through.
+
+*******************************************************************************/
+
+static int UHID_Event (int nUhid, const struct uhid_event* pEvent)
+{
+    struct uhid_event tReply;
+    const uint8_t* pReport;
+    uint16_t nSize;
+
+    memset (&tReply, 0, sizeof (tReply));
+
+    switch (pEvent->type)
+    {
+        case UHID_SET_REPORT:
+            tReply.type = UHID_SET_REPORT_REPLY;
+            tReply.u.set_report_reply.id = pEvent->u.set_report.id;
+
+            pReport = pEvent->u.set_report.data;
+            nSize = pEvent->u.set_report.size;
+            if ((KEYBOARD_FEATURE_COUNT < nSize) && (0 == pReport[0]))
+            {
+                pReport++;
+                nSize--;
+            }
+
+            if ((UHID_FEATURE_REPORT != pEvent->u.set_report.rtype) || (KEYBOARD_FEATURE_COUNT != nSize))
+            {
+                tReply.u.set_report_reply.err = EIO;
+                break;
+            }
+            UHID_RunClock ();
+            HOST_SetReport (pReport);
+            break;
+
+        case UHID_GET_REPORT:
+            tReply.type = UHID_GET_REPORT_REPLY;
+            tReply.u.get_report_reply.id = pEvent->u.get_report.id;
+
+            if (UHID_FEATURE_REPORT != pEvent->u.get_report.rtype)
+            {
+                tReply.u.get_report_reply.err = EIO;
+                break;
+            }
+            tReply.u.get_report_reply.data[0] = 0;
+            memcpy (&tReply.u.get_report_reply.data[1], HOST_GetReport (), KEYBOARD_FEATURE_COUNT);
+            tReply.u.get_report_reply.size = 1 + KEYBOARD_FEATURE_COUNT;
+            break;
+
+        default:
+            // START, STOP, OPEN, CLOSE and the LED output reports
+            return (0);
+    }
+
+    return (UHID_Write (nUhid, &tReply));
+}
+
+/*******************************************************************************
+
+  UHID_Device
+
+  Run one device until a signal stops it
+
+*******************************************************************************/
+
+static int UHID_Device (const char* szNode, const char* szDir, uint32_t nSerial)
+{
+    struct uhid_event tEvent;
+    struct pollfd tPoll;
+    char szImage[512];
+    int nUhid;
+    int nRet = 0;
+
+    if (NULL != szDir)
+    {
+        snprintf (szImage, sizeof (szImage), "%s/nk%08X.img", szDir, nSerial);
+    }
+    if (0 != HOST_DeviceOpen ((NULL != szDir) ? szImage : NULL, nSerial))
+    {
+        fprintf (stderr, "%08X: can't map the flash image at 0x%08x\n", nSerial, HOST_FLASH_BASE);
+        return (1);
+    }
+
+    nUhid = open (szNode, O_RDWR | O_CLOEXEC);
+    if ((0 > nUhid) || (0 != UHID_Create (nUhid, nSerial)))
+    {
+        perror (szNode);
+        HOST_DeviceClose ();
+        return (1);
+    }
+
+    tPoll.fd = nUhid;
+    tPoll.events = POLLIN;
+    while (!cUhidStop)
+    {
+        if (0 >= poll (&tPoll, 1, -1))
+        {
+            continue;       // EINTR of the stop signal
+        }
+        if (sizeof (tEvent) > read (nUhid, &tEvent, sizeof (tEvent)))
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            perror ("uhid read");
+            nRet = 1;
+            break;
+        }
+        if (0 != UHID_Event (nUhid, &tEvent))
+        {
+            nRet = 1;
+            break;
+        }
+    }
+
+    memset (&tEvent, 0, sizeof (tEvent));
+    tEvent.type = UHID_DESTROY;
+    UHID_Write (nUhid, &tEvent);
+    close (nUhid);
+
+    HOST_DeviceClose ();
+    return (nRet);
+}
+
+/*******************************************************************************
+
+  UHID_Reaped
+
+  Forget a device process which has ended
+
+*******************************************************************************/
+
+static void UHID_Reaped (pid_t* pPids, int nDevices, pid_t nChild)
+{
+    int i;
+
+    for (i = 0; i < nDevices; i++)
+    {
+        if (nChild == pPids[i])
+        {
+            pPids[i] = 0;
+        }
+    }
+}
+
+/*******************************************************************************
+
+  main
+
+*******************************************************************************/
+
+int main (int argc, char* argv[])
+{
+    static pid_t nPid[UHID_MAX_DEVICES];
+    const char* szNode = "/dev/uhid";
+    const char* szDir = NULL;
+    uint32_t nSerial = HOST_DEFAULT_SERIAL;
+    struct sigaction tAction;
+    int nDevices = 1;
+    int nRunning;
+    pid_t nChild;
+    int nStatus;
+    int nRet = 0;
+    int nOpt;
+    int i;
+
+    while (-1 != (nOpt = getopt (argc, argv, "n:s:d:u:")))
+    {
+        switch (nOpt)
+        {
+            case 'n':
+                nDevices = atoi (optarg);
+                break;
+            case 's':
+                nSerial = strtoul (optarg, NULL, 16);
+                break;
+            case 'd':
+                szDir = optarg;
+                break;
+            case 'u':
+                szNode = optarg;
+                break;
+            default:
+                nDevices = 0;
+                break;
+        }
+    }
+    if ((0 >= nDevices) || (UHID_MAX_DEVICES < nDevices) || (optind != argc))
+    {
+        fprintf (stderr, "usage: %s [-n count] [-s first serial] [-d image dir] [-u uhid node]\n", argv[0]);
+        return (2);
+    }
+
+    memset (&tAction, 0, sizeof (tAction));
+    tAction.sa_handler = UHID_Stop;
+    sigaction (SIGINT, &tAction, NULL);
+    sigaction (SIGTERM, &tAction, NULL);
+
+    if (1 == nDevices)
+    {
+        return (UHID_Device (szNode, szDir, nSerial));
+    }
+
+    // The firmware state is global and the flash is mapped at a fixed
+    // address, so each device needs a process
+    for (i = 0; i < nDevices; i++)
+    {
+        nPid[i] = fork ();
+        if (0 == nPid[i])
+        {
+            return (UHID_Device (szNode, szDir, nSerial + i));
+        }
+        if (0 > nPid[i])
+        {
+            perror ("fork");
+            nDevices = i;
+            cUhidStop = 1;
+            break;
+        }
+    }
+
+    nRunning = nDevices;
+    while (!cUhidStop && (0 < nRunning))
+    {
+        nChild = wait (&nStatus);
+        if (0 < nChild)
+        {
+            UHID_Reaped (nPid, nDevices, nChild);
+            nRunning--;
+            nRet |= !WIFEXITED (nStatus) || (0 != WEXITSTATUS (nStatus));
+        }
+    }
+
+    for (i = 0; i < nDevices; i++)
+    {
+        if (0 < nPid[i])
+        {
+            kill (nPid[i], SIGTERM);
+        }
+    }
+    while (0 < wait (&nStatus))
+    {
+        nRet |= !WIFEXITED (nStatus) || (0 != WEXITSTATUS (nStatus));
+    }
+    return (nRet);
+}
@@ -0,0 +1,466 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Smartcard USART of the host build
+ *
+ * The USART_* functions used by smartcard.c, on a modeled I/O line to the
+ * card of host_sccard.c. The line has its own clock in ns: a sent byte
+ * takes one character time and comes back as echo like on the half duplex
+ * line of the target, the bytes of the card arrive at the time given by
+ * the card model. A poll of the empty receiver costs nPollNs, so the
+ * timeouts of smartcard.c take the time of the target. The line clock
+ * drives the 1 ms timer, a wait for the card ticks the firmware.
+ *
+ * The RXNE interrupt is done by USART_ITConfig (): while it is enabled
+ * the arrived bytes are passed to CRD_USART_IRQHandler (), without bytes
+ * the clock advances until the transfer timeout of CRD_TransferTick ().
+ * With HOST_UsartSetAsync () the firmware waits for the answer in the
+ * scheduler (CRD_SetIdleTask) instead, each __WFI () then receives until
+ * the next byte or tick.
+ *
+ * The register page of USART1 is mapped at its address, smartcard.c reads
+ * the prescaler from USART1->GTPR. The interrupt handler runs from RAM on
+ * the target and uses the registers: it finds the byte in DR with RXNE set
+ * in SR and ends the transfer by clearing RXNEIE in CR1.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <sys/mman.h>
+#include "stm32f10x.h"
+#include "stm32f10x_usart.h"
+#include "smartcard.h"
+#include "host.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE     0x100000
+#endif
+
+#define USART_PAGE              (USART1_BASE & ~0xFFF)
+#define USART_PAGE_SIZE         0x1000
+
+#define USART_RX_FIFO           512         // power of 2
+#define USART_MIN_CHAR_ETU      12          // 1 start, 8 data, parity, 2 stop bits
+
+typedef struct
+{
+    uint8_t cByte;
+    uint64_t nArrivalNs;
+} typeUsartRxByte;
+
+static uint64_t nUsartNowNs = 0;
+static uint64_t nUsartNextTickNs = 1000000;
+static uint32_t nUsartBaud = 9677;
+static uint8_t cUsartData = 0;
+
+static typeUsartRxByte tUsartRx[USART_RX_FIFO];
+static uint32_t nUsartRxHead = 0;
+static uint32_t nUsartRxTail = 0;
+static uint64_t nUsartRxLastNs = 0;
+
+static uint8_t cUsartInIrq = FALSE;
+static uint8_t cUsartAsync = FALSE;
+
+/*******************************************************************************
+
+  HOST_UsartOpen
+
+  Map the register page of USART1, returns 0 or -1
+
+*******************************************************************************/
+
+int HOST_UsartOpen (void)
+{
+    void* pPage;
+
+    pPage = mmap ((void *) USART_PAGE, USART_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if ((void *) USART_PAGE != pPage)
+    {
+        if (MAP_FAILED != pPage)
+        {
+            munmap (pPage, USART_PAGE_SIZE);
+        }
+        return (-1);
+    }
+
+    nUsartRxHead = 0;
+    nUsartRxTail = 0;
+    return (0);
+}
+
+/*******************************************************************************
+
+  HOST_UsartClose
+
+*******************************************************************************/
+
+void HOST_UsartClose (void)
+{
+    munmap ((void *) USART_PAGE, USART_PAGE_SIZE);
+}
+
+/*******************************************************************************
+
+  HOST_UsartAdvance
+
+  Advance the line clock by nNs, each passed ms is a tick of the timer
+
+*******************************************************************************/
+
+void HOST_UsartAdvance (uint64_t nNs)
+{
+    nUsartNowNs += nNs;
+    while (nUsartNextTickNs <= nUsartNowNs)
+    {
+        nUsartNextTickNs += 1000000;
+        HOST_TimerTick ();
+    }
+}
+
+/*******************************************************************************
+
+  HOST_UsartTimeNs
+
+  Line clock, the time of the firmware spent waiting for the card
+
+*******************************************************************************/
+
+uint64_t HOST_UsartTimeNs (void)
+{
+    return (nUsartNowNs);
+}
+
+/*******************************************************************************
+
+  HOST_UsartClockHz
+
+  Card clock of the USART, PCLK2 / (2 * prescaler)
+
+*******************************************************************************/
+
+uint32_t HOST_UsartClockHz (void)
+{
+    RCC_ClocksTypeDef tClocks;
+    uint32_t nPrescaler = USART1->GTPR & USART_GTPR_PSC;
+
+    RCC_GetClocksFreq (&tClocks);
+    return ((0 == nPrescaler) ? 0 : tClocks.PCLK2_Frequency / (2 * nPrescaler));
+}
+
+/*******************************************************************************
+
+  HOST_UsartBaud
+
+*******************************************************************************/
+
+uint32_t HOST_UsartBaud (void)
+{
+    return (nUsartBaud);
+}
+
+/*******************************************************************************
+
+  HOST_UsartQueue
+
+  Byte of the card, starts nDelayNs after the end of the previous byte
+  (or now) and takes nCharNs on the line
+
+*******************************************************************************/
+
+void HOST_UsartQueue (uint8_t cByte, uint64_t nDelayNs, uint64_t nCharNs)
+{
+    uint64_t nStartNs;
+
+    if (USART_RX_FIFO <= nUsartRxTail - nUsartRxHead)
+    {
+        return;     // overrun, the byte is lost
+    }
+
+    nStartNs = (nUsartRxLastNs > nUsartNowNs) ? nUsartRxLastNs : nUsartNowNs;
+    nUsartRxLastNs = nStartNs + nDelayNs + nCharNs;
+
+    tUsartRx[nUsartRxTail % USART_RX_FIFO].cByte = cByte;
+    tUsartRx[nUsartRxTail % USART_RX_FIFO].nArrivalNs = nUsartRxLastNs;
+    nUsartRxTail++;
+}
+
+/*******************************************************************************
+
+  HOST_UsartFlush
+
+  Drop the received bytes, the card has been switched off
+
+*******************************************************************************/
+
+void HOST_UsartFlush (void)
+{
+    nUsartRxHead = nUsartRxTail;
+    nUsartRxLastNs = nUsartNowNs;
+}
+
+/*******************************************************************************
+
+  USART_RxArrived
+
+*******************************************************************************/
+
+static int USART_RxArrived (void)
+{
+    return ((nUsartRxHead != nUsartRxTail) && (tUsartRx[nUsartRxHead % USART_RX_FIFO].nArrivalNs <= nUsartNowNs));
+}
+
+/*******************************************************************************
+
+  USART_Receive
+
+  Pass an arrived byte to the interrupt handler or advance the clock until
+  the next byte or tick
+
+*******************************************************************************/
+
+static void USART_Receive (USART_TypeDef * USARTx)
+{
+    uint64_t nWakeNs;
+
+    if (USART_RxArrived ())
+    {
+        USARTx->DR = tUsartRx[nUsartRxHead % USART_RX_FIFO].cByte;
+        USARTx->SR = USART_FLAG_RXNE;
+        nUsartRxHead++;
+        CRD_USART_IRQHandler ();
+        USARTx->SR = 0;
+        return;
+    }
+
+    // Sleep until the next byte or the next tick, which may end the
+    // transfer by its timeout
+    nWakeNs = nUsartNextTickNs;
+    if ((nUsartRxHead != nUsartRxTail) && (tUsartRx[nUsartRxHead % USART_RX_FIFO].nArrivalNs < nWakeNs))
+    {
+        nWakeNs = tUsartRx[nUsartRxHead % USART_RX_FIFO].nArrivalNs;
+    }
+    HOST_UsartAdvance (nWakeNs - nUsartNowNs);
+}
+
+/*******************************************************************************
+
+  HOST_UsartSetAsync
+
+  Receive the card answer at the __WFI () of the firmware, it must wait
+  for the answer in an idle task (CRD_SetIdleTask). Otherwise the answer
+  is received in USART_ITConfig ().
+
+*******************************************************************************/
+
+void HOST_UsartSetAsync (uint8_t cAsync)
+{
+    cUsartAsync = cAsync;
+}
+
+/*******************************************************************************
+
+  HOST_UsartWaitForInterrupt
+
+  __WFI () of the firmware, returns 1 if the receive was served or 0 if no
+  transfer is running
+
+*******************************************************************************/
+
+int HOST_UsartWaitForInterrupt (void)
+{
+    if ((FALSE == cUsartAsync) || (0 == (USART1->CR1 & USART_CR1_RXNEIE)))
+    {
+        return (0);
+    }
+
+    USART_Receive (USART1);
+    return (1);
+}
+
+/*******************************************************************************
+
+  USART_CharNs
+
+  Character time of the reader, the guard time is the character time in
+  etu like in SC_SetHwParams ()
+
+*******************************************************************************/
+
+static uint64_t USART_CharNs (void)
+{
+    uint32_t nEtu = USART1->GTPR >> 8;
+
+    if (USART_MIN_CHAR_ETU > nEtu)
+    {
+        nEtu = USART_MIN_CHAR_ETU;
+    }
+    return ((uint64_t) nEtu * 1000000000 / nUsartBaud);
+}
+
+/*******************************************************************************
+
+  USART_* functions of the standard peripheral library
+
+*******************************************************************************/
+
+void USART_DeInit (USART_TypeDef * USARTx)
+{
+    memset ((void *) USARTx, 0, sizeof (USART_TypeDef));
+    HOST_UsartFlush ();
+}
+
+void USART_Init (USART_TypeDef * USARTx, USART_InitTypeDef * USART_InitStruct)
+{
+    if (0 != USART_InitStruct->USART_BaudRate)
+    {
+        nUsartBaud = USART_InitStruct->USART_BaudRate;
+    }
+}
+
+void USART_ClockInit (USART_TypeDef * USARTx, USART_ClockInitTypeDef * USART_ClockInitStruct)
+{
+}
+
+void USART_Cmd (USART_TypeDef * USARTx, FunctionalState NewState)
+{
+}
+
+void USART_SmartCardCmd (USART_TypeDef * USARTx, FunctionalState NewState)
+{
+}
+
+void USART_SmartCardNACKCmd (USART_TypeDef * USARTx, FunctionalState NewState)
+{
+}
+
+void USART_DMACmd (USART_TypeDef * USARTx, uint16_t USART_DMAReq, FunctionalState NewState)
+{
+}
+
+void USART_SetPrescaler (USART_TypeDef * USARTx, uint8_t USART_Prescaler)
+{
+    USARTx->GTPR = (USARTx->GTPR & USART_GTPR_GT) | USART_Prescaler;
+}
+
+void USART_SetGuardTime (USART_TypeDef * USARTx, uint8_t USART_GuardTime)
+{
+    USARTx->GTPR = (USARTx->GTPR & USART_GTPR_PSC) | (uint16_t) (USART_GuardTime << 8);
+}
+
+/*******************************************************************************
+
+  USART_SendData
+
+  The byte is on the line until the transfer complete flag, then it is
+  received as echo and by the card
+
+*******************************************************************************/
+
+void USART_SendData (USART_TypeDef * USARTx, uint16_t Data)
+{
+    uint64_t nCharNs = USART_CharNs ();
+
+    HOST_UsartAdvance (nCharNs);
+
+    // The echo is the next byte of the receiver
+    HOST_UsartQueue ((uint8_t) Data, 0, 0);
+    HOST_CardReceive ((uint8_t) Data);
+}
+
+/*******************************************************************************
+
+  USART_GetFlagStatus
+
+  A poll of the empty receiver takes the time of a poll loop on the target
+
+*******************************************************************************/
+
+FlagStatus USART_GetFlagStatus (USART_TypeDef * USARTx, uint16_t USART_FLAG)
+{
+    switch (USART_FLAG)
+    {
+        case USART_FLAG_TC:
+        case USART_FLAG_TXE:
+            return (SET);
+
+        case USART_FLAG_RXNE:
+            if (USART_RxArrived ())
+            {
+                return (SET);
+            }
+            HOST_UsartAdvance (tHostCardLatency.nPollNs);
+            return (RESET);
+
+        default:
+            // No parity errors and overruns on the modeled line
+            return (RESET);
+    }
+}
+
+/*******************************************************************************
+
+  USART_ReceiveData
+
+*******************************************************************************/
+
+uint16_t USART_ReceiveData (USART_TypeDef * USARTx)
+{
+    if (USART_RxArrived ())
+    {
+        cUsartData = tUsartRx[nUsartRxHead % USART_RX_FIFO].cByte;
+        nUsartRxHead++;
+    }
+    return (cUsartData);
+}
+
+/*******************************************************************************
+
+  USART_ITConfig
+
+  Enabling the RXNE interrupt runs the interrupt handler until it is
+  disabled again by the end of the transfer, in the async mode the
+  __WFI () of the firmware does it
+
+*******************************************************************************/
+
+void USART_ITConfig (USART_TypeDef * USARTx, uint16_t USART_IT, FunctionalState NewState)
+{
+    if (USART_IT_RXNE != USART_IT)
+    {
+        return;
+    }
+
+    if (ENABLE != NewState)
+    {
+        USARTx->CR1 &= ~USART_CR1_RXNEIE;
+        return;
+    }
+
+    USARTx->CR1 |= USART_CR1_RXNEIE;
+    if ((TRUE == cUsartInIrq) || (TRUE == cUsartAsync))
+    {
+        return;
+    }
+
+    cUsartInIrq = TRUE;
+    while (0 != (USARTx->CR1 & USART_CR1_RXNEIE))
+    {
+        USART_Receive (USARTx);
+    }
+    cUsartInIrq = FALSE;
+}
@@ -0,0 +1,264 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * USB peripheral of the CCID host build
+ *
+ * The register page and the packet memory (PMA) of the USB peripheral are
+ * mapped at their address, so usb_regs.c and usb_mem.c run unchanged. The
+ * endpoint registers are kept here instead (see src/host/inc/usb_regs.h):
+ * a write has the effect of the hardware, CTR_RX/CTR_TX are only cleared
+ * by a 0 and the DTOG and STAT bits are toggled by a 1.
+ *
+ * The host side is modeled for the double buffered bulk endpoints. An OUT
+ * packet goes to the buffer given by DTOG_RX, an IN packet is sent from
+ * the buffer given by DTOG_TX. Toggling SW_BUF passes a buffer between
+ * the application and the hardware, the endpoint NAKs while the
+ * application owns both buffers (OUT) or none is released (IN). The
+ * callbacks of usb_endp.c are left to the caller.
+ *
+ * nkvpcd passes its messages to CCID_DispatchMessage () in
+ * UsbMessageBuffer and leaves the endpoints unused, nkccid drives them.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <sys/mman.h>
+#include "stm32f10x.h"
+#include "hw_config.h"
+#include "usb_regs.h"
+#include "host.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE     0x100000
+#endif
+
+// Register page and PMA, PMAAddr is the page after RegBase
+#define USB_PAGE                (RegBase & ~0xFFF)
+#define USB_PAGE_SIZE           0x2000
+
+#define USB_ENDPOINTS           8
+#define USB_PMA_COUNT_MASK      0x3FF
+
+#define USB_EP_CLEAR_ONLY       (EP_CTR_RX | EP_CTR_TX)
+#define USB_EP_TOGGLE           (EP_DTOG_RX | EPRX_STAT | EP_DTOG_TX | EPTX_STAT)
+#define USB_EP_READ_WRITE       (EP_T_FIELD | EP_KIND | EPADDR_FIELD)
+
+uint8_t Bulk_Data_Buff[BULK_MAX_PACKET_SIZE];
+uint16_t Data_Len = 0;
+uint8_t Bot_State;
+
+static uint16_t nUsbEndpoint[USB_ENDPOINTS];
+static uint8_t nUsbBuffersFull[USB_ENDPOINTS];  // OUT: owned by the application, IN: released
+
+/*******************************************************************************
+
+  HOST_UsbOpen
+
+  Map the register page and the PMA of the USB peripheral, returns 0 or -1
+
+*******************************************************************************/
+
+int HOST_UsbOpen (void)
+{
+    void* pPage;
+
+    pPage = mmap ((void *) USB_PAGE, USB_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if ((void *) USB_PAGE != pPage)
+    {
+        if (MAP_FAILED != pPage)
+        {
+            munmap (pPage, USB_PAGE_SIZE);
+        }
+        return (-1);
+    }
+
+    memset (nUsbEndpoint, 0, sizeof (nUsbEndpoint));
+    memset (nUsbBuffersFull, 0, sizeof (nUsbBuffersFull));
+    return (0);
+}
+
+/*******************************************************************************
+
+  HOST_UsbClose
+
+*******************************************************************************/
+
+void HOST_UsbClose (void)
+{
+    munmap ((void *) USB_PAGE, USB_PAGE_SIZE);
+}
+
+/*******************************************************************************
+
+  HOST_UsbIsDoubleBulk
+
+*******************************************************************************/
+
+static int HOST_UsbIsDoubleBulk (uint8_t cEndpoint)
+{
+    return ((EP_BULK == (nUsbEndpoint[cEndpoint] & EP_T_FIELD)) && (0 != (nUsbEndpoint[cEndpoint] & EP_KIND)));
+}
+
+/*******************************************************************************
+
+  HOST_UsbGetEndpoint
+
+*******************************************************************************/
+
+uint16_t HOST_UsbGetEndpoint (uint8_t cEndpoint)
+{
+    return (nUsbEndpoint[cEndpoint]);
+}
+
+/*******************************************************************************
+
+  HOST_UsbSetEndpoint
+
+  Write to an endpoint register. A toggled SW_BUF of an enabled double
+  buffered endpoint passes a buffer to the hardware.
+
+*******************************************************************************/
+
+void HOST_UsbSetEndpoint (uint8_t cEndpoint, uint16_t nValue)
+{
+    uint16_t nOld = nUsbEndpoint[cEndpoint];
+    uint16_t nNew;
+
+    nNew = (nOld & nValue & USB_EP_CLEAR_ONLY) | ((nOld ^ nValue) & USB_EP_TOGGLE) | (nValue & USB_EP_READ_WRITE) | (nOld & EP_SETUP);
+    nUsbEndpoint[cEndpoint] = nNew;
+
+    if (!HOST_UsbIsDoubleBulk (cEndpoint))
+    {
+        return;
+    }
+
+    // OUT, SW_BUF is DTOG_TX: the application frees a buffer
+    if ((EP_RX_DIS != (nNew & EPRX_STAT)) && (0 != ((nOld ^ nNew) & EP_DTOG_TX)) && (0 < nUsbBuffersFull[cEndpoint]))
+    {
+        nUsbBuffersFull[cEndpoint]--;
+    }
+
+    // IN, SW_BUF is DTOG_RX: the application releases a buffer
+    if ((EP_TX_DIS != (nNew & EPTX_STAT)) && (0 != ((nOld ^ nNew) & EP_DTOG_RX)) && (2 > nUsbBuffersFull[cEndpoint]))
+    {
+        nUsbBuffersFull[cEndpoint]++;
+    }
+}
+
+/*******************************************************************************
+
+  HOST_UsbPma
+
+  PMA word of a buffer descriptor or a buffer
+
+*******************************************************************************/
+
+static volatile uint32_t* HOST_UsbPma (uint16_t nAddr)
+{
+    return ((volatile uint32_t *) (PMAAddr + nAddr * 2));
+}
+
+/*******************************************************************************
+
+  HOST_UsbOut
+
+  OUT transaction of nLength bytes to a double buffered bulk endpoint,
+  cEndpoint is the index of the endpoint register (ENDPn), not the
+  endpoint address of the descriptor. Returns 1 if the packet was taken, the caller runs the OUT callback of
+  the endpoint, or 0 for a NAK.
+
+*******************************************************************************/
+
+int HOST_UsbOut (uint8_t cEndpoint, const uint8_t * pData, int nLength)
+{
+    volatile uint32_t* pCount;
+    uint16_t nBuffer;
+    int i;
+
+    if (!HOST_UsbIsDoubleBulk (cEndpoint) || (EP_RX_VALID != (nUsbEndpoint[cEndpoint] & EPRX_STAT)) || (2 <= nUsbBuffersFull[cEndpoint]))
+    {
+        return (0);
+    }
+
+    // Buffer 0 uses the tx, buffer 1 the rx entries of the descriptor
+    if (0 == (nUsbEndpoint[cEndpoint] & EP_DTOG_RX))
+    {
+        nBuffer = _GetEPTxAddr (cEndpoint);
+        pCount = HOST_UsbPma (_GetBTABLE () + cEndpoint * 8 + 2);
+    }
+    else
+    {
+        nBuffer = _GetEPRxAddr (cEndpoint);
+        pCount = HOST_UsbPma (_GetBTABLE () + cEndpoint * 8 + 6);
+    }
+
+    for (i = 0; i < nLength; i += 2)
+    {
+        *HOST_UsbPma (nBuffer + i) = pData[i] | ((i + 1 < nLength) ? pData[i + 1] << 8 : 0);
+    }
+    *pCount = (*pCount & ~USB_PMA_COUNT_MASK) | nLength;
+
+    nUsbEndpoint[cEndpoint] ^= EP_DTOG_RX;
+    nUsbEndpoint[cEndpoint] |= EP_CTR_RX;
+    nUsbBuffersFull[cEndpoint]++;
+    return (1);
+}
+
+/*******************************************************************************
+
+  HOST_UsbIn
+
+  IN transaction of a double buffered bulk endpoint, cEndpoint is the
+  index of the endpoint register (ENDPn). Returns the length
+  of the packet in pData, the caller runs the IN callback of the endpoint,
+  or -1 for a NAK.
+
+*******************************************************************************/
+
+int HOST_UsbIn (uint8_t cEndpoint, uint8_t * pData)
+{
+    uint16_t nBuffer;
+    int nLength;
+    int i;
+
+    if (!HOST_UsbIsDoubleBulk (cEndpoint) || (EP_TX_VALID != (nUsbEndpoint[cEndpoint] & EPTX_STAT)) || (0 == nUsbBuffersFull[cEndpoint]))
+    {
+        return (-1);
+    }
+
+    if (0 == (nUsbEndpoint[cEndpoint] & EP_DTOG_TX))
+    {
+        nBuffer = _GetEPTxAddr (cEndpoint);
+        nLength = _GetEPTxCount (cEndpoint);
+    }
+    else
+    {
+        nBuffer = _GetEPRxAddr (cEndpoint);
+        nLength = _GetEPRxCount (cEndpoint);
+    }
+
+    for (i = 0; i < nLength; i++)
+    {
+        pData[i] = (uint8_t) (*HOST_UsbPma (nBuffer + (i & ~1)) >> (8 * (i & 1)));
+    }
+
+    nUsbEndpoint[cEndpoint] ^= EP_DTOG_TX;
+    nUsbEndpoint[cEndpoint] |= EP_CTR_TX;
+    nUsbBuffersFull[cEndpoint]--;
+    return (nLength);
+}
@@ -0,0 +1,441 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * nkvpcd, the CCID interface of the firmware as virtual card reader
+ *
+ *   nkvpcd [-f flash image] [-l latency file] [-r replay file] [-w record file] [host [port]]
+ *
+ * Connects to vpcd of vsmartcard (default localhost:35963), so pcscd,
+ * GnuPG and OpenSC see the card of the host build. Each request of vpcd
+ * is sent as CCID message through CCID_DispatchMessage (), the firmware
+ * does the T=1 exchange through smartcard.c with the card of host_sccard.c
+ * and its backend: the software OpenPGP card or, with -r, a card recorded
+ * with -w. -l loads the latency model of the card.
+ *
+ * At the end the time per APDU is printed: the modeled time of the card
+ * and its line, the host time of the firmware and of the card backend.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "stm32f10x.h"
+#include "CCID_Global.h"
+#include "CCID_usb.h"
+#include "host.h"
+
+#define VPCD_DEFAULT_HOST       "localhost"
+#define VPCD_DEFAULT_PORT       "35963"
+
+// Control messages of vpcd, all others are command APDUs
+#define VPCD_CTRL_OFF           0
+#define VPCD_CTRL_ON            1
+#define VPCD_CTRL_RESET         2
+#define VPCD_CTRL_ATR           4
+
+#define VPCD_MAX_MESSAGE        (USB_MESSAGE_BUFFER_MAX_LENGTH - USB_MESSAGE_HEADER_SIZE)
+
+#define CCID_RDR_TO_PC_DATABLOCK    0x80
+#define CCID_STATUS_FAILED          0x40
+
+static volatile sig_atomic_t cVpcdStop = 0;
+
+static uint8_t cVpcdATR[HOST_CARD_MAX_ATR];
+static int nVpcdATR;
+static uint8_t cVpcdSequence;
+
+static uint32_t nVpcdApdus;
+static uint64_t nVpcdDispatchNs;
+static uint64_t nVpcdCardNs;
+static uint64_t nVpcdLineNs;
+
+/*******************************************************************************
+
+  VPCD_Stop
+
+*******************************************************************************/
+
+static void VPCD_Stop (int nSignal)
+{
+    cVpcdStop = 1;
+}
+
+/*******************************************************************************
+
+  VPCD_Ns
+
+*******************************************************************************/
+
+static uint64_t VPCD_Ns (void)
+{
+    struct timespec tNow;
+
+    clock_gettime (CLOCK_MONOTONIC, &tNow);
+    return ((uint64_t) tNow.tv_sec * 1000000000 + tNow.tv_nsec);
+}
+
+/*******************************************************************************
+
+  VPCD_Connect
+
+*******************************************************************************/
+
+static int VPCD_Connect (const char* szHost, const char* szPort)
+{
+    struct addrinfo tHints;
+    struct addrinfo* pInfo;
+    struct addrinfo* pAddr;
+    int nSocket = -1;
+    int nRet;
+
+    memset (&tHints, 0, sizeof (tHints));
+    tHints.ai_family = AF_UNSPEC;
+    tHints.ai_socktype = SOCK_STREAM;
+
+    nRet = getaddrinfo (szHost, szPort, &tHints, &pInfo);
+    if (0 != nRet)
+    {
+        fprintf (stderr, "%s: %s\n", szHost, gai_strerror (nRet));
+        return (-1);
+    }
+
+    for (pAddr = pInfo; NULL != pAddr; pAddr = pAddr->ai_next)
+    {
+        nSocket = socket (pAddr->ai_family, pAddr->ai_socktype, pAddr->ai_protocol);
+        if (0 > nSocket)
+        {
+            continue;
+        }
+        if (0 == connect (nSocket, pAddr->ai_addr, pAddr->ai_addrlen))
+        {
+            break;
+        }
+        close (nSocket);
+        nSocket = -1;
+    }
+    freeaddrinfo (pInfo);
+
+    if (0 > nSocket)
+    {
+        fprintf (stderr, "can't connect to vpcd at %s:%s\n", szHost, szPort);
+    }
+    return (nSocket);
+}
+
+/*******************************************************************************
+
+  VPCD_ReadAll
+
+  Returns 0, or -1 at the end of the connection
+
+*******************************************************************************/
+
+static int VPCD_ReadAll (int nSocket, uint8_t * pData, int nLength)
+{
+    ssize_t nRead;
+
+    while (0 < nLength)
+    {
+        nRead = read (nSocket, pData, nLength);
+        if ((0 > nRead) && (EINTR == errno) && !cVpcdStop)
+        {
+            continue;
+        }
+        if (0 >= nRead)
+        {
+            return (-1);
+        }
+        pData += nRead;
+        nLength -= nRead;
+    }
+    return (0);
+}
+
+/*******************************************************************************
+
+  VPCD_Send
+
+  Message with a 2 byte length in network byte order
+
+*******************************************************************************/
+
+static int VPCD_Send (int nSocket, const uint8_t * pData, int nLength)
+{
+    uint8_t cMessage[2 + VPCD_MAX_MESSAGE];
+
+    cMessage[0] = (uint8_t) (nLength >> 8);
+    cMessage[1] = (uint8_t) nLength;
+    memcpy (&cMessage[2], pData, nLength);
+
+    if (2 + nLength != write (nSocket, cMessage, 2 + nLength))
+    {
+        perror ("vpcd write");
+        return (-1);
+    }
+    return (0);
+}
+
+/*******************************************************************************
+
+  VPCD_Message
+
+  Pass a CCID message to the firmware like the bulk out endpoint. Returns
+  the length of abData of the answer or -1 for a failed command.
+
+*******************************************************************************/
+
+static int VPCD_Message (uint8_t cType, const uint8_t * pData, int nLength, uint8_t ** ppAnswer)
+{
+    uint32_t nAnswer;
+
+    memset (UsbMessageBuffer, 0, USB_MESSAGE_HEADER_SIZE);
+    UsbMessageBuffer[OFFSET_BMESSAGETYPE] = cType;
+    UsbMessageBuffer[OFFSET_DWLENGTH] = (uint8_t) nLength;
+    UsbMessageBuffer[OFFSET_DWLENGTH + 1] = (uint8_t) (nLength >> 8);
+    UsbMessageBuffer[OFFSET_BSEQ] = cVpcdSequence++;
+    if (0 < nLength)
+    {
+        memcpy (&UsbMessageBuffer[OFFSET_ABDATA], pData, nLength);
+    }
+
+    Set_bBulkOutCompleteFlag;
+    CCID_DispatchMessage ();
+
+    *ppAnswer = &UsbMessageBuffer[OFFSET_ABDATA];
+    nAnswer = UsbMessageBuffer[OFFSET_DWLENGTH] | (UsbMessageBuffer[OFFSET_DWLENGTH + 1] << 8);
+
+    if ((0 != (UsbMessageBuffer[OFFSET_BSTATUS] & CCID_STATUS_FAILED)) || (VPCD_MAX_MESSAGE < nAnswer))
+    {
+        return (-1);
+    }
+    return ((int) nAnswer);
+}
+
+/*******************************************************************************
+
+  VPCD_PowerOn
+
+  Keep the ATR for the ATR requests of vpcd
+
+*******************************************************************************/
+
+static void VPCD_PowerOn (void)
+{
+    uint8_t* pAnswer;
+    int nLength;
+
+    nLength = VPCD_Message (PC_TO_RDR_ICCPOWERON, NULL, 0, &pAnswer);
+    if ((0 >= nLength) || (HOST_CARD_MAX_ATR < nLength) || (CCID_RDR_TO_PC_DATABLOCK != UsbMessageBuffer[OFFSET_BMESSAGETYPE]))
+    {
+        fprintf (stderr, "power on failed\n");
+        nVpcdATR = 0;
+        return;
+    }
+    memcpy (cVpcdATR, pAnswer, nLength);
+    nVpcdATR = nLength;
+}
+
+/*******************************************************************************
+
+  VPCD_Request
+
+  Answer a request of vpcd, returns 0 or -1
+
+*******************************************************************************/
+
+static int VPCD_Request (int nSocket, const uint8_t * pRequest, int nLength)
+{
+    static const uint8_t cNoAnswer[] = { 0x6F, 0x00 };
+    uint8_t* pAnswer;
+    uint64_t nStart;
+    uint64_t nCard;
+    uint64_t nLine;
+    int nAnswer;
+
+    if (1 == nLength)
+    {
+        switch (pRequest[0])
+        {
+            case VPCD_CTRL_OFF:
+                VPCD_Message (PC_TO_RDR_ICCPOWEROFF, NULL, 0, &pAnswer);
+                nVpcdATR = 0;
+                return (0);
+
+            case VPCD_CTRL_ON:
+            case VPCD_CTRL_RESET:
+                VPCD_PowerOn ();
+                return (0);
+
+            case VPCD_CTRL_ATR:
+                if (0 == nVpcdATR)
+                {
+                    VPCD_PowerOn ();
+                }
+                return (VPCD_Send (nSocket, cVpcdATR, nVpcdATR));
+
+            default:
+                fprintf (stderr, "unknown vpcd control %d\n", pRequest[0]);
+                return (0);
+        }
+    }
+
+    nStart = VPCD_Ns ();
+    nCard = HOST_CardBackendNs ();
+    nLine = HOST_UsartTimeNs ();
+
+    nAnswer = VPCD_Message (PC_TO_RDR_XFRBLOCK, pRequest, nLength, &pAnswer);
+
+    nCard = HOST_CardBackendNs () - nCard;
+    nVpcdDispatchNs += VPCD_Ns () - nStart - nCard;
+    nVpcdCardNs += nCard;
+    nVpcdLineNs += HOST_UsartTimeNs () - nLine;
+    nVpcdApdus++;
+
+    if (2 > nAnswer)
+    {
+        return (VPCD_Send (nSocket, cNoAnswer, sizeof (cNoAnswer)));
+    }
+    return (VPCD_Send (nSocket, pAnswer, nAnswer));
+}
+
+/*******************************************************************************
+
+  main
+
+*******************************************************************************/
+
+int main (int argc, char* argv[])
+{
+    uint8_t cRequest[VPCD_MAX_MESSAGE];
+    const char* szHost = VPCD_DEFAULT_HOST;
+    const char* szPort = VPCD_DEFAULT_PORT;
+    const char* szImage = NULL;
+    const char* szReplay = NULL;
+    const char* szRecord = NULL;
+    const char* szLatency = NULL;
+    struct sigaction tAction;
+    uint8_t cLength[2];
+    int nLength;
+    int nSocket;
+    int nOpt;
+
+    while (-1 != (nOpt = getopt (argc, argv, "f:l:r:w:")))
+    {
+        switch (nOpt)
+        {
+            case 'f':
+                szImage = optarg;
+                break;
+            case 'l':
+                szLatency = optarg;
+                break;
+            case 'r':
+                szReplay = optarg;
+                break;
+            case 'w':
+                szRecord = optarg;
+                break;
+            default:
+                fprintf (stderr, "usage: %s [-f flash image] [-l latency file] [-r replay file] [-w record file] [host [port]]\n", argv[0]);
+                return (2);
+        }
+    }
+    if (optind < argc)
+    {
+        szHost = argv[optind++];
+    }
+    if (optind < argc)
+    {
+        szPort = argv[optind++];
+    }
+
+    if (NULL != szReplay)
+    {
+        if (0 != HOST_ReplayOpen (szReplay))
+        {
+            fprintf (stderr, "%s: no card recording\n", szReplay);
+            return (1);
+        }
+        HOST_CardSetBackend (&tHostReplayCard);
+    }
+    if ((NULL != szRecord) && (0 != HOST_CardRecord (szRecord)))
+    {
+        return (1);
+    }
+    if ((NULL != szLatency) && (0 != HOST_CardLoadLatency (szLatency)))
+    {
+        return (1);
+    }
+
+    memset (&tAction, 0, sizeof (tAction));
+    tAction.sa_handler = VPCD_Stop;
+    sigaction (SIGINT, &tAction, NULL);
+    sigaction (SIGTERM, &tAction, NULL);
+
+    if (0 != HOST_DeviceOpen (szImage, HOST_DEFAULT_SERIAL))
+    {
+        fprintf (stderr, "can't map the flash image at 0x%08x\n", HOST_FLASH_BASE);
+        return (1);
+    }
+
+    nSocket = VPCD_Connect (szHost, szPort);
+    if (0 > nSocket)
+    {
+        HOST_DeviceClose ();
+        return (1);
+    }
+
+    while (!cVpcdStop)
+    {
+        if (0 != VPCD_ReadAll (nSocket, cLength, 2))
+        {
+            break;
+        }
+        nLength = (cLength[0] << 8) | cLength[1];
+        if ((0 == nLength) || (VPCD_MAX_MESSAGE < nLength) || (0 != VPCD_ReadAll (nSocket, cRequest, nLength)))
+        {
+            fprintf (stderr, "bad vpcd message of %d bytes\n", nLength);
+            break;
+        }
+        if (0 != VPCD_Request (nSocket, cRequest, nLength))
+        {
+            break;
+        }
+    }
+
+    close (nSocket);
+    HOST_DeviceClose ();
+
+    if (0 < nVpcdApdus)
+    {
+        fprintf (stderr, "%u APDUs, card and line %.1f us modeled, firmware %.1f us, card backend %.1f us per APDU\n", nVpcdApdus,
+                 nVpcdLineNs / 1000.0 / nVpcdApdus, nVpcdDispatchNs / 1000.0 / nVpcdApdus, nVpcdCardNs / 1000.0 / nVpcdApdus);
+    }
+    if (NULL != szReplay)
+    {
+        fprintf (stderr, "%u replay mismatches\n", HOST_ReplayMismatches ());
+        return (0 != HOST_ReplayMismatches ());
+    }
+    return (0);
+}
@@ -0,0 +1,305 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * nkwear, flash wear of a usage profile
+ *
+ *   nkwear [-f flash image] [-d days] [-H codes] [-T logins] [-P edits] [-W writes]
+ *
+ * Runs the storage code for the given days, per day:
+ *   -H  HOTP codes of slot 1, get_code_from_hotp_slot ()        (default 20)
+ *   -T  TOTP logins, set_time_value () and a code of slot 1     (default 4)
+ *   -P  password safe edits, PWS_WriteSlot ()                   (default 1)
+ *   -W  OTP slot writes, cmd_write_to_slot () of HOTP slot 1    (default 0.01)
+ * The counts may be fractions. The perf counters are flushed after each
+ * action, like a device that stays plugged in.
+ *
+ * Prints the erases and programs of each used page and projects the years
+ * until the first page reaches the endurance of tHostFlashTiming.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "stm32f10x.h"
+#include "CCIDHID_usb_desc.h"
+#include "hotp.h"
+#include "report_protocol.h"
+#include "password_safe.h"
+#include "FlashStorage.h"
+#include "HandleAesStorageKey.h"
+#include "perf_counters.h"
+#include "host.h"
+
+#define WEAR_DAYS_PER_YEAR      365.25
+#define WEAR_START_TIME         1500000000  // first TOTP time, s
+
+typedef struct
+{
+    uint32_t nAddress;
+    const char* szName;
+} typeWearPage;
+
+// Flash map of hotp.h, password_safe.h and FlashStorage.h
+static const typeWearPage tWearPages[] = {
+    {SLOT4_COUNTER_ADDRESS, "hotp counter 4"},
+    {PERF_COUNTERS_ADDRESS, "perf counters"},
+    {PWS_FLASH_START_ADDRESS, "password safe"},
+    {FLASHC_USER_PAGE, "user page"},
+    {TIME_ADDRESS, "totp time"},
+    {SLOTS_PAGE1_ADDRESS, "otp slots 1"},
+    {SLOTS_PAGE2_ADDRESS, "otp slots 2"},
+    {SLOT1_COUNTER_ADDRESS, "hotp counter 1"},
+    {SLOT2_COUNTER_ADDRESS, "hotp counter 2"},
+    {SLOT3_COUNTER_ADDRESS, "hotp counter 3"},
+    {BACKUP_PAGE_ADDRESS, "backup"},
+};
+
+/*******************************************************************************
+
+  WEAR_PageName
+
+*******************************************************************************/
+
+static const char* WEAR_PageName (uint32_t nAddress)
+{
+    unsigned int i;
+
+    for (i = 0; i < sizeof (tWearPages) / sizeof (tWearPages[0]); i++)
+    {
+        if (nAddress == tWearPages[i].nAddress)
+        {
+            return (tWearPages[i].szName);
+        }
+    }
+    return ("");
+}
+
+/*******************************************************************************
+
+  WEAR_WriteOtpSlot
+
+  Program slot 1 of the given type (0x10 HOTP, 0x20 TOTP) like the write to
+  slot command
+
+*******************************************************************************/
+
+static void WEAR_WriteOtpSlot (uint8_t cSlotNumber)
+{
+    OTP_slot tSlot;
+    uint8_t cOutput[KEYBOARD_FEATURE_COUNT];
+
+    memset (&tSlot, 0, sizeof (tSlot));
+    tSlot.slot_number = cSlotNumber;
+    memcpy (tSlot.name, "wear", 4);
+    memset (tSlot.secret, 0x5A, SECRET_LENGTH_DEFINE);
+    tSlot.interval_or_counter = (0x20 == cSlotNumber) ? 30 : 0;
+
+    cmd_write_to_slot (&tSlot, cOutput);
+}
+
+/*******************************************************************************
+
+  WEAR_EditPws
+
+*******************************************************************************/
+
+static uint8_t WEAR_EditPws (uint32_t nEdit)
+{
+    typePasswordSafeSlot_st tSlot;
+
+    memset (&tSlot, 0, sizeof (tSlot));
+    snprintf ((char *) tSlot.SlotName_au8, sizeof (tSlot.SlotName_au8), "wear");
+    snprintf ((char *) tSlot.SlotPassword_au8, sizeof (tSlot.SlotPassword_au8), "pw%u", nEdit);
+    snprintf ((char *) tSlot.SlotLoginName_au8, sizeof (tSlot.SlotLoginName_au8), "user");
+
+    return (PWS_WriteSlot (nEdit % PWS_SLOT_COUNT, &tSlot));
+}
+
+/*******************************************************************************
+
+  WEAR_Due
+
+  Actions of a day for a rate of fRate per day, the fractions are carried
+  in *pCarry
+
+*******************************************************************************/
+
+static uint32_t WEAR_Due (double fRate, double* pCarry)
+{
+    uint32_t nCount;
+
+    *pCarry += fRate;
+    nCount = (uint32_t) * pCarry;
+    *pCarry -= nCount;
+    return (nCount);
+}
+
+/*******************************************************************************
+
+  main
+
+*******************************************************************************/
+
+int main (int argc, char* argv[])
+{
+    const typeHostFlashStats* pStats;
+    const char* szImage = NULL;
+    u8 cMasterKey[32];
+    double fHotp = 20, fTotp = 4, fPws = 1, fSlots = 0.01;
+    double fHotpCarry = 0, fTotpCarry = 0, fPwsCarry = 0, fSlotsCarry = 0;
+    double fPerYear;
+    double fYears;
+    double fFirstYears = 0;
+    uint32_t nFirstPage = HOST_FLASH_PAGES;
+    uint32_t nTime = WEAR_START_TIME;
+    uint32_t nEdits = 0;
+    uint32_t nDays = 3650;
+    uint32_t nDay;
+    uint32_t nCount;
+    uint32_t nPage;
+    int nOpt;
+
+    while (-1 != (nOpt = getopt (argc, argv, "f:d:H:T:P:W:")))
+    {
+        switch (nOpt)
+        {
+            case 'f':
+                szImage = optarg;
+                break;
+            case 'd':
+                nDays = strtoul (optarg, NULL, 0);
+                break;
+            case 'H':
+                fHotp = strtod (optarg, NULL);
+                break;
+            case 'T':
+                fTotp = strtod (optarg, NULL);
+                break;
+            case 'P':
+                fPws = strtod (optarg, NULL);
+                break;
+            case 'W':
+                fSlots = strtod (optarg, NULL);
+                break;
+            default:
+                fprintf (stderr, "usage: %s [-f flash image] [-d days] [-H codes] [-T logins] [-P edits] [-W writes]\n", argv[0]);
+                return (2);
+        }
+    }
+
+    if ((0 == nDays) || (0 > fHotp) || (0 > fTotp) || (0 > fPws) || (0 > fSlots))
+    {
+        fprintf (stderr, "%s: days must be > 0, counts >= 0\n", argv[0]);
+        return (2);
+    }
+
+    if (0 != HOST_DeviceOpen (szImage, HOST_DEFAULT_SERIAL))
+    {
+        fprintf (stderr, "can't map the flash image at 0x%08x\n", HOST_FLASH_BASE);
+        return (1);
+    }
+
+    // Device in use: OTP slots programmed, password safe key on the card
+    WEAR_WriteOtpSlot (0x10);
+    WEAR_WriteOtpSlot (0x20);
+    if (0 < fPws)
+    {
+        if ((TRUE != BuildPasswordSafeKey_u32 ()) || (0 != BuildNewAesMasterKey_u32 ((u8 *) HOST_CARD_ADMIN_PIN, cMasterKey)) || (CMD_STATUS_OK != PWS_EnableAccess ((u8 *) HOST_CARD_USER_PIN)))
+        {
+            fprintf (stderr, "can't set up the password safe\n");
+            return (1);
+        }
+    }
+    PERF_Flush ();
+    HOST_FlashResetStats ();
+
+    for (nDay = 0; nDay < nDays; nDay++)
+    {
+        for (nCount = WEAR_Due (fHotp, &fHotpCarry); 0 < nCount; nCount--)
+        {
+            get_code_from_hotp_slot (0);
+            PERF_Flush ();
+        }
+        for (nCount = WEAR_Due (fTotp, &fTotpCarry); 0 < nCount; nCount--)
+        {
+            set_time_value (nTime);
+            get_code_from_totp_slot (0, nTime / 30);
+            PERF_Flush ();
+            nTime += 60;
+        }
+        for (nCount = WEAR_Due (fPws, &fPwsCarry); 0 < nCount; nCount--)
+        {
+            if (TRUE != WEAR_EditPws (nEdits++))
+            {
+                fprintf (stderr, "day %u: password safe edit failed\n", nDay);
+                return (1);
+            }
+            PERF_Flush ();
+        }
+        for (nCount = WEAR_Due (fSlots, &fSlotsCarry); 0 < nCount; nCount--)
+        {
+            WEAR_WriteOtpSlot (0x10);
+            PERF_Flush ();
+        }
+        nTime += 24 * 60 * 60;
+    }
+
+    pStats = HOST_FlashStats ();
+
+    printf ("profile per day: %g HOTP codes, %g TOTP logins, %g password safe edits, %g OTP slot writes, %u days\n", fHotp, fTotp, fPws, fSlots, nDays);
+    printf ("page  address     erases    programs  erases/year  years to %u  \n", tHostFlashTiming.nEndurance);
+    for (nPage = 0; nPage < HOST_FLASH_PAGES; nPage++)
+    {
+        if ((0 == pStats->nErases[nPage]) && (0 == pStats->nPrograms[nPage]))
+        {
+            continue;
+        }
+
+        fPerYear = pStats->nErases[nPage] * WEAR_DAYS_PER_YEAR / nDays;
+        printf ("%4u  0x%08x  %8u  %10u  %11.1f", nPage, HOST_FLASH_BASE + nPage * HOST_FLASH_PAGE_SIZE, pStats->nErases[nPage], pStats->nPrograms[nPage], fPerYear);
+        if (0 < pStats->nErases[nPage])
+        {
+            fYears = tHostFlashTiming.nEndurance / fPerYear;
+            printf ("  %13.1f", fYears);
+            if ((HOST_FLASH_PAGES == nFirstPage) || (fYears < fFirstYears))
+            {
+                nFirstPage = nPage;
+                fFirstYears = fYears;
+            }
+        }
+        else
+        {
+            printf ("  %13s", "-");
+        }
+        printf ("  %s\n", WEAR_PageName (HOST_FLASH_BASE + nPage * HOST_FLASH_PAGE_SIZE));
+    }
+
+    printf ("flash busy %.1f ms per day, %u rejected programs\n", pStats->nBusyNs / 1000000.0 / nDays, pStats->nProgramErrors);
+    if (HOST_FLASH_PAGES == nFirstPage)
+    {
+        printf ("no page erased\n");
+    }
+    else
+    {
+        printf ("first worn out page: 0x%08x (%s) after %.1f years\n", HOST_FLASH_BASE + nFirstPage * HOST_FLASH_PAGE_SIZE, WEAR_PageName (HOST_FLASH_BASE + nFirstPage * HOST_FLASH_PAGE_SIZE), fFirstYears);
+    }
+
+    HOST_DeviceClose ();
+    return (0);
+}
@@ -0,0 +1,150 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Hardware shim of the Linux host build (build/host)
+ */
+
+#ifndef HOST_H_
+#define HOST_H_
+
+#include <stdint.h>
+
+// Emulated flash, mapped read only at the address of the target flash
+#define HOST_FLASH_BASE             0x08000000
+#define HOST_FLASH_SIZE             (128 * 1024)
+#define HOST_FLASH_PAGE_SIZE        1024
+#define HOST_FLASH_PAGES            (HOST_FLASH_SIZE / HOST_FLASH_PAGE_SIZE)
+
+typedef struct
+{
+    uint32_t nEraseNs;          // page erase
+    uint32_t nProgramNs;        // halfword program
+    uint32_t nEndurance;        // erase cycles of a page
+} typeHostFlashTiming;
+
+extern typeHostFlashTiming tHostFlashTiming;
+
+typedef struct
+{
+    uint32_t nErases[HOST_FLASH_PAGES];
+    uint32_t nPrograms[HOST_FLASH_PAGES];   // halfwords
+    uint32_t nProgramErrors;                // rejected, the halfword wasn't erased
+    uint64_t nBusyNs;
+} typeHostFlashStats;
+
+int HOST_FlashOpen (const char* szImage);
+void HOST_FlashClose (void);
+const typeHostFlashStats* HOST_FlashStats (void);
+void HOST_FlashResetStats (void);
+
+// Fake 1 ms timer, replaces the TIM2 interrupt
+void HOST_TimerTick (void);
+void HOST_SetTickHook (void (*pfHook) (void));
+void HOST_Wait (uint32_t nMs);
+
+// LEDs
+#define HOST_LED_OATH               0
+#define HOST_LED_VERIFY_ERROR       1
+#define HOST_LED_VERIFY_CORRECT     2
+#define HOST_LEDS                   3
+
+uint32_t HOST_GetBlinks (uint8_t cLed);
+
+// Card of the host build (host_sccard.c), a T=1 card at the USART of
+// smartcard.c
+#define HOST_CARD_USER_PIN          "123456"
+#define HOST_CARD_ADMIN_PIN         "12345678"
+
+// Card backend, answers the APDUs below the T=1 layer of the card
+typedef struct
+{
+    const char* szName;
+    void (*pfInit) (uint32_t nSeed);            // factory state
+    void (*pfSetSerial) (uint32_t nSerial);     // may be NULL
+    int (*pfPowerOn) (uint8_t * pATR);          // ATR length, 0 = mute
+    int (*pfTransmit) (const uint8_t * pCommand, int nCommand, uint8_t * pResponse, int nMaxResponse);  // response length with SW1 SW2, -1 = mute
+} typeHostCardBackend;
+
+#define HOST_CARD_MAX_ATR           33
+#define HOST_CARD_MAX_APDU          (5 + 255 + 1)
+#define HOST_CARD_MAX_RESPONSE      (256 + 2)
+
+extern const typeHostCardBackend tHostOpenPGPCard;
+extern const typeHostCardBackend tHostReplayCard;
+
+// Latency model of the card
+typedef struct
+{
+    uint32_t nAtrDelayClk;      // rising reset to the first ATR byte, card clocks
+    uint32_t nCharEtu;          // character of the card
+    uint32_t nBlockGuardEtu;    // BGT, before a block of the card
+    uint32_t nPollNs;           // poll of the empty receiver by the firmware
+    uint32_t nDefaultUs;        // processing time of an APDU
+    uint32_t nInsUs[256];       // processing time by INS, 0 = nDefaultUs
+} typeHostCardLatency;
+
+extern typeHostCardLatency tHostCardLatency;
+
+void HOST_CardInit (uint32_t nSeed);
+void HOST_CardSetSerial (uint32_t nSerial);
+void HOST_CardSetBackend (const typeHostCardBackend * pBackend);
+int HOST_CardRecord (const char* szFile);
+int HOST_CardLoadLatency (const char* szFile);
+uint64_t HOST_CardBackendNs (void);
+uint32_t HOST_CardApdus (void);
+uint32_t HOST_CardLineErrors (void);
+void HOST_CardRejectBlocks (uint32_t nBlocks);
+
+// Card side of the line, from the GPIO pins and USART_SendData ()
+void HOST_CardPower (uint8_t cOn);
+void HOST_CardReset (uint8_t cHigh);
+void HOST_CardReceive (uint8_t cByte);
+
+int HOST_ReplayOpen (const char* szFile);
+void HOST_ReplayClear (void);
+int HOST_ReplayAdd (const uint8_t * pCommand, int nCommand, const uint8_t * pResponse, int nResponse);
+void HOST_ReplaySetATR (const uint8_t * pATR, int nATR);
+uint32_t HOST_ReplayMismatches (void);
+
+// Smartcard USART (host_usart.c), the line to the card with its own clock
+int HOST_UsartOpen (void);
+void HOST_UsartClose (void);
+void HOST_UsartAdvance (uint64_t nNs);
+uint64_t HOST_UsartTimeNs (void);
+uint32_t HOST_UsartClockHz (void);
+uint32_t HOST_UsartBaud (void);
+void HOST_UsartQueue (uint8_t cByte, uint64_t nDelayNs, uint64_t nCharNs);
+void HOST_UsartFlush (void);
+void HOST_UsartSetAsync (uint8_t cAsync);
+int HOST_UsartWaitForInterrupt (void);
+
+// USB peripheral (host_usb.c), the host side of the double buffered bulk endpoints
+int HOST_UsbOpen (void);
+void HOST_UsbClose (void);
+int HOST_UsbOut (uint8_t cEndpoint, const uint8_t * pData, int nLength);   // 1 = taken, 0 = NAK
+int HOST_UsbIn (uint8_t cEndpoint, uint8_t * pData);                       // packet length, -1 = NAK
+
+// Device, the startup of main () and the feature reports of the keyboard interface
+#define HOST_DEFAULT_SERIAL         0x00005F11
+
+int HOST_DeviceOpen (const char* szImage, uint32_t nSerial);
+void HOST_DeviceClose (void);
+void HOST_SetReport (const uint8_t* pReport);
+const uint8_t* HOST_GetReport (void);
+
+#endif /* HOST_H_ */
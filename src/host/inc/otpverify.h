@@ -0,0 +1,76 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Bulk HOTP/TOTP verification for servers (libnkotp.a, src/host/host_otpverify.c)
+ *
+ * The codes are those of get_hotp_value () in src/hotp/hotp.c. A code is
+ * HMAC-SHA1 of the big endian counter with the 40 byte secret of the slot,
+ * zero padded, then dynamic_truncate () and 6 or 8 digits.
+ *
+ * HOTP: the counter of a slot starts at interval_or_counter of the slot
+ * data. The device accepts a code (CMD_VERIFY_OTP_CODE) in the window of
+ * OTPV_HOTP_WINDOW counters and continues after it, a server verifies with
+ * nWindow = OTPV_HOTP_WINDOW and continues at nCounter + nResult + 1.
+ *
+ * TOTP: the counter is the time / interval_or_counter of the slot, see
+ * OTPV_TotpCounter ().
+ */
+
+#ifndef OTPVERIFY_H_
+#define OTPVERIFY_H_
+
+#include <stdint.h>
+
+#define OTPV_SECRET_LENGTH          40      // SECRET_LENGTH_DEFINE of hotp.h
+#define OTPV_HOTP_WINDOW            10      // look ahead of validate_code_from_hotp_slot ()
+
+#define OTPV_CODE_NOT_VALID         -2      // nResult, like validate_code_from_hotp_slot ()
+
+// SHA-1 kernels, OTPV_KERNEL_AUTO takes the widest one of the CPU
+#define OTPV_KERNEL_AUTO            0
+#define OTPV_KERNEL_SCALAR          1
+#define OTPV_KERNEL_SSE4            2       // 4 lanes
+#define OTPV_KERNEL_AVX2            3       // 8 lanes
+
+// A secret with the HMAC pads hashed ahead
+typedef struct
+{
+    uint32_t nInner[5];
+    uint32_t nOuter[5];
+    uint8_t cDigits;
+} typeOtpvKey;
+
+typedef struct
+{
+    const typeOtpvKey* pKey;
+    uint64_t nCounter;      // first counter of the window
+    uint32_t nCode;
+    int nResult;            // offset of the code in the window or OTPV_CODE_NOT_VALID
+} typeOtpvRequest;
+
+int OTPV_KeyInit (typeOtpvKey * pKey, const uint8_t * pSecret, uint8_t cSecretLength, uint8_t cDigits);
+uint64_t OTPV_TotpCounter (uint64_t nTime, uint64_t nInterval);
+
+int OTPV_SetKernel (int nKernel);
+const char* OTPV_KernelName (void);
+
+uint32_t OTPV_Code (const typeOtpvKey * pKey, uint64_t nCounter);
+void OTPV_Codes (const typeOtpvKey * pKey, uint64_t nCounter, uint32_t * pCodes, uint32_t nCodes);
+void OTPV_Verify (typeOtpvRequest * pRequests, uint32_t nRequests, uint32_t nWindow);
+
+#endif /* OTPVERIFY_H_ */
@@ -0,0 +1,66 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host build: replaces the Cortex-M3 core header (core_cm3.h) and then
+ * includes the device header of the firmware. The register definitions
+ * stay, host code must not use the peripherals directly.
+ */
+
+#ifndef HOST_STM32F10X_H_
+#define HOST_STM32F10X_H_
+
+#include <stdint.h>
+
+// Keep core_cm3.h out, its intrinsics are ARM assembler
+#define __CM3_CORE_H__
+
+#define __I                 volatile const
+#define __O                 volatile
+#define __IO                volatile
+#define __INLINE            inline
+#define __ASM               __asm
+
+void HOST_WaitForInterrupt (void);
+
+static __INLINE void __enable_irq (void)
+{
+}
+
+static __INLINE void __disable_irq (void)
+{
+}
+
+// Sleeping until the next interrupt is one tick of the fake timer
+static __INLINE void __WFI (void)
+{
+    HOST_WaitForInterrupt ();
+}
+
+static __INLINE void __NOP (void)
+{
+}
+
+// The 10 ms SysTick is emulated by the fake timer
+static __INLINE uint32_t SysTick_Config (uint32_t ticks)
+{
+    return (0);
+}
+
+#include_next "stm32f10x.h"
+
+#endif /* HOST_STM32F10X_H_ */
@@ -0,0 +1,42 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host build: includes usb_regs.h of the USB driver and passes the access
+ * to the endpoint registers to the model of host_usb.c, their bits don't
+ * behave like memory. The Makefile forces this header into the objects
+ * using the endpoint registers, usb_lib.h finds the driver header in its
+ * own directory.
+ */
+
+#ifndef HOST_USB_REGS_H_
+#define HOST_USB_REGS_H_
+
+// From the include path, a header of this directory found by "" breaks its #include_next
+#include <stm32f10x.h>
+#include_next "usb_regs.h"
+
+uint16_t HOST_UsbGetEndpoint (uint8_t cEndpoint);
+void HOST_UsbSetEndpoint (uint8_t cEndpoint, uint16_t nValue);
+
+#undef _SetENDPOINT
+#undef _GetENDPOINT
+
+#define _SetENDPOINT(bEpNum,wRegValue)  HOST_UsbSetEndpoint (bEpNum, (uint16_t) (wRegValue))
+#define _GetENDPOINT(bEpNum)            HOST_UsbGetEndpoint (bEpNum)
+
+#endif /* HOST_USB_REGS_H_ */
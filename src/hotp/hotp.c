@@ -27,6 +27,10 @@
 #include "hotp.h"
 #include "string.h"
 #include "memory_ops.h"
+#include "perf_counters.h"
+#include "profile.h"
+#include "scratch.h"
+#include "ramfunc.h"
 
 const int SECRET_LENGTH = SECRET_LENGTH_DEFINE;
 
@@ -36,8 +40,6 @@ __I uint32_t hotp_slot_counters[NUMBER_OF_HOTP_SLOTS] = { SLOT1_COUNTER_ADDRESS,
     SLOT4_COUNTER_ADDRESS,
 };
 
-uint8_t page_buffer[SLOT_PAGE_SIZE];
-
 
 uint32_t get_HOTP_slot_offset(int slot_count){
     return SLOTS_PAGE1_ADDRESS + get_slot_offset(slot_count);
@@ -122,6 +124,28 @@ uint32_t value = time << 8;
     return time;
 }
 
+/*
+ * Flash access counted by the performance counters, the flash must be
+ * unlocked. Executed from RAM, the smartcard answer is received meanwhile.
+ */
+uint8_t erase_flash_page (uint32_t addr)
+{
+    PERF_CountFlashErase (addr);
+    return RAM_FlashErasePage (addr);
+}
+
+uint8_t program_flash_word (uint32_t addr, uint32_t data)
+{
+    PERF_CountFlashPrograms (2);
+    return RAM_FlashProgramWord (addr, data);
+}
+
+uint8_t program_flash_halfword (uint32_t addr, uint16_t data)
+{
+    PERF_CountFlashPrograms (1);
+    return RAM_FlashProgramHalfWord (addr, data);
+}
+
 void write_data_to_flash (uint8_t * data, uint16_t len, uint32_t addr)
 {
 uint16_t i;
@@ -139,7 +163,7 @@ FLASH_Status err = FLASH_COMPLETE;
     {
 uint16_t halfword = (data[i]) + (data[i + 1] << 8);
 
-        err = FLASH_ProgramHalfWord (addr + i, halfword);
+        err = program_flash_halfword (addr + i, halfword);
         if (err != FLASH_COMPLETE)
         {
         };
@@ -159,8 +183,10 @@ uint8_t hmac_result[20];
 
 uint64_t c = endian_swap (counter);
 
+    PROF_BEGIN (PROF_MARKER_HOTP_VALUE);
     hmac_sha1 (hmac_result, secret, secret_length * 8, &c, 64);
 uint32_t hotp_result = dynamic_truncate (hmac_result);
+    PROF_END (PROF_MARKER_HOTP_VALUE);
 
     if (len == 6)
         hotp_result = hotp_result % 1000000;
@@ -257,7 +283,7 @@ FLASH_Status err = FLASH_COMPLETE;
     {
         if (getu32 ((uint8_t *) (TIME_ADDRESS + TIME_OFFSET * i)) == 0xffffffff)
         {
-            err = FLASH_ProgramWord (TIME_ADDRESS + TIME_OFFSET * i, (time) & 0xffffffff);
+            err = program_flash_word (TIME_ADDRESS + TIME_OFFSET * i, (time) & 0xffffffff);
             if (err != FLASH_COMPLETE)
                 return err;
             flag = 1;
@@ -267,10 +293,10 @@ FLASH_Status err = FLASH_COMPLETE;
 
     if (!flag)
     {
-        err = FLASH_ErasePage (TIME_ADDRESS);
+        err = erase_flash_page (TIME_ADDRESS);
         if (err != FLASH_COMPLETE)
             return err;
-        err = FLASH_ProgramWord (TIME_ADDRESS, (time) & 0xffffffff);
+        err = program_flash_word (TIME_ADDRESS, (time) & 0xffffffff);
         if (err != FLASH_COMPLETE)
             return err;
     }
@@ -292,14 +318,14 @@ FLASH_Status err = FLASH_COMPLETE;
 
     FLASH_Unlock ();
 
-    err = FLASH_ErasePage (addr);
+    err = erase_flash_page (addr);
     if (err != FLASH_COMPLETE)
         return err;
 
-    err = FLASH_ProgramWord (addr, counter & 0xffffffff);
+    err = program_flash_word (addr, counter & 0xffffffff);
     if (err != FLASH_COMPLETE)
         return err;
-    err = FLASH_ProgramWord (addr + 4, (counter >> 32) & 0xffffffff);
+    err = program_flash_word (addr + 4, (counter >> 32) & 0xffffffff);
     if (err != FLASH_COMPLETE)
         return err;
 
@@ -324,6 +350,7 @@ FLASH_Status err = FLASH_COMPLETE;
     {
         // Entire page is filled, erase cycle
         counter = get_counter_value (addr) + 1;
+        PERF_Count (PERF_HOTP_ROLLOVERS);
 
 
         /*
@@ -335,44 +362,44 @@ FLASH_Status err = FLASH_COMPLETE;
            err=FLASH_ProgramWord(BACKUP_PAGE_ADDRESS+8, (counter>>32)&0xffffffff); if (err!=FLASH_COMPLETE) return err; */
 
         FLASH_Unlock ();
-        err = FLASH_ErasePage (BACKUP_PAGE_ADDRESS);
+        err = erase_flash_page (BACKUP_PAGE_ADDRESS);
         if (err != FLASH_COMPLETE)
             return err;
 
         // write address to backup page
 
 
-        err = FLASH_ProgramWord (BACKUP_PAGE_ADDRESS, counter & 0xffffffff);
+        err = program_flash_word (BACKUP_PAGE_ADDRESS, counter & 0xffffffff);
         if (err != FLASH_COMPLETE)
             return err;
-        err = FLASH_ProgramWord (BACKUP_PAGE_ADDRESS + 4, (counter >> 32) & 0xffffffff);
+        err = program_flash_word (BACKUP_PAGE_ADDRESS + 4, (counter >> 32) & 0xffffffff);
         if (err != FLASH_COMPLETE)
             return err;
 
 
-        err = FLASH_ProgramWord (BACKUP_PAGE_ADDRESS + BACKUP_ADDRESS_OFFSET, addr);
+        err = program_flash_word (BACKUP_PAGE_ADDRESS + BACKUP_ADDRESS_OFFSET, addr);
         if (err != FLASH_COMPLETE)
             return err;
 
-        err = FLASH_ProgramWord (BACKUP_PAGE_ADDRESS + BACKUP_LENGTH_OFFSET, 8);
+        err = program_flash_word (BACKUP_PAGE_ADDRESS + BACKUP_LENGTH_OFFSET, 8);
         if (err != FLASH_COMPLETE)
             return err;
 
 
 
-        err = FLASH_ErasePage (addr);
+        err = erase_flash_page (addr);
         if (err != FLASH_COMPLETE)
             return err;
 
-        err = FLASH_ProgramWord (addr, counter & 0xffffffff);
+        err = program_flash_word (addr, counter & 0xffffffff);
         if (err != FLASH_COMPLETE)
             return err;
-        err = FLASH_ProgramWord (addr + 4, (counter >> 32) & 0xffffffff);
+        err = program_flash_word (addr + 4, (counter >> 32) & 0xffffffff);
         if (err != FLASH_COMPLETE)
             return err;
 
 
-        err = FLASH_ProgramHalfWord (BACKUP_PAGE_ADDRESS + BACKUP_OK_OFFSET, 0x4F4B);
+        err = program_flash_halfword (BACKUP_PAGE_ADDRESS + BACKUP_OK_OFFSET, 0x4F4B);
         if (err != FLASH_COMPLETE)
             return err;
 
@@ -396,7 +423,7 @@ FLASH_Status err = FLASH_COMPLETE;
         if ((uint32_t) ptr % 2)
         {   // odd byte
 
-            err = FLASH_ProgramHalfWord ((uint32_t) ptr - 1, 0x0000);
+            err = program_flash_halfword ((uint32_t) ptr - 1, 0x0000);
             if (err != FLASH_COMPLETE)
                 return err;
 
@@ -404,7 +431,7 @@ FLASH_Status err = FLASH_COMPLETE;
         else
         {   // even byte
 
-            err = FLASH_ProgramHalfWord ((uint32_t) ptr, 0xff00);
+            err = program_flash_halfword ((uint32_t) ptr, 0xff00);
             if (err != FLASH_COMPLETE)
                 return err;
         }
@@ -499,13 +526,13 @@ void backup_data (uint8_t * data, uint16_t len, uint32_t addr)
 FLASH_Status err = FLASH_COMPLETE;
 
     FLASH_Unlock ();
-    FLASH_ErasePage (BACKUP_PAGE_ADDRESS);
+    erase_flash_page (BACKUP_PAGE_ADDRESS);
     write_data_to_flash (data, len, BACKUP_PAGE_ADDRESS);
-    err = FLASH_ProgramHalfWord (BACKUP_PAGE_ADDRESS + BACKUP_LENGTH_OFFSET, len);
+    err = program_flash_halfword (BACKUP_PAGE_ADDRESS + BACKUP_LENGTH_OFFSET, len);
     if (err != FLASH_COMPLETE)
     {
     };
-    err = FLASH_ProgramWord (BACKUP_PAGE_ADDRESS + BACKUP_ADDRESS_OFFSET, addr);
+    err = program_flash_word (BACKUP_PAGE_ADDRESS + BACKUP_ADDRESS_OFFSET, addr);
     if (err != FLASH_COMPLETE)
     {
     }
@@ -516,7 +543,7 @@ FLASH_Status err = FLASH_COMPLETE;
 void erase_counter (uint8_t slot)
 {
     FLASH_Unlock ();
-    FLASH_ErasePage (hotp_slot_counters[slot]);
+    erase_flash_page (hotp_slot_counters[slot]);
     FLASH_Lock ();
 }
 
@@ -524,6 +551,9 @@ void erase_counter (uint8_t slot)
 void write_to_slot(OTP_slot *new_slot_data, uint32_t offset, uint16_t len)
 {
   FLASH_Status err = FLASH_COMPLETE;
+  uint8_t* page_buffer;
+
+  PROF_BEGIN (PROF_MARKER_WRITE_TO_SLOT);
 
     // choose the proper slot page
   uint32_t current_slot_address;
@@ -540,6 +570,7 @@ void write_to_slot(OTP_slot *new_slot_data, uint32_t offset, uint16_t len)
 
     // copy entire page to ram
     uint8_t* page = (uint8_t *) current_slot_address;
+    page_buffer = SCRATCH_Acquire (SCRATCH_OWNER_OTP_SLOTS);
     memcpy (page_buffer, page, SLOT_PAGE_SIZE);
 
     // check if the secret from the tool is empty and if it is use the old
@@ -566,13 +597,16 @@ void write_to_slot(OTP_slot *new_slot_data, uint32_t offset, uint16_t len)
     // write page to regular location
 
     FLASH_Unlock ();
-    FLASH_ErasePage (current_slot_address);
+    erase_flash_page (current_slot_address);
     write_data_to_flash (page_buffer, SLOT_PAGE_SIZE, current_slot_address);
-    err = FLASH_ProgramHalfWord (BACKUP_PAGE_ADDRESS + BACKUP_OK_OFFSET, 0x4F4B);
+    err = program_flash_halfword (BACKUP_PAGE_ADDRESS + BACKUP_OK_OFFSET, 0x4F4B);
     if (err != FLASH_COMPLETE)
     {
     };
     FLASH_Lock ();
+    SCRATCH_Release (SCRATCH_OWNER_OTP_SLOTS);
+
+    PROF_END (PROF_MARKER_WRITE_TO_SLOT);
 
     StartBlinkingOATHLED (2);
 }
@@ -597,9 +631,9 @@ uint16_t length = getu16 ((uint8_t *) BACKUP_PAGE_ADDRESS + BACKUP_LENGTH_OFFSET
         {
             FLASH_Unlock ();
 
-            FLASH_ErasePage (address);
+            erase_flash_page (address);
             write_data_to_flash ((uint8_t *) BACKUP_PAGE_ADDRESS, length, address);
-            FLASH_ErasePage (BACKUP_PAGE_ADDRESS);
+            erase_flash_page (BACKUP_PAGE_ADDRESS);
             FLASH_Lock ();
 
 
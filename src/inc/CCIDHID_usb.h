@@ -55,6 +55,8 @@
 /* Routines */
 /************************************************************************/
 
+void CCID_InitBulkTransfer (void);
+
 void CCID_Init (void);
 
 void CCID_Init_IT (void);
@@ -69,6 +71,12 @@ void CCID_BulkOutMessage (void);
 
 unsigned char CCID_BulkInMessage (void);
 
+void CCID_StartTimeExtension (void);
+
+void CCID_StopTimeExtension (void);
+
+void CCID_TimeExtensionTick (void);
+
 void CCID_DispatchMessage (void);
 
 void CCID_IntMessage (void);
@@ -27,7 +27,7 @@
 /* EP_NUM */
 /* defines how many endpoints are used by the device */
 /*-------------------------------------------------------------*/
-#define CCID_EP_NUM                          (5)
+#define CCID_EP_NUM                          (6)
 
 /*-------------------------------------------------------------*/
 /* -------------- Buffer Description Table ----------------- */
@@ -38,23 +38,32 @@
 
 /* EP0 */
 /* rx/tx buffer base address */
-#define CCID_ENDP0_RXADDR        (0x18)
-#define CCID_ENDP0_TXADDR        (0x58)
+#define CCID_ENDP0_RXADDR        (0x40)
+#define CCID_ENDP0_TXADDR        (0x80)
 
 /* EP1 */
-/* tx buffer base address */
-#define CCID_ENDP1_TXADDR        (0x98)
+/* tx buffer base address, notifications are max. 4 byte. In the unused
+   BTABLE entries of EP6 and EP7 */
+#define CCID_ENDP1_TXADDR        (0x30)
 
 /* EP2 */
-/* Rx buffer base address */
-#define CCID_ENDP2_RXADDR        (0xD8)
-/* Tx buffer base address */
-#define CCID_ENDP2_TXADDR        (0x118)
+/* Bulk in, double buffered: Tx buffer 0 and 1 base address */
+#define CCID_ENDP2_TXADDR0       (0xE0)
+#define CCID_ENDP2_TXADDR1       (0x120)
 
 /* EP3 */
+/* Bulk out, double buffered: Rx buffer 0 and 1 base address */
+#define CCID_ENDP3_RXADDR0       (0x160)
+#define CCID_ENDP3_RXADDR1       (0x1A0)
+
+/* EP4 */
 /* tx buffer base address */
-// #define ENDP3_TXADDR (0x158)
-#define ENDP4_TXADDR        (0x19C)
+#define ENDP4_TXADDR        (0x38)
+/* EP5 */
+/* HID command channel, interrupt in and out. The PMA is full, 32 byte
+   packets, a report takes two packets */
+#define CCID_ENDP5_TXADDR        (0xC0)
+#define CCID_ENDP5_RXADDR        (0x1E0)
 
 /* ISTR events */
 /* IMR_MSK */
@@ -77,8 +86,8 @@
 
 
 #define  CCID_EP1_OUT_Callback   NOP_Process
-// #define CCID_EP2_OUT_Callback NOP_Process
-#define  CCID_EP3_OUT_Callback   NOP_Process
+#define  CCID_EP2_OUT_Callback   NOP_Process
+// #define CCID_EP3_OUT_Callback NOP_Process
 #define  CCID_EP4_OUT_Callback   NOP_Process
 #define  CCID_EP5_OUT_Callback   NOP_Process
 #define  CCID_EP6_OUT_Callback   NOP_Process
@@ -30,7 +30,7 @@
 /* Exported macro ------------------------------------------------------------ */
 /* Exported define ----------------------------------------------------------- */
 #define CCID_SIZ_DEVICE_DESC              18
-#define CCID_SIZ_CONFIG_DESC              (1*0x09 + 2*0x09+ 1*0x07+ 0x09 + 0x36+3*0x07)
+#define CCID_SIZ_CONFIG_DESC              (1*0x09 + 2*0x09+ 1*0x07+ 0x09 + 0x36+3*0x07 + 0x09 + 0x09 + 2*0x07)
 // #define CCID_SIZ_CONFIG_DESC (1*0x09 + 3*0x09 +0x36 + 4*0x07)
 // #define CCID_SIZ_CONFIG_DESC (3*0x09 +2*0x36 + 6*0x07)
 
@@ -51,6 +51,11 @@
 #define KEYBOARD_SIZ_HID_DESC                   0x09
 // #define KEYBOARD_OFF_HID_DESC 0x66
 #define KEYBOARD_OFF_HID_DESC                   0x12
+// HID command channel interface, last in the configuration descriptor
+#define COMMAND_OFF_HID_DESC                    (CCID_SIZ_CONFIG_DESC - 2*0x07 - 0x09)
+#define COMMAND_SIZ_REPORT_DESC                 (34)
+#define COMMAND_INTERFACE_NO                    2
+#define COMMAND_PACKET_SIZE                     32
 
 
 #define JOYSTICK_SIZ_DEVICE_DESC                18
@@ -74,6 +79,8 @@ extern const uint8_t CCID_ConfigDescriptor[CCID_SIZ_CONFIG_DESC];
 
 extern const uint8_t Keyboard_ReportDescriptor[KEYBOARD_SIZ_REPORT_DESC];
 
+extern const uint8_t Command_ReportDescriptor[COMMAND_SIZ_REPORT_DESC];
+
 extern const uint8_t CCID_StringLangID[CCID_SIZ_STRING_LANGID];
 
 extern const uint8_t CCID_StringVendor[CCID_SIZ_STRING_VENDOR];
@@ -45,10 +45,27 @@ typedef enum _HID_REPORTS
     HID_FEATURE = 3
 } HID_REPORTS;
 
-extern uint8_t HID_SetReport_Value_tmp[KEYBOARD_FEATURE_COUNT];
-
 extern uint8_t HID_GetReport_Value_tmp[KEYBOARD_FEATURE_COUNT];
 
+// Feature report command queue, answers are read in the order of the commands
+#define HID_COMMAND_QUEUE_SIZE      4   // power of 2
+
+#define HID_COMMAND_FREE            0
+#define HID_COMMAND_QUEUED          1
+#define HID_COMMAND_DONE            2
+
+typedef struct
+{
+    volatile uint8_t cState;
+    uint8_t cCommand[KEYBOARD_FEATURE_COUNT];
+    uint8_t cAnswer[KEYBOARD_FEATURE_COUNT];
+} typeHidCommandSlot;
+
+// Command channel (interrupt endpoints of interface 2)
+#define HID_CHANNEL_RECEIVE         0
+#define HID_CHANNEL_QUEUED          1   // command complete, main loop parses it
+#define HID_CHANNEL_SEND            2   // answer is sent
+
 /* Exported constants -------------------------------------------------------- */
 #define USB_CCID_Storage_GetConfiguration          NOP_Process
 // #define USB_CCID_Storage_SetConfiguration NOP_Process //
@@ -106,10 +123,36 @@ uint8_t* Keyboard_GetReportDescriptor (uint16_t Length);
 
 uint8_t* Keyboard_GetHIDDescriptor (uint16_t Length);
 
+uint8_t* Command_GetReportDescriptor (uint16_t Length);
+
+uint8_t* Command_GetHIDDescriptor (uint16_t Length);
+
 uint8_t* Keyboard_GetReport_Feature (uint16_t Length);
 
 uint8_t* Keyboard_SetReport_Feature (uint16_t Length);
 
 uint8_t* Keyboard_SetReport_Output (uint16_t Length);
 
+uint8_t* HID_GetQueuedCommand (void);
+
+uint8_t* HID_GetQueuedAnswerBuffer (void);
+
+void HID_QueuedCommandDone (void);
+
+uint8_t* HID_GetBusyCommand (void);
+
+uint8_t* HID_GetBusyAnswerBuffer (void);
+
+void HID_BusyCommandDone (void);
+
+void HID_ChannelOutMessage (void);
+
+void HID_ChannelInMessage (void);
+
+uint8_t* HID_GetChannelCommand (void);
+
+uint8_t* HID_GetChannelAnswerBuffer (void);
+
+void HID_ChannelCommandDone (void);
+
 #endif /* __CCID_usb_prop_H */
@@ -34,10 +34,11 @@
 
 #define   USB_MESSAGE_BUFFER_LENGTH (272+30)
 
-extern unsigned char UsbMessageBuffer[USB_MESSAGE_BUFFER_LENGTH + 50];  // +
-                                                                        // 50
-                                                                        // for
-                                                                        // secure
+#define   USB_MESSAGE_BUFFER_SIZE   (USB_MESSAGE_BUFFER_LENGTH + 50)  // + 50 for secure
+
+// Message in work (dispatch and answer), points to one of two message
+// buffers. The other buffer receives the next message meanwhile.
+extern unsigned char* UsbMessageBuffer;
 
 #define USB_MESSAGE_BUFFER_MAX_LENGTH			(0x010F+10)
 #define ICC_MESSAGE_BUFFER_MAX_LENGTH			(0x0105+10)
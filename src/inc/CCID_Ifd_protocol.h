@@ -44,6 +44,7 @@
 #define SetT1_bTransactionType				(IccTransactionLevelType |= 	TYPE_MASK)
 #define bmTransactionLevel						(IccTransactionLevelType & 		LEVEL_MASK)
 #define SetChar_bmTransactionLevel		(IccTransactionLevelType &= (~LEVEL_MASK))
+#define SetShortApdu_bmTransactionLevel	(IccTransactionLevelType = (IccTransactionLevelType & (~LEVEL_MASK)) | SHORTAPDU_LEVEL)
 
 
 #define		INS			0x00
@@ -83,6 +84,8 @@ unsigned char IFD_XfrTpduT0 (unsigned char* , unsigned int* );
 
 unsigned char IFD_XfrTpduT1 (unsigned char* , unsigned int* );
 
+unsigned char IFD_XfrShortApdu (unsigned char* , unsigned int* );
+
 unsigned char IFD_GetParameters (unsigned char* );
 
 unsigned char IFD_SetParameters (unsigned char* , unsigned char);
@@ -96,3 +99,12 @@ unsigned char IFD_SetATRData (void);
 int GetExpectedAnswerSizeFromAPDU (unsigned char* pAPDU, int nSize);
 
 void IFD_EscapeSendHwName (unsigned char* pBlockBuffer, unsigned int* pBlockSize);
+
+#define IFD_ESCAPE_REPORT_COMMANDS  0x10
+#define IFD_ESCAPE_MAX_REPORTS      4   // 1 + 4 * 64 byte fit into a CCID message
+
+void IFD_EscapeReportCommands (unsigned char* pBlockBuffer, unsigned int* pBlockSize);
+
+#define IFD_ESCAPE_STREAM_OBJECT    0x11
+
+void IFD_EscapeStreamObject (unsigned char* pBlockBuffer, unsigned int* pBlockSize);
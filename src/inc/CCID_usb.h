@@ -50,11 +50,18 @@
 #define		CCIDCLASSREQUEST_GET_CLOCK_FREQUENCIES	0x02
 #define		CCIDCLASSREQUEST_GET_DATA_RATES					0x03
 
+/* Time extension request while the card works on a message */
+#define		CCID_STATUS_TIME_EXTENSION							0x80    // bmCommandStatus = 2, ICC present and active
+#define		CCID_TIME_EXTENSION_MULTIPLIER						0x01    // bError: multiplier of BWT
+#define		CCID_TIME_EXTENSION_INTERVAL						100     // in 10 ms systicks
+
 
 /************************************************************************/
 /* Routines */
 /************************************************************************/
 
+void CCID_InitBulkTransfer (void);
+
 void CCID_Init (void);
 
 void CCID_Init_IT (void);
@@ -69,6 +76,12 @@ void CCID_BulkOutMessage (void);
 
 unsigned char CCID_BulkInMessage (void);
 
+void CCID_StartTimeExtension (void);
+
+void CCID_StopTimeExtension (void);
+
+void CCID_TimeExtensionTick (void);
+
 void CCID_DispatchMessage (void);
 
 void CCID_IntMessage (void);
@@ -28,6 +28,7 @@
 #define APDU_ANSWER_SEL_FILE_TERM_STATE         0x6285  /* Selected file in termination state */
 #define APDU_ANSWER_MEMORY_FAILURE              0x6581  /* Memory failure */
 #define APDU_ANSWER_WRONG_LENGTH                0x6700  /* Wrong length (Lc and/or Le) */
+#define APDU_ANSWER_WRONG_LE                    0x6C00  /* Wrong Le, SW2 contains the exact number of available bytes */
 #define APDU_ANSWER_SEC_MSG_NOT_SUPPORTED       0x6882  /* Secure messaging not supported */
 #define APDU_ANSWER_LAST_CHAIN_CMD_EXPECTED     0x6884  /* Last command of the chain expected */
 #define APDU_ANSWER_SEC_STATUS_NOT_SATISFIED    0x6982  /* Security status not satisfied */
@@ -105,6 +106,7 @@ unsigned int CcidReset (void);
 #define CCID_TPDU_R_BLOCK_FLAG          0x80
 #define CCID_TPDU_R_BLOCK_SEQUENCE_FLAG 0x10
 #define CCID_TPDU_CHAINING_FLAG         0x20
+#define CCID_TPDU_R_BLOCK_ERROR         0x03    // EDC or parity error, other error
 
 #define CCID_CLA  0
 #define CCID_INS  1
@@ -115,24 +117,86 @@ unsigned int CcidReset (void);
 
 #define CCID_MAX_PIN_LENGTH (255u-CCID_DATA)
 
+#define CCID_TPDU_MAX_INF             254 // max. information field size of a I-block
+#define CCID_TPDU_MAX_RESENDS         3   // of a chained I-block rejected by the card
+
+#define CCID_APDU_MIN_LENGTH          4
+#define CCID_APDU_MAX_LENGTH          (CCID_DATA + 255 + 1) // short APDU, case 4
+#define CCID_APDU_TRAILER_SIZE        2
+#define CCID_SIZE_GET_RESPONSE        5
+#define CCID_GET_RESPONSE_MAX_LOOPS   16
+
+// Instructions changing the card state
+#define CCID_INS_SELECT                 0xA4
+#define CCID_INS_VERIFY                 0x20
+#define CCID_INS_CHANGE_REFERENCE_DATA  0x24
+#define CCID_INS_RESET_RETRY_COUNTER    0x2C
+#define CCID_INS_ACTIVATE_FILE          0x44
+#define CCID_INS_PUT_DATA               0xDA
+#define CCID_INS_PUT_DATA_ODD           0xDB
+#define CCID_INS_TERMINATE_DF           0xE6
+
+#define CCID_CACHE_AID_MAX_LENGTH     16
+#define CCID_CACHE_PW_STATUS_LENGTH   7
+
+
+typedef struct
+{
+  unsigned char cAIDValid;
+  unsigned char cAIDLength;
+  unsigned char cAID[CCID_CACHE_AID_MAX_LENGTH];
+  unsigned char cPWStatusValid;
+  unsigned char cPWStatus[CCID_CACHE_PW_STATUS_LENGTH];
+  unsigned char cAesSupportValid;
+  unsigned char cAesSupported;
+} typeCcidDataObjectCache;
+
+#define CCID_SESSION_APP_NONE         0
+#define CCID_SESSION_APP_OPENPGP      1
+
+#define CCID_SESSION_PIN_BIT(n)       (1 << ((n) & 0x03))   // PIN 1-3 or P2 0x81-0x83
+
+#define CCID_SESSION_NO_COMMAND       0xFF
+#define CCID_SESSION_STAT_COMMANDS    0x70  // HID commands 0x00 - 0x6F
+
+typedef struct
+{
+  unsigned char cPowered;
+  unsigned char cSelectedApp;
+  unsigned char cVerifiedPins;
+} typeCcidSession;
+
 
 typedef struct
 {
   unsigned char cAPDULength;
   unsigned short cAPDUAnswerStatus;
-  unsigned char cAPDUAnswerLength;
+  unsigned short cAPDUAnswerLength;  // up to CCID_TRANSFER_BUFFER_MAX
   unsigned char cTPDUSequence;
-  unsigned char cTPDULength;
+  unsigned short cTPDULength;
   unsigned char cAPDU[CCID_TRANSFER_BUFFER_MAX];
   unsigned char cTPDU[CCID_TRANSFER_BUFFER_MAX + CCID_TPDU_OVERHEAD];
 } typeSmartcardTransfer;
 
 void InitSCTStruct (typeSmartcardTransfer * _tSCT);
-unsigned char GenerateCRC (unsigned char* pData, unsigned char cLength);
+unsigned char GenerateCRC (unsigned char* pData, unsigned short cLength);
 void GenerateTPDU (typeSmartcardTransfer * _tSCT);
 void GenerateChainedTPDU (typeSmartcardTransfer * _tSCT);
 unsigned short SendTPDU (typeSmartcardTransfer * _tSCT);
 unsigned short SendAPDU (typeSmartcardTransfer * _tSCT);
+unsigned short SendChainedAPDU (typeSmartcardTransfer * _tSCT, unsigned char* pAPDU, unsigned int nAPDULength);
+int SetLeOfAPDU (unsigned char* pAPDU, unsigned int nSize, unsigned char cLe);
+unsigned short CcidXfrAPDU (unsigned char* pBuffer, unsigned int* pSize, unsigned int nMaxSize);
+void CcidInitSmartcardTransfer (void);
+void CcidInvalidateCache (void);
+void CcidCheckCacheInvalidation (unsigned char* pAPDU);
+void CcidSessionPowerOn (void);
+void CcidSessionPowerOff (void);
+void CcidSessionInvalidate (void);
+uint8_t CcidSessionIsPinVerified (unsigned char cPinNr);
+void CcidSessionSetCommand (unsigned char cCommand);
+unsigned short CcidSessionGetApdusAvoided (unsigned char cCommand);
+uint8_t LA_RestartSmartcard_u8 (void);
 
 
 
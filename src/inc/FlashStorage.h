@@ -28,6 +28,8 @@
 
 #include "stm32f10x.h"
 
+#define FLASHC_USER_PAGE 0x801dc00
+
 u8 WriteAESStorageKeyToUserPage (u8 * data);
 
 // u8 ReadAESStorageKeyToUserPage (u8 *data);
@@ -33,6 +33,7 @@
 // 0x801F400 <- slot 2 counter
 // 0x801F800 <- slot 3 counter
 // 0x8014000 <- slot 4 counter (attempt)
+// 0x8014400 <- performance counters
 // 0x801FC00 <- backup page
 
 
@@ -57,7 +58,7 @@
                             // backup pages with additional info
 
 //Highest address for flashing is currently 0x0800c688 (less than 50 kB; GCC 4.9.2, size optimization)
-//Lets start data at 80kB+
+//Lets start data at 80kB+, the FLASH region of the linker scripts ends here
 #define FLASH_MEMORY_BEGIN 0x8014000
 //Lowest region in use found in the firmware - PWS, src/inc/password_safe.h:42
 #define FLASH_MEMORY_LOWEST 0x801C000
@@ -71,6 +72,7 @@
 #define SLOT3_COUNTER_ADDRESS 0x801F800
 #define SLOT4_COUNTER_ADDRESS FLASH_MEMORY_BEGIN
 #define BACKUP_PAGE_ADDRESS 0x801FC00
+#define PERF_COUNTERS_ADDRESS 0x8014400
 
 //Flash size is 128kB, which defines as:
 #define FLASH_MEMORY_LIMIT 0x8020000
@@ -135,6 +137,10 @@ uint8_t increment_counter_page (uint32_t addr);
 
 void write_to_slot(OTP_slot *new_slot_data, uint32_t offset, uint16_t len);
 
+uint8_t erase_flash_page (uint32_t addr);
+uint8_t program_flash_word (uint32_t addr, uint32_t data);
+uint8_t program_flash_halfword (uint32_t addr, uint16_t data);
+
 void backup_data (uint8_t * data, uint16_t len, uint32_t addr);
 
 uint8_t check_backups (void);
@@ -0,0 +1,53 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include "stm32f10x.h"
+
+// Counter numbers, the order is the one of the flash record and of the HID readout
+#define PERF_ERASE_SLOTS            0   // flash page erases per region
+#define PERF_ERASE_COUNTERS         1
+#define PERF_ERASE_BACKUP           2
+#define PERF_ERASE_PWS              3
+#define PERF_ERASE_USER_PAGE        4
+#define PERF_ERASE_TIME             5
+#define PERF_ERASE_OTHER            6
+#define PERF_HALFWORD_PROGRAMS      7
+#define PERF_APDUS                  8   // smartcard APDUs send
+#define PERF_SC_CHAR_REPEATS        9   // characters repeated by the card after a parity error
+#define PERF_APDU_TIME_SUM          10  // us
+#define PERF_APDU_TIME_MAX          11  // us
+#define PERF_HID_COMMANDS           12
+#define PERF_CCID_MESSAGES          13
+#define PERF_HOTP_ROLLOVERS         14  // HOTP counter page full, erased
+#define PERF_COUNTERS               15
+
+// The RAM counters are written to the flash at most every 10 minutes
+#define PERF_FLUSH_INTERVAL_MS      (10 * 60 * 1000L)
+
+void PERF_Init (void);
+void PERF_Count (uint8_t cCounter);
+void PERF_CountFlashErase (uint32_t nAddress);
+void PERF_CountFlashPrograms (uint16_t nHalfwords);
+void PERF_CountApdu (uint32_t nCycles);
+uint32_t PERF_Get (uint8_t cCounter);
+void PERF_TimerTick (void);
+void PERF_Flush (void);
+
+#endif /* PERF_COUNTERS_H_ */
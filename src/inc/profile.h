@@ -0,0 +1,68 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+
+#ifdef __linux__
+// Host build, the ticks are ns of the monotonic clock
+#define PROF_CYCLES_PER_US          1000
+#else
+// Cycle counter runs with the core clock
+#define PROF_CYCLES_PER_US          72
+#endif
+
+void PROF_Init (void);
+uint32_t PROF_GetCycles (void);
+
+// Profiling markers
+#define PROF_MARKER_HOTP_VALUE      0   // get_hotp_value
+#define PROF_MARKER_SHA1_BLOCK      1   // sha1_nextBlock
+#define PROF_MARKER_AES_BLOCK       2   // aes_crypt_ecb
+#define PROF_MARKER_CARD_COMMAND    3   // CRD_SendCommand, transfer and wait
+#define PROF_MARKER_WRITE_TO_SLOT   4   // write_to_slot
+#define PROF_MARKER_PARSE_REPORT    5   // parse_report
+#define PROF_MARKERS                6
+
+typedef struct
+{
+    uint32_t nCount;
+    uint32_t nMin;
+    uint32_t nMax;
+    uint64_t nSum;
+} typeProfMarker;
+
+/*
+ * PROF_BEGIN and PROF_END enclose the measured code in one block. They are
+ * empty unless the firmware is build with ENABLE_PROFILING (make
+ * PROFILING=1).
+ */
+#ifdef ENABLE_PROFILING
+#define PROF_BEGIN(id)              uint32_t nProfStart_##id = PROF_GetCycles ()
+#define PROF_END(id)                PROF_Record ((id), PROF_GetCycles () - nProfStart_##id)
+
+void PROF_Record (uint8_t cMarker, uint32_t nCycles);
+void PROF_GetMarker (uint8_t cMarker, typeProfMarker * pMarker);
+void PROF_Clear (void);
+#else
+#define PROF_BEGIN(id)
+#define PROF_END(id)
+#endif
+
+#endif /* PROFILE_H_ */
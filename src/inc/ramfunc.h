@@ -0,0 +1,40 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RAMFUNC_H_
+#define RAMFUNC_H_
+
+#include "stm32f10x.h"
+#include "stm32f10x_flash.h"
+
+/*
+ * A function executed from RAM, the section .ramfunc is copied with .data
+ * by the startup code. It keeps running while the flash is erased or
+ * programmed, it must only call other RAMFUNC functions. The calls between
+ * flash and RAM are out of the range of a BL instruction, the linker adds
+ * long branch veneers. The host build has no flash stall, ramfunc.c is
+ * replaced by host_flash.c and host_rcc.c.
+ */
+#define RAMFUNC                     __attribute__ ((section (".ramfunc"), noinline))
+
+void RAM_InitVectorTable (void);
+
+RAMFUNC FLASH_Status RAM_FlashErasePage (uint32_t nAddress);
+RAMFUNC FLASH_Status RAM_FlashProgramHalfWord (uint32_t nAddress, uint16_t nData);
+RAMFUNC FLASH_Status RAM_FlashProgramWord (uint32_t nAddress, uint32_t nData);
+
+#endif /* RAMFUNC_H_ */
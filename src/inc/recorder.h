@@ -0,0 +1,63 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#include <stdint.h>
+
+#ifndef REC_RING_SIZE
+#define REC_RING_SIZE               2048    // bytes, power of 2
+#endif
+
+// Record types
+#define REC_HID_REPORT              1   // feature report given to parse_report, KEYBOARD_FEATURE_COUNT bytes
+#define REC_HID_ANSWER              2   // status byte of the answer
+#define REC_CCID_MESSAGE            3   // bulk out message in UsbMessageBuffer, header and abData
+#define REC_CCID_ANSWER             4   // header of the bulk in answer
+#define REC_TPDU_OUT                5   // T=1 block to the card
+#define REC_TPDU_IN                 6   // T=1 block of the card, empty if the card didn't answer
+
+/*
+ * A record is the header and nLength bytes of data. The recording is a
+ * stream of records, a position is the byte offset in the stream since the
+ * startup.
+ */
+typedef struct
+{
+    uint8_t cType;
+    uint8_t cReserved;
+    uint16_t nLength;
+    uint32_t nTime;             // ms, currentTime
+    uint32_t nCycles;           // see PROF_GetCycles
+} typeRecHeader;
+
+/*
+ * REC_RECORD logs the traffic of the device into a RAM ring, the oldest
+ * records are dropped. It is empty unless the firmware is build with
+ * ENABLE_RECORDER (make RECORDER=1). The records are read by CMD_GET_RECORDING.
+ */
+#ifdef ENABLE_RECORDER
+#define REC_RECORD(type, data, length)  REC_Write ((type), (data), (length))
+
+void REC_Write (uint8_t cType, const void* pData, uint16_t nLength);
+uint32_t REC_Read (uint32_t nPosition, uint8_t * pData, uint16_t nMaxLength, uint16_t * pnLength);
+#else
+#define REC_RECORD(type, data, length)  ((void) 0)
+#endif
+
+#endif /* RECORDER_H_ */
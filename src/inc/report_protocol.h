@@ -62,6 +62,16 @@
 #define CMD_DETECT_SC_AES                 0x6a
 #define CMD_NEW_AES_KEY                   0x6b
 #define GET_PRO_DEBUG                     0x6c
+#define CMD_GET_APDU_STATS                0x6d
+#define CMD_GET_SCHED_STATS               0x6e
+#define CMD_STREAM_OPEN                   0x6f
+#define CMD_STREAM_DATA                   0x70
+#define CMD_GET_COMMAND_STATS             0x71
+#define CMD_GET_PERF_COUNTERS             0x72
+#define CMD_GET_PROFILE                   0x73
+#define CMD_GET_TRACE                     0x74
+#define CMD_GET_RECORDING                 0x75
+#define CMD_GET_STACK_USAGE               0x76
 
 #define CMD_DATA_OFFSET                   0x01
 
@@ -85,6 +95,16 @@
 #define CMD_STATUS_ERROR_CHANGING_USER_PASSWORD     12
 #define CMD_STATUS_ERROR_CHANGING_ADMIN_PASSWORD    13
 #define CMD_STATUS_ERROR_UNBLOCKING_PIN             14
+#define CMD_STATUS_STREAM_ERROR                     15
+#define CMD_STATUS_BUSY                             16  // command queue full, not run
+
+// Authorization checked by the dispatcher before a command runs
+#define CMD_AUTH_NONE               0
+#define CMD_AUTH_ADMIN              1   // temporary admin password
+#define CMD_AUTH_USER               2   // temporary user password, if the user PIN protection is enabled
+
+#define CMD_FLAG_FLASH              0x01    // writes the flash
+#define CMD_FLAG_SMARTCARD          0x02    // uses the smartcard
 
 /*
    Output report size offset description 1 0 device status 1 1 last command's type 4 2 last command's CRC 1 6 last command's status 53 7 last
@@ -168,10 +188,22 @@ extern __IO uint8_t device_status;
 
 uint8_t parse_report (uint8_t * report, uint8_t * output);
 
+uint8_t parse_report_busy (uint8_t * report, uint8_t * output);
+
+uint8_t parse_stream_object (uint8_t * frame, size_t length, uint8_t * output);
+
+bool cmd_needs_smartcard (uint8_t cmd_type);
+
+bool parse_report_active (void);
+
 uint8_t cmd_get_status (uint8_t * report, uint8_t * output);
 
 uint8_t cmd_write_to_slot (OTP_slot *new_slot_data, uint8_t * output);
 
+uint8_t cmd_write_to_slot_report (uint8_t * report, uint8_t * output);
+
+uint8_t cmd_set_otp_data (uint8_t * report, uint8_t * output);
+
 uint8_t cmd_read_slot_name (uint8_t * report, uint8_t * output);
 
 uint8_t cmd_read_slot (uint8_t * report, uint8_t * output);
@@ -230,6 +262,26 @@ uint8_t cmd_unblock_pin (uint8_t * report, uint8_t * output);
 
 uint8_t cmd_getProDebug (uint8_t * report, uint8_t * output);
 
+uint8_t cmd_getApduStats (uint8_t * report, uint8_t * output);
+
+uint8_t cmd_getSchedStats (uint8_t * report, uint8_t * output);
+
+uint8_t cmd_stream_open (uint8_t * report, uint8_t * output);
+
+uint8_t cmd_stream_data (uint8_t * report, uint8_t * output);
+
+uint8_t cmd_get_command_stats (uint8_t * report, uint8_t * output);
+
+uint8_t cmd_get_perf_counters (uint8_t * report, uint8_t * output);
+
+uint8_t cmd_get_profile (uint8_t * report, uint8_t * output);
+
+uint8_t cmd_get_trace (uint8_t * report, uint8_t * output);
+
+uint8_t cmd_get_recording (uint8_t * report, uint8_t * output);
+
+uint8_t cmd_get_stack_usage (uint8_t * report, uint8_t * output);
+
 // START - OTP Test Routine --------------------------------
 /*
    uint8_t cmd_test_counter(uint8_t *report,uint8_t *output); uint8_t cmd_test_time(uint8_t *report,uint8_t *output); */
@@ -265,8 +317,10 @@ typedef struct {
     };
 } __packed write_to_slot_payload;
 
-static const int CMD_WRITE_CONFIG_PASSWORD_OFFSET = 6;
-static const int CMD_ERASE_SLOT_PASSWORD_OFFSET = 2;
+#define CMD_WTS_PASSWORD_OFFSET           1
+#define CMD_WRITE_CONFIG_PASSWORD_OFFSET  6
+#define CMD_ERASE_SLOT_PASSWORD_OFFSET    2
+#define CMD_SOD_PASSWORD_OFFSET           1
 
 typedef struct {
     uint8_t temporary_admin_password[25];
@@ -280,6 +334,53 @@ typedef struct {
   uint32_t otp_code_to_verify;
 } __packed cmd_query_verify_code;
 
+/*
+   CMD_STREAM_OPEN / CMD_STREAM_DATA
+
+   Upload of a whole object in as few reports as possible. The open report
+   carries the target, the object length, the CRC over the object and the
+   first bytes, the data reports carry the rest without an echo. The report
+   completing the object commits it.
+
+   The object CRC is calculated like the report CRC (STM32 CRC unit, little
+   endian 32 bit words), the object is padded with zeros to a word.
+
+   OTP slot object (77 bytes, admin temporary password needed):
+   15b name 40b secret 1b config 13b token id 8b counter or interval
+
+   Password safe object (63 bytes, password safe must be enabled):
+   11b name 20b password 32b login name
+
+   output: 1b bytes received, the status of the commit
+
+   The CCID escape takes a whole object in one frame (parse_stream_object):
+   the fields of the open report up to the data, then the object. The
+   answer has the layout of a CMD_STREAM_OPEN answer, the command CRC is
+   the object CRC of the frame.
+ */
+
+#define STREAM_TARGET_OTP_SLOT      'O'
+#define STREAM_TARGET_PWS_SLOT      'P'
+
+#define STREAM_OPEN_DATA_LENGTH     27
+#define STREAM_DATA_LENGTH          58
+
+typedef struct {
+  uint8_t temporary_admin_password[25];
+  uint8_t target;
+  uint8_t slot_number;
+  uint8_t length;
+  uint32_t object_crc;
+  uint8_t data[STREAM_OPEN_DATA_LENGTH];
+} __packed cmd_stream_open_payload;
+
+typedef struct {
+  uint8_t sequence; // 1 for the first data report
+  uint8_t data[STREAM_DATA_LENGTH];
+} __packed cmd_stream_data_payload;
+
+#define STREAM_OBJECT_HEADER_LENGTH (sizeof(cmd_stream_open_payload) - STREAM_OPEN_DATA_LENGTH)
+
 #include <stddef.h>
 size_t s_min(size_t a, size_t b);
 
@@ -0,0 +1,57 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include "stm32f10x.h"
+
+// Event classes, a lower number is a higher priority
+#define SCHED_CLASS_USB             0   // CCID protocol (bulk messages, card detect)
+#define SCHED_CLASS_HID_COMMAND     1   // HID feature report commands
+#define SCHED_CLASS_KEYBOARD        2   // Keyboard output (lock key HOTP)
+#define SCHED_CLASS_FLASH           3   // Background flash maintenance
+#define SCHED_CLASSES               4
+
+#define SCHED_CLASS_BIT(c)          (1 << (c))
+#define SCHED_ALLOW_NONE            0
+#define SCHED_ALLOW_ALL             (SCHED_CLASS_BIT (SCHED_CLASSES) - 1)
+// The CCID protocol owns the smartcard and never runs inside another task
+#define SCHED_ALLOW_NO_USB          (SCHED_ALLOW_ALL & ~SCHED_CLASS_BIT (SCHED_CLASS_USB))
+
+typedef void (*pfSchedTask) (void);
+
+typedef struct
+{
+    uint32_t nServed;
+    uint32_t nLatencySum;       // ms, wake to service
+    uint16_t nLatencyMax;       // ms
+    uint16_t nDeferred;
+} typeSchedStats;
+
+void SCHED_SetTask (uint8_t cClass, pfSchedTask pfTask);
+void SCHED_PostEvent (uint8_t cClass);
+void SCHED_DeferEvent (uint8_t cClass);
+void SCHED_TimerTick (void);
+uint32_t SCHED_GetTime (void);
+uint8_t SCHED_IsNested (void);
+void SCHED_Run (void);
+void SCHED_Yield (uint8_t cAllowMask);
+void SCHED_Wait (uint16_t nMs, uint8_t cAllowMask);
+void SCHED_GetStats (uint8_t cClass, typeSchedStats * pStats);
+
+#endif /* SCHEDULER_H_ */
@@ -0,0 +1,35 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCRATCH_H_
+#define SCRATCH_H_
+
+#include <stdint.h>
+
+// One flash page (FLASH_PAGE_SIZE), the read-modify-write buffer of all page writes
+#define SCRATCH_SIZE                1024
+
+// Owners, only one of them holds the scratch page at a time
+#define SCRATCH_OWNER_NONE          0
+#define SCRATCH_OWNER_OTP_SLOTS     1   // write_to_slot
+#define SCRATCH_OWNER_PWS           2   // password safe slots
+#define SCRATCH_OWNER_USER_PAGE     3   // FlashStorage.c
+
+uint8_t* SCRATCH_Acquire (uint8_t cOwner);
+void SCRATCH_Release (uint8_t cOwner);
+
+#endif /* SCRATCH_H_ */
@@ -25,6 +25,7 @@
 
 /* Includes ------------------------------------------------------------------ */
 #include "stm32f10x.h"
+#include "ramfunc.h"
 
 /* Exported constants -------------------------------------------------------- */
 #define T0_PROTOCOL        0x00 /* T0 protocol */
@@ -35,6 +36,16 @@
 #define LCmax              20
 #define SC_Receive_Timeout 0x8000   /* Direction to reader */
 
+/* Interrupt driven card transfer */
+#define SC_TRANSFER_IDLE                0
+#define SC_TRANSFER_RECEIVE             1
+#define SC_TRANSFER_DONE                2
+
+#define SC_TRANSFER_BUSY                (-1)    /* Return of CRD_PollCommand while receiving */
+
+#define SC_TRANSFER_FIRST_CHAR_TIMEOUT  8000    /* 10 ms ticks, allow card to work */
+#define SC_TRANSFER_CHAR_TIMEOUT        2       /* 10 ms ticks, end of answer */
+
 
 /* Smartcard Inteface GPIO pins */
 #define EXTI9_5_IRQChannel           ((unsigned char)0x17)  /* External Line [9:5] Ipterrupts */
@@ -185,6 +196,12 @@ char RestartSmartcard (void);
 
 void SC_SetHwParams (u8 cBaudrateIndex, u8 cConversion, u8 Guardtime, u8 Waitingtime);
 int CRD_SendCommand (unsigned char* pTransmitBuffer, unsigned int nCommandSize, unsigned int nExpectedAnswerSize, unsigned int* nReceivedAnswerSize);
+int CRD_StartCommand (unsigned char* pTransmitBuffer, unsigned int nCommandSize, void (*pfComplete) (int nStatus, unsigned int nReceivedSize));
+int CRD_PollCommand (unsigned int* nReceivedAnswerSize);
+unsigned char CRD_IsCommandActive (void);
+void CRD_SetIdleTask (void (*pfTask) (void));
+RAMFUNC void CRD_USART_IRQHandler (void);
+void CRD_TransferTick (void);
 
 void GPIO_Configuration_Smartcard (void);
 
@@ -0,0 +1,34 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STACK_USAGE_H_
+#define STACK_USAGE_H_
+
+#include <stdint.h>
+
+// __Init_Data () of the startup fills the RAM from _ebss up to the stack
+// pointer with this word, the stack overwrites it while it grows
+#define STACK_PAINT_PATTERN         0xC5C5C5C5
+
+#define STACK_RAM_START             0x20000000
+
+uint32_t STACK_GetHighWaterMark (void);
+uint32_t STACK_GetSize (void);
+uint32_t STACK_GetStaticSize (void);
+uint32_t STACK_GetRamSize (void);
+
+#endif /* STACK_USAGE_H_ */
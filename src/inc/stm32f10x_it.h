@@ -54,6 +54,8 @@ void USB_LP_CAN1_RX0_IRQHandler (void);
 
 void SDIO_IRQHandler (void);
 
+void USART1_IRQHandler (void);
+
 void TIM2_IRQHandler (void);
 
 #include "hw_config.h"
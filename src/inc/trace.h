@@ -0,0 +1,69 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+#define TRACE_MAX_ARGS              3
+#define TRACE_RECORDS               32  // power of 2
+#define TRACE_ITM_PORT              1   // ITM stimulus port of the SWO output
+
+/*
+ * A trace record, 20 bytes. The format string isn't part of the firmware
+ * image, nFormat is its offset in the .trace_fmt section of the ELF file
+ * (scripts/trace_decode.py).
+ */
+typedef struct
+{
+    uint16_t nFormat;
+    uint8_t cArgs;
+    uint8_t cReserved;
+    uint32_t nTime;             // cycles, see PROF_GetCycles
+    uint32_t nArgs[TRACE_MAX_ARGS];
+} typeTraceRecord;
+
+void TRACE_Write (uint32_t nFormat, uint8_t cArgs, uint32_t nArg0, uint32_t nArg1, uint32_t nArg2);
+uint32_t TRACE_GetRecords (uint32_t nFirst, typeTraceRecord * pRecords, uint8_t cMaxRecords, uint8_t * pcRecords);
+void TRACE_Drain (void);
+
+/*
+ * TRACE (format, ...) logs a printf style format with up to 3 integer
+ * arguments. Only the address of the format is stored, the text is
+ * formatted by the host. A %s argument can't be printed, the decoder shows
+ * the pointer.
+ */
+#define TRACE_SECTION               __attribute__ ((section (".trace_fmt"), used))
+#define TRACE_ARG(a)                ((uint32_t) (uintptr_t) (a))
+
+#define TRACE_RECORD(sz, n, a, b, c) \
+    do \
+    { \
+        static const char TRACE_SECTION szTraceFormat[] = sz; \
+        TRACE_Write ((uint32_t) (uintptr_t) szTraceFormat, (n), (a), (b), (c)); \
+    } while (0)
+
+#define TRACE_0(sz)                 TRACE_RECORD (sz, 0, 0, 0, 0)
+#define TRACE_1(sz, a)              TRACE_RECORD (sz, 1, TRACE_ARG (a), 0, 0)
+#define TRACE_2(sz, a, b)           TRACE_RECORD (sz, 2, TRACE_ARG (a), TRACE_ARG (b), 0)
+#define TRACE_3(sz, a, b, c)        TRACE_RECORD (sz, 3, TRACE_ARG (a), TRACE_ARG (b), TRACE_ARG (c))
+
+#define TRACE_SELECT(_0, _1, _2, _3, name, ...) name
+#define TRACE(...)                  TRACE_SELECT (__VA_ARGS__, TRACE_3, TRACE_2, TRACE_1, TRACE_0, -) (__VA_ARGS__)
+
+#endif /* TRACE_H_ */
@@ -54,7 +54,7 @@
 /* EP3 */
 /* tx buffer base address */
 // #define ENDP3_TXADDR (0x158)
-#define ENDP4_TXADDR        (0x19C)
+#define ENDP4_TXADDR        (0x38)  /* must match CCIDHID_usb_conf.h */
 
 
 /* ISTR events */
@@ -72,16 +72,16 @@
 // #define EP2_IN_Callback NOP_Process
 #define  EP3_IN_Callback   NOP_Process
 // #define EP4_IN_Callback NOP_Process
-#define  EP5_IN_Callback   NOP_Process
+// #define EP5_IN_Callback NOP_Process
 #define  EP6_IN_Callback   NOP_Process
 #define  EP7_IN_Callback   NOP_Process
 
 
 #define  EP1_OUT_Callback   NOP_Process
-// #define EP2_OUT_Callback NOP_Process
-#define  EP3_OUT_Callback   NOP_Process
+#define  EP2_OUT_Callback   NOP_Process
+// #define EP3_OUT_Callback NOP_Process
 #define  EP4_OUT_Callback   NOP_Process
-#define  EP5_OUT_Callback   NOP_Process
+// #define EP5_OUT_Callback NOP_Process
 #define  EP6_OUT_Callback   NOP_Process
 #define  EP7_OUT_Callback   NOP_Process
 
@@ -27,6 +27,7 @@
 #include "keyboard.h"
 #include "AccessInterface.h"
 #include "hotp.h"
+#include "scheduler.h"
 
 
 uint8_t keyboardBuffer[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
@@ -78,7 +79,12 @@ void sendKeys (uint8_t * buffer)
 {
     if (bDeviceState == CONFIGURED)
     {
-        while (!PrevXferComplete);
+        // Sleep until the endpoint 4 callback, other keyboard output or
+        // HID commands must not run in between
+        while (!PrevXferComplete)
+        {
+            SCHED_Yield (SCHED_CLASS_BIT (SCHED_CLASS_FLASH));
+        }
 
         PrevXferComplete = 0;
         /* Use the memory interface function to write to the selected endpoint */
@@ -36,6 +36,12 @@
 #include "CcidLocalAccess.h"
 #include "time.h"
 #include "password_safe.h"
+#include "scheduler.h"
+#include "profile.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include "recorder.h"
+#include "stack_usage.h"
 
 uint8_t temp_password[25];
 uint8_t temp_user_password[25];
@@ -59,11 +65,173 @@ size_t s_min(size_t a, size_t b){
   return b;
 }
 
+/*
+ * Command dispatch table. An entry gives the authorization checked before
+ * the handler runs and whether the command writes the flash or uses the
+ * smartcard. The position in the table indexes the execution time
+ * statistics. Keep the entries in ascending order of the command type,
+ * also within the #ifdef blocks: cmd_find () is a binary search and
+ * cmd_get_command_stats () continues at a command type.
+ */
+typedef struct {
+  uint8_t cmd_type;
+  uint8_t auth;
+  uint8_t password_offset;  // of the temporary password in the report
+  uint8_t flags;
+  uint8_t (*handler)(uint8_t *report, uint8_t *output);
+} cmd_dispatch_entry;
+
+static const cmd_dispatch_entry cmd_dispatch_table[] = {
+  { CMD_GET_STATUS,                    CMD_AUTH_NONE,  0,                                  0,                                    cmd_get_status },
+  { CMD_WRITE_TO_SLOT,                 CMD_AUTH_ADMIN, CMD_WTS_PASSWORD_OFFSET,            CMD_FLAG_FLASH,                       cmd_write_to_slot_report },
+  { CMD_READ_SLOT_NAME,                CMD_AUTH_NONE,  0,                                  0,                                    cmd_read_slot_name },
+  { CMD_READ_SLOT,                     CMD_AUTH_NONE,  0,                                  0,                                    cmd_read_slot },
+  { CMD_GET_CODE,                      CMD_AUTH_USER,  CMD_GC_PASSWORD_OFFSET,             CMD_FLAG_FLASH,                       cmd_get_code },
+  { CMD_WRITE_CONFIG,                  CMD_AUTH_ADMIN, CMD_WRITE_CONFIG_PASSWORD_OFFSET,   CMD_FLAG_FLASH,                       cmd_write_config },
+  { CMD_ERASE_SLOT,                    CMD_AUTH_ADMIN, CMD_ERASE_SLOT_PASSWORD_OFFSET,     CMD_FLAG_FLASH,                       cmd_erase_slot },
+  { CMD_FIRST_AUTHENTICATE,            CMD_AUTH_NONE,  0,                                  CMD_FLAG_SMARTCARD,                   cmd_first_authenticate },
+  { CMD_GET_PASSWORD_RETRY_COUNT,      CMD_AUTH_NONE,  0,                                  CMD_FLAG_SMARTCARD,                   cmd_get_password_retry_count },
+  { CMD_SET_TIME,                      CMD_AUTH_NONE,  0,                                  CMD_FLAG_FLASH,                       cmd_set_time },
+  { CMD_USER_AUTHENTICATE,             CMD_AUTH_NONE,  0,                                  CMD_FLAG_SMARTCARD,                   cmd_user_authenticate },
+  { CMD_GET_USER_PASSWORD_RETRY_COUNT, CMD_AUTH_NONE,  0,                                  CMD_FLAG_SMARTCARD,                   cmd_get_user_password_retry_count },
+  { CMD_UNLOCK_USER_PASSWORD,          CMD_AUTH_NONE,  0,                                  CMD_FLAG_SMARTCARD,                   cmd_unblock_pin },
+  { CMD_LOCK_DEVICE,                   CMD_AUTH_NONE,  0,                                  0,                                    cmd_lockDevice },
+  { CMD_FACTORY_RESET,                 CMD_AUTH_NONE,  0,                                  CMD_FLAG_SMARTCARD | CMD_FLAG_FLASH,  cmd_factory_reset },
+  { CMD_CHANGE_USER_PIN,               CMD_AUTH_NONE,  0,                                  CMD_FLAG_SMARTCARD,                   cmd_change_user_pin },
+  { CMD_CHANGE_ADMIN_PIN,              CMD_AUTH_NONE,  0,                                  CMD_FLAG_SMARTCARD,                   cmd_change_admin_pin },
+  { CMD_SEND_OTP_DATA,                 CMD_AUTH_ADMIN, CMD_SOD_PASSWORD_OFFSET,            0,                                    cmd_set_otp_data },
+  { CMD_VERIFY_OTP_CODE,               CMD_AUTH_NONE,  0,                                  CMD_FLAG_FLASH,                       cmd_verify_code },
+
+  // Password Safe functions
+  { CMD_GET_PW_SAFE_SLOT_STATUS,       CMD_AUTH_NONE,  0,                                  0,                                    cmd_getPasswordSafeStatus },
+  { CMD_GET_PW_SAFE_SLOT_NAME,         CMD_AUTH_NONE,  0,                                  0,                                    cmd_getPasswordSafeSlotName },
+  { CMD_GET_PW_SAFE_SLOT_PASSWORD,     CMD_AUTH_NONE,  0,                                  0,                                    cmd_getPasswordSafeSlotPassword },
+  { CMD_GET_PW_SAFE_SLOT_LOGINNAME,    CMD_AUTH_NONE,  0,                                  0,                                    cmd_getPasswordSafeSlotLoginName },
+  { CMD_SET_PW_SAFE_SLOT_DATA_1,       CMD_AUTH_NONE,  0,                                  0,                                    cmd_setPasswordSafeSetSlotData_1 },
+  { CMD_SET_PW_SAFE_SLOT_DATA_2,       CMD_AUTH_NONE,  0,                                  CMD_FLAG_FLASH,                       cmd_setPasswordSafeSetSlotData_2 },
+  { CMD_PW_SAFE_ERASE_SLOT,            CMD_AUTH_NONE,  0,                                  CMD_FLAG_FLASH,                       cmd_getPasswordSafeEraseSlot },
+  { CMD_PW_SAFE_ENABLE,                CMD_AUTH_NONE,  0,                                  CMD_FLAG_SMARTCARD,                   cmd_getPasswordSafeEnable },
+  { CMD_PW_SAFE_INIT_KEY,              CMD_AUTH_NONE,  0,                                  CMD_FLAG_SMARTCARD | CMD_FLAG_FLASH,  cmd_getPasswordSafeInitKey },
+#ifdef PWS_SEND_DATA
+  { CMD_PW_SAFE_SEND_DATA,             CMD_AUTH_NONE,  0,                                  0,                                    cmd_getPasswordSafeSendData },
+#endif // PWS_SEND_DATA
+
+  { CMD_DETECT_SC_AES,                 CMD_AUTH_NONE,  0,                                  CMD_FLAG_SMARTCARD,                   cmd_detectSmartCardAES },
+  { CMD_NEW_AES_KEY,                   CMD_AUTH_NONE,  0,                                  CMD_FLAG_SMARTCARD | CMD_FLAG_FLASH,  cmd_newAesKey },
+#ifdef ADD_DEBUG_COMMANDS
+#warning "Debug commands handled"
+  { GET_PRO_DEBUG,                     CMD_AUTH_NONE,  0,                                  0,                                    cmd_getProDebug },
+  { CMD_GET_APDU_STATS,                CMD_AUTH_NONE,  0,                                  0,                                    cmd_getApduStats },
+  { CMD_GET_SCHED_STATS,               CMD_AUTH_NONE,  0,                                  0,                                    cmd_getSchedStats },
+#endif // ADD_DEBUG_COMMANDS
+  // The stream target decides about the authorization
+  { CMD_STREAM_OPEN,                   CMD_AUTH_NONE,  0,                                  0,                                    cmd_stream_open },
+  { CMD_STREAM_DATA,                   CMD_AUTH_NONE,  0,                                  CMD_FLAG_FLASH,                       cmd_stream_data },
+  { CMD_GET_COMMAND_STATS,             CMD_AUTH_NONE,  0,                                  0,                                    cmd_get_command_stats },
+  { CMD_GET_PERF_COUNTERS,             CMD_AUTH_NONE,  0,                                  0,                                    cmd_get_perf_counters },
+#ifdef ENABLE_PROFILING
+  { CMD_GET_PROFILE,                   CMD_AUTH_NONE,  0,                                  0,                                    cmd_get_profile },
+#endif // ENABLE_PROFILING
+  { CMD_GET_TRACE,                     CMD_AUTH_NONE,  0,                                  0,                                    cmd_get_trace },
+#ifdef ENABLE_RECORDER
+  { CMD_GET_RECORDING,                 CMD_AUTH_NONE,  0,                                  0,                                    cmd_get_recording },
+#endif // ENABLE_RECORDER
+  { CMD_GET_STACK_USAGE,               CMD_AUTH_NONE,  0,                                  0,                                    cmd_get_stack_usage },
+};
+
+#define CMD_DISPATCH_ENTRIES (sizeof(cmd_dispatch_table) / sizeof(cmd_dispatch_table[0]))
+
+typedef struct {
+  uint32_t calls;
+  uint32_t cycles_min;
+  uint32_t cycles_max;
+  uint64_t cycles_sum;
+} cmd_dispatch_stats;
+
+static cmd_dispatch_stats cmd_stats[CMD_DISPATCH_ENTRIES];
+
+static int cmd_find(uint8_t cmd_type) {
+  unsigned int low = 0;
+  unsigned int high = CMD_DISPATCH_ENTRIES;
+  unsigned int entry_no;
+
+  while (low < high) {
+    entry_no = (low + high) / 2;
+    if (cmd_dispatch_table[entry_no].cmd_type == cmd_type)
+      return entry_no;
+    if (cmd_dispatch_table[entry_no].cmd_type < cmd_type)
+      low = entry_no + 1;
+    else
+      high = entry_no;
+  }
+  return -1;
+}
+
+static bool cmd_is_authorized(const cmd_dispatch_entry *entry, uint8_t *report) {
+  switch (entry->auth) {
+    case CMD_AUTH_ADMIN:
+      return is_valid_admin_temp_password(report + entry->password_offset);
+    case CMD_AUTH_USER:
+      return !is_user_PIN_protection_enabled() || is_valid_temp_user_password(report + entry->password_offset);
+    default:
+      return TRUE;
+  }
+}
+
+static void cmd_record_time(unsigned int entry_no, uint32_t cycles) {
+  cmd_dispatch_stats *const stats = &cmd_stats[entry_no];
+
+  if (0 == stats->calls || cycles < stats->cycles_min)
+    stats->cycles_min = cycles;
+  if (cycles > stats->cycles_max)
+    stats->cycles_max = cycles;
+  stats->cycles_sum += cycles;
+  stats->calls++;
+}
+
+/*
+ * Commands using the smartcard. While a card transfer of the CCID interface
+ * is in progress they stay queued.
+ */
+bool cmd_needs_smartcard(uint8_t cmd_type) {
+  int entry_no = cmd_find(cmd_type);
+
+  return 0 <= entry_no && 0 != (cmd_dispatch_table[entry_no].flags & CMD_FLAG_SMARTCARD);
+}
+
+/*
+ * A command is parsed (by the HID or by the CCID escape channel), a
+ * command waiting for the card must not start another one
+ */
+static bool parse_active = FALSE;
+
+bool parse_report_active(void) { return parse_active; }
+
+static void set_output_crc(uint8_t *output) {
+  uint32_t calculated_crc32;
+
+  CRC_ResetDR();
+  calculated_crc32 = CRC_CalcBlockCRC((uint32_t *) output, KEYBOARD_FEATURE_COUNT / 4 - 1);
+
+  output[OUTPUT_CRC_OFFSET] = calculated_crc32 & 0xFF;
+  output[OUTPUT_CRC_OFFSET + 1] = (calculated_crc32 >> 8) & 0xFF;
+  output[OUTPUT_CRC_OFFSET + 2] = (calculated_crc32 >> 16) & 0xFF;
+  output[OUTPUT_CRC_OFFSET + 3] = (calculated_crc32 >> 24) & 0xFF;
+}
+
 uint8_t parse_report(uint8_t * const report, uint8_t * const output) {
   uint8_t cmd_type = report[CMD_TYPE_OFFSET];
   uint32_t received_crc32;
   uint32_t calculated_crc32;
-  uint8_t not_authorized = 0;
+  uint32_t start_cycles;
+  int entry_no;
+
+  PROF_BEGIN(PROF_MARKER_PARSE_REPORT);
+  parse_active = TRUE;
+
+  // The readout of the recording isn't recorded
+  if (CMD_GET_RECORDING != cmd_type)
+    REC_RECORD(REC_HID_REPORT, report, KEYBOARD_FEATURE_COUNT);
 
   received_crc32 = getu32(report + KEYBOARD_FEATURE_COUNT - 4);
   CRC_ResetDR();
@@ -78,208 +246,98 @@ uint8_t parse_report(uint8_t * const report, uint8_t * const output) {
   output[OUTPUT_CMD_CRC_OFFSET + 3] = (uint8_t) ((calculated_crc32 >> 24) & 0xFF);
 
   if (calculated_crc32 == received_crc32) {
+    PERF_Count(PERF_HID_COMMANDS);
+    entry_no = cmd_find(cmd_type);
 
+    if (0 > entry_no) {
+      output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_UNKNOWN_COMMAND;
+    } else if (!cmd_is_authorized(&cmd_dispatch_table[entry_no], report)) {
+      output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_NOT_AUTHORIZED;
+    } else {
+      // Count the smartcard APDUs skipped by this command
+      CcidSessionSetCommand(cmd_type);
 
-    switch (cmd_type) {
-
-      case CMD_GET_STATUS:
-        cmd_get_status(report, output);
-        break;
-
-      case CMD_SEND_OTP_DATA: {
-        cmd_send_OTP_data const * const otp_data = (cmd_send_OTP_data*) (report+1);
-        if(is_valid_admin_temp_password(otp_data->temporary_admin_password)){
-          if (!write_to_slot_transaction_started){
-            memset((void *) &local_slot_content, 0, sizeof(local_slot_content));
-          }
-          write_to_slot_transaction_started = TRUE;
-          if (otp_data->type == 'N') {
-            size_t bytes_count = s_min(sizeof(otp_data->data), sizeof(local_slot_content.name));
-            memcpy(local_slot_content.name, otp_data->data, bytes_count);
-            memcpy(&output[OUTPUT_CMD_RESULT_OFFSET], local_slot_content.name, sizeof(local_slot_content.name));
-          } else if (otp_data->type == 'S') {
-            size_t offset = otp_data->id * sizeof(otp_data->data);
-            if (offset > sizeof(local_slot_content.secret) ){
-              offset = 0;
-            }
-            size_t bytes_count = s_min(sizeof(otp_data->data), sizeof(local_slot_content.secret)-offset);
-            memcpy(local_slot_content.secret+offset, otp_data->data, bytes_count);
-            memcpy(&output[OUTPUT_CMD_RESULT_OFFSET], local_slot_content.secret, sizeof(local_slot_content.secret));
-          }
-        } else
-          not_authorized = 1;
-      }
-        break;
-
-      case CMD_WRITE_TO_SLOT: {
-        write_to_slot_payload const * const payload = (write_to_slot_payload*) report;
-        if(is_valid_admin_temp_password(payload->temporary_admin_password)
-           && write_to_slot_transaction_started == TRUE) {
-          write_to_slot_transaction_started = FALSE;
-          local_slot_content.slot_number = payload->slot_number;
-          local_slot_content.interval_or_counter = payload->slot_counter_or_interval;
-          local_slot_content.config = payload->_slot_config;
-          memcpy(local_slot_content.token_id, payload->slot_token_id, sizeof(payload->slot_token_id));
-          cmd_write_to_slot(&local_slot_content, output);
-        } else
-          not_authorized = 1;
-        }
-        break;
-
-      case CMD_READ_SLOT_NAME:
-        cmd_read_slot_name(report, output);
-        break;
-
-      case CMD_READ_SLOT:
-        cmd_read_slot(report, output);
-        break;
-
-      case CMD_VERIFY_OTP_CODE:
-        cmd_verify_code(report, output);
-        break;
-
-      case CMD_GET_CODE: {
-        uint8_t *const user_temp_password = report + CMD_GC_PASSWORD_OFFSET;
-        if (!is_user_PIN_protection_enabled() || is_valid_temp_user_password(user_temp_password)) {
-              cmd_get_code(report, output);
-            } else
-              not_authorized = 1;
-        }
-        break;
-
-      case CMD_WRITE_CONFIG:
-        if (is_valid_admin_temp_password(report + CMD_WRITE_CONFIG_PASSWORD_OFFSET))
-          cmd_write_config(report, output);
-        else
-          not_authorized = 1;
-        break;
-
-      case CMD_ERASE_SLOT:
-        if (is_valid_admin_temp_password(report + CMD_ERASE_SLOT_PASSWORD_OFFSET))
-          cmd_erase_slot(report, output);
-        else
-          not_authorized = 1;
-        break;
-
-      case CMD_FIRST_AUTHENTICATE:
-        cmd_first_authenticate(report, output);
-        break;
-
-      case CMD_AUTHORIZE:
-        output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_UNKNOWN_COMMAND;
-        break;
-
-      case CMD_USER_AUTHORIZE:
-        output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_UNKNOWN_COMMAND;
-        break;
-
-      case CMD_GET_PASSWORD_RETRY_COUNT:
-        cmd_get_password_retry_count(report, output);
-        break;
-
-      case CMD_GET_USER_PASSWORD_RETRY_COUNT:
-        cmd_get_user_password_retry_count(report, output);
-        break;
-
-      case CMD_USER_AUTHENTICATE:
-        cmd_user_authenticate(report, output);
-        break;
-
-      case CMD_FACTORY_RESET:
-        cmd_factory_reset(report, output);
-        break;
-
-      case CMD_SET_TIME:
-        cmd_set_time(report, output);
-        break;
-
-        // Password Safe functions
-      case CMD_GET_PW_SAFE_SLOT_STATUS:
-        cmd_getPasswordSafeStatus(report, output);
-        break;
-      case CMD_GET_PW_SAFE_SLOT_NAME:
-        cmd_getPasswordSafeSlotName(report, output);
-        break;
-      case CMD_GET_PW_SAFE_SLOT_PASSWORD:
-        cmd_getPasswordSafeSlotPassword(report, output);
-        break;
-      case CMD_GET_PW_SAFE_SLOT_LOGINNAME:
-        cmd_getPasswordSafeSlotLoginName(report, output);
-        break;
-      case CMD_SET_PW_SAFE_SLOT_DATA_1:
-        cmd_setPasswordSafeSetSlotData_1(report, output);
-        break;
-      case CMD_SET_PW_SAFE_SLOT_DATA_2:
-        cmd_setPasswordSafeSetSlotData_2(report, output);
-        break;
-      case CMD_PW_SAFE_ERASE_SLOT:
-        cmd_getPasswordSafeEraseSlot(report, output);
-        break;
-      case CMD_PW_SAFE_ENABLE:
-        cmd_getPasswordSafeEnable(report, output);
-        break;
-      case CMD_PW_SAFE_INIT_KEY:
-        cmd_getPasswordSafeInitKey(report, output);
-        break;
-
-#ifdef PWS_SEND_DATA
-      case CMD_PW_SAFE_SEND_DATA:
-        cmd_getPasswordSafeSendData(report, output);
-        break;
-#endif // PWS_SEND_DATA
-
-      case CMD_LOCK_DEVICE:
-        cmd_lockDevice(report, output);
-        break;
-
-      case CMD_DETECT_SC_AES:
-        cmd_detectSmartCardAES(report, output);
-        break;
+      // The handlers report their result in the output status
+      start_cycles = PROF_GetCycles();
+      cmd_dispatch_table[entry_no].handler(report, output);
+      cmd_record_time(entry_no, PROF_GetCycles() - start_cycles);
 
-      case CMD_NEW_AES_KEY:
-        cmd_newAesKey(report, output);
-        break;
+      CcidSessionSetCommand(CCID_SESSION_NO_COMMAND);
+    }
+  } else
+    output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_WRONG_CRC;
 
-#ifdef ADD_DEBUG_COMMANDS
-#warning "Debug commands handled"
-      case GET_PRO_DEBUG:
-        cmd_getProDebug(report, output);
-        break;
-#endif // ADD_DEBUG_COMMANDS
+  set_output_crc(output);
 
-      case CMD_CHANGE_USER_PIN:
-        cmd_change_user_pin(report, output);
-        break;
+  if (CMD_GET_RECORDING != cmd_type)
+    REC_RECORD(REC_HID_ANSWER, &output[OUTPUT_CMD_STATUS_OFFSET], 1);
 
-      case CMD_CHANGE_ADMIN_PIN:
-        cmd_change_admin_pin(report, output);
-        break;
+  parse_active = FALSE;
+  PROF_END(PROF_MARKER_PARSE_REPORT);
+  return 0;
+}
 
-      case CMD_UNLOCK_USER_PASSWORD:
-        cmd_unblock_pin(report, output);
-        break;
+/*
+ * Answer of a report rejected by the full command queue: the command type
+ * and CRC of the report with CMD_STATUS_BUSY, the command isn't run
+ */
+uint8_t parse_report_busy(uint8_t * const report, uint8_t * const output) {
+  uint32_t calculated_crc32;
 
-      default:   // Non of the above cases was selected => unknown
-        // command
-        output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_UNKNOWN_COMMAND;
-        break;
-    }
+  CRC_ResetDR();
+  calculated_crc32 = CRC_CalcBlockCRC((uint32_t *) report, KEYBOARD_FEATURE_COUNT / 4 - 1);
 
-    if (not_authorized)
-      output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_NOT_AUTHORIZED;
+  memset(output, 0, KEYBOARD_FEATURE_COUNT);
+  output[OUTPUT_CMD_TYPE_OFFSET] = report[CMD_TYPE_OFFSET];
 
-  } else
-    output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_WRONG_CRC;
+  output[OUTPUT_CMD_CRC_OFFSET] = (uint8_t) (calculated_crc32 & 0xFF);
+  output[OUTPUT_CMD_CRC_OFFSET + 1] = (uint8_t) ((calculated_crc32 >> 8) & 0xFF);
+  output[OUTPUT_CMD_CRC_OFFSET + 2] = (uint8_t) ((calculated_crc32 >> 16) & 0xFF);
+  output[OUTPUT_CMD_CRC_OFFSET + 3] = (uint8_t) ((calculated_crc32 >> 24) & 0xFF);
+  output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_BUSY;
 
-  CRC_ResetDR();
-  calculated_crc32 = CRC_CalcBlockCRC((uint32_t *) output, KEYBOARD_FEATURE_COUNT / 4 - 1);
+  set_output_crc(output);
+  return 0;
+}
 
-  output[OUTPUT_CRC_OFFSET] = calculated_crc32 & 0xFF;
-  output[OUTPUT_CRC_OFFSET + 1] = (calculated_crc32 >> 8) & 0xFF;
-  output[OUTPUT_CRC_OFFSET + 2] = (calculated_crc32 >> 16) & 0xFF;
-  output[OUTPUT_CRC_OFFSET + 3] = (calculated_crc32 >> 24) & 0xFF;
+/*
+ * Output: for each command type called since startup, starting at the
+ * command type in report[1]: 1b command type, 1b authorization (high
+ * nibble) and flags (low nibble), 2b calls (saturated), 4b min, 4b max and
+ * 4b average execution time in cycles (little endian)
+ */
+uint8_t cmd_get_command_stats(uint8_t *report, uint8_t *output) {
+  unsigned int entry_no;
+  unsigned int offset = 0;
+  uint8_t *data;
+  uint16_t calls;
+  uint32_t cycles_avg;
+
+  for (entry_no = 0; entry_no < CMD_DISPATCH_ENTRIES; entry_no++) {
+    const cmd_dispatch_entry *const entry = &cmd_dispatch_table[entry_no];
+    const cmd_dispatch_stats *const stats = &cmd_stats[entry_no];
+
+    if (entry->cmd_type < report[CMD_DATA_OFFSET] || 0 == stats->calls)
+      continue;
+
+    if (offset + 16 > OUTPUT_CMD_RESULT_LENGTH)
+      break;
+
+    calls = (stats->calls < 0xFFFF) ? stats->calls : 0xFFFF;
+    cycles_avg = (uint32_t) (stats->cycles_sum / stats->calls);
+
+    data = output + OUTPUT_CMD_RESULT_OFFSET + offset;
+    data[0] = entry->cmd_type;
+    data[1] = (uint8_t) ((entry->auth << 4) | entry->flags);
+    memcpy(data + 2, &calls, 2);
+    memcpy(data + 4, &stats->cycles_min, 4);
+    memcpy(data + 8, &stats->cycles_max, 4);
+    memcpy(data + 12, &cycles_avg, 4);
+    offset += 16;
+  }
 
-  return 0;
+  output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_OK;
+  return (0);
 }
 
 bool is_user_PIN_protection_enabled(void) { return *((uint8_t *) (SLOTS_PAGE1_ADDRESS + GLOBAL_CONFIG_OFFSET + 3)) == 1; }
@@ -359,6 +417,45 @@ bool is_TOTP_slot_programmed(int slot_no){
   return is_programmed;
 }
 
+uint8_t cmd_set_otp_data(uint8_t *report, uint8_t *output) {
+  cmd_send_OTP_data const * const otp_data = (cmd_send_OTP_data*) (report+1);
+
+  if (!write_to_slot_transaction_started){
+    memset((void *) &local_slot_content, 0, sizeof(local_slot_content));
+  }
+  write_to_slot_transaction_started = TRUE;
+  if (otp_data->type == 'N') {
+    size_t bytes_count = s_min(sizeof(otp_data->data), sizeof(local_slot_content.name));
+    memcpy(local_slot_content.name, otp_data->data, bytes_count);
+    memcpy(&output[OUTPUT_CMD_RESULT_OFFSET], local_slot_content.name, sizeof(local_slot_content.name));
+  } else if (otp_data->type == 'S') {
+    size_t offset = otp_data->id * sizeof(otp_data->data);
+    if (offset > sizeof(local_slot_content.secret) ){
+      offset = 0;
+    }
+    size_t bytes_count = s_min(sizeof(otp_data->data), sizeof(local_slot_content.secret)-offset);
+    memcpy(local_slot_content.secret+offset, otp_data->data, bytes_count);
+    memcpy(&output[OUTPUT_CMD_RESULT_OFFSET], local_slot_content.secret, sizeof(local_slot_content.secret));
+  }
+  return 0;
+}
+
+uint8_t cmd_write_to_slot_report(uint8_t *report, uint8_t *output) {
+  write_to_slot_payload const * const payload = (write_to_slot_payload*) report;
+
+  if (write_to_slot_transaction_started != TRUE) {
+    output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_NOT_AUTHORIZED;
+    return 1;
+  }
+
+  write_to_slot_transaction_started = FALSE;
+  local_slot_content.slot_number = payload->slot_number;
+  local_slot_content.interval_or_counter = payload->slot_counter_or_interval;
+  local_slot_content.config = payload->_slot_config;
+  memcpy(local_slot_content.token_id, payload->slot_token_id, sizeof(payload->slot_token_id));
+  return cmd_write_to_slot(&local_slot_content, output);
+}
+
 uint8_t cmd_read_slot_name(uint8_t *report, uint8_t *output) {
 
   uint8_t slot_no = report[1];
@@ -836,6 +933,178 @@ uint8_t cmd_setPasswordSafeSetSlotData_2(uint8_t *report, uint8_t *output) {
   return (0);
 }
 
+/*
+ * Streamed object upload, see CMD_STREAM_OPEN in report_protocol.h
+ */
+#define STREAM_OTP_OBJECT_LENGTH  (sizeof(OTP_slot) - offsetof(OTP_slot, name))
+#define STREAM_PWS_OBJECT_LENGTH  (PWS_SLOTNAME_LENGTH + PWS_PASSWORD_LENGTH + PWS_LOGINNAME_LENGTH)
+#define STREAM_MAX_OBJECT_LENGTH  STREAM_OTP_OBJECT_LENGTH
+
+static uint8_t stream_target = 0;   // 0 - no stream open
+static uint8_t stream_slot;
+static uint8_t stream_length;
+static uint8_t stream_received;
+static uint8_t stream_sequence;
+static uint32_t stream_crc;
+static uint32_t stream_buffer[(STREAM_MAX_OBJECT_LENGTH + 3) / 4];
+
+// Clears the object, called when a stream is opened, aborted or committed
+static void stream_reset(void) {
+  memset(stream_buffer, 0, sizeof(stream_buffer));
+  stream_target = 0;
+  stream_received = 0;
+}
+
+static void stream_commit(uint8_t *output) {
+  uint8_t *const object = (uint8_t *) stream_buffer;
+  uint32_t calculated_crc32;
+
+  CRC_ResetDR();
+  calculated_crc32 = CRC_CalcBlockCRC(stream_buffer, (stream_length + 3) / 4);
+
+  if (calculated_crc32 != stream_crc) {
+    output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_WRONG_CRC;
+  } else if (STREAM_TARGET_OTP_SLOT == stream_target) {
+    OTP_slot slot;
+
+    memset(&slot, 0, sizeof(slot));
+    slot.slot_number = stream_slot;
+    memcpy(slot.name, object, STREAM_OTP_OBJECT_LENGTH);
+    cmd_write_to_slot(&slot, output);
+    memset(&slot, 0, sizeof(slot));
+  } else {
+    if (TRUE == PWS_WriteSlotData_1(stream_slot, object, object + PWS_SLOTNAME_LENGTH)
+        && TRUE == PWS_WriteSlotData_2(stream_slot, object + PWS_SLOTNAME_LENGTH + PWS_PASSWORD_LENGTH)) {
+      output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_OK;
+    } else {
+      output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_NOT_AUTHORIZED;
+    }
+  }
+
+  stream_reset();
+}
+
+static void stream_add(const uint8_t *data, size_t length, uint8_t *output) {
+  size_t bytes_count = s_min(length, stream_length - stream_received);
+
+  memcpy((uint8_t *) stream_buffer + stream_received, data, bytes_count);
+  stream_received += bytes_count;
+  output[OUTPUT_CMD_RESULT_OFFSET] = stream_received;
+
+  if (stream_received == stream_length)
+    stream_commit(output);
+}
+
+static uint8_t stream_open(cmd_stream_open_payload const * const payload, uint8_t *output) {
+  size_t object_length;
+
+  stream_reset();
+
+  if (STREAM_TARGET_OTP_SLOT == payload->target) {
+    if (!is_valid_admin_temp_password(payload->temporary_admin_password)) {
+      output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_NOT_AUTHORIZED;
+      return 1;
+    }
+    if (!is_HOTP_slot_number(payload->slot_number) && !is_TOTP_slot_number(payload->slot_number)) {
+      output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_WRONG_SLOT;
+      return 1;
+    }
+    object_length = STREAM_OTP_OBJECT_LENGTH;
+  } else if (STREAM_TARGET_PWS_SLOT == payload->target) {
+    // The password safe key is checked at the commit
+    if (PWS_SLOT_COUNT <= payload->slot_number) {
+      output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_WRONG_SLOT;
+      return 1;
+    }
+    object_length = STREAM_PWS_OBJECT_LENGTH;
+  } else {
+    output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_STREAM_ERROR;
+    return 1;
+  }
+
+  if (payload->length != object_length) {
+    output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_STREAM_ERROR;
+    return 1;
+  }
+
+  stream_target = payload->target;
+  stream_slot = payload->slot_number;
+  stream_length = payload->length;
+  stream_crc = payload->object_crc;
+  stream_sequence = 1;
+
+  stream_add(payload->data, sizeof(payload->data), output);
+  return 0;
+}
+
+/*
+ * The object bytes of the reports aren't kept either, the report buffers
+ * of the command queue are only overwritten by the next report
+ */
+uint8_t cmd_stream_open(uint8_t *report, uint8_t *output) {
+  uint8_t res = stream_open((cmd_stream_open_payload*) (report + 1), output);
+
+  memset(report + 1 + offsetof(cmd_stream_open_payload, data), 0, STREAM_OPEN_DATA_LENGTH);
+  return res;
+}
+
+/*
+ * A whole object in one frame, opened and completed like by the reports
+ */
+uint8_t parse_stream_object(uint8_t *frame, size_t length, uint8_t *output) {
+  cmd_stream_open_payload open;
+  size_t first;
+
+  parse_active = TRUE;
+  stream_reset();
+
+  memset(output, 0, KEYBOARD_FEATURE_COUNT);
+  output[OUTPUT_CMD_TYPE_OFFSET] = CMD_STREAM_OPEN;
+
+  if (STREAM_OBJECT_HEADER_LENGTH > length) {
+    output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_STREAM_ERROR;
+  } else {
+    memcpy(&open, frame, STREAM_OBJECT_HEADER_LENGTH);
+    memcpy(&output[OUTPUT_CMD_CRC_OFFSET], &open.object_crc, 4);
+
+    if (open.length != length - STREAM_OBJECT_HEADER_LENGTH) {
+      output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_STREAM_ERROR;
+    } else {
+      first = s_min(open.length, STREAM_OPEN_DATA_LENGTH);
+      memset(open.data, 0, sizeof(open.data));
+      memcpy(open.data, frame + STREAM_OBJECT_HEADER_LENGTH, first);
+
+      // The open commits an object fitting into its data
+      if (0 == stream_open(&open, output) && 0 != stream_target)
+        stream_add(frame + STREAM_OBJECT_HEADER_LENGTH + first, open.length - first, output);
+    }
+    memset(&open, 0, sizeof(open));
+    memset(frame + STREAM_OBJECT_HEADER_LENGTH, 0, length - STREAM_OBJECT_HEADER_LENGTH);
+  }
+
+  set_output_crc(output);
+  parse_active = FALSE;
+  return 0;
+}
+
+uint8_t cmd_stream_data(uint8_t *report, uint8_t *output) {
+  cmd_stream_data_payload const * const payload = (cmd_stream_data_payload*) (report + 1);
+  uint8_t res = 0;
+
+  // A lost or repeated report aborts the upload
+  if (0 == stream_target || payload->sequence != stream_sequence) {
+    stream_reset();
+    output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_STREAM_ERROR;
+    res = 1;
+  } else {
+    stream_sequence++;
+    stream_add(payload->data, sizeof(payload->data), output);
+  }
+
+  memset(report + 1 + offsetof(cmd_stream_data_payload, data), 0, STREAM_DATA_LENGTH);
+  return res;
+}
+
 uint8_t cmd_getPasswordSafeEraseSlot(uint8_t *report, uint8_t *output) {
   u32 Ret_u32;
 
@@ -946,8 +1215,178 @@ uint8_t cmd_getProDebug(uint8_t *report, uint8_t *output) {
   memcpy(output + OUTPUT_CMD_RESULT_OFFSET, data, data_length);
   return (0);
 }
+
+/*
+ * Output: 1b command type 2b APDUs avoided (little endian) for each command
+ * with a non zero counter, starting at the command type in report[1]
+ */
+uint8_t cmd_getApduStats(uint8_t *report, uint8_t *output) {
+  unsigned int cmd;
+  unsigned short count;
+  unsigned int offset = 0;
+
+  for (cmd = report[CMD_DATA_OFFSET]; cmd < CCID_SESSION_STAT_COMMANDS; cmd++) {
+    count = CcidSessionGetApdusAvoided(cmd);
+    if (0 == count)
+      continue;
+
+    if (offset + 3 > OUTPUT_CMD_RESULT_LENGTH)
+      break;
+
+    output[OUTPUT_CMD_RESULT_OFFSET + offset] = (uint8_t) cmd;
+    output[OUTPUT_CMD_RESULT_OFFSET + offset + 1] = (uint8_t) (count & 0xFF);
+    output[OUTPUT_CMD_RESULT_OFFSET + offset + 2] = (uint8_t) (count >> 8);
+    offset += 3;
+  }
+
+  output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_OK;
+  return (0);
+}
+
+/*
+ * Output: for each scheduler class 4b tasks served, 4b summed wake to
+ * service latency in ms, 2b max latency in ms, 2b deferred (little endian)
+ */
+uint8_t cmd_getSchedStats(uint8_t *report, uint8_t *output) {
+  typeSchedStats stats;
+  uint8_t *data = output + OUTPUT_CMD_RESULT_OFFSET;
+  uint8_t cls;
+
+  for (cls = 0; cls < SCHED_CLASSES; cls++) {
+    SCHED_GetStats(cls, &stats);
+    memcpy(data, &stats.nServed, 4);
+    memcpy(data + 4, &stats.nLatencySum, 4);
+    memcpy(data + 8, &stats.nLatencyMax, 2);
+    memcpy(data + 10, &stats.nDeferred, 2);
+    data += 12;
+  }
+
+  output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_OK;
+  return (0);
+}
 #endif
 
+/*
+ * Output: the performance counters starting at the counter number in
+ * report[1], 4b each (little endian), see perf_counters.h
+ */
+uint8_t cmd_get_perf_counters(uint8_t *report, uint8_t *output) {
+  uint8_t counter;
+  uint32_t value;
+  unsigned int offset = 0;
+
+  for (counter = report[CMD_DATA_OFFSET]; counter < PERF_COUNTERS; counter++) {
+    if (offset + 4 > OUTPUT_CMD_RESULT_LENGTH)
+      break;
+
+    value = PERF_Get(counter);
+    memcpy(output + OUTPUT_CMD_RESULT_OFFSET + offset, &value, 4);
+    offset += 4;
+  }
+
+  output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_OK;
+  return (0);
+}
+
+#ifdef ENABLE_PROFILING
+/*
+ * Output: for each profiling marker starting at the marker in report[1]:
+ * 1b marker, 4b count, 4b min, 4b max, 4b average cycles (little endian).
+ * A non zero report[2] clears the markers after the readout.
+ */
+uint8_t cmd_get_profile(uint8_t *report, uint8_t *output) {
+  typeProfMarker marker;
+  uint8_t marker_no;
+  uint32_t cycles_avg;
+  uint8_t *data;
+  unsigned int offset = 0;
+
+  for (marker_no = report[CMD_DATA_OFFSET]; marker_no < PROF_MARKERS; marker_no++) {
+    if (offset + 17 > OUTPUT_CMD_RESULT_LENGTH)
+      break;
+
+    PROF_GetMarker(marker_no, &marker);
+    cycles_avg = (0 == marker.nCount) ? 0 : (uint32_t) (marker.nSum / marker.nCount);
+
+    data = output + OUTPUT_CMD_RESULT_OFFSET + offset;
+    data[0] = marker_no;
+    memcpy(data + 1, &marker.nCount, 4);
+    memcpy(data + 5, &marker.nMin, 4);
+    memcpy(data + 9, &marker.nMax, 4);
+    memcpy(data + 13, &cycles_avg, 4);
+    offset += 17;
+  }
+
+  if (0 != report[CMD_DATA_OFFSET + 1])
+    PROF_Clear();
+
+  output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_OK;
+  return (0);
+}
+#endif // ENABLE_PROFILING
+
+/*
+ * Output: 4b number of the first record, 1b record count, the trace
+ * records (20b each, see trace.h) starting at the record number in
+ * report[1..4] (little endian). Overwritten records are skipped, the
+ * host continues with the next number until no record is returned.
+ */
+uint8_t cmd_get_trace(uint8_t *report, uint8_t *output) {
+  typeTraceRecord records[(OUTPUT_CMD_RESULT_LENGTH - 5) / sizeof(typeTraceRecord)];
+  uint32_t first;
+  uint8_t count;
+
+  memcpy(&first, report + CMD_DATA_OFFSET, 4);
+  first = TRACE_GetRecords(first, records, sizeof(records) / sizeof(records[0]), &count);
+
+  memcpy(output + OUTPUT_CMD_RESULT_OFFSET, &first, 4);
+  output[OUTPUT_CMD_RESULT_OFFSET + 4] = count;
+  memcpy(output + OUTPUT_CMD_RESULT_OFFSET + 5, records, count * sizeof(typeTraceRecord));
+
+  output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_OK;
+  return (0);
+}
+
+#ifdef ENABLE_RECORDER
+/*
+ * Output: 4b stream position of the first byte, 1b byte count, the bytes
+ * of the recording (see recorder.h) starting at the position in
+ * report[1..4] (little endian). If the position has been dropped the
+ * oldest record is returned, the host drops its incomplete record then.
+ */
+uint8_t cmd_get_recording(uint8_t *report, uint8_t *output) {
+  uint32_t position;
+  uint16_t count;
+
+  memcpy(&position, report + CMD_DATA_OFFSET, 4);
+  position = REC_Read(position, output + OUTPUT_CMD_RESULT_OFFSET + 5, OUTPUT_CMD_RESULT_LENGTH - 5, &count);
+
+  memcpy(output + OUTPUT_CMD_RESULT_OFFSET, &position, 4);
+  output[OUTPUT_CMD_RESULT_OFFSET + 4] = (uint8_t) count;
+
+  output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_OK;
+  return (0);
+}
+#endif // ENABLE_RECORDER
+
+/*
+ * Output: 4b stack high water mark since the reset, 4b RAM left for the
+ * stack, 4b static RAM (.data and .bss), 4b RAM size (little endian),
+ * see stack_usage.h
+ */
+uint8_t cmd_get_stack_usage(uint8_t *report, uint8_t *output) {
+  uint32_t values[4];
+
+  values[0] = STACK_GetHighWaterMark();
+  values[1] = STACK_GetSize();
+  values[2] = STACK_GetStaticSize();
+  values[3] = STACK_GetRamSize();
+  memcpy(output + OUTPUT_CMD_RESULT_OFFSET, values, sizeof(values));
+
+  output[OUTPUT_CMD_STATUS_OFFSET] = CMD_STATUS_OK;
+  return (0);
+}
+
 uint8_t cmd_lockDevice(uint8_t *report, uint8_t *output) {
   // Disable password safe
   PWS_DisableKey();
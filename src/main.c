@@ -35,6 +35,10 @@
 #include "string.h"
 #include "CcidLocalAccess.h"
 #include "HandleAesStorageKey.h"
+#include "scheduler.h"
+#include "profile.h"
+#include "perf_counters.h"
+#include "trace.h"
 
 
 int nGlobalStickState = STICK_STATE_SMARTCARD;
@@ -50,6 +54,16 @@ jmp_buf jmpRestartUSB;          // reentrypoint for USB device change
 
 void sendHOTPCodeForSlot(uint8_t slot_number);
 
+static void UsbProtocolTask(void);
+
+static void HidCommandTask(void);
+
+static void KeyboardTask(void);
+
+static void FlashTask(void);
+
+static void SmartcardIdleTask(void);
+
 #ifdef COMPILE_TEST
 /*******************************************************************************
 
@@ -107,51 +121,166 @@ int main(void) {
 
   SysTick_Config(720000);    // set systemtick to 10 ms - for delay ()
 
+  PROF_Init();
+
 
   /* Setup before USB startup */
 
   check_backups();
+  PERF_Init();
   SmartCardInitInterface();
 
   USB_Start();
 
   StartupCheck_u8();
 
-  /* Endless loop after USB startup */
+  SCHED_SetTask(SCHED_CLASS_USB, UsbProtocolTask);
+  SCHED_SetTask(SCHED_CLASS_HID_COMMAND, HidCommandTask);
+  SCHED_SetTask(SCHED_CLASS_KEYBOARD, KeyboardTask);
+  SCHED_SetTask(SCHED_CLASS_FLASH, FlashTask);
+
+  /* Serve HID requests while waiting for the card */
+  CRD_SetIdleTask(SmartcardIdleTask);
+
+  /* Initial card detect */
+  SCHED_PostEvent(SCHED_CLASS_USB);
+
+  /* Endless loop after USB startup, sleeps while there is nothing to do */
   while (1) {
-    if (device_status == STATUS_RECEIVED_REPORT) {
-      device_status = STATUS_BUSY;
-      parse_report(HID_SetReport_Value_tmp, HID_GetReport_Value_tmp);
-      device_status = STATUS_READY;
-    }
+    SCHED_Run();
+    TRACE_Drain();
+  }
+}
 
-    if (numLockClicked) {
-      numLockClicked = 0;
-      uint8_t slot_number = ((uint8_t *) SLOTS_PAGE1_ADDRESS + GLOBAL_CONFIG_OFFSET)[0];
-      sendHOTPCodeForSlot(slot_number);
-    }
+/*******************************************************************************
 
-    if (capsLockClicked) {
-      capsLockClicked = 0;
-      uint8_t slot_number = ((uint8_t *) SLOTS_PAGE1_ADDRESS + GLOBAL_CONFIG_OFFSET)[1];
-      sendHOTPCodeForSlot(slot_number);
-    }
+  UsbProtocolTask
 
-    if (scrollLockClicked) {
-      scrollLockClicked = 0;
-      uint8_t slot_number = ((uint8_t *) SLOTS_PAGE1_ADDRESS + GLOBAL_CONFIG_OFFSET)[2];
-      sendHOTPCodeForSlot(slot_number);
-    }
+  Posted by the CCID bulk endpoints and the USB reset
 
-    CCID_CheckUsbCommunication();
-    if (TRUE == nFlagSendSMCardInserted) {
-      CCID_SendCardDetect(); // Send card detect to host
-      nFlagSendSMCardInserted = FALSE;
-    }
+*******************************************************************************/
 
+static void UsbProtocolTask(void) {
+  CCID_CheckUsbCommunication();
+  if (TRUE == nFlagSendSMCardInserted) {
+    CCID_SendCardDetect(); // Send card detect to host
+    nFlagSendSMCardInserted = FALSE;
   }
 }
 
+/*******************************************************************************
+
+  HidCommandTask
+
+  Answer a report rejected by the full queue with CMD_STATUS_BUSY, else
+  parse a report of the command channel or the oldest queued feature
+  report, the task is posted again while more are waiting. Inside the wait
+  of another task the card may be busy, reports needing the card are left
+  to the main loop. So are all reports while a CCID escape command is
+  parsed. Reports writing the flash may run, the card answer is received
+  from RAM meanwhile (ramfunc.c).
+
+*******************************************************************************/
+
+static void HidCommandTask(void) {
+  uint8_t *report = HID_GetBusyCommand();
+  uint8_t channel;
+
+  if (NULL != report) {
+    parse_report_busy(report, HID_GetBusyAnswerBuffer());
+    HID_BusyCommandDone();
+    return;
+  }
+
+  report = HID_GetChannelCommand();
+  channel = (NULL != report);
+
+  if (!channel)
+    report = HID_GetQueuedCommand();
+
+  if (NULL == report)
+    return;
+
+  if (SCHED_IsNested() && (parse_report_active() || cmd_needs_smartcard(report[CMD_TYPE_OFFSET]))) {
+    SCHED_DeferEvent(SCHED_CLASS_HID_COMMAND);
+    return;
+  }
+
+  device_status = STATUS_BUSY;
+  if (channel) {
+    parse_report(report, HID_GetChannelAnswerBuffer());
+    HID_ChannelCommandDone();
+  } else {
+    parse_report(report, HID_GetQueuedAnswerBuffer());
+    HID_QueuedCommandDone();
+  }
+}
+
+/*******************************************************************************
+
+  KeyboardTask
+
+  Type the HOTP codes requested by a double click of a lock key, during a
+  card command too. Not while a command is parsed, it may be in the middle
+  of an OTP slot update.
+
+*******************************************************************************/
+
+static void KeyboardTask(void) {
+  if (SCHED_IsNested() && parse_report_active()) {
+    SCHED_DeferEvent(SCHED_CLASS_KEYBOARD);
+    return;
+  }
+
+  if (numLockClicked) {
+    numLockClicked = 0;
+    uint8_t slot_number = ((uint8_t *) SLOTS_PAGE1_ADDRESS + GLOBAL_CONFIG_OFFSET)[0];
+    sendHOTPCodeForSlot(slot_number);
+  }
+
+  if (capsLockClicked) {
+    capsLockClicked = 0;
+    uint8_t slot_number = ((uint8_t *) SLOTS_PAGE1_ADDRESS + GLOBAL_CONFIG_OFFSET)[1];
+    sendHOTPCodeForSlot(slot_number);
+  }
+
+  if (scrollLockClicked) {
+    scrollLockClicked = 0;
+    uint8_t slot_number = ((uint8_t *) SLOTS_PAGE1_ADDRESS + GLOBAL_CONFIG_OFFSET)[2];
+    sendHOTPCodeForSlot(slot_number);
+  }
+}
+
+/*******************************************************************************
+
+  FlashTask
+
+  Save the performance counters. Not inside the wait of another task, it
+  may be in the middle of a flash write.
+
+*******************************************************************************/
+
+static void FlashTask(void) {
+  if (SCHED_IsNested()) {
+    SCHED_DeferEvent(SCHED_CLASS_FLASH);
+    return;
+  }
+
+  PERF_Flush();
+}
+
+/*******************************************************************************
+
+  SmartcardIdleTask
+
+  Called by CRD_SendCommand while waiting for the card answer
+
+*******************************************************************************/
+
+static void SmartcardIdleTask(void) {
+  SCHED_Yield(SCHED_ALLOW_NO_USB);
+}
+
 void sendHOTPCodeForSlot(uint8_t slot_number) {
   if (slot_number <= 2) {
         OTP_slot *const otp_slot = (OTP_slot *) get_HOTP_slot_offset(slot_number);
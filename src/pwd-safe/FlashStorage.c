@@ -31,6 +31,7 @@
 #include "FlashStorage.h"
 #include "password_safe.h"
 #include "hotp.h"
+#include "scratch.h"
 
 typeStick20Configuration_st StickConfiguration_st;
 
@@ -43,8 +44,6 @@ typeStick20Configuration_st StickConfiguration_st;
 
 unsigned int debug_len = 0;
 
-#define FLASHC_USER_PAGE 0x801dc00
-
 /*
 
    Userpage layout PAGE: 0x801DC00
@@ -53,30 +52,43 @@ unsigned int debug_len = 0;
    133 Base for AES key hidden volume (32 byte) 134 - 137 ID of sd card (4 byte) 138 - 141 Last stored real timestamp (4 byte) 142 - 145 ID of sc
    card (4 byte) 146 - 177 XOR mask for sc tranfered keys (32 byte) 178 - 209 Password safe key (32 byte) 210 - Debug */
 
-#ifdef ADD_DEBUG_COMMANDS
+/*******************************************************************************
 
-void WriteDebug (u8 * data, unsigned int length)
-{
-    unsigned char page_buffer[FLASH_PAGE_SIZE];
+  WriteToUserPage
 
-    memcpy (page_buffer, FLASHC_USER_PAGE, FLASH_PAGE_SIZE);
-    memcpy (page_buffer + 210, data, length);
+  Changes Length_u32 bytes of the user page at Offset_u32. The page is
+  copied to the scratch page, changed there and written back.
 
-    debug_len += length;
+*******************************************************************************/
+
+static void WriteToUserPage (u32 Offset_u32, const u8 * Data_pu8, u32 Length_u32)
+{
+u8* page_buffer = SCRATCH_Acquire (SCRATCH_OWNER_USER_PAGE);
+
+    memcpy (page_buffer, (const void *) FLASHC_USER_PAGE, FLASH_PAGE_SIZE);
+    memcpy (page_buffer + Offset_u32, Data_pu8, Length_u32);
 
     FLASH_Unlock ();
-    FLASH_ErasePage (FLASHC_USER_PAGE);
+    erase_flash_page (FLASHC_USER_PAGE);
     write_data_to_flash (page_buffer, FLASH_PAGE_SIZE, FLASHC_USER_PAGE);
     FLASH_Lock ();
+
+    SCRATCH_Release (SCRATCH_OWNER_USER_PAGE);
+}
+
+#ifdef ADD_DEBUG_COMMANDS
+
+void WriteDebug (u8 * data, unsigned int length)
+{
+    WriteToUserPage (210, data, length);
+
+    debug_len += length;
 }
 
 
 void GetDebug (u8 * data, unsigned int* length)
 {
-    unsigned char page_buffer[FLASH_PAGE_SIZE];
-
-    memcpy (page_buffer, FLASHC_USER_PAGE, FLASH_PAGE_SIZE);
-    memcpy (data, page_buffer + 210, debug_len);
+    memcpy (data, (const void *) (FLASHC_USER_PAGE + 210), debug_len);
     *length = debug_len;
     debug_len = 0;
 }
@@ -96,15 +108,7 @@ void GetDebug (u8 * data, unsigned int* length)
 u8 WriteAESStorageKeyToUserPage (u8 * data)
 {
     // flashc_memcpy(FLASHC_USER_PAGE,data,32,TRUE);
-unsigned char page_buffer[FLASH_PAGE_SIZE];
-
-    memcpy (page_buffer, (const void *) FLASHC_USER_PAGE, FLASH_PAGE_SIZE);
-    memcpy (page_buffer, data, 32);
-
-    FLASH_Unlock ();
-    FLASH_ErasePage (FLASHC_USER_PAGE);
-    write_data_to_flash (page_buffer, FLASH_PAGE_SIZE, FLASHC_USER_PAGE);
-    FLASH_Lock ();
+    WriteToUserPage (0, data, 32);
 
     return (TRUE);
 }
@@ -205,16 +209,7 @@ u8 WriteStickConfigurationToUserPage (void)
     StickConfiguration_st.VersionInfo_au8[3] = 0;   // Build number not used
 
     // flashc_memcpy(FLASHC_USER_PAGE + 72,&StickConfiguration_st,30,TRUE);
-
-uint8_t page_buffer[FLASH_PAGE_SIZE];
-
-    memcpy (page_buffer, (const void *) FLASHC_USER_PAGE, FLASH_PAGE_SIZE);
-    memcpy (page_buffer + 72, (u8 *) & StickConfiguration_st, 28);
-
-    FLASH_Unlock ();
-    FLASH_ErasePage (FLASHC_USER_PAGE);
-    write_data_to_flash (page_buffer, FLASH_PAGE_SIZE, FLASHC_USER_PAGE);
-    FLASH_Lock ();
+    WriteToUserPage (72, (u8 *) & StickConfiguration_st, 28);
 
     return (TRUE);
 }
@@ -831,15 +826,7 @@ u8 ClearStickKeysNotInitatedToFlash (void)
 u8 WriteXorPatternToFlash (u8 * XorPattern_pu8)
 {
     // flashc_memcpy(FLASHC_USER_PAGE + 146,XorPattern_pu8,32,TRUE);
-unsigned char page_buffer[FLASH_PAGE_SIZE];
-
-    memcpy (page_buffer, (const void *) FLASHC_USER_PAGE, FLASH_PAGE_SIZE);
-    memcpy (page_buffer + 146, XorPattern_pu8, 32);
-
-    FLASH_Unlock ();
-    FLASH_ErasePage (FLASHC_USER_PAGE);
-    write_data_to_flash (page_buffer, FLASH_PAGE_SIZE, FLASHC_USER_PAGE);
-    FLASH_Lock ();
+    WriteToUserPage (146, XorPattern_pu8, 32);
 
     return (TRUE);
 }
@@ -886,16 +873,7 @@ u8 ReadXorPatternFromFlash (u8 * XorPattern_pu8)
 u8 WritePasswordSafeKey (u8 * data)
 {
     // memcpy ((void*)(FLASHC_USER_PAGE + 178),data,32);
-
-unsigned char page_buffer[FLASH_PAGE_SIZE];
-
-    memcpy (page_buffer, (const void *) FLASHC_USER_PAGE, FLASH_PAGE_SIZE);
-    memcpy (page_buffer + 178, data, 32);
-
-    FLASH_Unlock ();
-    FLASH_ErasePage (FLASHC_USER_PAGE);
-    write_data_to_flash (page_buffer, FLASH_PAGE_SIZE, FLASHC_USER_PAGE);
-    FLASH_Lock ();
+    WriteToUserPage (178, data, 32);
     return (TRUE);
 }
 
@@ -948,7 +926,7 @@ u32 i;
 
 u32 i1;
 
-uint8_t page_buffer[FLASH_PAGE_SIZE];
+uint8_t* page_buffer;
 
     // Clear user page
     for (i1 = 0; i1 < 7; i1++)
@@ -958,12 +936,7 @@ uint8_t page_buffer[FLASH_PAGE_SIZE];
             EraseStoreData_au8[i] = (u8) (rand () % 256);
         }
         // flashc_memcpy((void*)FLASHC_USER_PAGE,EraseStoreData_au8,256,TRUE);
-        memcpy (page_buffer, (const void *) FLASHC_USER_PAGE, FLASH_PAGE_SIZE);
-        memcpy (page_buffer, EraseStoreData_au8, 256);
-        FLASH_Unlock ();
-        FLASH_ErasePage (FLASHC_USER_PAGE);
-        write_data_to_flash (page_buffer, FLASH_PAGE_SIZE, FLASHC_USER_PAGE);
-        FLASH_Lock ();
+        WriteToUserPage (0, EraseStoreData_au8, 256);
 
     }
 
@@ -989,12 +962,16 @@ uint8_t page_buffer[FLASH_PAGE_SIZE];
         // flashc_memcpy((void*)(PWS_FLASH_START_ADDRESS+256),EraseStoreData_au8,256,TRUE);
 
         // memcpy(page_buffer, PWS_FLASH_START_ADDRESS, FLASH_PAGE_SIZE);
-        memcpy (page_buffer, EraseStoreData_au8, 256);
-        memcpy (page_buffer + 256, EraseStoreData_au8, 256);
+        page_buffer = SCRATCH_Acquire (SCRATCH_OWNER_PWS);
+        for (i = 0; i < FLASH_PAGE_SIZE; i += 256)
+        {
+            memcpy (page_buffer + i, EraseStoreData_au8, 256);
+        }
         FLASH_Unlock ();
-        FLASH_ErasePage (PWS_FLASH_START_ADDRESS);
+        erase_flash_page (PWS_FLASH_START_ADDRESS);
         write_data_to_flash (page_buffer, FLASH_PAGE_SIZE, PWS_FLASH_START_ADDRESS);
         FLASH_Lock ();
+        SCRATCH_Release (SCRATCH_OWNER_PWS);
 
     }
 
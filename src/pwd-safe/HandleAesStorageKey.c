@@ -42,6 +42,7 @@
 // #include "CCID/Local_ACCESS/OpenPGP_V20.h"
 #include "FlashStorage.h"
 #include "HandleAesStorageKey.h"
+#include "trace.h"
 
 
 /*******************************************************************************
@@ -82,7 +83,7 @@ u8 StorageKey_au8[AES_KEYSIZE_256_BIT];
 u8 Buffer_au8[AES_KEYSIZE_256_BIT];
 
 #ifdef LOCAL_DEBUG
-    // CI_TickLocalPrintf ("BuildNewAesStorageKey\r\n");
+    TRACE ("BuildNewAesStorageKey\r\n");
 #endif
     // Wait for next smartcard cmd
     DelayMs (10);
@@ -91,7 +92,7 @@ u8 Buffer_au8[AES_KEYSIZE_256_BIT];
     if (FALSE == getRandomNumber (AES_KEYSIZE_256_BIT / 2, StorageKey_au8))
     {
 #ifdef LOCAL_DEBUG
-        // CI_LocalPrintf ("GetRandomNumber fails\n\r");
+        TRACE ("GetRandomNumber fails\n\r");
 #endif
         return (FALSE);
     }
@@ -100,7 +101,7 @@ u8 Buffer_au8[AES_KEYSIZE_256_BIT];
     if (FALSE == getRandomNumber (AES_KEYSIZE_256_BIT / 2, &StorageKey_au8[AES_KEYSIZE_256_BIT / 2]))
     {
 #ifdef LOCAL_DEBUG
-        // CI_LocalPrintf ("GetRandomNumber fails\n\r");
+        TRACE ("GetRandomNumber fails\n\r");
 #endif
         return (FALSE);
     }
@@ -192,7 +193,7 @@ int i;
 
 u32 BuildNewAesMasterKey_u32 (u8 * AdminPW_pu8, u8 * MasterKey_pu8)
 {
-    RestartSmartcard ();
+    LA_RestartSmartcard_u8 ();
 
     // Wait for next smartcard cmd
     DelayMs (10);
@@ -254,22 +255,21 @@ u32 BuildNewXorPattern_u32 (void)
 u8 XorPattern_au8[AES_KEYSIZE_256_BIT];
 
 #ifdef LOCAL_DEBUG
-    // CI_TickLocalPrintf ("BuildNewXorPattern_u32\r\n");
+    TRACE ("BuildNewXorPattern_u32\r\n");
 #endif
 
-    RestartSmartcard ();
-    // LA_RestartSmartcard_u8 ();
+    LA_RestartSmartcard_u8 ();
 
 
 #ifdef LOCAL_DEBUG
-    // CI_LocalPrintf ("GetRandomNumber\n\r");
+    TRACE ("GetRandomNumber\n\r");
 #endif
 
     // Get a random number for the master key
     if (FALSE == getRandomNumber (AES_KEYSIZE_256_BIT / 2, XorPattern_au8))
     {
 #ifdef LOCAL_DEBUG
-        // CI_LocalPrintf ("GetRandomNumber fails\n\r");
+        TRACE ("GetRandomNumber fails\n\r");
 #endif
         return (FALSE);
     }
@@ -278,7 +278,7 @@ u8 XorPattern_au8[AES_KEYSIZE_256_BIT];
     if (FALSE == getRandomNumber (AES_KEYSIZE_256_BIT / 2, &XorPattern_au8[AES_KEYSIZE_256_BIT / 2]))
     {
 #ifdef LOCAL_DEBUG
-        // CI_LocalPrintf ("GetRandomNumber fails\n\r");
+        TRACE ("GetRandomNumber fails\n\r");
 #endif
         return (FALSE);
     }
@@ -391,7 +391,7 @@ u8 MasterKey_au8[AES_KEYSIZE_256_BIT];
 u32 DecryptKeyViaSmartcard_u32 (u8 * StorageKey_pu8)
 {
 #ifdef LOCAL_DEBUG
-    // CI_LocalPrintf ("DecryptKeyViaSmartcard\r\n");
+    TRACE ("DecryptKeyViaSmartcard\r\n");
     // //HexPrint (AES_KEYSIZE_256_BIT,StorageKey_pu8);
     // //CI_LocalPrintf ("\r\n");
 #endif
@@ -400,7 +400,7 @@ u32 DecryptKeyViaSmartcard_u32 (u8 * StorageKey_pu8)
     if (FALSE == testScAesKey (AES_KEYSIZE_256_BIT, StorageKey_pu8))
     {
 #ifdef LOCAL_DEBUG
-        // CI_LocalPrintf ("Smartcard access failed\r\n");
+        TRACE ("Smartcard access failed\r\n");
 #endif
         return (FALSE);
     }
@@ -519,13 +519,13 @@ u8 CheckStatus_u8 = TRUE;
         return (TRUE);
     }
 
-    // CI_LocalPrintf ("*** AES keys unsecure ***\r\n");
+    TRACE ("*** AES keys unsecure ***\r\n");
 
     ReadStickConfigurationFromUserPage ();
 
     if (TRUE == StickConfiguration_st.StickKeysNotInitiated_u8)
     {
-        // CI_LocalPrintf ("*** Set flash bit NotInitated ***\r\n");
+        TRACE ("*** Set flash bit NotInitated ***\r\n");
         SetStickKeysNotInitatedToFlash ();
     }
 
@@ -56,6 +56,8 @@
 // #include "USB_CCID/USB_CCID.h"
 #include "FlashStorage.h"
 #include "HandleAesStorageKey.h"
+#include "trace.h"
+#include "scratch.h"
 // #include "OTP/keyboard.h"
 // #include "LED_test.h"
 
@@ -136,19 +138,17 @@ u8 PWS_WriteSlot (u8 Slot_u8, typePasswordSafeSlot_st * Slot_st)
 {
 u8* AesKeyPointer_pu8;
 
-    CI_LocalPrintf
-        ("PWS_WriteSlot: Slot %d. Name -%s- Loginname -%s- PW -%s-\r\n",
-         Slot_u8, Slot_st->SlotName_au8, Slot_st->SlotLoginName_au8, Slot_st->SlotPassword_au8);
+    TRACE ("PWS_WriteSlot: Slot %d\r\n", Slot_u8);
 
     if (PWS_SLOT_COUNT <= Slot_u8)
     {
-        CI_LocalPrintf ("PWS_WriteSlot: Wrong slot nr %d\r\n", Slot_u8);
+        TRACE ("PWS_WriteSlot: Wrong slot nr %d\r\n", Slot_u8);
         return (FALSE);
     }
 
     if (FALSE == PWS_GetDecryptedPasswordSafeKey (&AesKeyPointer_pu8))
     {
-        CI_LocalPrintf ("PWS_WriteSlot: Key not decrypted\r\n");
+        TRACE ("PWS_WriteSlot: Key not decrypted\r\n");
         return (FALSE);
     }
 
@@ -163,9 +163,16 @@ u8* AesKeyPointer_pu8;
     CI_LocalPrintf ("\n\r");
 #endif
 
-    // Encrypt data (max 256 byte per encryption)
-unsigned char Slot_st_encrypted[PWS_SLOT_LENGTH];
+    // Copy the flash page, the slot is encrypted into its place
+uint8_t* page = (uint8_t *) PWS_FLASH_START_ADDRESS;
+
+uint8_t* page_buffer = SCRATCH_Acquire (SCRATCH_OWNER_PWS);
+
+uint8_t* Slot_st_encrypted = page_buffer + (PWS_SLOT_LENGTH * Slot_u8);
 
+    memcpy (page_buffer, page, FLASH_PAGE_SIZE);
+
+    // Encrypt data (max 256 byte per encryption)
 aes_context aes_ctx;
 
     aes_setkey_enc (&aes_ctx, AesKeyPointer_pu8, 256);
@@ -185,17 +192,11 @@ int i;
 #endif
 
     // Write to flash
-uint8_t page_buffer[FLASH_PAGE_SIZE];
-
-uint8_t* page = (uint8_t *) PWS_FLASH_START_ADDRESS;
-
-    memcpy (page_buffer, page, FLASH_PAGE_SIZE);
-    memcpy (page_buffer + (PWS_SLOT_LENGTH * Slot_u8), Slot_st_encrypted, PWS_SLOT_LENGTH);
-
     FLASH_Unlock ();
-    FLASH_ErasePage (PWS_FLASH_START_ADDRESS);
+    erase_flash_page (PWS_FLASH_START_ADDRESS);
     write_data_to_flash (page_buffer, FLASH_PAGE_SIZE, PWS_FLASH_START_ADDRESS);
     FLASH_Lock ();
+    SCRATCH_Release (SCRATCH_OWNER_PWS);
 
     // LED_GreenOff ();
     return (TRUE);
@@ -226,18 +227,18 @@ u8* AesKeyPointer_pu8;
 #endif
 typePasswordSafeSlot_st Slot_st;
 
-    CI_LocalPrintf ("PWS_EraseSlot: Slot %d\r\n", Slot_u8);
+    TRACE ("PWS_EraseSlot: Slot %d\r\n", Slot_u8);
 
     if (PWS_SLOT_COUNT <= Slot_u8)
     {
-        CI_LocalPrintf ("PWS_EraseSlot: Wrong slot nr %d\r\n", Slot_u8);
+        TRACE ("PWS_EraseSlot: Wrong slot nr %d\r\n", Slot_u8);
         return (FALSE);
     }
 
     // Check for unlock
     if (FALSE == PWS_GetDecryptedPasswordSafeKey (&AesKeyPointer_pu8))
     {
-        CI_LocalPrintf ("PWS_EraseSlot: user password not entered\r\n");
+        TRACE ("PWS_EraseSlot: user password not entered\r\n");
         return (FALSE);
     }
 
@@ -253,9 +254,16 @@ typePasswordSafeSlot_st Slot_st;
     CI_LocalPrintf ("\n\r");
 #endif
 
-    // Encrypt data (max 256 byte per encryption)
-unsigned char Slot_st_encrypted[PWS_SLOT_LENGTH];
+    // Copy the flash page, the slot is encrypted into its place
+uint8_t* page = (uint8_t *) PWS_FLASH_START_ADDRESS;
+
+uint8_t* page_buffer = SCRATCH_Acquire (SCRATCH_OWNER_PWS);
+
+uint8_t* Slot_st_encrypted = page_buffer + (PWS_SLOT_LENGTH * Slot_u8);
 
+    memcpy (page_buffer, page, FLASH_PAGE_SIZE);
+
+    // Encrypt data (max 256 byte per encryption)
 aes_context aes_ctx;
 
     aes_setkey_enc (&aes_ctx, AesKeyPointer_pu8, 256);
@@ -275,17 +283,11 @@ int i;
 #endif
 
     // Write to flash
-uint8_t page_buffer[FLASH_PAGE_SIZE];
-
-uint8_t* page = (uint8_t *) PWS_FLASH_START_ADDRESS;
-
-    memcpy (page_buffer, page, FLASH_PAGE_SIZE);
-    memcpy (page_buffer + (PWS_SLOT_LENGTH * Slot_u8), Slot_st_encrypted, PWS_SLOT_LENGTH);
-
     FLASH_Unlock ();
-    FLASH_ErasePage (PWS_FLASH_START_ADDRESS);
+    erase_flash_page (PWS_FLASH_START_ADDRESS);
     write_data_to_flash (page_buffer, FLASH_PAGE_SIZE, PWS_FLASH_START_ADDRESS);
     FLASH_Lock ();
+    SCRATCH_Release (SCRATCH_OWNER_PWS);
 
     // LED_GreenOff ();
     return (TRUE);
@@ -313,13 +315,13 @@ u8* AesKeyPointer_pu8;
 
     if (PWS_SLOT_COUNT <= Slot_u8)
     {
-        CI_LocalPrintf ("PWS_ReadSlot: Wrong slot nr %d\r\n", Slot_u8);
+        TRACE ("PWS_ReadSlot: Wrong slot nr %d\r\n", Slot_u8);
         return (FALSE);
     }
 
     if (FALSE == PWS_GetDecryptedPasswordSafeKey (&AesKeyPointer_pu8))
     {
-        CI_LocalPrintf ("PWS_ReadSlot: key not decrypted\r\n");
+        TRACE ("PWS_ReadSlot: key not decrypted\r\n");
         return (FALSE); // Aes key is not decrypted
     }
 
@@ -374,6 +376,7 @@ int i;
 u8 PWS_GetAllSlotStatus (u8 * StatusArray_pu8)
 {
 u32 i;
+u32 Active_u32 = 0;
 
 u8* AesKeyPointer_pu8;
 
@@ -390,7 +393,7 @@ typePasswordSafeSlot_st Slot_st;
     // Check for user password enable
     if (FALSE == PWS_GetDecryptedPasswordSafeKey (&AesKeyPointer_pu8))
     {
-        CI_LocalPrintf ("PWS_ReadSlot: key not decrypted\r\n");
+        TRACE ("PWS_ReadSlot: key not decrypted\r\n");
         return (FALSE); // Aes key is not decrypted
     }
 
@@ -401,23 +404,12 @@ typePasswordSafeSlot_st Slot_st;
             if (PWS_SLOT_ACTIV_TOKEN == Slot_st.SlotActiv_u8)
             {
                 StatusArray_pu8[i] = TRUE;
+                Active_u32 |= 1UL << i;
             }
         }
     }
 
-    CI_LocalPrintf ("PWS_ReadSlot: Slot status : ");
-    for (i = 0; i < PWS_SLOT_COUNT; i++)
-    {
-        if (TRUE == StatusArray_pu8[i])
-        {
-            CI_LocalPrintf ("1");
-        }
-        else
-        {
-            CI_LocalPrintf ("0");
-        }
-    }
-    CI_LocalPrintf ("\r\n");
+    TRACE ("PWS_GetAllSlotStatus: Active slots %08x\r\n", Active_u32);
 
     return (TRUE);
 }
@@ -444,7 +436,7 @@ u8 PWS_GetSlotName (u8 Slot_u8, u8 * Name_pu8)
 #endif
 typePasswordSafeSlot_st Slot_st;
 
-    CI_LocalPrintf ("PWS_GetSlotName: Slot %d\r\n", Slot_u8);
+    TRACE ("PWS_GetSlotName: Slot %d\r\n", Slot_u8);
 
     // Clear the output arry
     memset (Name_pu8, 0, PWS_SLOTNAME_LENGTH);
@@ -481,7 +473,7 @@ u8 PWS_GetSlotPassword (u8 Slot_u8, u8 * Password_pu8)
 #endif
 typePasswordSafeSlot_st Slot_st;
 
-    CI_LocalPrintf ("PWS_GetSlotPassword: Slot %d\r\n", Slot_u8);
+    TRACE ("PWS_GetSlotPassword: Slot %d\r\n", Slot_u8);
 
     // Clear the output array
     memset (Password_pu8, 0, PWS_SLOTNAME_LENGTH);
@@ -518,7 +510,7 @@ u8 PWS_GetSlotLoginName (u8 Slot_u8, u8 * Loginname_pu8)
 #endif
 typePasswordSafeSlot_st Slot_st;
 
-    CI_LocalPrintf ("PWS_GetSlotLoginName: Slot %d\r\n", Slot_u8);
+    TRACE ("PWS_GetSlotLoginName: Slot %d\r\n", Slot_u8);
 
     // Clear the output array
     memset (Loginname_pu8, 0, PWS_LOGINNAME_LENGTH);
@@ -602,21 +594,20 @@ u32 BuildPasswordSafeKey_u32 (void)
 {
 u8 Key_au8[AES_KEYSIZE_256_BIT];
 
-    CI_TickLocalPrintf ("BuildPasswordSafeKey_u32\r\n");
-    RestartSmartcard ();
-    // LA_RestartSmartcard_u8 ();
+    TRACE ("BuildPasswordSafeKey_u32\r\n");
+    LA_RestartSmartcard_u8 ();
 
     // Get a random number for the master key
     if (FALSE == getRandomNumber (AES_KEYSIZE_256_BIT / 2, Key_au8))
     {
-        CI_LocalPrintf ("GetRandomNumber fails 1\n\r");
+        TRACE ("GetRandomNumber fails 1\n\r");
         return (FALSE);
     }
 
     // Get a random number for the master key
     if (FALSE == getRandomNumber (AES_KEYSIZE_256_BIT / 2, &Key_au8[AES_KEYSIZE_256_BIT / 2]))
     {
-        CI_LocalPrintf ("GetRandomNumber fails 2\n\r");
+        TRACE ("GetRandomNumber fails 2\n\r");
         return (FALSE);
     }
 
@@ -649,7 +640,7 @@ u8 PWS_DecryptedPasswordSafeKey (void)
         return (TRUE);
     }
 
-    CI_LocalPrintf ("Decrypt password safe key\r\n");
+    TRACE ("Decrypt password safe key\r\n");
 
     // Get the encrypted hidden volume slots key
     ReadPasswordSafeKey (DecryptedPasswordSafeKey_au8);
@@ -685,12 +676,11 @@ u8 PWS_EnableAccess (u8 * password)
 {
 unsigned short ret;
 
-    CI_LocalPrintf ("PWS_EnableAccess: ");
 
     ret = CcidVerifyPin (2, (unsigned char *) password);    // 2 = user pw
     if (APDU_ANSWER_COMMAND_CORRECT != ret)
     {
-        CI_LocalPrintf (" *** FAIL ***\r\n");
+        TRACE ("PWS_EnableAccess: *** FAIL *** Verify PIN %04x\r\n", ret);
         return CMD_STATUS_WRONG_PASSWORD;
     }
 
@@ -698,11 +688,11 @@ unsigned short ret;
 
     if (TRUE != ret)
     {
-        CI_LocalPrintf (" *** FAIL ***. Can't decrypt key\r\n");
+        TRACE ("PWS_EnableAccess: *** FAIL ***. Can't decrypt key\r\n");
         return CMD_STATUS_AES_DEC_FAILED;
     }
 
-    CI_LocalPrintf ("OK\r\n");
+    TRACE ("PWS_EnableAccess: OK\r\n");
 
     return CMD_STATUS_OK;
 }
@@ -748,12 +738,12 @@ u8 PWS_InitKey (void)
 {
 u32 Ret_u32;
 
-    CI_LocalPrintf ("PWS_InitKey\r\n");
+    TRACE ("PWS_InitKey\r\n");
 
     Ret_u32 = PWS_DecryptedPasswordSafeKey ();
     if (TRUE != Ret_u32)
     {
-        CI_LocalPrintf ("PWS_InitKey: *** FAIL ***\r\n");
+        TRACE ("PWS_InitKey: *** FAIL ***\r\n");
         return (FALSE);
     }
 
@@ -29,6 +29,8 @@
  */
 
 /* Includes ------------------------------------------------------------------ */
+#include "stack_usage.h"
+
 /* Private typedef ----------------------------------------------------------- */
 /* Private define ------------------------------------------------------------ */
 #define WEAK __attribute__ ((weak))
@@ -337,14 +339,14 @@ void Reset_Handler (void)
 }
 
 /**
- * @brief  initializes data and bss sections
+ * @brief  initializes data and bss sections, paints the free RAM below the stack
  * @param  None
  * @retval : None
 */
 
 void __Init_Data (void)
 {
-    unsigned long* pulSrc,* pulDest;
+    unsigned long* pulSrc,* pulDest,* pulStack;
 
     /* Copy the data segment initializers from flash to SRAM */
     pulSrc = &_sidata;
@@ -358,6 +360,12 @@ void __Init_Data (void)
     {
         *(pulDest++) = 0;
     }
+    /* Paint the RAM up to the stack pointer for STACK_GetHighWaterMark () */
+    asm volatile (" MOV %0, sp":"=r" (pulStack));
+    for (pulDest = &_ebss; pulDest < pulStack;)
+    {
+        *(pulDest++) = STACK_PAINT_PATTERN;
+    }
 }
 
 /*******************************************************************************
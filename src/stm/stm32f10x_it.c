@@ -27,6 +27,11 @@
 #include "hw_config.h"
 #include "platform_config.h"
 #include "hotp.h"
+#include "CCID_usb.h"
+#include "smartcard.h"
+#include "scheduler.h"
+#include "perf_counters.h"
+#include "ramfunc.h"
 
 /* Private typedef ----------------------------------------------------------- */
 /* Private define ------------------------------------------------------------ */
@@ -170,6 +175,12 @@ void SysTick_Handler (void)
         TimeCounter = 100;
         current_time++;
     }
+
+    /* Timeout of the card answer */
+    CRD_TransferTick ();
+
+    /* Keep the host waiting while the card is busy */
+    CCID_TimeExtensionTick ();
 }
 
 /******************************************************************************/
@@ -216,6 +227,20 @@ void SDIO_IRQHandler (void)
 
 }
 
+/*******************************************************************************
+* Function Name  : USART1_IRQHandler
+* Description    : This function handles the smartcard USART interrupt
+*                  requests (receive and parity error). Executed from RAM,
+*                  it runs while the flash is erased.
+* Input          : None
+* Output         : None
+* Return         : None
+*******************************************************************************/
+RAMFUNC void USART1_IRQHandler (void)
+{
+    CRD_USART_IRQHandler ();
+}
+
 /******************************************************************************/
 /* STM32F10x Peripherals Interrupt Handlers */
 /* Add here the Interrupt Handler for the used peripheral(s) (PPP), for the */
@@ -243,6 +268,8 @@ void TIM2_IRQHandler (void)
     {
         TIM2->SR &= ~TIM_SR_UIF;    // clear UIF flag
         currentTime++;
+        SCHED_TimerTick ();
+        PERF_TimerTick ();
 
         int blink_verify = 0;
         blink_verify += Blink_process(&blinkVerifyError);
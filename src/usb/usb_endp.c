@@ -26,6 +26,8 @@
 
 #include "platform_config.h"
 #include "CCID_usb.h"
+#include "scheduler.h"
+#include "CCIDHID_usb_prop.h"
 
 /* Private typedef ----------------------------------------------------------- */
 /* Private define ------------------------------------------------------------ */
@@ -52,17 +54,19 @@ void EP1_IN_Callback (void)
 }
 
 /*******************************************************************************
-* Function Name  : EP2_OUT_Callback.
-* Description    : EP2 OUT Callback Routine.
+* Function Name  : EP3_OUT_Callback.
+* Description    : EP3 OUT Callback Routine (CCID bulk out).
 * Input          : None.
 * Output         : None.
 * Return         : None.
 *******************************************************************************/
-void EP2_OUT_Callback (void)
+void EP3_OUT_Callback (void)
 {
 
     CCID_BulkOutMessage ();
 
+    SCHED_PostEvent (SCHED_CLASS_USB);
+
 }
 
 /*******************************************************************************
@@ -77,6 +81,8 @@ void EP2_IN_Callback (void)
 
     CCID_BulkInMessage ();
 
+    SCHED_PostEvent (SCHED_CLASS_USB);
+
 }
 
 /*******************************************************************************
@@ -93,6 +99,34 @@ void XEP3_IN_Callback (void)
     // SwitchSmartcardLED(DISABLE);
 }
 
+/*******************************************************************************
+* Function Name  : EP5_OUT_Callback.
+* Description    : EP5 OUT Callback Routine (HID command channel).
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void EP5_OUT_Callback (void)
+{
+
+    HID_ChannelOutMessage ();
+
+}
+
+/*******************************************************************************
+* Function Name  : EP5_IN_Callback.
+* Description    : EP5 IN Callback Routine (HID command channel).
+* Input          : None.
+* Output         : None.
+* Return         : None.
+*******************************************************************************/
+void EP5_IN_Callback (void)
+{
+
+    HID_ChannelInMessage ();
+
+}
+
 void EP4_IN_Callback (void)
 {
     /* Set the transfer complete token to inform upper layer that the current transfer has been complete */
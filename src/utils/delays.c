@@ -24,7 +24,9 @@
  *      Author: RB
  */
 
+#include "stm32f10x.h"
 #include "delays.h"
+#include "scheduler.h"
 
 /*******************************************************************************
 
@@ -99,6 +101,9 @@ void Delay1Ms (void)
 
   DelayMs
 
+  Sleeps for nMs ms, the HID tasks run meanwhile. The CCID protocol
+  is not run, the caller may be in the middle of a smartcard sequence.
+
   Reviews
   Date      Reviewer        Info
   16.08.13  RB              First review
@@ -107,10 +112,5 @@ void Delay1Ms (void)
 
 void DelayMs (int nMs)
 {
-    int i;
-
-    for (i = 0; i < nMs; i++)
-    {
-        Delay1Ms ();
-    }
+    SCHED_Wait ((uint16_t) nMs, SCHED_ALLOW_NO_USB);
 }
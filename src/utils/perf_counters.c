@@ -0,0 +1,282 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Performance counters
+ *
+ * The counters are kept in RAM and written from time to time to their own
+ * flash page. The page is a log of records, a flush appends a record and
+ * the page is erased only when it is full. At startup the last complete
+ * record is loaded, so the counters cover the lifetime of the device.
+ */
+
+#include <string.h>
+#include "stm32f10x.h"
+#include "type.h"
+#include "hotp.h"
+#include "password_safe.h"
+#include "FlashStorage.h"
+#include "scheduler.h"
+#include "profile.h"
+#include "perf_counters.h"
+
+/*******************************************************************************
+
+ Local declarations
+
+*******************************************************************************/
+
+#define PERF_RECORD_MAGIC           0x46524550  // "PERF"
+
+typedef struct
+{
+    uint32_t nCounter[PERF_COUNTERS];
+    uint32_t nMagic;            // written last, marks a complete record
+} typePerfRecord;
+
+#define PERF_RECORDS_PER_PAGE       (FLASH_PAGE_SIZE / sizeof (typePerfRecord))
+
+// Changed by the interrupt handlers too, only the main context reads them
+static volatile uint32_t nCounters[PERF_COUNTERS];
+static volatile uint8_t cDirty = FALSE;
+
+static uint8_t cLoaded = FALSE;
+static volatile uint32_t nFlushTimer = 0;
+
+/*******************************************************************************
+
+  PERF_IsErased
+
+*******************************************************************************/
+
+static uint8_t PERF_IsErased (const typePerfRecord * pRecord)
+{
+    const uint32_t* pWord = (const uint32_t *) pRecord;
+    unsigned int i;
+
+    for (i = 0; i < sizeof (typePerfRecord) / 4; i++)
+    {
+        if (0xFFFFFFFF != pWord[i])
+        {
+            return (FALSE);
+        }
+    }
+    return (TRUE);
+}
+
+/*******************************************************************************
+
+  PERF_Init
+
+  Load the counters of the last complete record
+
+*******************************************************************************/
+
+void PERF_Init (void)
+{
+    const typePerfRecord* pRecord = (const typePerfRecord *) PERF_COUNTERS_ADDRESS;
+    unsigned int i;
+    int nLast = -1;
+
+    // Keep the counters over a restart of the USB device
+    if (TRUE == cLoaded)
+    {
+        return;
+    }
+    cLoaded = TRUE;
+
+    for (i = 0; i < PERF_RECORDS_PER_PAGE; i++)
+    {
+        if (PERF_RECORD_MAGIC == pRecord[i].nMagic)
+        {
+            nLast = i;
+        }
+    }
+
+    if (0 <= nLast)
+    {
+        memcpy ((void *) nCounters, pRecord[nLast].nCounter, sizeof (nCounters));
+    }
+}
+
+/*******************************************************************************
+
+  PERF_Count
+
+*******************************************************************************/
+
+void PERF_Count (uint8_t cCounter)
+{
+    if (PERF_COUNTERS <= cCounter)
+    {
+        return;
+    }
+    nCounters[cCounter]++;
+    cDirty = TRUE;
+}
+
+/*******************************************************************************
+
+  PERF_CountFlashErase
+
+  Count a page erase for the region of the page
+
+*******************************************************************************/
+
+void PERF_CountFlashErase (uint32_t nAddress)
+{
+    switch (nAddress)
+    {
+        case SLOTS_PAGE1_ADDRESS:
+        case SLOTS_PAGE2_ADDRESS:
+            PERF_Count (PERF_ERASE_SLOTS);
+            break;
+        case SLOT1_COUNTER_ADDRESS:
+        case SLOT2_COUNTER_ADDRESS:
+        case SLOT3_COUNTER_ADDRESS:
+        case SLOT4_COUNTER_ADDRESS:
+            PERF_Count (PERF_ERASE_COUNTERS);
+            break;
+        case BACKUP_PAGE_ADDRESS:
+            PERF_Count (PERF_ERASE_BACKUP);
+            break;
+        case PWS_FLASH_START_ADDRESS:
+            PERF_Count (PERF_ERASE_PWS);
+            break;
+        case FLASHC_USER_PAGE:
+            PERF_Count (PERF_ERASE_USER_PAGE);
+            break;
+        case TIME_ADDRESS:
+            PERF_Count (PERF_ERASE_TIME);
+            break;
+        default:
+            PERF_Count (PERF_ERASE_OTHER);
+            break;
+    }
+}
+
+/*******************************************************************************
+
+  PERF_CountFlashPrograms
+
+*******************************************************************************/
+
+void PERF_CountFlashPrograms (uint16_t nHalfwords)
+{
+    nCounters[PERF_HALFWORD_PROGRAMS] += nHalfwords;
+    cDirty = TRUE;
+}
+
+/*******************************************************************************
+
+  PERF_CountApdu
+
+  Count a smartcard APDU and its time
+
+*******************************************************************************/
+
+void PERF_CountApdu (uint32_t nCycles)
+{
+    uint32_t nTime = nCycles / PROF_CYCLES_PER_US;
+
+    nCounters[PERF_APDUS]++;
+    nCounters[PERF_APDU_TIME_SUM] += nTime;
+    if (nCounters[PERF_APDU_TIME_MAX] < nTime)
+    {
+        nCounters[PERF_APDU_TIME_MAX] = nTime;
+    }
+    cDirty = TRUE;
+}
+
+/*******************************************************************************
+
+  PERF_Get
+
+*******************************************************************************/
+
+uint32_t PERF_Get (uint8_t cCounter)
+{
+    if (PERF_COUNTERS <= cCounter)
+    {
+        return (0);
+    }
+    return (nCounters[cCounter]);
+}
+
+/*******************************************************************************
+
+  PERF_TimerTick
+
+  Called by the 1 ms TIM2 interrupt, posts the flush
+
+*******************************************************************************/
+
+void PERF_TimerTick (void)
+{
+    nFlushTimer++;
+    if (PERF_FLUSH_INTERVAL_MS <= nFlushTimer)
+    {
+        nFlushTimer = 0;
+        SCHED_PostEvent (SCHED_CLASS_FLASH);
+    }
+}
+
+/*******************************************************************************
+
+  PERF_Flush
+
+  Append the counters to the flash page if they were changed. Erases the
+  page only when no free record is left.
+
+*******************************************************************************/
+
+void PERF_Flush (void)
+{
+    const typePerfRecord* pRecord = (const typePerfRecord *) PERF_COUNTERS_ADDRESS;
+    typePerfRecord tRecord;
+    unsigned int i;
+
+    if (FALSE == cDirty)
+    {
+        return;
+    }
+
+    for (i = 0; i < PERF_RECORDS_PER_PAGE; i++)
+    {
+        if (TRUE == PERF_IsErased (&pRecord[i]))
+        {
+            break;
+        }
+    }
+
+    FLASH_Unlock ();
+
+    if (PERF_RECORDS_PER_PAGE <= i)
+    {
+        erase_flash_page (PERF_COUNTERS_ADDRESS);
+        i = 0;
+    }
+
+    memcpy (tRecord.nCounter, (void *) nCounters, sizeof (tRecord.nCounter));
+    write_data_to_flash ((uint8_t *) tRecord.nCounter, sizeof (tRecord.nCounter), (uint32_t) & pRecord[i]);
+    program_flash_word ((uint32_t) & pRecord[i].nMagic, PERF_RECORD_MAGIC);
+
+    FLASH_Lock ();
+
+    // The programs of the flush are saved with the next change
+    cDirty = FALSE;
+}
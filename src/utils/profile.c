@@ -0,0 +1,135 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Timing with the cycle counter of the Cortex-M3 DWT unit. The counter
+ * wraps after 59 s at 72 MHz, a difference of two reads is valid below.
+ * A host build uses the monotonic clock instead.
+ */
+
+#include <string.h>
+#ifdef __linux__
+#include <time.h>
+#else
+#include "stm32f10x.h"
+#endif
+#include "profile.h"
+
+#ifndef __linux__
+// DWT registers, not part of the CMSIS version used here
+#define DWT_CTRL                (*(volatile uint32_t *) 0xE0001000)
+#define DWT_CYCCNT              (*(volatile uint32_t *) 0xE0001004)
+#define DWT_CTRL_CYCCNTENA      0x00000001
+#endif
+
+#ifdef ENABLE_PROFILING
+static typeProfMarker tMarkers[PROF_MARKERS];
+#endif
+
+/*******************************************************************************
+
+  PROF_Init
+
+  Start the cycle counter, the trace unit must be enabled first
+
+*******************************************************************************/
+
+void PROF_Init (void)
+{
+#ifndef __linux__
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA;
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+#endif
+}
+
+/*******************************************************************************
+
+  PROF_GetCycles
+
+*******************************************************************************/
+
+uint32_t PROF_GetCycles (void)
+{
+#ifdef __linux__
+    struct timespec tNow;
+
+    clock_gettime (CLOCK_MONOTONIC, &tNow);
+    return ((uint32_t) tNow.tv_sec * 1000000000UL + (uint32_t) tNow.tv_nsec);
+#else
+    return (DWT_CYCCNT);
+#endif
+}
+
+#ifdef ENABLE_PROFILING
+/*******************************************************************************
+
+  PROF_Record
+
+  Add a measurement to a marker, called by PROF_END
+
+*******************************************************************************/
+
+void PROF_Record (uint8_t cMarker, uint32_t nCycles)
+{
+    typeProfMarker* pMarker;
+
+    if (PROF_MARKERS <= cMarker)
+    {
+        return;
+    }
+
+    pMarker = &tMarkers[cMarker];
+    if ((0 == pMarker->nCount) || (nCycles < pMarker->nMin))
+    {
+        pMarker->nMin = nCycles;
+    }
+    if (nCycles > pMarker->nMax)
+    {
+        pMarker->nMax = nCycles;
+    }
+    pMarker->nSum += nCycles;
+    pMarker->nCount++;
+}
+
+/*******************************************************************************
+
+  PROF_GetMarker
+
+*******************************************************************************/
+
+void PROF_GetMarker (uint8_t cMarker, typeProfMarker * pMarker)
+{
+    if (PROF_MARKERS <= cMarker)
+    {
+        memset (pMarker, 0, sizeof (typeProfMarker));
+        return;
+    }
+    *pMarker = tMarkers[cMarker];
+}
+
+/*******************************************************************************
+
+  PROF_Clear
+
+*******************************************************************************/
+
+void PROF_Clear (void)
+{
+    memset (tMarkers, 0, sizeof (tMarkers));
+}
+#endif // ENABLE_PROFILING
@@ -0,0 +1,261 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Flash operations executed from RAM
+ *
+ * A page erase (up to 40 ms) or a program stalls every read of the flash,
+ * the fetch of code and of interrupt vectors too. The smartcard USART
+ * receives a byte per ms, so its interrupt handler is a RAMFUNC and the
+ * vector table is copied to RAM. The erase and program sequences run from
+ * RAM as well and disable all other interrupts meanwhile: their handlers
+ * are in the flash, a stalled handler would block the USART interrupt.
+ * The interrupts pending meanwhile are served at the end of the operation.
+ */
+
+#include "stm32f10x.h"
+#include "stm32f10x_flash.h"
+#include "ramfunc.h"
+
+/*******************************************************************************
+
+ Local declarations
+
+*******************************************************************************/
+
+#define RAM_VECTORS                 76          // 16 exceptions, 60 interrupts of the high density devices
+#define RAM_NVIC_REGS               2           // enable registers of the 60 interrupts
+
+#define RAM_FLASH_ERASE_POLLS       0x200000    // > 40 ms
+#define RAM_FLASH_PROGRAM_POLLS     0x2000      // > 70 us
+
+#define RAM_SYSTICK_TICKINT         (1 << SYSTICK_TICKINT)
+#define RAM_SYSTICK_COUNTFLAG       (1 << 16)
+#define RAM_ICSR_PENDSTSET          (1 << 26)
+
+// VTOR needs an alignment to the table size rounded up to a power of 2
+static uint32_t nRamVectors[RAM_VECTORS] __attribute__ ((aligned (512)));
+
+/*******************************************************************************
+
+  RAM_InitVectorTable
+
+  Copy the vector table of the flash to RAM and use it
+
+*******************************************************************************/
+
+void RAM_InitVectorTable (void)
+{
+    const uint32_t* pFlashVectors = (const uint32_t *) NVIC_VectTab_FLASH;
+    int i;
+
+    for (i = 0; i < RAM_VECTORS; i++)
+    {
+        nRamVectors[i] = pFlashVectors[i];
+    }
+
+    NVIC_SetVectorTable (NVIC_VectTab_RAM, (uint32_t) nRamVectors - NVIC_VectTab_RAM);
+}
+
+/*******************************************************************************
+
+  RAM_StopInterrupts
+
+  Disable all interrupts but the one of the smartcard USART, the enabled
+  ones are stored in pnEnabled
+
+*******************************************************************************/
+
+static RAMFUNC void RAM_StopInterrupts (uint32_t * pnEnabled)
+{
+    int i;
+
+    for (i = 0; i < RAM_NVIC_REGS; i++)
+    {
+        pnEnabled[i] = NVIC->ISER[i];
+        if ((USART1_IRQn >> 5) == i)
+        {
+            NVIC->ICER[i] = pnEnabled[i] & ~(1 << (USART1_IRQn & 0x1F));
+        }
+        else
+        {
+            NVIC->ICER[i] = pnEnabled[i];
+        }
+    }
+
+    // Reading CTRL clears the count flag
+    pnEnabled[RAM_NVIC_REGS] = SysTick->CTRL & RAM_SYSTICK_TICKINT;
+    SysTick->CTRL &= ~RAM_SYSTICK_TICKINT;
+}
+
+/*******************************************************************************
+
+  RAM_RestartInterrupts
+
+  A SysTick passed meanwhile is pended, more ticks are lost like in a flash
+  stall
+
+*******************************************************************************/
+
+static RAMFUNC void RAM_RestartInterrupts (const uint32_t * pnEnabled)
+{
+    int i;
+
+    for (i = 0; i < RAM_NVIC_REGS; i++)
+    {
+        NVIC->ISER[i] = pnEnabled[i];
+    }
+
+    if (0 != pnEnabled[RAM_NVIC_REGS])
+    {
+        if (0 != (SysTick->CTRL & RAM_SYSTICK_COUNTFLAG))
+        {
+            SCB->ICSR = RAM_ICSR_PENDSTSET;
+        }
+        SysTick->CTRL |= RAM_SYSTICK_TICKINT;
+    }
+}
+
+/*******************************************************************************
+
+  RAM_FlashWait
+
+  Wait for the end of a flash operation like FLASH_WaitForLastOperation,
+  the error flags are left set
+
+*******************************************************************************/
+
+static RAMFUNC FLASH_Status RAM_FlashWait (uint32_t nPolls)
+{
+    while (0 != (FLASH->SR & FLASH_FLAG_BSY))
+    {
+        if (0 == nPolls)
+        {
+            return (FLASH_TIMEOUT);
+        }
+        nPolls--;
+    }
+
+    if (0 != (FLASH->SR & FLASH_FLAG_PGERR))
+    {
+        return (FLASH_ERROR_PG);
+    }
+
+    if (0 != (FLASH->SR & FLASH_FLAG_WRPRTERR))
+    {
+        return (FLASH_ERROR_WRP);
+    }
+
+    return (FLASH_COMPLETE);
+}
+
+/*******************************************************************************
+
+  RAM_FlashHalfWord
+
+  Program a half word
+
+*******************************************************************************/
+
+static RAMFUNC FLASH_Status RAM_FlashHalfWord (uint32_t nAddress, uint16_t nData)
+{
+    FLASH_Status nStatus;
+
+    nStatus = RAM_FlashWait (RAM_FLASH_PROGRAM_POLLS);
+    if (FLASH_COMPLETE == nStatus)
+    {
+        FLASH->CR |= FLASH_CR_PG;
+        *(__IO uint16_t *) nAddress = nData;
+        nStatus = RAM_FlashWait (RAM_FLASH_PROGRAM_POLLS);
+        FLASH->CR &= ~FLASH_CR_PG;
+    }
+    return (nStatus);
+}
+
+/*******************************************************************************
+
+  RAM_FlashErasePage
+
+  FLASH_ErasePage from RAM, the flash must be unlocked
+
+*******************************************************************************/
+
+RAMFUNC FLASH_Status RAM_FlashErasePage (uint32_t nAddress)
+{
+    uint32_t nEnabled[RAM_NVIC_REGS + 1];
+    FLASH_Status nStatus;
+
+    RAM_StopInterrupts (nEnabled);
+
+    nStatus = RAM_FlashWait (RAM_FLASH_ERASE_POLLS);
+    if (FLASH_COMPLETE == nStatus)
+    {
+        FLASH->CR |= FLASH_CR_PER;
+        FLASH->AR = nAddress;
+        FLASH->CR |= FLASH_CR_STRT;
+
+        nStatus = RAM_FlashWait (RAM_FLASH_ERASE_POLLS);
+        FLASH->CR &= ~FLASH_CR_PER;
+    }
+
+    RAM_RestartInterrupts (nEnabled);
+    return (nStatus);
+}
+
+/*******************************************************************************
+
+  RAM_FlashProgramHalfWord
+
+  FLASH_ProgramHalfWord from RAM, the flash must be unlocked
+
+*******************************************************************************/
+
+RAMFUNC FLASH_Status RAM_FlashProgramHalfWord (uint32_t nAddress, uint16_t nData)
+{
+    uint32_t nEnabled[RAM_NVIC_REGS + 1];
+    FLASH_Status nStatus;
+
+    RAM_StopInterrupts (nEnabled);
+    nStatus = RAM_FlashHalfWord (nAddress, nData);
+    RAM_RestartInterrupts (nEnabled);
+    return (nStatus);
+}
+
+/*******************************************************************************
+
+  RAM_FlashProgramWord
+
+  FLASH_ProgramWord from RAM, the low half word first
+
+*******************************************************************************/
+
+RAMFUNC FLASH_Status RAM_FlashProgramWord (uint32_t nAddress, uint32_t nData)
+{
+    uint32_t nEnabled[RAM_NVIC_REGS + 1];
+    FLASH_Status nStatus;
+
+    RAM_StopInterrupts (nEnabled);
+
+    nStatus = RAM_FlashHalfWord (nAddress, (uint16_t) nData);
+    if (FLASH_COMPLETE == nStatus)
+    {
+        nStatus = RAM_FlashHalfWord (nAddress + 2, (uint16_t) (nData >> 16));
+    }
+
+    RAM_RestartInterrupts (nEnabled);
+    return (nStatus);
+}
@@ -0,0 +1,146 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Traffic recorder
+ *
+ * The HID feature reports, the CCID messages and the T=1 blocks of the
+ * card are written with a timestamp into a byte ring. A new record drops
+ * the oldest whole records until it fits. The recording is read by
+ * CMD_GET_RECORDING and played back by the host build (src/host/host_player.c).
+ *
+ * All records are written by the main context, parse_report and the CCID
+ * dispatch don't run in an interrupt handler.
+ */
+
+#include <string.h>
+#include "stm32f10x.h"
+#include "hw_config.h"
+#include "profile.h"
+#include "recorder.h"
+
+#ifdef ENABLE_RECORDER
+
+#define REC_RING_MASK           (REC_RING_SIZE - 1)
+
+static uint8_t cRecRing[REC_RING_SIZE];
+
+// Stream positions of the next record and of the oldest record in the ring
+static uint32_t nRecHead = 0;
+static uint32_t nRecTail = 0;
+
+/*******************************************************************************
+
+  REC_Copy
+
+  Copy nLength bytes to the ring at the stream position nPosition
+
+*******************************************************************************/
+
+static void REC_Copy (uint32_t nPosition, const uint8_t * pData, uint16_t nLength)
+{
+    uint32_t nOffset = nPosition & REC_RING_MASK;
+    uint32_t nFirst = REC_RING_SIZE - nOffset;
+
+    if (nFirst >= nLength)
+    {
+        memcpy (&cRecRing[nOffset], pData, nLength);
+    }
+    else
+    {
+        memcpy (&cRecRing[nOffset], pData, nFirst);
+        memcpy (cRecRing, &pData[nFirst], nLength - nFirst);
+    }
+}
+
+/*******************************************************************************
+
+  REC_Write
+
+  Add a record, a record larger than the ring is left out
+
+*******************************************************************************/
+
+void REC_Write (uint8_t cType, const void* pData, uint16_t nLength)
+{
+    typeRecHeader tHeader;
+    uint32_t nSize = sizeof (tHeader) + nLength;
+    uint16_t nOldLength;
+
+    if (REC_RING_SIZE < nSize)
+    {
+        return;
+    }
+
+    // Drop the oldest records, the length is at offset 2 of a header
+    while (REC_RING_SIZE < nRecHead + nSize - nRecTail)
+    {
+        nOldLength = cRecRing[(nRecTail + 2) & REC_RING_MASK] | (cRecRing[(nRecTail + 3) & REC_RING_MASK] << 8);
+        nRecTail += sizeof (tHeader) + nOldLength;
+    }
+
+    tHeader.cType = cType;
+    tHeader.cReserved = 0;
+    tHeader.nLength = nLength;
+    tHeader.nTime = (uint32_t) currentTime;
+    tHeader.nCycles = PROF_GetCycles ();
+
+    REC_Copy (nRecHead, (const uint8_t *) &tHeader, sizeof (tHeader));
+    REC_Copy (nRecHead + sizeof (tHeader), (const uint8_t *) pData, nLength);
+    nRecHead += nSize;
+}
+
+/*******************************************************************************
+
+  REC_Read
+
+  Read up to nMaxLength bytes of the stream from nPosition. Returns the
+  position of the first byte, which is the oldest record if nPosition has
+  been dropped.
+
+*******************************************************************************/
+
+uint32_t REC_Read (uint32_t nPosition, uint8_t * pData, uint16_t nMaxLength, uint16_t * pnLength)
+{
+    uint32_t nLength;
+    uint32_t i;
+
+    if ((int32_t) (nPosition - nRecTail) < 0)
+    {
+        nPosition = nRecTail;
+    }
+    if ((int32_t) (nRecHead - nPosition) < 0)
+    {
+        nPosition = nRecHead;
+    }
+
+    nLength = nRecHead - nPosition;
+    if (nMaxLength < nLength)
+    {
+        nLength = nMaxLength;
+    }
+
+    for (i = 0; i < nLength; i++)
+    {
+        pData[i] = cRecRing[(nPosition + i) & REC_RING_MASK];
+    }
+
+    *pnLength = (uint16_t) nLength;
+    return (nPosition);
+}
+
+#endif /* ENABLE_RECORDER */
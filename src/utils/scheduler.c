@@ -0,0 +1,308 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Cooperative run to completion scheduler
+ *
+ * Interrupt handlers post an event for a class, the main loop runs the
+ * task of the highest pending class and sleeps (WFI) when nothing is
+ * pending. A task waiting for the hardware (SCHED_Yield, SCHED_Wait) lets
+ * the other allowed classes run in between, a class never runs nested in
+ * itself.
+ */
+
+#include <stddef.h>
+#include "stm32f10x.h"
+#include "type.h"
+#include "scheduler.h"
+
+/*******************************************************************************
+
+ Local declarations
+
+*******************************************************************************/
+
+static pfSchedTask pfTasks[SCHED_CLASSES];
+
+// Written by the interrupt handlers, a byte store is atomic
+static volatile uint8_t cPending[SCHED_CLASSES];
+static volatile uint32_t nPostTime[SCHED_CLASSES];
+
+// Main context only
+static uint8_t cDeferred[SCHED_CLASSES];
+static uint8_t cActiveMask = 0;
+static uint8_t cNesting = 0;
+static typeSchedStats tStats[SCHED_CLASSES];
+
+// ms since startup, incremented by the TIM2 interrupt
+static volatile uint32_t nSchedTime = 0;
+
+/*******************************************************************************
+
+  SCHED_SetTask
+
+  Register the task run for the events of a class
+
+*******************************************************************************/
+
+void SCHED_SetTask (uint8_t cClass, pfSchedTask pfTask)
+{
+    if (SCHED_CLASSES <= cClass)
+    {
+        return;
+    }
+    pfTasks[cClass] = pfTask;
+}
+
+/*******************************************************************************
+
+  SCHED_PostEvent
+
+  Mark a class as pending, callable from the interrupt handlers. Events of
+  the same class are merged until the task runs.
+
+*******************************************************************************/
+
+void SCHED_PostEvent (uint8_t cClass)
+{
+    if (SCHED_CLASSES <= cClass)
+    {
+        return;
+    }
+
+    if (FALSE == cPending[cClass])
+    {
+        nPostTime[cClass] = nSchedTime;
+        cPending[cClass] = TRUE;
+    }
+}
+
+/*******************************************************************************
+
+  SCHED_DeferEvent
+
+  Called by a running task which can't do its work now. The event is kept
+  for the main loop, nested runs skip it.
+
+*******************************************************************************/
+
+void SCHED_DeferEvent (uint8_t cClass)
+{
+    if (SCHED_CLASSES <= cClass)
+    {
+        return;
+    }
+    cDeferred[cClass] = TRUE;
+    tStats[cClass].nDeferred++;
+}
+
+/*******************************************************************************
+
+  SCHED_TimerTick
+
+  Called by the 1 ms TIM2 interrupt
+
+*******************************************************************************/
+
+void SCHED_TimerTick (void)
+{
+    nSchedTime++;
+}
+
+/*******************************************************************************
+
+  SCHED_GetTime
+
+*******************************************************************************/
+
+uint32_t SCHED_GetTime (void)
+{
+    return (nSchedTime);
+}
+
+/*******************************************************************************
+
+  SCHED_IsNested
+
+  TRUE when the running task was started inside the wait of another task
+
+*******************************************************************************/
+
+uint8_t SCHED_IsNested (void)
+{
+    return (0 != cNesting);
+}
+
+/*******************************************************************************
+
+  SCHED_NextClass
+
+  Highest pending class which is allowed, not running and has a task.
+  Returns -1 if there is none.
+
+*******************************************************************************/
+
+static int SCHED_NextClass (uint8_t cAllowMask, uint8_t cWithDeferred)
+{
+    int nClass;
+
+    for (nClass = 0; nClass < SCHED_CLASSES; nClass++)
+    {
+        if ((0 == (cAllowMask & SCHED_CLASS_BIT (nClass))) || (0 != (cActiveMask & SCHED_CLASS_BIT (nClass))) || (NULL == pfTasks[nClass]))
+        {
+            continue;
+        }
+
+        if ((TRUE == cPending[nClass]) || ((TRUE == cWithDeferred) && (TRUE == cDeferred[nClass])))
+        {
+            return (nClass);
+        }
+    }
+
+    return (-1);
+}
+
+/*******************************************************************************
+
+  SCHED_RunTask
+
+*******************************************************************************/
+
+static void SCHED_RunTask (int nClass)
+{
+    uint32_t nLatency;
+
+    // Clear before the run, an event posted meanwhile runs the task again
+    cPending[nClass] = FALSE;
+    cDeferred[nClass] = FALSE;
+
+    nLatency = nSchedTime - nPostTime[nClass];
+    tStats[nClass].nServed++;
+    tStats[nClass].nLatencySum += nLatency;
+    if (tStats[nClass].nLatencyMax < nLatency)
+    {
+        tStats[nClass].nLatencyMax = (nLatency < 0xFFFF) ? nLatency : 0xFFFF;
+    }
+
+    cActiveMask |= SCHED_CLASS_BIT (nClass);
+    pfTasks[nClass] ();
+    cActiveMask &= ~SCHED_CLASS_BIT (nClass);
+}
+
+/*******************************************************************************
+
+  SCHED_Sleep
+
+  Sleep until the next interrupt if no allowed class is pending. The check
+  is done with disabled interrupts, a pending interrupt still wakes up the
+  WFI.
+
+*******************************************************************************/
+
+static void SCHED_Sleep (uint8_t cAllowMask, uint8_t cWithDeferred)
+{
+    __disable_irq ();
+    if (0 > SCHED_NextClass (cAllowMask, cWithDeferred))
+    {
+        __WFI ();
+    }
+    __enable_irq ();
+}
+
+/*******************************************************************************
+
+  SCHED_Run
+
+  One pass of the main loop
+
+*******************************************************************************/
+
+void SCHED_Run (void)
+{
+    int nClass;
+
+    nClass = SCHED_NextClass (SCHED_ALLOW_ALL, TRUE);
+    if (0 <= nClass)
+    {
+        SCHED_RunTask (nClass);
+        return;
+    }
+
+    SCHED_Sleep (SCHED_ALLOW_ALL, TRUE);
+}
+
+/*******************************************************************************
+
+  SCHED_Yield
+
+  Called by a task waiting for the hardware. Runs every allowed pending
+  class once, or sleeps until the next interrupt if there is none.
+
+*******************************************************************************/
+
+void SCHED_Yield (uint8_t cAllowMask)
+{
+    uint8_t cDone = 0;
+    int nClass;
+
+    cNesting++;
+    while (0 <= (nClass = SCHED_NextClass (cAllowMask & ~cDone, FALSE)))
+    {
+        cDone |= SCHED_CLASS_BIT (nClass);
+        SCHED_RunTask (nClass);
+    }
+    cNesting--;
+
+    if (0 == cDone)
+    {
+        SCHED_Sleep (cAllowMask, FALSE);
+    }
+}
+
+/*******************************************************************************
+
+  SCHED_Wait
+
+  Wait at least nMs ms, the allowed classes run meanwhile. Needs the TIM2
+  interrupt.
+
+*******************************************************************************/
+
+void SCHED_Wait (uint16_t nMs, uint8_t cAllowMask)
+{
+    uint32_t nStart = nSchedTime;
+
+    while ((nSchedTime - nStart) <= nMs)
+    {
+        SCHED_Yield (cAllowMask);
+    }
+}
+
+/*******************************************************************************
+
+  SCHED_GetStats
+
+*******************************************************************************/
+
+void SCHED_GetStats (uint8_t cClass, typeSchedStats * pStats)
+{
+    if (SCHED_CLASSES <= cClass)
+    {
+        return;
+    }
+    *pStats = tStats[cClass];
+}
@@ -0,0 +1,119 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Scratch page
+ *
+ * The OTP slots, the password safe and the user page are written by
+ * copying the flash page to RAM, changing it and writing it back. They
+ * share this static page instead of a buffer each, so the page is not
+ * part of the stack depth of the callers. The owner acquires the page and
+ * releases it after the write. The page writes run in the main loop only,
+ * they don't nest.
+ *
+ * With make SCRATCH_CHECKS=1 an acquire of a held page or a release by
+ * another owner stops the firmware (aborts the host build), and a released
+ * page is overwritten to show a use after the release.
+ */
+
+#include <string.h>
+#ifdef ENABLE_SCRATCH_CHECKS
+#ifdef __linux__
+#include <stdio.h>
+#include <stdlib.h>
+#endif
+#include "trace.h"
+#endif
+#include "stm32f10x.h"
+#include "type.h"
+#include "hotp.h"
+#include "password_safe.h"
+#include "scratch.h"
+
+#if (FLASH_PAGE_SIZE > SCRATCH_SIZE) || (SLOT_PAGE_SIZE > SCRATCH_SIZE)
+#error "SCRATCH_SIZE is smaller than a flash page"
+#endif
+
+// Words for the halfword flash writes and the OTP_slot casts
+static uint32_t nScratchPage[SCRATCH_SIZE / 4];
+
+#ifdef ENABLE_SCRATCH_CHECKS
+
+#define SCRATCH_RELEASED_PATTERN    0xDE
+
+static uint8_t cScratchOwner = SCRATCH_OWNER_NONE;
+
+/*******************************************************************************
+
+  SCRATCH_OwnerError
+
+*******************************************************************************/
+
+static void SCRATCH_OwnerError (uint8_t cOwner)
+{
+    TRACE ("SCRATCH: owner %d, page held by %d\r\n", cOwner, cScratchOwner);
+#ifdef __linux__
+    fprintf (stderr, "scratch page: owner %d, page held by %d\n", cOwner, cScratchOwner);
+    abort ();
+#else
+    // Stop here, like assert_failed ()
+    while (1)
+    {
+    }
+#endif
+}
+#endif // ENABLE_SCRATCH_CHECKS
+
+/*******************************************************************************
+
+  SCRATCH_Acquire
+
+  Returns the scratch page, SCRATCH_SIZE bytes. The content is undefined.
+
+*******************************************************************************/
+
+uint8_t* SCRATCH_Acquire (uint8_t cOwner)
+{
+#ifdef ENABLE_SCRATCH_CHECKS
+    if ((SCRATCH_OWNER_NONE != cScratchOwner) || (SCRATCH_OWNER_NONE == cOwner))
+    {
+        SCRATCH_OwnerError (cOwner);
+    }
+    cScratchOwner = cOwner;
+#endif
+    return ((uint8_t *) nScratchPage);
+}
+
+/*******************************************************************************
+
+  SCRATCH_Release
+
+*******************************************************************************/
+
+void SCRATCH_Release (uint8_t cOwner)
+{
+#ifdef ENABLE_SCRATCH_CHECKS
+    if (cOwner != cScratchOwner)
+    {
+        SCRATCH_OwnerError (cOwner);
+    }
+    cScratchOwner = SCRATCH_OWNER_NONE;
+    memset (nScratchPage, SCRATCH_RELEASED_PATTERN, sizeof (nScratchPage));
+#else
+    (void) cOwner;
+#endif
+}
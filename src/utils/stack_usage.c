@@ -0,0 +1,107 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Stack and RAM usage
+ *
+ * The RAM holds .data and .bss from STACK_RAM_START to _ebss, the stack
+ * grows down from _estack towards them. The free RAM in between is painted
+ * at reset, the lowest overwritten word is the high water mark of the
+ * stack. The static part per module and the worst case stack from the
+ * call graph are reported at build time by scripts/ram_report.py.
+ * A host build has no such RAM layout and reports zeros.
+ */
+
+#include "stack_usage.h"
+
+#ifndef __linux__
+// Defined in the linker script
+extern unsigned long _ebss;
+extern unsigned long _estack;
+#endif
+
+/*******************************************************************************
+
+  STACK_GetHighWaterMark
+
+  Returns the largest stack size in bytes since the reset
+
+*******************************************************************************/
+
+uint32_t STACK_GetHighWaterMark (void)
+{
+#ifdef __linux__
+    return (0);
+#else
+    const uint32_t* pWord = (const uint32_t *) &_ebss;
+
+    while ((pWord < (const uint32_t *) &_estack) && (STACK_PAINT_PATTERN == *pWord))
+    {
+        pWord++;
+    }
+    return ((uint32_t) &_estack - (uint32_t) pWord);
+#endif
+}
+
+/*******************************************************************************
+
+  STACK_GetSize
+
+  Returns the RAM left for the stack by .data and .bss
+
+*******************************************************************************/
+
+uint32_t STACK_GetSize (void)
+{
+#ifdef __linux__
+    return (0);
+#else
+    return ((uint32_t) &_estack - (uint32_t) &_ebss);
+#endif
+}
+
+/*******************************************************************************
+
+  STACK_GetStaticSize
+
+  Returns the size of .data and .bss
+
+*******************************************************************************/
+
+uint32_t STACK_GetStaticSize (void)
+{
+#ifdef __linux__
+    return (0);
+#else
+    return ((uint32_t) &_ebss - STACK_RAM_START);
+#endif
+}
+
+/*******************************************************************************
+
+  STACK_GetRamSize
+
+*******************************************************************************/
+
+uint32_t STACK_GetRamSize (void)
+{
+#ifdef __linux__
+    return (0);
+#else
+    return ((uint32_t) &_estack - STACK_RAM_START);
+#endif
+}
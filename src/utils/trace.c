@@ -0,0 +1,156 @@
+/*
+ * This file is part of Nitrokey.
+ *
+ * Nitrokey is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * Nitrokey is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Nitrokey. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Binary trace log
+ *
+ * TRACE writes a record into a RAM ring, the oldest records are
+ * overwritten. The records are read by the HID command CMD_GET_TRACE or
+ * send to a debugger by the ITM stimulus port TRACE_ITM_PORT (SWO). Both
+ * readers have their own position, a record has a number counting from the
+ * startup.
+ */
+
+#include <string.h>
+#ifndef __linux__
+#include "stm32f10x.h"
+#endif
+#include "profile.h"
+#include "trace.h"
+
+#define TRACE_RECORD_WORDS      (sizeof (typeTraceRecord) / sizeof (uint32_t))
+
+static typeTraceRecord tTraceRecords[TRACE_RECORDS];
+
+// Number of records written since the startup
+static volatile uint32_t nTraceCount = 0;
+
+#ifndef __linux__
+// ITM output position, record number and word in the record
+static uint32_t nItmRecord = 0;
+static uint8_t cItmWord = 0;
+#endif
+
+/*******************************************************************************
+
+  TRACE_Write
+
+  Called by the TRACE macros, from the main context or an interrupt
+  handler. Only the reservation of the record disables the interrupts.
+
+*******************************************************************************/
+
+void TRACE_Write (uint32_t nFormat, uint8_t cArgs, uint32_t nArg0, uint32_t nArg1, uint32_t nArg2)
+{
+    typeTraceRecord* pRecord;
+#ifndef __linux__
+    uint32_t nPriMask;
+
+    nPriMask = __get_PRIMASK ();
+    __disable_irq ();
+#endif
+    pRecord = &tTraceRecords[nTraceCount & (TRACE_RECORDS - 1)];
+    nTraceCount++;
+#ifndef __linux__
+    __set_PRIMASK (nPriMask);
+#endif
+
+    pRecord->nFormat = (uint16_t) nFormat;
+    pRecord->cArgs = cArgs;
+    pRecord->cReserved = 0;
+    pRecord->nTime = PROF_GetCycles ();
+    pRecord->nArgs[0] = nArg0;
+    pRecord->nArgs[1] = nArg1;
+    pRecord->nArgs[2] = nArg2;
+}
+
+/*******************************************************************************
+
+  TRACE_GetRecords
+
+  Copy up to cMaxRecords records starting with the record number nFirst.
+  Records already overwritten are skipped. Returns the number of the first
+  copied record, *pcRecords is the count.
+
+*******************************************************************************/
+
+uint32_t TRACE_GetRecords (uint32_t nFirst, typeTraceRecord * pRecords, uint8_t cMaxRecords, uint8_t * pcRecords)
+{
+    uint32_t nCount = nTraceCount;
+    uint8_t cRecords = 0;
+
+    if ((nCount - nFirst) > TRACE_RECORDS)
+    {
+        // Overwritten or not yet written
+        nFirst = (nCount < TRACE_RECORDS) ? 0 : nCount - TRACE_RECORDS;
+    }
+
+    while ((cRecords < cMaxRecords) && ((nFirst + cRecords) != nCount))
+    {
+        memcpy (&pRecords[cRecords], &tTraceRecords[(nFirst + cRecords) & (TRACE_RECORDS - 1)], sizeof (typeTraceRecord));
+        cRecords++;
+    }
+
+    *pcRecords = cRecords;
+    return (nFirst);
+}
+
+/*******************************************************************************
+
+  TRACE_Drain
+
+  Send the new records to the ITM stimulus port while its FIFO has room,
+  called by the main loop. Does nothing unless a debugger enabled the port.
+
+*******************************************************************************/
+
+void TRACE_Drain (void)
+{
+#ifndef __linux__
+    uint32_t* pWords;
+
+    if ((0 == (CoreDebug->DEMCR & CoreDebug_DEMCR_TRCENA)) || (0 == (ITM->TCR & ITM_TCR_ITMENA)) || (0 == (ITM->TER & (1UL << TRACE_ITM_PORT))))
+    {
+        return;
+    }
+
+    if ((nTraceCount - nItmRecord) > TRACE_RECORDS)
+    {
+        // Overwritten, restart with the oldest record
+        nItmRecord = nTraceCount - TRACE_RECORDS;
+        cItmWord = 0;
+    }
+
+    while (nItmRecord != nTraceCount)
+    {
+        if (0 == ITM->PORT[TRACE_ITM_PORT].u32)
+        {
+            return;     // FIFO full
+        }
+
+        pWords = (uint32_t *) &tTraceRecords[nItmRecord & (TRACE_RECORDS - 1)];
+        ITM->PORT[TRACE_ITM_PORT].u32 = pWords[cItmWord];
+
+        cItmWord++;
+        if (TRACE_RECORD_WORDS <= cItmWord)
+        {
+            cItmWord = 0;
+            nItmRecord++;
+        }
+    }
+#endif
+}